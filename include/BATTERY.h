@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+
+// Battery voltage from the ADC samples to centivolts (the unit of the telemetry frame), integer
+// only, shared with the host report (vcu_host battery). Stages, in order:
+//   oversample   sum of one DMA block -> mean ADC code in Q4, averaging N samples cuts the
+//                white noise by sqrt(N) and resolves below one LSB with the ADC's own noise as dither
+//   calibrate    piecewise linear code -> pin mV, breakpoints from the eFuse characterization
+//                at boot (the ESP32 ADC is noticeably nonlinear above ~2.5 V at 11 dB)
+//   divider      pin mV -> pack centivolts, resistor ratio plus a single point trim gain
+//   filter       one pole, Q8 centivolts, time constant BATTERY_FILTER_MS at the block rate
+// Derating (VCU_BATTERY_DERATE=1) scales the throttle deflection from neutral linearly from
+// 100 % at BATTERY_DERATE_START to BATTERY_DERATE_MIN at BATTERY_CUTOFF, per cell.
+
+#define BATTERY_CAL_POINTS      9           // breakpoints every 512 codes, 0 - 4096
+#define BATTERY_Q               4           // oversampled code fraction bits
+#define BATTERY_FILTER_Q        8
+
+#define BATTERY_DIVIDER_TOP     100         // kOhm, pack to pin
+#define BATTERY_DIVIDER_BOTTOM  10          // kOhm, pin to ground: 3.1 V at the pin is 34 V at the pack
+#define BATTERY_TRIM_Q16        65536       // measured / reported at one known voltage, Q16
+
+#define BATTERY_BLOCK_SAMPLES   256         // oversampling factor, 20 kHz / 256 = 78 filter steps per second
+#define BATTERY_SAMPLE_HZ       20000
+#define BATTERY_FILTER_MS       500
+
+#ifndef BATTERY_CELLS
+#define BATTERY_CELLS           4
+#endif
+#define BATTERY_PRESENT_CV      300         // below this there is no pack on the divider: report 0, no derating
+#define BATTERY_DERATE_START    360         // centivolts per cell under load
+#define BATTERY_CUTOFF          330
+#define BATTERY_DERATE_MIN      64          // Q8 share of the throttle deflection left at the cutoff
+
+struct BATTERYCAL {
+  uint16_t mv[BATTERY_CAL_POINTS];          // pin mV at codes 0, 512, ... 4096
+};
+
+// typical 11 dB curve, used until (or instead of, without eFuse data) the characterization
+static const BATTERYCAL batteryDefaultCal = {{75, 490, 905, 1320, 1735, 2150, 2560, 2935, 3210}};
+
+struct BATTERYFILTER {
+  bool primed;
+  int32_t value;                            // centivolts Q8
+  uint16_t alpha;                           // Q16
+};
+
+
+//==================================================================================//
+
+// one DMA block of raw 12 bit codes, mean code in Q4
+inline uint32_t batteryOversample(uint32_t sum, uint32_t count) {
+  return count ? (uint32_t)(((uint64_t)sum << BATTERY_Q) + count / 2) / count : 0;
+}
+
+// oversampled code (Q4) to pin mV, linear between breakpoints
+inline uint32_t batteryPinMv(const BATTERYCAL& cal, uint32_t code) {
+  uint32_t index = code >> (9 + BATTERY_Q);
+  if (index >= BATTERY_CAL_POINTS - 1) return cal.mv[BATTERY_CAL_POINTS - 1];
+  uint32_t fraction = code & ((1 << (9 + BATTERY_Q)) - 1);
+  int32_t span = (int32_t)cal.mv[index + 1] - cal.mv[index];
+  return cal.mv[index] + ((span * (int32_t)fraction) >> (9 + BATTERY_Q));
+}
+
+inline int32_t batteryCentivolts(uint32_t pinMv) {
+  uint64_t cv = (uint64_t)pinMv * (BATTERY_DIVIDER_TOP + BATTERY_DIVIDER_BOTTOM) * BATTERY_TRIM_Q16;
+  return (int32_t)((cv / (BATTERY_DIVIDER_BOTTOM * 10ULL) + 32768) >> 16);
+}
+
+// alpha for a time constant at a given update rate: dt / (tau + dt), Q16
+inline uint16_t batteryAlpha(uint32_t updateHz, uint32_t tauMs) {
+  uint32_t dtUs = 1000000UL / updateHz;
+  return (uint16_t)(((uint64_t)dtUs << 16) / (tauMs * 1000ULL + dtUs));
+}
+
+inline void batteryFilterReset(BATTERYFILTER& filter, uint16_t alpha) {
+  filter.primed = false;
+  filter.value = 0;
+  filter.alpha = alpha;
+}
+
+// one block in, filtered centivolts out, starts settled on the first block
+inline int16_t batteryFilterUpdate(BATTERYFILTER& filter, int32_t cv) {
+  int32_t x = cv << BATTERY_FILTER_Q;
+  if (!filter.primed) {
+    filter.value = x;
+    filter.primed = true;
+  } else {
+    filter.value += (int32_t)(((int64_t)(x - filter.value) * filter.alpha) >> 16);
+  }
+  return (filter.value + (1 << (BATTERY_FILTER_Q - 1))) >> BATTERY_FILTER_Q;
+}
+
+// all stages for one block of samples
+inline int16_t batteryUpdate(BATTERYFILTER& filter, const BATTERYCAL& cal, uint32_t sum, uint32_t count) {
+  int16_t cv = batteryFilterUpdate(filter, batteryCentivolts(batteryPinMv(cal, batteryOversample(sum, count))));
+  return cv < BATTERY_PRESENT_CV ? 0 : cv;
+}
+
+
+//==================================================================================//
+
+// share of the throttle deflection allowed at a pack voltage, Q8 (256 = all of it)
+inline uint16_t batteryDerate(int16_t cv) {
+  const int32_t start = BATTERY_DERATE_START * BATTERY_CELLS;
+  const int32_t cutoff = BATTERY_CUTOFF * BATTERY_CELLS;
+  if (cv == 0 || cv >= start) return 256;
+  if (cv <= cutoff) return BATTERY_DERATE_MIN;
+  return BATTERY_DERATE_MIN + (256 - BATTERY_DERATE_MIN) * (cv - cutoff) / (start - cutoff);
+}
+
+// throttle in us around the 1500 us neutral
+inline int16_t batteryLimit(int16_t throttle, uint16_t derate) {
+  return 1500 + (((int32_t)(throttle - 1500) * derate) >> 8);
+}
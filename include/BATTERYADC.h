@@ -0,0 +1,148 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include <BATTERY.h>
+
+// Battery voltage sampled continuously by the ADC DMA controller (ESP-IDF 4.4 adc_digi driver):
+// the ADC runs at BATTERY_SAMPLE_HZ without any CPU involvement, the BATTERY task wakes once per
+// DMA block, reduces it to one filtered value (BATTERY.h) and stores it atomically. The control
+// loop only ever loads that value, batteryVoltage() costs one 16 bit read.
+//
+// Pin: GPIO 34 (ADC1 channel 6, input only). ADC2 is not usable while WiFi/BLE is active.
+
+#define BATTERY_ADC_CHANNEL     ADC1_CHANNEL_6
+#define BATTERY_DMA_BYTES       (BATTERY_BLOCK_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+#define BATTERY_STACK_SIZE      3072
+
+static BATTERYCAL _battery_cal = batteryDefaultCal;
+static BATTERYFILTER _battery_filter;
+static std::atomic<int16_t> _battery_cv(0);           // BATTERY task -> anyone
+static std::atomic<uint16_t> _battery_derate(256);    // Q8
+static uint8_t _battery_block[BATTERY_DMA_BYTES];
+static uint32_t _battery_overruns = 0;                // DMA ring full, samples dropped
+
+static const uint32_t batteryStaticBytes = sizeof(_battery_cal) + sizeof(_battery_filter) + sizeof(_battery_cv) +
+                                           sizeof(_battery_derate) + sizeof(_battery_block) + sizeof(uint32_t);
+
+
+//==================================================================================//
+
+// latest filtered pack voltage in centivolts, 0 without a pack on the divider
+inline int16_t batteryVoltage() {
+  return _battery_cv.load(std::memory_order_relaxed);
+}
+
+// latest derating factor for batteryLimit(), Q8
+inline uint16_t batteryDerating() {
+  return _battery_derate.load(std::memory_order_relaxed);
+}
+
+// calibration breakpoints from the eFuse data (two point or Vref), the default curve without it
+void batteryCalibrate() {
+  esp_adc_cal_characteristics_t chars;
+  esp_adc_cal_value_t source = esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &chars);
+  if (source == ESP_ADC_CAL_VAL_DEFAULT_VREF) {
+    Serial.println("Battery: no eFuse ADC calibration, typical curve");
+    return;
+  }
+  for (uint8_t i = 0; i < BATTERY_CAL_POINTS; i++) {
+    _battery_cal.mv[i] = esp_adc_cal_raw_to_voltage(min(i * 512, 4095), &chars);
+  }
+}
+
+// before the tasks start: the driver allocates its DMA ring here, ahead of the heap seal
+bool batteryBegin() {
+  batteryCalibrate();
+  batteryFilterReset(_battery_filter, batteryAlpha(BATTERY_SAMPLE_HZ / BATTERY_BLOCK_SAMPLES, BATTERY_FILTER_MS));
+
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = 4 * BATTERY_DMA_BYTES;
+  init.conv_num_each_intr = BATTERY_DMA_BYTES;
+  init.adc1_chan_mask = BIT(BATTERY_ADC_CHANNEL);
+  init.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_11;
+  pattern.channel = BATTERY_ADC_CHANNEL;
+  pattern.unit = 0;
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = 1;               // required on the ESP32
+  config.conv_limit_num = 250;
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = BATTERY_SAMPLE_HZ;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&config) != ESP_OK) return false;
+
+  return adc_digi_start() == ESP_OK;
+}
+
+// parked (POWERSAVE.h): the running ADC driver would keep the CPU out of light sleep, the last
+// voltage is held meanwhile
+void batteryPause(bool paused) {
+  if (paused) adc_digi_stop();
+  else adc_digi_start();
+}
+
+// one filter step for the next DMA block, waiting up to 'waitMs' for it; false without a block
+static bool batteryRead(uint32_t waitMs) {
+  uint32_t length = 0;
+  esp_err_t result = adc_digi_read_bytes(_battery_block, BATTERY_DMA_BYTES, &length, waitMs);
+  if (result == ESP_ERR_INVALID_STATE) _battery_overruns++;     // data is still valid
+  else if (result != ESP_OK) return false;
+
+  uint32_t sum = 0, count = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+    const adc_digi_output_data_t* sample = (const adc_digi_output_data_t*)&_battery_block[i];
+    if (sample->type1.channel != BATTERY_ADC_CHANNEL) continue;
+    sum += sample->type1.data;
+    count++;
+  }
+  if (count == 0) return true;
+
+  int16_t cv = batteryUpdate(_battery_filter, _battery_cal, sum, count);
+  _battery_cv.store(cv, std::memory_order_relaxed);
+  _battery_derate.store(batteryDerate(cv), std::memory_order_relaxed);
+  return true;
+}
+
+// BATTERY task: one filter step per DMA block, paced by the ADC
+void BATTERY(void * pvParameters) {
+  while (1) {
+    batteryRead(ADC_MAX_DELAY);
+  }
+}
+
+
+//==================================================================================//
+
+#if VCU_BATTERY_DERATE
+// output policy decorator: throttle deflection limited by the pack voltage, steering untouched
+template<class OUT>
+struct DeratedOutput {
+    static const uint32_t staticBytes = OUT::staticBytes;
+
+    static void begin() {
+        OUT::begin();
+    }
+
+    static void write(int16_t throttle, uint8_t steeringAngle) {
+        OUT::write(batteryLimit(throttle, batteryDerating()), steeringAngle);
+    }
+
+    static void stop() {
+        OUT::stop();
+    }
+
+    static bool speed(int32_t& mmPerS) {
+        return OUT::speed(mmPerS);
+    }
+};
+#endif
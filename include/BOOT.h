@@ -0,0 +1,99 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Boot sequencer bookkeeping. setup() only brings the actuators to neutral and starts the
+// tasks; each task initializes its own inputs in parallel (CAN and receiver in CANBUS, BLE in
+// XBOXTASK) and marks its stage here. Optional subsystems that fail are marked degraded and
+// retried by their task instead of halting the VCU. Times are esp_timer us since app start
+// (the ROM and second stage bootloader, ~250 ms with default settings, come on top).
+//
+// Boot record (DIAG_RECORD_BOOT, sent once when the boot completes):
+//   [0x50] [degraded stage mask] [actuators ms x2] [CAN ms x2] [first control step ms x2]
+
+#define BOOT_TARGET_MS    500     // boot to first control step
+
+enum boot_stage_enum{
+  BOOT_ACTUATORS = 0,             // outputs attached at neutral
+  BOOT_TASKS,                     // CANBUS / VCU tasks started
+  BOOT_CAN,                       // CAN controller running
+  BOOT_RECEIVER,                  // radio receiver attached
+  BOOT_CONTROL,                   // first control step of the VCU task
+  BOOT_STAGES
+};
+
+enum boot_status_enum{
+  BOOT_PENDING = 0,
+  BOOT_OK,
+  BOOT_DEGRADED,                  // failed, the VCU runs without it and the owner retries
+  BOOT_SKIPPED                    // not part of this build
+};
+
+struct BOOTSTAGE {
+  volatile uint8_t status;
+  volatile int64_t at;            // us since app start
+};
+
+static const char* const _boot_stage_names[BOOT_STAGES] = {
+  "actuators neutral", "tasks started", "CAN bus", "radio receiver", "first control step"
+};
+
+static BOOTSTAGE _boot_stages[BOOT_STAGES];
+static bool _boot_reported = false;
+
+
+//==================================================================================//
+
+// first mark of a stage wins: a degraded stage that recovers later stays degraded in the report
+void bootMark(uint8_t stage, uint8_t status) {
+  if (stage >= BOOT_STAGES || _boot_stages[stage].status != BOOT_PENDING) return;
+  _boot_stages[stage].at = esp_timer_get_time();
+  _boot_stages[stage].status = status;
+}
+
+bool bootComplete() {
+  for (uint8_t i = 0; i < BOOT_STAGES; i++) {
+    if (_boot_stages[i].status == BOOT_PENDING) return false;
+  }
+  return true;
+}
+
+uint16_t bootMillis(uint8_t stage) {
+  return min(_boot_stages[stage].at / 1000, (int64_t)0xFFFF);
+}
+
+// prints the stage table once all stages are through, returns true that one time
+bool bootReport() {
+  if (_boot_reported || !bootComplete()) return false;
+  _boot_reported = true;
+
+  static const char* const status[] = {"pending", "ok", "DEGRADED", "skipped"};
+  Serial.println("Boot stages:");
+  for (uint8_t i = 0; i < BOOT_STAGES; i++) {
+    Serial.printf("  %-20s %-9s %4u ms\n", _boot_stage_names[i], status[_boot_stages[i].status],
+                  _boot_stages[i].status == BOOT_SKIPPED ? 0 : bootMillis(i));
+  }
+  uint16_t control = bootMillis(BOOT_CONTROL);
+  Serial.printf("Boot to first control step: %u ms (target %u ms)%s\n", control, BOOT_TARGET_MS,
+                control > BOOT_TARGET_MS ? " OVER TARGET" : "");
+  return true;
+}
+
+void bootRecord(uint8_t record[8], uint8_t type) {
+  uint8_t degraded = 0;
+  for (uint8_t i = 0; i < BOOT_STAGES; i++) {
+    if (_boot_stages[i].status == BOOT_DEGRADED) degraded |= 1 << i;
+  }
+  uint16_t actuators = bootMillis(BOOT_ACTUATORS);
+  uint16_t can = bootMillis(BOOT_CAN);
+  uint16_t control = bootMillis(BOOT_CONTROL);
+
+  record[0] = type;
+  record[1] = degraded;
+  record[2] = actuators >> 8;
+  record[3] = actuators & 0xFF;
+  record[4] = can >> 8;
+  record[5] = can & 0xFF;
+  record[6] = control >> 8;
+  record[7] = control & 0xFF;
+}
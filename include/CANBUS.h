@@ -1,8 +1,17 @@
+#pragma once
+
+#ifdef CAN_BACKEND_SOCKETCAN
+#include <Arduino.h>
+#include <SOCKETCAN.h>  // host build against a Linux CAN interface
+#else
 #include <CAN.h>
+#endif
 
 #define TX_GPIO_NUM   17  // Connects to CTX
 #define RX_GPIO_NUM   16  // Connects to CRX
 
+#define COMMAND_CAN_BASE  0x100   // drive commands for a VCU on COMMAND_CAN_BASE + CANBUS_ID
+
 struct CANRECIEVER {
   bool recieved;
   bool extended;
@@ -16,12 +25,39 @@ struct CANRECIEVER {
   int16_t voltage;
   int8_t velocity;
   int8_t acknowledged;
+  uint8_t data[8];      // raw payload, for frames that are not drive commands
+  int64_t at;           // local us when the frame was received
+  bool stamped;         // extended frame carrying a clock stamp (CLOCKSYNC.h), id is then the base ID
+  uint32_t stamp;
+};
+
+// drive command taken over by the control task
+struct CANCOMMAND {
+  int8_t driveMode;
+  int16_t throttle;
+  uint8_t steeringAngle;
+  int64_t at;             // local us when received
+  bool stamped;           // age is known (VCU_CLOCK_SYNC)
+  int32_t age;            // us from the master's stamp to reception
+  int16_t curvature;      // 1/km, drive mode 6 (STEERCAL.h)
+};
+
+// status frame content handed from the control task to the CAN task
+struct CANTELEMETRY {
+  int8_t driveMode;
+  int16_t throttle;
+  uint8_t steeringAngle;
+  int16_t voltage;
+  int8_t velocity;        // 0.1 m/s, measured (Output::speed()), 0 without feedback
+  int8_t acknowledged;
+  int64_t at;             // local us when the control task took the sample, 0 = not stamped
 };
 
 
 //==================================================================================//
 
-void setupCANBUS() {
+// false when the controller did not start, the caller runs without CAN and retries
+inline bool setupCANBUS() {
   Serial.println ("CAN Receiver/Receiver");
 
   // Set the pins
@@ -30,48 +66,96 @@ void setupCANBUS() {
   // start the CAN bus at 1 Mbps
   if (!CAN.begin (1E6)) {
     Serial.println ("Starting CAN failed!");
-    while (1);
+    return false;
   }
   else {
     Serial.println ("CAN Initialized");
+    return true;
   }
 }
 
 
 //==================================================================================//
 
-void canSender(int CANBUS_ID, int8_t driveMode, int16_t throttle, uint8_t steeringAngle, int16_t voltage, int8_t velocity, int8_t acknowledged) {
-  //Serial.print("Sending packet ... ");
-
-  CAN.beginPacket(CANBUS_ID);  // Sets the ID and clears the transmit buffer
-  
+// status frame layout, multi byte values big endian
+inline void canPack(uint8_t data[8], int8_t driveMode, int16_t throttle, uint8_t steeringAngle, int16_t voltage, int8_t velocity, int8_t acknowledged) {
+  data[0] = driveMode;
 
-  CAN.write(driveMode); // Write driveMode as 1 byte
-  
+  // Break throttle value into two bytes
+  data[1] = (uint8_t)(throttle >> 8); // High byte
+  data[2] = (uint8_t)(throttle & 0xFF); // Low byte
 
-  // Break throttle value into two bytes and write them
-  CAN.write((uint8_t)(throttle >> 8)); // High byte
-  CAN.write((uint8_t)(throttle & 0xFF)); // Low byte
-  
+  data[3] = steeringAngle;
 
-  CAN.write(steeringAngle); // Write steering angle as 1 byte
-  
+  // Break voltage value into two bytes
+  data[4] = (uint8_t)(voltage >> 8); // High byte
+  data[5] = (uint8_t)(voltage & 0xFF); // Low byte
 
-  // Break voltage value into two bytes and write them
-  CAN.write((uint8_t)(voltage >> 8)); // High byte
-  CAN.write((uint8_t)(voltage & 0xFF)); // Low byte
+  data[6] = velocity;
+  data[7] = acknowledged;
+}
 
-  CAN.write(velocity); // Write 1 byte
-  CAN.write(acknowledged); // Write 1 byte
+inline void canSender(int CANBUS_ID, int8_t driveMode, int16_t throttle, uint8_t steeringAngle, int16_t voltage, int8_t velocity, int8_t acknowledged) {
+  //Serial.print("Sending packet ... ");
 
+  uint8_t data[8];
+  canPack(data, driveMode, throttle, steeringAngle, voltage, velocity, acknowledged);
 
+  // Sets the ID and clears the transmit buffer, IDs above 0x7FF go out as extended frames (clock stamps)
+  if (CANBUS_ID > 0x7FF) CAN.beginExtendedPacket(CANBUS_ID);
+  else CAN.beginPacket(CANBUS_ID);
+  CAN.write(data, 8);
   CAN.endPacket();
 
   //Serial.println("done");
 }
 
-CANRECIEVER canReceiver() {
-  CANRECIEVER msg;
+// drive command layout of a received data frame, shared by the polling and the ISR receive paths
+inline void canDecode(CANRECIEVER& msg, const uint8_t* data, int packetSize) {
+  msg.length = packetSize;
+
+  for (int i = 0; i < 8; i++) {
+    msg.data[i] = i < packetSize ? data[i] : 0;
+  }
+
+  // Read and print integer values
+  if (packetSize >= 4) { // Ensure we have at least 4 bytes
+    int8_t driveMode = msg.data[0]; // Read 8-bit signed integer
+
+    // Read the next two bytes and combine them into a int16_t
+    uint8_t highByte = msg.data[1];
+    uint8_t lowByte = msg.data[2];
+    int16_t throttle = (highByte << 8) | lowByte; // Combine bytes
+    // Interpret as signed integer
+    if (throttle & 0x8000) { // Check if the sign bit is set
+      throttle |= 0xFFFF0000; // Sign-extend to 32-bit
+    }
+
+    uint8_t steeringAngle = msg.data[3]; // Read 8-bit signed integer
+
+    // Read the next two bytes and combine them into a int16_t
+    highByte = msg.data[4];
+    lowByte = msg.data[5];
+    int16_t voltage = (highByte << 8) | lowByte; // Combine bytes
+    // Interpret as signed integer
+    if (voltage & 0x8000) { // Check if the sign bit is set
+      voltage |= 0xFFFF0000; // Sign-extend to 32-bit
+    }
+
+    int8_t velocity = msg.data[6]; // Read 8-bit signed integer
+    int8_t acknowledged = msg.data[7]; // Read 8-bit signed integer
+
+    msg.driveMode = driveMode;
+    msg.throttle = throttle;
+    msg.steeringAngle = steeringAngle;
+    msg.voltage = voltage/100;
+    msg.velocity = velocity;
+    msg.acknowledged = acknowledged;
+  }
+}
+
+inline CANRECIEVER canReceiver() {
+  CANRECIEVER msg = CANRECIEVER();
 
   msg.recieved = false;
   msg.extended = false;
@@ -81,6 +165,11 @@ CANRECIEVER canReceiver() {
 
   if (packetSize) {
     msg.recieved = true;
+#ifdef CAN_BACKEND_SOCKETCAN
+    msg.at = CAN.packetTimestamp() ? CAN.packetTimestamp() / 1000 : esp_timer_get_time();   // kernel receive time
+#else
+    msg.at = esp_timer_get_time();
+#endif
 
     if (CAN.packetExtended()) {
       msg.extended = true;
@@ -96,44 +185,13 @@ CANRECIEVER canReceiver() {
       msg.reqLength = CAN.packetDlc();
 
     } else {
-      msg.length = packetSize;
-
-      // Read and print integer values
-      if (packetSize >= 4) { // Ensure we have at least 4 bytes
-        int8_t driveMode = CAN.read(); // Read 8-bit signed integer
-
-        // Read the next two bytes and combine them into a int16_t
-        uint8_t highByte = CAN.read();
-        uint8_t lowByte = CAN.read();
-        int16_t throttle = (highByte << 8) | lowByte; // Combine bytes
-        // Interpret as signed integer
-        if (throttle & 0x8000) { // Check if the sign bit is set
-          throttle |= 0xFFFF0000; // Sign-extend to 32-bit
-        }
-
-        uint8_t steeringAngle = CAN.read(); // Read 8-bit signed integer
-
-        // Read the next two bytes and combine them into a int16_t
-        highByte = CAN.read();
-        lowByte = CAN.read();
-        int16_t voltage = (highByte << 8) | lowByte; // Combine bytes
-        // Interpret as signed integer
-        if (voltage & 0x8000) { // Check if the sign bit is set
-          voltage |= 0xFFFF0000; // Sign-extend to 32-bit
-        }
-
-        int8_t velocity = CAN.read(); // Read 8-bit signed integer
-        int8_t acknowledged = CAN.read(); // Read 8-bit signed integer
-
-        msg.driveMode = driveMode;
-        msg.throttle = throttle;
-        msg.steeringAngle = steeringAngle;
-        msg.voltage = voltage/100;
-        msg.velocity = velocity;
-        msg.acknowledged = acknowledged;
+      uint8_t data[8];
+      for (int i = 0; i < 8; i++) {
+        data[i] = i < packetSize ? CAN.read() : 0;
       }
+      canDecode(msg, data, packetSize);
     }
   }
 
   return msg;
-}
\ No newline at end of file
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <stdint.h>
+
+// CAN controller health: error state, error counts by type and the restart logic after
+// bus-off, with no hardware access so the host runs it against a mock controller
+// (vcu_host sim-canhealth). The CANBUS task samples the controller every loop (CANMONITOR.h)
+// and carries out the action canHealthUpdate() returns:
+//   CAN_ACTION_RECOVER  bus-off: release the controller's reset, it rejoins after 128 x 11
+//                       recessive bits (1.4 ms at 1 Mbps)
+//   CAN_ACTION_REINIT   no recovery within CAN_RECOVER_MS or the controller never started:
+//                       restart it, then again after a backoff doubling up to CAN_RESTART_MAX_MS
+// An outage runs from the first sample that finds the controller off the bus until it has
+// stayed on the bus for CAN_STABLE_MS; the outage time counts up to the first sample back on
+// the bus. While an outage runs the CAN driven modes hold the failsafe throttle.
+// Error counts: transmit errors from the TEC increases (8 per error, up to 256 at a bus-off),
+// receive errors from the REC increases, and per sample with new errors the type the controller
+// captured (bit, form, stuff, other). Errors cancelled out between two samples by frames that
+// went through are not seen, so the counts are a lower bound.
+//
+// Diagnostics records (once a second with the others):
+//   state:  [0xB0] [state] [TEC] [REC] [bus-offs, saturating] [restarts, saturating]
+//           [outage ms, 2 bytes, saturating: the running one, else the last]
+//   errors: [0xC0] [bit] [form] [stuff] [other] [transmit] [receive] [receive overruns], since
+//           the last record, saturating
+
+#define CAN_RECOVER_MS          20          // bus-off recovery before the controller is restarted
+#define CAN_RESTART_MIN_MS      20          // first restart backoff
+#define CAN_RESTART_MAX_MS      1000
+#define CAN_STABLE_MS           20          // on the bus this long ends the outage
+#define CAN_WARNING_LIMIT       96
+#define CAN_PASSIVE_LIMIT       128
+
+#define CAN_STATE_ACTIVE        0
+#define CAN_STATE_WARNING       1           // TEC or REC from 96
+#define CAN_STATE_PASSIVE       2           // TEC or REC from 128, no active error flags
+#define CAN_STATE_BUS_OFF       3           // TEC over 255, the controller left the bus
+#define CAN_STATE_STOPPED       4           // not started, or restarting
+
+#define CAN_ACTION_NONE         0
+#define CAN_ACTION_RECOVER      1
+#define CAN_ACTION_REINIT       2
+
+#define CAN_ERROR_BIT           0           // error code capture, bits 7-6
+#define CAN_ERROR_FORM          1
+#define CAN_ERROR_STUFF         2
+#define CAN_ERROR_OTHER         3
+
+// what the controller shows at one sample
+struct CANSAMPLE {
+    bool running;                           // started and not held in reset
+    bool busOff;
+    uint8_t tec;
+    uint8_t rec;
+    uint8_t errorCode;                      // last captured error (SJA1000 ECC layout)
+    bool overrun;                           // receive FIFO overrun since the last sample
+};
+
+struct CANHEALTH {
+    uint8_t state;
+    uint8_t tec;
+    uint8_t rec;
+
+    // outage and restart
+    int64_t outageStart;                    // 0 = on the bus
+    int64_t backOnAt;                       // first sample back on the bus, 0 = still off
+    int64_t actionAt;                       // next restart
+    uint32_t backoffMs;
+    bool released;                          // bus-off recovery running
+
+    // since boot
+    uint32_t busOffs;
+    uint32_t restarts;
+    uint32_t outages;
+    uint32_t lastOutageMs;
+    uint32_t longestOutageMs;
+    uint32_t totalOutageMs;
+
+    // since the last record
+    uint32_t errorTypes[4];
+    uint32_t txErrors;
+    uint32_t rxErrors;
+    uint32_t overruns;
+};
+
+
+//==================================================================================//
+
+inline void canHealthReset(CANHEALTH& health) {
+    health = CANHEALTH();
+    health.state = CAN_STATE_STOPPED;
+    health.backoffMs = CAN_RESTART_MIN_MS;
+}
+
+// the CAN driven modes hold the failsafe throttle
+inline bool canHealthDown(const CANHEALTH& health) {
+    return health.outageStart != 0;
+}
+
+// frames may go out: the controller is on the bus (also while the outage is being confirmed)
+inline bool canHealthTransmit(const CANHEALTH& health) {
+    return health.state < CAN_STATE_BUS_OFF;
+}
+
+inline uint8_t canHealthState(uint8_t tec, uint8_t rec) {
+    uint8_t worst = tec > rec ? tec : rec;
+    if (worst >= CAN_PASSIVE_LIMIT) return CAN_STATE_PASSIVE;
+    if (worst >= CAN_WARNING_LIMIT) return CAN_STATE_WARNING;
+    return CAN_STATE_ACTIVE;
+}
+
+// every CANBUS loop with the latest sample, returns what to do with the controller
+inline uint8_t canHealthUpdate(CANHEALTH& health, const CANSAMPLE& sample, int64_t now) {
+    if (sample.overrun) health.overruns++;
+
+    if (!sample.running || sample.busOff) {
+        health.backOnAt = 0;
+        if (health.outageStart == 0) {
+            health.outageStart = now;
+            health.outages++;
+        }
+
+        if (sample.busOff && !sample.running) {
+            // held in reset after bus-off (a new one if the last was released): release it, a
+            // restart only if the recovery does not bring it back; after a restart the backoff
+            // still holds the next one off
+            if (health.state != CAN_STATE_BUS_OFF || health.released) {
+                // the TEC went past 255 since the last sample
+                health.busOffs++;
+                health.txErrors += (256 - health.tec + 7) / 8;
+                health.errorTypes[sample.errorCode >> 6]++;
+                health.tec = 0;
+                health.rec = 0;
+            }
+            health.state = CAN_STATE_BUS_OFF;
+            health.released = true;
+            int64_t recoverBy = now + CAN_RECOVER_MS * 1000LL;
+            if (health.actionAt < recoverBy) health.actionAt = recoverBy;
+            return CAN_ACTION_RECOVER;
+        }
+        if (!sample.busOff) health.state = CAN_STATE_STOPPED;
+        if (now < health.actionAt) return CAN_ACTION_NONE;
+
+        health.released = false;
+        health.restarts++;
+        health.state = CAN_STATE_STOPPED;
+        health.actionAt = now + health.backoffMs * 1000LL;
+        health.backoffMs = health.backoffMs * 2 < CAN_RESTART_MAX_MS ? health.backoffMs * 2 : CAN_RESTART_MAX_MS;
+        return CAN_ACTION_REINIT;
+    }
+
+    // on the bus: new errors by the counter increases, the type from the capture
+    bool errors = false;
+    if (health.state < CAN_STATE_BUS_OFF) {
+        if (sample.tec > health.tec) {
+            health.txErrors += (sample.tec - health.tec + 7) / 8;
+            errors = true;
+        }
+        if (sample.rec > health.rec) {
+            health.rxErrors += sample.rec - health.rec;
+            errors = true;
+        }
+    }
+    if (errors) health.errorTypes[sample.errorCode >> 6]++;
+    health.tec = sample.tec;
+    health.rec = sample.rec;
+    health.state = canHealthState(sample.tec, sample.rec);
+    health.released = false;
+
+    if (health.outageStart != 0) {
+        if (health.backOnAt == 0) health.backOnAt = now;
+        if (now - health.backOnAt >= CAN_STABLE_MS * 1000LL) {
+            uint32_t duration = (health.backOnAt - health.outageStart) / 1000;
+            health.lastOutageMs = duration;
+            health.totalOutageMs += duration;
+            if (duration > health.longestOutageMs) health.longestOutageMs = duration;
+            health.outageStart = 0;
+            health.backOnAt = 0;
+            health.backoffMs = CAN_RESTART_MIN_MS;
+        }
+    }
+    return CAN_ACTION_NONE;
+}
+
+
+//==================================================================================//
+
+inline uint8_t canHealthSaturate(uint32_t value) {
+    return value < 255 ? value : 255;
+}
+
+inline void canHealthRecord(uint8_t record[8], uint8_t type, const CANHEALTH& health, int64_t now) {
+    uint32_t outage = health.outageStart != 0 ? (now - health.outageStart) / 1000 : health.lastOutageMs;
+    if (outage > 0xFFFF) outage = 0xFFFF;
+
+    record[0] = type;
+    record[1] = health.state;
+    record[2] = health.tec;
+    record[3] = health.rec;
+    record[4] = canHealthSaturate(health.busOffs);
+    record[5] = canHealthSaturate(health.restarts);
+    record[6] = outage >> 8;
+    record[7] = outage & 0xFF;
+}
+
+// error counts of the window, cleared once sent
+inline void canHealthErrorRecord(uint8_t record[8], uint8_t type, CANHEALTH& health) {
+    record[0] = type;
+    for (uint8_t i = 0; i < 4; i++) {
+        record[1 + i] = canHealthSaturate(health.errorTypes[i]);
+        health.errorTypes[i] = 0;
+    }
+    record[5] = canHealthSaturate(health.txErrors);
+    record[6] = canHealthSaturate(health.rxErrors);
+    record[7] = canHealthSaturate(health.overruns);
+    health.txErrors = 0;
+    health.rxErrors = 0;
+    health.overruns = 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <CANBUS.h>
+#include <CANHEALTH.h>
+#include <atomic>
+
+// Controller side of the CAN health monitor (logic in CANHEALTH.h). The CAN library keeps the
+// ESP32's SJA1000 compatible controller to itself and has no error state, so the status, error
+// counter and error capture registers are read here directly. None of them is cleared by
+// reading except the error capture, which only re-arms it; the interrupt register, which the
+// library's receive interrupt reads, is left alone.
+// Bus-off puts the controller into reset mode, where the transmit buffer registers are the
+// acceptance filter: nothing may be sent until it is back (canMonitorTransmit(), also checked
+// by the time-triggered slot timer).
+
+#define CAN_REG_BASE          0x3ff6b000UL  // the library's REG_BASE, registers 4 bytes apart
+#define CAN_REG_MOD           0x00
+#define CAN_REG_CMR           0x01
+#define CAN_REG_SR            0x02
+#define CAN_REG_ECC           0x0C
+#define CAN_REG_RXERR         0x0E
+#define CAN_REG_TXERR         0x0F
+
+#define CAN_MOD_RESET         0x01
+#define CAN_CMR_CLEAR_OVERRUN 0x08
+#define CAN_SR_OVERRUN        0x02
+#define CAN_SR_BUS_OFF        0x80
+
+#define CAN_DOWN_THROTTLE     1500        // CAN driven modes while the bus is down
+
+static CANHEALTH _can_health;
+static std::atomic<bool> _can_down(false);      // CANBUS task -> VCU task
+static std::atomic<bool> _can_tx_ok(false);     // CANBUS task -> slot timer
+
+static const uint32_t canMonitorStaticBytes = sizeof(CANHEALTH) + 2 * sizeof(std::atomic<bool>);
+
+
+//==================================================================================//
+
+static inline uint8_t canRegister(uint8_t reg) {
+  return *(volatile uint32_t*)(uintptr_t)(CAN_REG_BASE + 4 * reg) & 0xFF;
+}
+
+static inline void canRegisterWrite(uint8_t reg, uint8_t value) {
+  *(volatile uint32_t*)(uintptr_t)(CAN_REG_BASE + 4 * reg) = value;
+}
+
+// 'started' as far as the driver knows (setupCANBUS() went through)
+CANSAMPLE canSample(bool started) {
+  CANSAMPLE sample = CANSAMPLE();
+  if (!started) return sample;
+
+  uint8_t status = canRegister(CAN_REG_SR);
+  sample.busOff = status & CAN_SR_BUS_OFF;
+  sample.running = !(canRegister(CAN_REG_MOD) & CAN_MOD_RESET);
+  sample.tec = canRegister(CAN_REG_TXERR);
+  sample.rec = canRegister(CAN_REG_RXERR);
+  sample.errorCode = canRegister(CAN_REG_ECC);
+  if (status & CAN_SR_OVERRUN) {
+    sample.overrun = true;
+    canRegisterWrite(CAN_REG_CMR, CAN_CMR_CLEAR_OVERRUN);
+  }
+  return sample;
+}
+
+// bus-off: leave reset mode, the controller counts 128 x 11 recessive bits and rejoins
+void canRecover() {
+  canRegisterWrite(CAN_REG_MOD, canRegister(CAN_REG_MOD) & ~CAN_MOD_RESET);
+}
+
+// CANBUS task, after the action has been carried out
+void canMonitorPublish() {
+  _can_down.store(canHealthDown(_can_health), std::memory_order_release);
+  _can_tx_ok.store(canHealthTransmit(_can_health), std::memory_order_release);
+}
+
+inline bool canMonitorDown() {
+  return _can_down.load(std::memory_order_acquire);
+}
+
+inline bool canMonitorTransmit() {
+  return _can_tx_ok.load(std::memory_order_acquire);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <CANBUS.h>
+#include <HANDOFF.h>
+#include <PURSUIT.h>
+#include <CLOCKSYNC.h>
+#include <SETPOINT.h>
+#include <STEERCAL.h>
+
+// Frame dispatch of the CANBUS task, shared by the firmware (src/main.cpp) and the host build
+// (vcu_host run), so a soak test on a Linux CAN interface takes the frames the way the VCU does.
+// canRoute() decides what a received frame is for and hands it over to the control task,
+// canRouteLog() prints it. A VCU takes only what is addressed to it: remote requests for its own
+// ID, drive commands on COMMAND_CAN_BASE + ID, paths on PATH_CAN_BASE + ID, setpoints on
+// SETPOINT_CAN_BASE + ID and steering tables on STEERCAL_CAN_BASE + ID. The TT reference, the
+// status frames of other VCUs and their command, path, setpoint and table IDs are ignored.
+
+enum can_route_enum{
+  CAN_ROUTE_RTR = 0,                  // remote request, nothing to hand over
+  CAN_ROUTE_COMMAND,                  // drive command, published
+  CAN_ROUTE_PATH,                     // path waypoint, the path is published once complete
+  CAN_ROUTE_SETPOINT,                 // trajectory setpoints, queued
+  CAN_ROUTE_STEERCAL,                 // steering table part, or a commit that was rejected
+  CAN_ROUTE_STEERCAL_LOADED,          // commit of a valid steering table, published
+  CAN_ROUTE_IGNORED                   // not for this VCU, or too short for a command
+};
+
+// CANBUS task side of the handoffs a frame can go to, owned by the caller
+struct CANROUTES {
+  int canId;                          // this VCU
+  Handoff<CANCOMMAND>* command;       // CANBUS -> VCU
+  PATH* pathBuilding;                 // path reception (PURSUIT.h)
+  PATH* pathLatest;
+  Handoff<PATH>* path;                // CANBUS -> VCU
+  const CLOCKSYNC* clock;             // master timebase for command ages, NULL without VCU_CLOCK_SYNC
+  SETPOINTQUEUE* setpoints;           // CANBUS -> VCU (SETPOINT.h)
+  SETPOINTRX* setpointRx;
+  STEERCAL* steerCalLatest;           // steering table reception (STEERCAL.h), the table in use
+  STEERCALRX* steerCalRx;
+  Handoff<STEERCAL>* steerCal;        // CANBUS -> VCU
+};
+
+
+//==================================================================================//
+
+// us from the master's stamp to reception, false while the frame or the clock cannot tell
+inline bool canRouteAge(const CANROUTES& routes, const CANRECIEVER& msg, int32_t& age) {
+  if (routes.clock == NULL || !msg.stamped || routes.clock->state < CLOCK_TRACKING) return false;
+  age = clockAge(*routes.clock, msg.at, msg.stamp);
+  return true;
+}
+
+inline uint8_t canRoute(CANROUTES& routes, const CANRECIEVER& msg) {
+  if (msg.extended && !msg.stamped) return CAN_ROUTE_IGNORED;
+  if (msg.rtr) return msg.id == routes.canId ? CAN_ROUTE_RTR : CAN_ROUTE_IGNORED;
+
+  if (msg.id == PATH_CAN_BASE + routes.canId) {
+    if (pathReceive(*routes.pathBuilding, *routes.pathLatest, msg.data, msg.length)) {
+      routes.path->publish(*routes.pathLatest);
+    }
+    return CAN_ROUTE_PATH;
+  }
+
+  if (msg.id == SETPOINT_CAN_BASE + routes.canId) {
+    setpointReceive(*routes.setpoints, *routes.setpointRx, msg.data, msg.length, msg.at);
+    return CAN_ROUTE_SETPOINT;
+  }
+
+  if (msg.id == STEERCAL_CAN_BASE + routes.canId) {
+    if (!steerCalReceive(*routes.steerCalRx, *routes.steerCalLatest, msg.data, msg.length)) return CAN_ROUTE_STEERCAL;
+    routes.steerCal->publish(*routes.steerCalLatest);
+    return CAN_ROUTE_STEERCAL_LOADED;
+  }
+
+  // shorter frames carry no drive command, canDecode() leaves the fields zero
+  if (msg.id != COMMAND_CAN_BASE + routes.canId || msg.length < 4) return CAN_ROUTE_IGNORED;
+
+  CANCOMMAND command = {msg.driveMode, msg.throttle, msg.steeringAngle, msg.at, false, 0,
+                        (int16_t)((msg.data[4] << 8) | msg.data[5])};
+  command.stamped = canRouteAge(routes, msg, command.age);
+  routes.command->publish(command);
+  return CAN_ROUTE_COMMAND;
+}
+
+// one line per frame on the serial port, nothing for frames that were not for this VCU
+inline void canRouteLog(const CANROUTES& routes, const CANRECIEVER& msg, uint8_t route) {
+  if (route == CAN_ROUTE_IGNORED) return;
+
+  Serial.print("recieved");
+  Serial.print("\tid: 0x");
+  Serial.print(msg.id, HEX);
+
+  if (msg.extended) {
+    Serial.print("\textended");
+  }
+
+  if (route == CAN_ROUTE_RTR) {
+    Serial.print("\trtr");
+    Serial.print("\trequested length: ");
+    Serial.print(msg.reqLength);
+
+  } else if (route == CAN_ROUTE_PATH) {
+    Serial.print("\tpath waypoint: ");
+    Serial.print(msg.data[0] & PATH_INDEX_MASK);
+
+  } else if (route == CAN_ROUTE_SETPOINT) {
+    if (msg.data[0] & SETPOINT_FLAG_START) Serial.print("\ttrajectory start");
+    if (msg.data[0] & SETPOINT_FLAG_END) Serial.print("\ttrajectory end");
+
+  } else if (route == CAN_ROUTE_STEERCAL_LOADED) {
+    Serial.print("\tsteering table loaded");
+
+  } else if (route == CAN_ROUTE_STEERCAL) {
+    if (msg.data[0] & STEERCAL_FLAG_COMMIT) Serial.print("\tsteering table rejected");
+
+  } else {
+    Serial.print("\tlength: ");
+    Serial.print(msg.length);
+    Serial.print("\tdrive mode: ");
+    Serial.print(msg.driveMode);
+    Serial.print("\tthrottle: ");
+    Serial.print(msg.throttle);
+    Serial.print("\tsteering angle: ");
+    Serial.print(msg.steeringAngle);
+    Serial.print("\tvoltage: ");
+    Serial.print(msg.voltage);
+    Serial.print("\tvelocity: ");
+    Serial.print(msg.velocity);
+    Serial.print("\tacknowledged: ");
+    Serial.print(msg.acknowledged);
+
+    int32_t age;
+    if (canRouteAge(routes, msg, age)) {
+      Serial.print("\tage us: ");
+      Serial.print(age);
+    }
+  }
+  Serial.println();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include <CANBUS.h>
+#include <ESTOP.h>
+#include <atomic>
+
+// Interrupt driven CAN reception (VCU_CAN_TT, VCU_CLOCK_SYNC, VCU_EVENT_DRIVEN): every frame is taken in the
+// CAN receive interrupt together with its esp_timer time stamp and handed to the CANBUS task
+// through a wait-free ring, so reference and sync frames are timed by their arrival on the
+// bus and not by when the task gets around to polling. The task is notified per frame. With
+// VCU_ESTOP the frames on ESTOP_CAN_ID go to the emergency stop hook instead, ahead of the ring
+// (ESTOPOUT.h).
+
+#define CAN_RX_RING       16      // frames, power of two
+
+struct CANFRAME {
+  int64_t at;                     // esp_timer us when the frame was received
+  uint32_t id;
+  bool extended;
+  bool rtr;
+  uint8_t dlc;
+  uint8_t data[8];
+};
+
+static CANFRAME _can_rx[CAN_RX_RING];
+static std::atomic<uint8_t> _can_rx_head(0);    // CAN interrupt
+static std::atomic<uint8_t> _can_rx_tail(0);    // CANBUS task
+static TaskHandle_t _can_rx_task = NULL;
+static uint32_t _can_rx_overflow = 0;           // frames lost, ring full
+
+// emergency stop, runs in the interrupt: receive time, payload, length
+typedef void (*CANRXHOOK)(int64_t at, const uint8_t* data, uint8_t dlc);
+static CANRXHOOK _can_rx_estop = NULL;
+
+static const uint32_t canRxStaticBytes = sizeof(_can_rx) + 2 * sizeof(std::atomic<uint8_t>) + sizeof(TaskHandle_t) +
+                                         sizeof(uint32_t) + sizeof(CANRXHOOK);
+
+
+//==================================================================================//
+
+// CAN receive callback, runs in the library's interrupt handler
+void canRxIsr(int packetSize) {
+  int64_t at = esp_timer_get_time();
+  if (_can_rx_estop != NULL && CAN.packetId() == ESTOP_CAN_ID && !CAN.packetExtended() && !CAN.packetRtr()) {
+    uint8_t dlc = packetSize < 8 ? packetSize : 8;
+    uint8_t data[8];
+    for (uint8_t i = 0; i < dlc; i++) data[i] = CAN.read();
+    _can_rx_estop(at, data, dlc);
+    return;
+  }
+
+  uint8_t head = _can_rx_head.load(std::memory_order_relaxed);
+  uint8_t next = (head + 1) & (CAN_RX_RING - 1);
+  if (next == _can_rx_tail.load(std::memory_order_acquire)) {
+    _can_rx_overflow++;
+    return;
+  }
+
+  CANFRAME& frame = _can_rx[head];
+  frame.at = at;
+  frame.id = CAN.packetId();
+  frame.extended = CAN.packetExtended();
+  frame.rtr = CAN.packetRtr();
+  frame.dlc = frame.rtr ? CAN.packetDlc() : packetSize;
+  for (uint8_t i = 0; i < 8; i++) {
+    frame.data[i] = (!frame.rtr && i < packetSize) ? CAN.read() : 0;
+  }
+  _can_rx_head.store(next, std::memory_order_release);
+
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(_can_rx_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// after setupCANBUS(), 'task' is notified for every received frame, 'estop' takes ESTOP_CAN_ID
+void canRxBegin(TaskHandle_t task, CANRXHOOK estop = NULL) {
+  _can_rx_task = task;
+  _can_rx_estop = estop;
+  CAN.onReceive(canRxIsr);
+}
+
+// CANBUS task: next frame from the ring, same fields as canReceiver() plus the receive time
+CANRECIEVER canRxReceiver() {
+  CANRECIEVER msg = CANRECIEVER();
+
+  uint8_t tail = _can_rx_tail.load(std::memory_order_relaxed);
+  if (tail == _can_rx_head.load(std::memory_order_acquire)) return msg;
+
+  const CANFRAME& frame = _can_rx[tail];
+  msg.recieved = true;
+  msg.extended = frame.extended;
+  msg.rtr = frame.rtr;
+  msg.id = frame.id;
+  msg.at = frame.at;
+  if (frame.rtr) msg.reqLength = frame.dlc;
+  else canDecode(msg, frame.data, frame.dlc);
+
+  _can_rx_tail.store((tail + 1) & (CAN_RX_RING - 1), std::memory_order_release);
+  return msg;
+}
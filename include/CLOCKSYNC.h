@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdint.h>
+#include <CANBUS.h>
+
+// Shared microsecond timebase over CAN (VCU_CLOCK_SYNC=1), two step sync like PTP / CANopen:
+//   SYNC       id CLOCK_SYNC_ID      [sequence]
+//   FOLLOW_UP  id CLOCK_FOLLOWUP_ID  [sequence] [master time of that SYNC on the bus, us x7]
+// The master takes the time of the SYNC frame once it has actually left (transmit done or
+// its own echo) and sends it afterwards, so its transmit queue does not matter. The VCU
+// time stamps the SYNC on reception (CANRX.h), pairs it with the follow-up and feeds the
+// pair to a PI servo that tracks offset and drift of the master clock. Between syncs the
+// master time is extrapolated with the estimated drift.
+//
+// Compact stamps: command and status frames are sent as extended frames whose 29 bit ID is
+// the usual 11 bit ID followed by the low CLOCK_STAMP_BITS bits of the master time, so the
+// payload layout stays as it is and the arbitration order of the 11 bit IDs is kept. The
+// stamps wrap every 262 ms, ages up to half of that are measured.
+//
+// Integer only, shared with the host simulation (vcu_host sim-clock).
+
+#define CLOCK_SYNC_ID         0x080
+#define CLOCK_FOLLOWUP_ID     0x081
+#define CLOCK_SYNC_MS         100       // master sync period
+#define CLOCK_STAMP_BITS      18
+#define CLOCK_STAMP_MASK      0x3FFFF
+#define CLOCK_STEP_US         1000      // larger offset errors step the clock instead of slewing it
+#define CLOCK_LOCK_US         50        // offset error counted as locked
+#define CLOCK_LOCK_SAMPLES    4         // locked samples in a row before reporting CLOCK_LOCKED
+#define CLOCK_MAX_GAP_US      2000000   // longer without a sample restarts the drift estimate
+#define CLOCK_MAX_DRIFT_PPB   500000    // crystal plus estimation error, clamp
+
+enum clock_state_enum{
+  CLOCK_UNSYNCED = 0,
+  CLOCK_STEPPED,                  // offset set from one sample, no drift estimate yet
+  CLOCK_TRACKING,
+  CLOCK_LOCKED
+};
+
+struct CLOCKSYNC {
+  uint8_t state;
+  int64_t baseLocal;              // last correction point, local us
+  int64_t baseMaster;             // master us at baseLocal
+  int32_t driftPpb;               // local clock runs fast by this much
+  int32_t error;                  // offset error of the last sample, us
+  uint8_t good;                   // samples within CLOCK_LOCK_US in a row
+  uint32_t samples;
+  uint32_t steps;
+};
+
+struct CLOCKPENDING {
+  bool valid;
+  uint8_t sequence;
+  int64_t at;                     // local reception time of the SYNC
+};
+
+// command latency over one diagnostics window
+struct CLOCKLATENCY {
+  uint32_t count;
+  uint32_t rxMax;                 // us, master stamp to reception
+  uint32_t applyMax;              // us, master stamp to the control task applying it
+  uint64_t applySum;
+};
+
+
+//==================================================================================//
+
+inline int64_t clockToMaster(const CLOCKSYNC& clock, int64_t local) {
+  int64_t elapsed = local - clock.baseLocal;
+  return clock.baseMaster + elapsed - elapsed * clock.driftPpb / 1000000000LL;
+}
+
+inline void clockStep(CLOCKSYNC& clock, int64_t master, int64_t local) {
+  clock.baseLocal = local;
+  clock.baseMaster = master;
+  clock.state = CLOCK_STEPPED;
+  clock.good = 0;
+}
+
+// one SYNC / FOLLOW_UP pair: master time of the SYNC and its local reception time
+inline void clockSample(CLOCKSYNC& clock, int64_t master, int64_t local) {
+  clock.samples++;
+  int64_t interval = local - clock.baseLocal;
+
+  if (clock.state == CLOCK_UNSYNCED || interval <= 0 || interval > CLOCK_MAX_GAP_US) {
+    clock.error = 0;
+    clockStep(clock, master, local);
+    return;
+  }
+
+  int64_t predicted = clockToMaster(clock, local);
+  int64_t error = master - predicted;
+  clock.error = (int32_t)constrain(error, (int64_t)INT32_MIN, (int64_t)INT32_MAX);
+
+  if (error > CLOCK_STEP_US || error < -CLOCK_STEP_US) {
+    clock.steps++;
+    clockStep(clock, master, local);
+    return;
+  }
+
+  // error > 0: the master moved on further than predicted, the local clock is slower than assumed
+  int64_t rate = error * 1000000000LL / interval;
+  if (clock.state == CLOCK_STEPPED) {
+    // second sample: drift straight from the two points
+    clock.driftPpb -= rate;
+    clock.baseMaster = master;
+    clock.state = CLOCK_TRACKING;
+  } else {
+    // PI servo: half of the error into the time base, 1/16 of the rate error into the drift
+    // (reception jitter of 20 us is 200 ppm over one sync period, the drift has to average it)
+    clock.driftPpb -= rate / 16;
+    clock.baseMaster = predicted + error / 2;
+  }
+  clock.baseLocal = local;
+  clock.driftPpb = constrain(clock.driftPpb, -CLOCK_MAX_DRIFT_PPB, CLOCK_MAX_DRIFT_PPB);
+
+  clock.good = (error <= CLOCK_LOCK_US && error >= -CLOCK_LOCK_US) ? min(clock.good + 1, 0xFF) : 0;
+  if (clock.good >= CLOCK_LOCK_SAMPLES) clock.state = CLOCK_LOCKED;
+  else if (clock.good == 0) clock.state = CLOCK_TRACKING;
+}
+
+// true for SYNC and FOLLOW_UP frames, which are consumed here
+inline bool clockReceive(CLOCKSYNC& clock, CLOCKPENDING& pending, const CANRECIEVER& msg) {
+  if (msg.extended || msg.rtr) return false;
+
+  if (msg.id == CLOCK_SYNC_ID && msg.length >= 1) {
+    pending.valid = true;
+    pending.sequence = msg.data[0];
+    pending.at = msg.at;
+    return true;
+  }
+  if (msg.id == CLOCK_FOLLOWUP_ID && msg.length == 8) {
+    if (pending.valid && pending.sequence == msg.data[0]) {
+      int64_t master = 0;
+      for (uint8_t i = 1; i < 8; i++) master = (master << 8) | msg.data[i];
+      clockSample(clock, master, pending.at);
+    }
+    pending.valid = false;
+    return true;
+  }
+  return false;
+}
+
+
+//==================================================================================//
+
+inline uint32_t clockStamp(const CLOCKSYNC& clock, int64_t local) {
+  return (uint32_t)clockToMaster(clock, local) & CLOCK_STAMP_MASK;
+}
+
+// extended ID of a stamped frame
+inline uint32_t clockStampedId(uint16_t id, uint32_t stamp) {
+  return ((uint32_t)id << CLOCK_STAMP_BITS) | (stamp & CLOCK_STAMP_MASK);
+}
+
+// splits a stamped extended frame into its 11 bit ID and stamp, false for other frames
+inline bool clockUnstamp(CANRECIEVER& msg) {
+  if (!msg.extended) return false;
+  msg.stamped = true;
+  msg.stamp = msg.id & CLOCK_STAMP_MASK;
+  msg.id = msg.id >> CLOCK_STAMP_BITS;
+  return true;
+}
+
+// us between a stamp and a local time, negative if the stamp lies ahead (clock not locked)
+inline int32_t clockAge(const CLOCKSYNC& clock, int64_t local, uint32_t stamp) {
+  int32_t age = (int32_t)((clockStamp(clock, local) - stamp) & CLOCK_STAMP_MASK);
+  return age > CLOCK_STAMP_MASK / 2 ? age - (CLOCK_STAMP_MASK + 1) : age;
+}
+
+inline void clockLatency(CLOCKLATENCY& latency, int32_t rxAge, int32_t applyAge) {
+  if (rxAge < 0 || applyAge < 0) return;
+  latency.count++;
+  latency.rxMax = max(latency.rxMax, (uint32_t)rxAge);
+  latency.applyMax = max(latency.applyMax, (uint32_t)applyAge);
+  latency.applySum += applyAge;
+}
+
+// [0x70] [state] [offset error us x2] [drift 0.01 ppm x2] [max command age at reception, 0.1 ms]
+// [max command age when applied, 0.1 ms]   (signed where it can be negative)
+inline void clockRecord(uint8_t record[8], uint8_t type, const CLOCKSYNC& clock, const CLOCKLATENCY& latency) {
+  int16_t error = constrain(clock.error, -32768, 32767);
+  int16_t drift = constrain(clock.driftPpb / 10, -32768, 32767);
+  record[0] = type;
+  record[1] = clock.state;
+  record[2] = (error >> 8) & 0xFF;
+  record[3] = error & 0xFF;
+  record[4] = (drift >> 8) & 0xFF;
+  record[5] = drift & 0xFF;
+  record[6] = min(latency.rxMax / 100, (uint32_t)0xFF);
+  record[7] = min(latency.applyMax / 100, (uint32_t)0xFF);
+}
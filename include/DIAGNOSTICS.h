@@ -0,0 +1,228 @@
+#include <Arduino.h>
+#include <CAN.h>
+#include <esp_heap_caps.h>
+#include <STATICMEM.h>
+#include <DIAGRECORD.h>
+#if VCU_CAN_TT
+#include <TTNODE.h>
+#endif
+
+// Diagnostics output (compact 8 byte records, one CAN frame each)
+#define DIAG_OUT_CAN      0
+#define DIAG_OUT_SERIAL   1
+
+#ifndef DIAG_OUTPUT
+#define DIAG_OUTPUT       DIAG_OUT_CAN
+#endif
+
+#define DIAG_PERIOD_MS    1000    // publish period
+#define DIAG_MAX_TASKS    4
+#define DIAG_SERIAL_SYNC  0xA5    // serial record: sync, type, 8 byte payload
+
+struct DIAGTASK {
+  TaskHandle_t handle;
+  uint32_t busySum;               // us of work since last publish
+  uint32_t busyMax;               // longest single loop since last publish
+  uint32_t loops;                 // loops since last publish
+  int64_t loopStart;
+  uint32_t periodMin;             // loop start to loop start, since last publish
+  uint32_t periodMax;
+  uint32_t periodSum;
+  uint32_t runTimeLast;           // FreeRTOS run time counter at last publish
+};
+
+static DIAGTASK _diag_tasks[DIAG_MAX_TASKS];
+static portMUX_TYPE _diag_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t _diag_last_publish = 0;
+static uint32_t _diag_total_last = 0;
+
+
+//==================================================================================//
+
+void setupDIAGNOSTICS () {
+  for (uint8_t i = 0; i < DIAG_MAX_TASKS; i++) {
+    _diag_tasks[i] = DIAGTASK();
+  }
+  _diag_last_publish = esp_timer_get_time();
+  Serial.println("Diagnostics ready");
+}
+
+// register a task handle so its stack and run time can be sampled
+void diagRegisterTask(uint8_t index, TaskHandle_t handle) {
+  if (index < DIAG_MAX_TASKS) {
+    _diag_tasks[index].handle = handle;
+  }
+}
+
+// call at the top of a task loop, before any work
+void diagLoopBegin(uint8_t index) {
+  int64_t now = esp_timer_get_time();
+  int64_t last = _diag_tasks[index].loopStart;
+  _diag_tasks[index].loopStart = now;
+  if (last == 0) return;
+
+  uint32_t period = now - last;
+  portENTER_CRITICAL(&_diag_mux);
+  _diag_tasks[index].periodSum += period;
+  if (_diag_tasks[index].periodMin == 0 || period < _diag_tasks[index].periodMin) {
+    _diag_tasks[index].periodMin = period;
+  }
+  if (period > _diag_tasks[index].periodMax) {
+    _diag_tasks[index].periodMax = period;
+  }
+  portEXIT_CRITICAL(&_diag_mux);
+}
+
+// call at the end of a task loop, right before the task yields
+void diagLoopEnd(uint8_t index) {
+  uint32_t busy = esp_timer_get_time() - _diag_tasks[index].loopStart;
+
+  portENTER_CRITICAL(&_diag_mux);
+  _diag_tasks[index].busySum += busy;
+  _diag_tasks[index].loops++;
+  if (busy > _diag_tasks[index].busyMax) {
+    _diag_tasks[index].busyMax = busy;
+  }
+  portEXIT_CRITICAL(&_diag_mux);
+}
+
+
+//==================================================================================//
+
+void diagWriteRecord(int canId, const uint8_t record[8]) {
+#if DIAG_OUTPUT == DIAG_OUT_CAN && VCU_CAN_TT
+  ttQueueFrame(canId, record, 8);     // sent in the node's queue slots
+#elif DIAG_OUTPUT == DIAG_OUT_CAN
+  CAN.beginPacket(canId);
+  CAN.write(record, 8);
+  CAN.endPacket();
+#else
+  (void)canId;
+  Serial.write(DIAG_SERIAL_SYNC);
+  Serial.write(record, 8);
+#endif
+}
+
+// cpu share of every registered task in 0.5 % steps, from the FreeRTOS run time counters
+void diagSampleRunTime(uint8_t load[DIAG_MAX_TASKS]) {
+  for (uint8_t i = 0; i < DIAG_MAX_TASKS; i++) {
+    load[i] = 0;
+  }
+
+#if configGENERATE_RUN_TIME_STATS == 1 && configUSE_TRACE_FACILITY == 1
+  static TaskStatus_t status[16];
+  uint32_t total;
+  UBaseType_t count = uxTaskGetSystemState(status, 16, &total);
+
+  // the run time counter covers both cores
+  uint32_t totalDelta = (total - _diag_total_last) * portNUM_PROCESSORS;
+  _diag_total_last = total;
+  if (totalDelta == 0) return;
+
+  for (UBaseType_t s = 0; s < count; s++) {
+    for (uint8_t i = 0; i < DIAG_MAX_TASKS; i++) {
+      if (_diag_tasks[i].handle != NULL && status[s].xHandle == _diag_tasks[i].handle) {
+        uint32_t delta = status[s].ulRunTimeCounter - _diag_tasks[i].runTimeLast;
+        _diag_tasks[i].runTimeLast = status[s].ulRunTimeCounter;
+        load[i] = min((uint64_t)delta * 200 / totalDelta, (uint64_t)255);
+      }
+    }
+  }
+#endif
+}
+
+// publish the task and jitter records of every registered task plus the heap and memory records,
+// true once per window
+bool publishDiagnostics(int canId) {
+  int64_t now = esp_timer_get_time();
+  uint32_t window = now - _diag_last_publish;
+  if (window < DIAG_PERIOD_MS * 1000UL) return false;
+  _diag_last_publish = now;
+
+  uint8_t load[DIAG_MAX_TASKS];
+  diagSampleRunTime(load);
+
+  for (uint8_t i = 0; i < DIAG_MAX_TASKS; i++) {
+    if (_diag_tasks[i].handle == NULL) continue;
+
+    portENTER_CRITICAL(&_diag_mux);
+    DIAGTASK task = _diag_tasks[i];
+    _diag_tasks[i].busySum = 0;
+    _diag_tasks[i].busyMax = 0;
+    _diag_tasks[i].loops = 0;
+    _diag_tasks[i].periodMin = 0;
+    _diag_tasks[i].periodMax = 0;
+    _diag_tasks[i].periodSum = 0;
+    portEXIT_CRITICAL(&_diag_mux);
+
+    // without run time stats fall back to the measured busy share of the window
+    if (load[i] == 0 && task.busySum > 0) {
+      load[i] = min((uint64_t)task.busySum * 200 / window, (uint64_t)255);
+    }
+
+    uint16_t stackFree = uxTaskGetStackHighWaterMark(task.handle);   // bytes on the ESP32 port
+    uint16_t busyAvg = task.loops ? min(task.busySum / task.loops, (uint32_t)0xFFFF) : 0;
+    uint16_t busyMax = min(task.busyMax, (uint32_t)0xFFFF);
+
+    uint8_t record[8];
+    record[0] = DIAG_RECORD_TASK | i;
+    record[1] = load[i];
+    record[2] = stackFree >> 8;
+    record[3] = stackFree & 0xFF;
+    record[4] = busyAvg >> 8;
+    record[5] = busyAvg & 0xFF;
+    record[6] = busyMax >> 8;
+    record[7] = busyMax & 0xFF;
+    diagWriteRecord(canId, record);
+
+    // loop period spread, the control jitter figure used to compare task layouts
+    uint16_t periodMin = min(task.periodMin, (uint32_t)0xFFFF);
+    uint16_t periodMax = min(task.periodMax, (uint32_t)0xFFFF);
+    uint16_t periodAvg = task.loops ? min(task.periodSum / task.loops, (uint32_t)0xFFFF) : 0;
+
+    record[0] = DIAG_RECORD_JITTER | i;
+    record[1] = periodMin >> 8;
+    record[2] = periodMin & 0xFF;
+    record[3] = periodMax >> 8;
+    record[4] = periodMax & 0xFF;
+    record[5] = periodAvg >> 8;
+    record[6] = periodAvg & 0xFF;
+    record[7] = 0;
+    diagWriteRecord(canId, record);
+  }
+
+  uint32_t freeHeap = min(esp_get_free_heap_size(), (uint32_t)0xFFFFFF);
+  uint32_t minHeap = min(esp_get_minimum_free_heap_size(), (uint32_t)0xFFFFFF);
+  uint32_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) / 1024;
+
+  uint8_t record[8];
+  record[0] = DIAG_RECORD_HEAP;
+  record[1] = freeHeap >> 16;
+  record[2] = (freeHeap >> 8) & 0xFF;
+  record[3] = freeHeap & 0xFF;
+  record[4] = minHeap >> 16;
+  record[5] = (minHeap >> 8) & 0xFF;
+  record[6] = minHeap & 0xFF;
+  record[7] = min(largest, (uint32_t)0xFF);     // KiB
+  diagWriteRecord(canId, record);
+
+  // heap use after init (STATICMEM.h)
+  int32_t blocks, bytes;
+  memCheck(blocks, bytes);
+
+  record[0] = DIAG_RECORD_MEMORY;
+  record[1] = _mem_seal.sealed;
+  record[2] = min(_mem_seal.violations, (uint32_t)0xFF);
+  record[3] = (blocks >> 8) & 0xFF;
+  record[4] = blocks & 0xFF;
+  record[5] = (bytes >> 16) & 0xFF;
+  record[6] = (bytes >> 8) & 0xFF;
+  record[7] = bytes & 0xFF;
+  diagWriteRecord(canId, record);
+
+#if VCU_CAN_TT
+  ttRecord(record, DIAG_RECORD_TT);
+  diagWriteRecord(canId, record);
+#endif
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// Diagnostics CAN ID and record types, shared by DIAGNOSTICS.h and the host tools (no Arduino
+// dependencies, unlike DIAGNOSTICS.h).
+
+#define DIAG_CAN_BASE     0x600   // diagnostics frames go out on DIAG_CAN_BASE + CANBUS_ID
+
+// Record layouts (multi byte values big endian, like canSender)
+//   task: [0x10 | task] [cpu load, 0.5 % steps] [stack high-water, bytes x2] [avg busy us x2] [max busy us x2]
+//   heap: [0x20] [free heap x3] [minimum free heap ever x3] [largest free block, KiB]
+//   jitter: [0x30 | task] [min loop period us x2] [max loop period us x2] [avg loop period us x2] [0]
+//   memory: [0x40] [heap sealed] [violations] [heap blocks since seal x2] [heap bytes since seal x3]  (signed)
+//   boot: [0x50] once, layout in BOOT.h
+//   time-triggered CAN: [0x60] with VCU_CAN_TT, layout in TTNODE.h
+//   clock sync: [0x70] with VCU_CLOCK_SYNC, layout in CLOCKSYNC.h
+//   wake-up: [0x80] control wake-ups and input latency, layout in WAKEUP.h
+//   RC link: [0x90] link quality and failsafe, [0xA0 | part] inter-frame gaps, layouts in RCLINK.h;
+//            [0xA8] with VCU_RX2, receiver diversity, layout in RXDIVERSITY.h
+//   CAN health: [0xB0] error state and outages, [0xC0] errors by type, layouts in CANHEALTH.h
+//   power: [0xD0] with VCU_POWER_SAVE, level residency and wake-up latency, layout in POWERSTATE.h
+//   yaw: [0xE0] with VCU_YAW_CONTROL, yaw-rate feedback and IMU state, layout in YAWRATE.h
+//   e-stop: [0xF0] with VCU_ESTOP, stop state, re-arm sequence and stop latency, layout in ESTOP.h
+//   job: [0x08 | job] with VCU_JOBS, run time and deadlines of each cooperative job, layout in JOBS.h
+enum diag_record_enum{
+  DIAG_RECORD_JOB = 0x08,         // low 3 bits carry the job index; 0x00 - 0x07 read as drive modes
+  DIAG_RECORD_TASK = 0x10,        // low nibble carries the task index
+  DIAG_RECORD_HEAP = 0x20,
+  DIAG_RECORD_JITTER = 0x30,
+  DIAG_RECORD_MEMORY = 0x40,
+  DIAG_RECORD_BOOT = 0x50,
+  DIAG_RECORD_TT = 0x60,
+  DIAG_RECORD_CLOCK = 0x70,
+  DIAG_RECORD_WAKE = 0x80,
+  DIAG_RECORD_RC_LINK = 0x90,
+  DIAG_RECORD_RC_GAPS = 0xA0,     // low nibble carries the histogram part
+  DIAG_RECORD_RC_DIVERSITY = 0xA8,
+  DIAG_RECORD_CAN = 0xB0,
+  DIAG_RECORD_CAN_ERRORS = 0xC0,
+  DIAG_RECORD_POWER = 0xD0,
+  DIAG_RECORD_YAW = 0xE0,
+  DIAG_RECORD_ESTOP = 0xF0
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+
+// DShot frame encoding for the RMT peripheral, no hardware access so the host build can check it
+// bit for bit (vcu_host dshot-frames).
+// Frame: 16 bits MSB first, [11 bit value] [telemetry request] [4 bit CRC], each bit one period
+// of 1 / (SPEED kbit/s) high for 3/4 (1) or 3/8 (0) of it. Values 1 - 47 are ESC commands, 0 is
+// motor stop; in 3D mode (the ESC set to bidirectional rotation, as a car needs) 48 - 1047 is
+// reverse and 1048 - 2047 forward. With bidirectional DShot the line idles high, every level is
+// inverted and the CRC too, and the ESC answers each frame ~30 us later with its eRPM:
+//   21 bits at 5/4 of the frame bit rate, a level change for every 1, the 20 bits behind it GCR
+//   coded (5 bits per nibble) [12 bit period: 3 bit exponent, 9 bit mantissa, us] [4 bit CRC]
+//
+// RMT items are 32 bit words, bits 0-14 duration, 15 level, 16-30 duration, 31 level (ticks of
+// 80 MHz, no divider), one item per bit. The items of every nibble are precomputed once per
+// speed and polarity, so a frame is four table copies.
+
+#define DSHOT_FRAME_BITS        16
+#define DSHOT_ITEMS             (DSHOT_FRAME_BITS + 1)      // and the end marker
+#define DSHOT_RMT_CLOCK_HZ      80000000UL
+#define DSHOT_VALUE_MAX         2047
+#define DSHOT_VALUE_MIN         48          // below: ESC commands
+#define DSHOT_3D_FORWARD        1048        // 3D mode: 48 - 1047 reverse, 1048 - 2047 forward
+#define DSHOT_TELEMETRY_BITS    21
+#define DSHOT_PERIOD_STOPPED    65408       // largest period the reply can carry: motor stopped
+
+struct DSHOTSYMBOLS {
+    uint32_t nibble[16][4];                 // RMT items, MSB first
+    uint16_t bitTicks;                      // frame bit period
+    uint16_t replyTicks;                    // telemetry bit period
+};
+
+// speed from motor electrical period
+struct DSHOTDRIVETRAIN {
+    uint8_t polePairs;
+    uint16_t gearRatio;                     // motor turns per wheel turn, Q8
+    uint16_t wheelCircumference;            // mm
+};
+
+
+//==================================================================================//
+
+// one bit: 'active' ticks at the active level (high, low when inverted), then 'rest'
+inline uint32_t dshotItem(uint16_t active, uint16_t rest, bool inverted) {
+    uint32_t first = inverted ? 0 : 1;
+    return (uint32_t)active | (first << 15) | ((uint32_t)rest << 16) | ((first ^ 1) << 31);
+}
+
+// items of every nibble for SPEED kbit/s (150, 300, 600)
+inline void dshotSymbols(DSHOTSYMBOLS& symbols, uint16_t speed, bool inverted) {
+    uint32_t bit = (DSHOT_RMT_CLOCK_HZ / 1000 + speed / 2) / speed;
+    uint32_t one = (bit * 3 + 2) / 4;
+    uint32_t zero = (bit * 3 + 4) / 8;
+    symbols.bitTicks = bit;
+    symbols.replyTicks = (bit * 4 + 2) / 5;
+
+    for (uint8_t n = 0; n < 16; n++) {
+        for (uint8_t i = 0; i < 4; i++) {
+            uint32_t active = (n & (0x08 >> i)) ? one : zero;
+            symbols.nibble[n][i] = dshotItem(active, bit - active, inverted);
+        }
+    }
+}
+
+// 11 bit value and telemetry request to the frame, CRC over the three nibbles
+inline uint16_t dshotPacket(uint16_t value, bool telemetry, bool inverted) {
+    uint16_t packet = ((value & 0x07FF) << 1) | (telemetry ? 1 : 0);
+    uint16_t crc = packet ^ (packet >> 4) ^ (packet >> 8);
+    if (inverted) crc = ~crc;
+    return (packet << 4) | (crc & 0x0F);
+}
+
+inline void dshotEncode(const DSHOTSYMBOLS& symbols, uint16_t packet, uint32_t items[DSHOT_ITEMS]) {
+    for (uint8_t n = 0; n < 4; n++) {
+        const uint32_t* nibble = symbols.nibble[(packet >> (12 - 4 * n)) & 0x0F];
+        for (uint8_t i = 0; i < 4; i++) items[4 * n + i] = nibble[i];
+    }
+    items[DSHOT_FRAME_BITS] = 0;
+}
+
+// throttle us (1000 - 2000) to a 3D mode value, 0 (stop) within 'deadband' us of neutral; the
+// first us past the band is the lowest value of its direction
+inline uint16_t dshotThrottle(int16_t throttle, uint16_t deadband) {
+    int32_t offset = (int32_t)throttle - 1500;
+    int32_t span = 500 - deadband - 1;
+    if (offset > (int32_t)deadband) {
+        int32_t value = DSHOT_3D_FORWARD + (offset - deadband - 1) * (DSHOT_VALUE_MAX - DSHOT_3D_FORWARD) / span;
+        return value < DSHOT_VALUE_MAX ? value : DSHOT_VALUE_MAX;
+    }
+    if (offset < -(int32_t)deadband) {
+        int32_t value = DSHOT_VALUE_MIN + (-offset - deadband - 1) * (DSHOT_3D_FORWARD - 1 - DSHOT_VALUE_MIN) / span;
+        return value < DSHOT_3D_FORWARD - 1 ? value : DSHOT_3D_FORWARD - 1;
+    }
+    return 0;
+}
+
+
+//==================================================================================//
+
+// GCR quintet to nibble, 0xFF = not a code
+static const uint8_t dshotGcrNibble[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x09, 0x0A, 0x0B, 0xFF, 0x0D, 0x0E, 0x0F,
+    0xFF, 0xFF, 0x02, 0x03, 0xFF, 0x05, 0x06, 0x07, 0xFF, 0x00, 0x08, 0x01, 0xFF, 0x04, 0x0C, 0xFF
+};
+
+// ESC reply as captured by the RMT receiver (line low first, ends in idle high) to the
+// electrical period in us; false if it is no valid reply (our own frame, noise, CRC)
+inline bool dshotTelemetryDecode(const uint32_t* items, uint16_t count, uint16_t replyTicks, uint32_t& periodUs) {
+    uint32_t value = 0;
+    uint8_t bits = 0;
+    for (uint16_t i = 0; i < 2 * count; i++) {
+        uint16_t duration = (i & 1) ? (items[i / 2] >> 16) & 0x7FFF : items[i / 2] & 0x7FFF;
+        if (duration == 0) break;           // idle: the last run
+        uint8_t length = (duration + replyTicks / 2) / replyTicks;
+        if (length == 0 || bits + length >= DSHOT_TELEMETRY_BITS) break;
+        value = (value << length) | (1UL << (length - 1));
+        bits += length;
+    }
+    if (bits == 0 || bits >= DSHOT_TELEMETRY_BITS) return false;
+
+    // the last run lasts until the end of the frame
+    uint8_t rest = DSHOT_TELEMETRY_BITS - bits;
+    value = (value << rest) | (1UL << (rest - 1));
+    value ^= value >> 1;
+
+    uint16_t decoded = 0;
+    for (int8_t shift = 15; shift >= 0; shift -= 5) {
+        uint8_t nibble = dshotGcrNibble[(value >> shift) & 0x1F];
+        if (nibble == 0xFF) return false;
+        decoded = (decoded << 4) | nibble;
+    }
+
+    uint16_t crc = decoded ^ (decoded >> 8);
+    crc ^= crc >> 4;
+    if ((crc & 0x0F) != 0x0F) return false;
+
+    uint16_t e = decoded >> 4;
+    periodUs = (uint32_t)(e & 0x01FF) << (e >> 9);
+    return true;
+}
+
+// signed speed in mm/s from the electrical period, 'direction' the sign of the last command
+inline int32_t dshotSpeed(uint32_t periodUs, const DSHOTDRIVETRAIN& drivetrain, int8_t direction) {
+    if (periodUs == 0 || periodUs >= DSHOT_PERIOD_STOPPED) return 0;
+    int64_t speed = 1000000LL * drivetrain.wheelCircumference * 256 /
+                    ((int64_t)periodUs * drivetrain.polePairs * drivetrain.gearRatio);
+    return direction < 0 ? -(int32_t)speed : (int32_t)speed;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESP32Servo.h>
+#include <driver/rmt.h>
+#include <driver/gpio.h>
+#include <freertos/ringbuf.h>
+#include <DSHOTFRAME.h>
+
+// DShot output policy (VCU_OUTPUT=OUTPUT_DSHOT): the steering stays a servo, the drive motor ESC
+// gets DShot frames from the RMT peripheral instead of 50 Hz servo pulses, so a new throttle
+// reaches the ESC within one frame (27 us at DShot600) and there is no pulse width calibration
+// to drift. The throttle maps onto 3D mode values (DSHOTFRAME.h), the ESC has to be set to 3D.
+// For DSHOT_ARM_MS after begin() every frame is motor stop so the ESC can arm; begin() does not
+// wait for it, the frames of the control loop (or the timer) arm the ESC.
+//   PERIOD_US = 0   one frame per write(), at the rate of the control loop
+//   PERIOD_US > 0   an esp_timer repeats the latest value every PERIOD_US; without write() for
+//                   DSHOT_FAILSAFE_MS it sends motor stop
+// With TELEMETRY (bidirectional DShot) the line idles high and the ESC answers every frame with
+// its eRPM. A second RMT channel listens on the same pin (open drain, pulled up) and buffers the
+// replies; they are decoded when the next frame goes out, our own frame is rejected by the
+// decoder. speed() turns the latest period into mm/s through dshotDrivetrain.
+
+#define DSHOT_RMT_TX_CHANNEL        RMT_CHANNEL_0
+#define DSHOT_RMT_RX_CHANNEL        RMT_CHANNEL_4
+#define DSHOT_DEADBAND_US           10      // around neutral: motor stop
+#define DSHOT_ARM_MS                300     // motor stop frames after begin(), the ESC arms on them
+#define DSHOT_FAILSAFE_MS           100
+#define DSHOT_REPLY_MAX_AGE_MS      100     // older eRPM: no measured speed
+#define DSHOT_RX_BUFFER             512     // bytes of RMT items
+
+// 540 size sensorless motor (one pole pair), 8:1 final drive, 65 mm wheels
+const DSHOTDRIVETRAIN dshotDrivetrain = {1, 8 * 256, 204};
+
+struct DSHOTOUTSTATS {
+    uint32_t frames;          // frames sent
+    uint32_t replies;         // valid eRPM replies
+};
+
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US>
+struct DshotOutput {
+    static_assert(SPEED == 150 || SPEED == 300 || SPEED == 600, "DShot speed must be 150, 300 or 600");
+
+    static Servo steering;
+    static DSHOTSYMBOLS symbols;
+    static uint32_t items[DSHOT_ITEMS];
+    static volatile uint16_t value;           // write() -> frame timer
+    static volatile uint32_t writtenMs;
+    static volatile uint32_t armedMs;         // motor stop until then
+    static volatile int8_t direction;         // sign of the last non-zero value
+    static volatile uint32_t periodUs;        // latest eRPM reply
+    static volatile uint32_t replyMs;         // 0 = none yet
+    static RingbufHandle_t replies;
+    static esp_timer_handle_t timer;
+    static DSHOTOUTSTATS stats;
+    static const uint32_t staticBytes = sizeof(Servo) + sizeof(DSHOTSYMBOLS) + sizeof(items) + sizeof(uint16_t) +
+                                        4 * sizeof(uint32_t) + sizeof(int8_t) + sizeof(RingbufHandle_t) +
+                                        sizeof(esp_timer_handle_t) + sizeof(DSHOTOUTSTATS);
+
+    static void begin() {
+        steering.attach(STEERING_PIN);
+        steering.write(centerSteeringAngle);
+        Serial.println("Steering Setup Done!");
+
+        dshotSymbols(symbols, SPEED, TELEMETRY);
+
+        rmt_config_t tx = RMT_DEFAULT_CONFIG_TX((gpio_num_t)MOTOR_PIN, DSHOT_RMT_TX_CHANNEL);
+        tx.clk_div = 1;                                   // 12.5 ns ticks
+        tx.tx_config.idle_output_en = true;
+        tx.tx_config.idle_level = TELEMETRY ? RMT_IDLE_LEVEL_HIGH : RMT_IDLE_LEVEL_LOW;
+        rmt_config(&tx);
+        rmt_driver_install(DSHOT_RMT_TX_CHANNEL, 0, 0);
+
+        if (TELEMETRY) {
+            rmt_config_t rx = RMT_DEFAULT_CONFIG_RX((gpio_num_t)MOTOR_PIN, DSHOT_RMT_RX_CHANNEL);
+            rx.clk_div = 1;
+            rx.rx_config.filter_en = true;
+            rx.rx_config.filter_ticks_thresh = 20;        // 250 ns glitches
+            rx.rx_config.idle_threshold = symbols.replyTicks * 6;   // longer than any run of a reply
+            rmt_config(&rx);
+            rmt_driver_install(DSHOT_RMT_RX_CHANNEL, DSHOT_RX_BUFFER, 0);
+            rmt_get_ringbuf_handle(DSHOT_RMT_RX_CHANNEL, &replies);
+
+            // the RX setup made the pin an input: route the TX channel back and let the ESC pull
+            rmt_set_gpio(DSHOT_RMT_TX_CHANNEL, RMT_MODE_TX, (gpio_num_t)MOTOR_PIN, false);
+            gpio_set_direction((gpio_num_t)MOTOR_PIN, GPIO_MODE_INPUT_OUTPUT_OD);
+            gpio_pullup_en((gpio_num_t)MOTOR_PIN);
+            rmt_rx_start(DSHOT_RMT_RX_CHANNEL, true);
+        }
+
+        // motor stop until the ESC has armed
+        armedMs = millis() + DSHOT_ARM_MS;
+        writtenMs = millis();
+        send(0);
+
+        if (PERIOD_US > 0) {
+            esp_timer_create_args_t args = {};
+            args.callback = onTimer;
+            args.name = "dshot";
+            esp_timer_create(&args, &timer);
+            esp_timer_start_periodic(timer, PERIOD_US);
+        }
+        Serial.println("DShot Motor Setup Done!");
+    }
+
+    static void write(int16_t throttle, uint8_t steeringAngle) {
+        steering.write(steeringAngle);
+
+        uint16_t next = dshotThrottle(throttle, DSHOT_DEADBAND_US);
+        if (next != 0) direction = next >= DSHOT_3D_FORWARD ? 1 : -1;
+        value = next;
+        writtenMs = millis();
+        if (PERIOD_US == 0) send(arming() ? 0 : next);
+    }
+
+    // motor stop in the next frame: the frame timer's, or with PERIOD_US 0 the next write()'s
+    static void stop() {
+        value = 0;
+    }
+
+    // esp_timer task, every PERIOD_US
+    static void onTimer(void*) {
+        send(arming() || millis() - writtenMs > DSHOT_FAILSAFE_MS ? 0 : value);
+    }
+
+    static bool arming() {
+        return (int32_t)(millis() - armedMs) < 0;
+    }
+
+    static void send(uint16_t next) {
+        if (TELEMETRY) collect();
+        dshotEncode(symbols, dshotPacket(next, false, TELEMETRY), items);
+        rmt_write_items(DSHOT_RMT_TX_CHANNEL, (const rmt_item32_t*)items, DSHOT_ITEMS, false);
+        stats.frames++;
+    }
+
+    // replies buffered since the last frame
+    static void collect() {
+        size_t size;
+        uint32_t* captured;
+        while ((captured = (uint32_t*)xRingbufferReceive(replies, &size, 0)) != NULL) {
+            uint32_t period;
+            if (dshotTelemetryDecode(captured, size / sizeof(uint32_t), symbols.replyTicks, period)) {
+                periodUs = period;
+                replyMs = millis();
+                stats.replies++;
+            }
+            vRingbufferReturnItem(replies, captured);
+        }
+    }
+
+    // measured speed in mm/s, false without a recent reply
+    static bool speed(int32_t& mmPerS) {
+        uint32_t at = replyMs;
+        if (!TELEMETRY || at == 0 || millis() - at > DSHOT_REPLY_MAX_AGE_MS) return false;
+        mmPerS = dshotSpeed(periodUs, dshotDrivetrain, direction);
+        return true;
+    }
+};
+
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> Servo DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::steering;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> DSHOTSYMBOLS DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::symbols;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> uint32_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::items[DSHOT_ITEMS];
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> volatile uint16_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::value = 0;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> volatile uint32_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::writtenMs = 0;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> volatile uint32_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::armedMs = 0;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> volatile int8_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::direction = 1;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> volatile uint32_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::periodUs = 0;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> volatile uint32_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::replyMs = 0;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> RingbufHandle_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::replies = NULL;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> esp_timer_handle_t DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::timer = NULL;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN, uint16_t SPEED, bool TELEMETRY, uint16_t PERIOD_US> DSHOTOUTSTATS DshotOutput<STEERING_PIN, MOTOR_PIN, SPEED, TELEMETRY, PERIOD_US>::stats;
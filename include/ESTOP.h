@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+
+// Emergency stop over CAN (VCU_ESTOP). A frame on ESTOP_CAN_ID, the highest priority ID on the
+// bus, is taken in the CAN receive interrupt before anything else (CANRX.h): the motor goes to
+// neutral right there and the stop is latched, commands keep steering but the throttle stays at
+// neutral until the VCU is re-armed. No hardware access, the host checks the sequences and the
+// latency against the polled path (vcu_host sim-estop).
+//
+// Frames on ESTOP_CAN_ID, standard 11 bit, node = own CAN ID big endian, 0 = every VCU:
+//   stop      [ESTOP_CMD_STOP] [node x2]            shorter than 3 bytes it stops every VCU
+//   re-arm    [ESTOP_CMD_REARM] [node x2] [sequence]
+// Re-arm sequence:
+//   1. stop frame: STOPPED, the sequence counts up (repeats of the stop while stopped do not)
+//   2. re-arm frame carrying the current sequence, read from the diagnostics record: ARMING; a
+//      re-arm with another sequence (an older stop, a replayed log) is rejected and counted
+//   3. the commanded throttle within neutralUs of neutral for rearmMs without a break: RUN
+// A stop frame in ARMING latches STOPPED again. Until RUN every write puts the motor at neutral.
+//
+// Stop latency: from the receive interrupt's time stamp to the motor output written to neutral,
+// the output's own frame period follows (servo PWM, SBUS or DShot frames).
+//
+// Diagnostics record (once a second with the others):
+//   e-stop: [0xF0] [state, 0 run 1 stopped 2 arming] [sequence] [last stop latency us x2]
+//           [longest stop latency us x2, window] [rejected re-arms, saturating], window cleared once sent
+
+#define ESTOP_CAN_ID            0x000       // outranks TT_REFERENCE_ID and everything else
+#define ESTOP_CMD_STOP          0x5A
+#define ESTOP_CMD_REARM         0xA5
+#define ESTOP_ALL               0
+
+#define ESTOP_RUN               0
+#define ESTOP_STOPPED           1
+#define ESTOP_ARMING            2
+
+// what a frame on ESTOP_CAN_ID did
+#define ESTOP_IGNORED           0           // another node, unknown command, too short
+#define ESTOP_LATCHED           1           // motor to neutral
+#define ESTOP_REPEATED          2           // already stopped
+#define ESTOP_REARMING          3
+#define ESTOP_REJECTED          4           // re-arm with a stale sequence or while running
+
+struct ESTOPCONFIG {
+    uint16_t node;                          // own CAN ID
+    uint16_t rearmMs;                       // throttle held at neutral before RUN
+    uint16_t neutralUs;                     // around 1500 us that count as neutral
+};
+
+struct ESTOPSTATE {
+    uint8_t state;
+    uint8_t sequence;                       // stops latched, the key of the re-arm frame
+    int64_t neutralSince;                   // ARMING: first write at neutral, 0 = not at neutral
+    uint32_t stops;                         // since boot
+
+    // window
+    uint32_t latencyLast;                   // us
+    uint32_t latencyMax;
+    uint32_t rejected;
+};
+
+
+//==================================================================================//
+
+inline void estopReset(ESTOPSTATE& state) {
+    state = ESTOPSTATE();
+}
+
+inline bool estopForNode(const ESTOPCONFIG& config, const uint8_t* data, uint8_t dlc) {
+    if (dlc < 3) return data[0] == ESTOP_CMD_STOP;
+    uint16_t node = (data[1] << 8) | data[2];
+    return node == ESTOP_ALL || node == config.node;
+}
+
+// CAN receive interrupt: a data frame on ESTOP_CAN_ID, returns ESTOP_IGNORED ... ESTOP_REJECTED;
+// on ESTOP_LATCHED the caller puts the motor at neutral at once
+inline uint8_t estopFrame(ESTOPSTATE& state, const ESTOPCONFIG& config, const uint8_t* data, uint8_t dlc) {
+    if (dlc == 0 || !estopForNode(config, data, dlc)) return ESTOP_IGNORED;
+
+    if (data[0] == ESTOP_CMD_STOP) {
+        if (state.state == ESTOP_STOPPED) return ESTOP_REPEATED;
+        state.state = ESTOP_STOPPED;
+        state.sequence++;
+        state.stops++;
+        return ESTOP_LATCHED;
+    }
+
+    if (data[0] == ESTOP_CMD_REARM && dlc >= 4) {
+        if (state.state != ESTOP_STOPPED || data[3] != state.sequence) {
+            state.rejected++;
+            return ESTOP_REJECTED;
+        }
+        state.state = ESTOP_ARMING;
+        state.neutralSince = 0;
+        return ESTOP_REARMING;
+    }
+    return ESTOP_IGNORED;
+}
+
+// CAN receive interrupt, after the motor was written: receive time stamp to now
+inline void estopLatency(ESTOPSTATE& state, uint32_t us) {
+    state.latencyLast = us;
+    if (us > state.latencyMax) state.latencyMax = us;
+}
+
+// control task, every write: true while the throttle may pass, otherwise the motor stays at
+// neutral; completes ARMING once 'throttle' was held at neutral for rearmMs
+inline bool estopGate(ESTOPSTATE& state, const ESTOPCONFIG& config, int16_t throttle, int64_t now) {
+    if (state.state == ESTOP_RUN) return true;
+    if (state.state == ESTOP_STOPPED) return false;
+
+    int16_t offset = throttle - 1500;
+    if (offset > (int16_t)config.neutralUs || offset < -(int16_t)config.neutralUs) {
+        state.neutralSince = 0;
+        return false;
+    }
+    if (state.neutralSince == 0) state.neutralSince = now;
+    if (now - state.neutralSince < (int64_t)config.rearmMs * 1000) return false;
+
+    state.state = ESTOP_RUN;
+    return true;
+}
+
+
+//==================================================================================//
+
+inline uint8_t estopSaturate(uint32_t value) {
+    return value < 255 ? value : 255;
+}
+
+inline void estopRecord(uint8_t record[8], uint8_t type, ESTOPSTATE& state) {
+    uint16_t last = state.latencyLast < 0xFFFF ? state.latencyLast : 0xFFFF;
+    uint16_t longest = state.latencyMax < 0xFFFF ? state.latencyMax : 0xFFFF;
+
+    record[0] = type;
+    record[1] = state.state;
+    record[2] = state.sequence;
+    record[3] = last >> 8;
+    record[4] = last & 0xFF;
+    record[5] = longest >> 8;
+    record[6] = longest & 0xFF;
+    record[7] = estopSaturate(state.rejected);
+
+    state.latencyMax = 0;
+    state.rejected = 0;
+}
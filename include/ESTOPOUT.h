@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESTOP.h>
+#include <WAKEUP.h>
+
+// Emergency stop fast path (VCU_ESTOP), sequences and record layout in ESTOP.h. The CAN receive
+// interrupt hands every frame on ESTOP_CAN_ID to EstopOutput::receive() before it touches the
+// receive ring, so a full ring or a busy CANBUS task does not hold it up: the motor is written
+// to neutral through Output::stop() inside the interrupt, then the control task is woken. The
+// polled path it replaces took the CANBUS task's 5 ms poll, the handoff and the VCU task's 12 ms
+// loop, and nothing at all while a drive mode sat in a vTaskDelay.
+//
+// Each output's stop() is interrupt safe and takes effect with the output's next frame: the
+// servo PWM's next period (20 ms at 50 Hz), the next SBUS frame (7 / 14 ms), the next DShot frame
+// (VCU_DSHOT_PERIOD_US, or the control task's next write when that is 0). Stop frames should be
+// repeated by the sender: the frame that wakes a parked VCU (VCU_POWER_SAVE) is lost.
+
+#define ESTOP_REARM_MS          500
+#define ESTOP_NEUTRAL_US        25
+
+const ESTOPCONFIG estopConfig = {VCU_CANBUS_ID, ESTOP_REARM_MS, ESTOP_NEUTRAL_US};
+
+static ESTOPSTATE _estop;
+static portMUX_TYPE _estop_mux = portMUX_INITIALIZER_UNLOCKED;    // CAN interrupt <-> control task
+
+static const uint32_t estopStaticBytes = sizeof(_estop) + sizeof(_estop_mux);
+
+
+//==================================================================================//
+
+// latched or re-arming: the motor stays at neutral
+inline bool estopHolding() {
+  portENTER_CRITICAL(&_estop_mux);
+  bool holding = _estop.state != ESTOP_RUN;
+  portEXIT_CRITICAL(&_estop_mux);
+  return holding;
+}
+
+// CANBUS task, with the diagnostics
+void estopDiagRecord(uint8_t record[8], uint8_t type) {
+  portENTER_CRITICAL(&_estop_mux);
+  estopRecord(record, type, _estop);
+  portEXIT_CRITICAL(&_estop_mux);
+}
+
+// output policy decorator, outermost: throttle held at neutral from the stop frame until re-armed
+template<class OUT>
+struct EstopOutput {
+    static const uint32_t staticBytes = OUT::staticBytes;
+
+    static void begin() {
+        OUT::begin();
+    }
+
+    static void write(int16_t throttle, uint8_t steeringAngle) {
+        portENTER_CRITICAL(&_estop_mux);
+        bool pass = estopGate(_estop, estopConfig, throttle, esp_timer_get_time());
+        portEXIT_CRITICAL(&_estop_mux);
+        if (!pass) throttle = 1500;
+        OUT::write(throttle, steeringAngle);
+
+        // a stop frame taken while this write was under way: its neutral got overwritten
+        if (pass && throttle != 1500 && estopHolding()) OUT::stop();
+    }
+
+    static void stop() {
+        OUT::stop();
+    }
+
+    static bool speed(int32_t& mmPerS) {
+        return OUT::speed(mmPerS);
+    }
+
+    // CAN receive interrupt: a data frame on ESTOP_CAN_ID received at local time 'at'
+    static void receive(int64_t at, const uint8_t* data, uint8_t dlc) {
+        portENTER_CRITICAL_ISR(&_estop_mux);
+        uint8_t action = estopFrame(_estop, estopConfig, data, dlc);
+        portEXIT_CRITICAL_ISR(&_estop_mux);
+        if (action != ESTOP_LATCHED && action != ESTOP_REPEATED) return;
+
+        OUT::stop();
+        uint32_t latency = esp_timer_get_time() - at;
+        portENTER_CRITICAL_ISR(&_estop_mux);
+        estopLatency(_estop, latency);
+        portEXIT_CRITICAL_ISR(&_estop_mux);
+
+        wakeControlFromISR(WAKE_ESTOP);
+    }
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+// Integer trigonometry for the control loop. Angles are binary angles (uint32_t, 2^32 = 360 deg),
+// sines and tangents are Q14 (16384 = 1.0), steering angles come out in centidegrees.
+
+#define FIXED_ONE_Q14     16384
+#define FIXED_BAM_PER_DEG 11930465UL      // 2^32 / 360
+
+// sin over one quarter wave in 64 steps, Q14
+static const int16_t _fixed_sin_table[65] = {
+    0, 402, 804, 1205, 1606, 2006, 2404, 2801, 3196, 3590, 3981, 4370, 4756, 5139, 5520, 5897,
+    6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765, 9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297,
+    11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395, 13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+    15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986, 16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+    16384
+};
+
+
+//==================================================================================//
+
+// sin of a binary angle, Q14, linear interpolation between table steps (error < 0.0002)
+inline int32_t fixedSin(uint32_t angle) {
+    uint8_t quadrant = angle >> 30;
+    uint32_t inQuadrant = angle & 0x3FFFFFFF;
+    if (quadrant & 1) inQuadrant = 0x40000000 - inQuadrant;
+
+    uint32_t index = inQuadrant >> 24;                  // 64 steps per quadrant
+    uint32_t fraction = (inQuadrant >> 8) & 0xFFFF;     // 16 bit position between steps
+    int32_t value = _fixed_sin_table[index];
+    if (index < 64) {
+        value += (int32_t)(((int64_t)(_fixed_sin_table[index + 1] - value) * fraction) >> 16);
+    }
+    return (quadrant & 2) ? -value : value;
+}
+
+inline int32_t fixedCos(uint32_t angle) {
+    return fixedSin(angle + 0x40000000);
+}
+
+// atan of a Q14 ratio in centidegrees, error below 0.25 deg over the whole range
+inline int32_t fixedAtan(int32_t ratio) {
+    bool negative = ratio < 0;
+    int64_t t = negative ? -(int64_t)ratio : ratio;
+    bool inverted = t > FIXED_ONE_Q14;
+    if (inverted) t = ((int64_t)FIXED_ONE_Q14 * FIXED_ONE_Q14) / t;
+
+    // atan(t) ~ t * (45 deg + 15.64 deg * (1 - t)) for 0 <= t <= 1
+    int32_t result = (int32_t)((t * (4500LL * FIXED_ONE_Q14 + 1564LL * (FIXED_ONE_Q14 - t))) >> 28);
+    if (inverted) result = 9000 - result;
+    return negative ? -result : result;
+}
@@ -10,11 +10,9 @@ For any questions or inquiries, please contact https://github.com/VICLER */
 
 #include <Arduino.h>
 #include "SBUS.h"
-
-enum rx_mode_enum{
-  PPM_MODE = 0,
-  SBUS_MODE
-};
+#include <RCFILTER.h>
+#include <RCLINK.h>
+#include <RXDIVERSITY.h>
 
 #define RX_THROTTLE_CH  0
 #define RX_STEERING_CH  1
@@ -23,17 +21,17 @@ enum rx_mode_enum{
 struct PPMData {
   bool available = 0;
   bool failsafe = 0;
+  uint32_t frames = 0;    // complete frames seen (counted at sync)
+  int64_t syncAt = 0;     // local us of the last sync, the end of the frame
   uint16_t channels[RX_MAX_CHANNELS] = {1500,1500,1500,1500,1500,1500,1500,1500};
 };
 
-volatile static PPMData _ppm_data;  // ppm data buffer used in interrupt.
-
 struct SBUSData{
   float channelsCal[RX_MAX_CHANNELS] = {1, 1, 1, 1, 1, 1, 1, 1};
   uint16_t channels[RX_MAX_CHANNELS] = {1500,1500,1500,1500,1500,1500,1500,1500};
-  bool failSafe;
-  bool lostFrame;
-  bool available;
+  bool failSafe = 0;
+  bool lostFrame = 0;
+  bool available = 0;
 };
 
 enum drive_mode_enum{
@@ -44,123 +42,356 @@ enum drive_mode_enum{
 };
 
 
-static void PPM_ISR(); // isr for ppm receiver signal
-SBUS sbusReceiver = SBUS(Serial1);  // hardware serial 1 for sbus receiver
-const int receiverPin = 4;  // radio receiver pin
-const uint8_t rxMode = PPM_MODE;  // default rx mode
-
 struct FRYSKY{
   uint8_t steeringAngle;
   uint16_t throttle;
+  int64_t at;             // local us when the frame behind the values was complete, 0 = failsafe values
 };
 
+#define RX_TIMEOUT_MS   100   // no new frame for this long -> neutral
 
+// Per channel input filters, applied once per received frame (delays in RCFILTER.h)
+const RCFILTERCONFIG rxThrottleFilter = {true, RC_FILTER_NONE, 0, 0, 0};                  // spike rejection only: 1 frame
+const RCFILTERCONFIG rxSteeringFilter = {true, RC_FILTER_ALPHA_BETA, 32768, 6554, 256};  // median + alpha-beta, 1 frame lead
 
-//==================================================================================//
+static RCFILTERSTATE _rx_throttle_filter;
+static RCFILTERSTATE _rx_steering_filter;
 
-void setupFRYSKY () {
-    Serial.println("Initializing FrySky Pro Module");
-    Serial.println("Selecting Mode...");
+// Link quality (RCLINK.h): from 25 % lost frames in the last 32 the throttle offset is
+// halved until the loss is back at 10 %
+const RCLINKCONFIG rxLinkConfig = {25, 10, 128};
 
-    if(rxMode == PPM_MODE){
-        attachInterrupt(receiverPin, PPM_ISR, RISING);   // isr for measuring ppm signal from radio receiver
-        Serial.println("PPM Receiver ready");
+static RCLINKSTATS _rx_link;
 
-    } else if (rxMode == SBUS_MODE){
-        sbusReceiver.begin(receiverPin, 5, true);
-        Serial.println("SBUS Receiver ready");
-    }
-}
+// Receiver diversity (RXDIVERSITY.h): the other receiver fills in from 125 % of the active one's
+// period without a frame, and takes over when the active one is down or 20 points worse in lost %
+const RXDIVCONFIG rxDiversityConfig = {125, 20, RX_TIMEOUT_MS};
 
-// isr for reading ppm rx signal
-void IRAM_ATTR PPM_ISR(){
-    static portMUX_TYPE _isr_mux = portMUX_INITIALIZER_UNLOCKED;
-    static uint8_t ch_index = 0;
-    static int64_t last_us;
-
-    portENTER_CRITICAL_ISR(&_isr_mux);
-    int64_t curr_us = esp_timer_get_time();
-    int64_t ch_width = curr_us - last_us;
-    last_us = curr_us;
-    portEXIT_CRITICAL_ISR(&_isr_mux);
-
-    if(ch_width > 3000 and ch_width < 12000) // sync
-    {
-        ch_index = 0;
-        _ppm_data.available = false;
-        if(_ppm_data.failsafe) _ppm_data.failsafe = false;
-        return;
-    }
-    else if(ch_width > 12000)   // pulse width to long -> receiver not connected
-    {   
-        _ppm_data.failsafe = true;
-        _ppm_data.available = false; 
-        return;
-    }
-
-    if(ch_index < RX_MAX_CHANNELS)
-        _ppm_data.channels[ch_index++] = constrain(ch_width, 1000, 2000);
-    _ppm_data.available = true;
-}
 
-bool getPPMData(PPMData& data){
-    for(byte i = 0; i < RX_MAX_CHANNELS; i++)
-        data.channels[i] = _ppm_data.channels[i];
-    return _ppm_data.available;
-}
 
-bool getSbusData(SBUSData& data){
-    if(sbusReceiver.readCal(data.channelsCal, &data.failSafe, &data.lostFrame)){
-        for(byte i = 0; i < RX_MAX_CHANNELS; i++){
-            data.channels[i] = data.channelsCal[i] * 1000 / 2 + 1500;    // convert channel values to 1000 - 2000
-            data.channels[i] = constrain(data.channels[i], 1000, 2000);
+//==================================================================================//
+
+// Receiver policies, selected per build environment in VCUCONFIG.h. Only the selected one
+// is instantiated, so an unused receiver adds neither its ISR, its buffers nor the SBUS object.
+//   begin()                           attach the receiver on PIN
+//   read(throttle, steering, failsafe, lost) latest channel values, true when a new frame arrived;
+//                                     'lost' when the receiver flags the frame as lost
+//   frameAt()                         local us when the latest frame was complete
+//   linkAt(at)                        time of that frame for the link statistics (diversity: RXDIVERSITY.h)
+//   notify(task)                      give 'task' a notification per complete frame (VCU_EVENT_DRIVEN)
+//   sleep(on)                         hand the pin to the wake-up interrupt and back (VCU_POWER_SAVE)
+
+// PPM sum signal, pulse widths measured in a pin interrupt
+template<uint8_t PIN>
+struct PpmReceiver {
+    static volatile PPMData data;    // ppm data buffer used in interrupt.
+    static uint32_t lastFrames;
+    static TaskHandle_t task;
+    static const uint32_t staticBytes = sizeof(PPMData) + sizeof(uint32_t) + sizeof(TaskHandle_t);
+
+    static void begin() {
+        attachInterrupt(PIN, isr, RISING);   // isr for measuring ppm signal from radio receiver
+        Serial.println("PPM Receiver ready");
+    }
+
+    // isr for reading ppm rx signal
+    static void IRAM_ATTR isr() {
+        static portMUX_TYPE _isr_mux = portMUX_INITIALIZER_UNLOCKED;
+        static uint8_t ch_index = 0;
+        static int64_t last_us;
+
+        portENTER_CRITICAL_ISR(&_isr_mux);
+        int64_t curr_us = esp_timer_get_time();
+        int64_t ch_width = curr_us - last_us;
+        last_us = curr_us;
+        portEXIT_CRITICAL_ISR(&_isr_mux);
+
+        if(ch_width > 3000 and ch_width < 12000) // sync
+        {
+            ch_index = 0;
+            data.syncAt = curr_us;
+            data.frames++;
+            data.available = false;
+            if(data.failsafe) data.failsafe = false;
+
+            if(task != NULL){
+                BaseType_t woken = pdFALSE;
+                vTaskNotifyGiveFromISR(task, &woken);
+                portYIELD_FROM_ISR(woken);
+            }
+            return;
+        }
+        else if(ch_width > 12000)   // pulse width to long -> receiver not connected
+        {
+            data.failsafe = true;
+            data.available = false;
+            return;
         }
-        return 1;
+
+        if(ch_index < RX_MAX_CHANNELS)
+            data.channels[ch_index++] = constrain(ch_width, 1000, 2000);
+        data.available = true;
     }
-    return 0;
-}
 
-FRYSKY getData() {
-    FRYSKY frysky;
-    
-    uint16_t throttle_us = 1500;
-    uint16_t steering_us = 1500;
-    bool data_available = false;  // Initialize to false
-    bool failsafe = false;        // Initialize to false
-    
-    if(rxMode == PPM_MODE){
+    static bool get(PPMData& copy) {
+        for(byte i = 0; i < RX_MAX_CHANNELS; i++)
+            copy.channels[i] = data.channels[i];
+        copy.failsafe = data.failsafe;
+        copy.frames = data.frames;
+        return data.available;
+    }
+
+    // PPM has no lost frame flag, RCLINK.h finds them in the gaps between syncs
+    static bool read(uint16_t& throttle, uint16_t& steering, bool& failsafe, bool& lost) {
         PPMData ppm_data;
-        data_available = getPPMData(ppm_data);  // Get PPM data
+        get(ppm_data);
         failsafe = ppm_data.failsafe;
+        lost = false;
+        throttle = ppm_data.channels[RX_THROTTLE_CH];
+        steering = ppm_data.channels[RX_STEERING_CH];
+
+        // the frame counter moves at every sync, the channels then hold the previous full frame
+        bool fresh = ppm_data.frames != lastFrames;
+        lastFrames = ppm_data.frames;
+        return fresh;
+    }
 
-        throttle_us = ppm_data.channels[RX_THROTTLE_CH];
-        steering_us = ppm_data.channels[RX_STEERING_CH];
+    // the interrupt runs on this core: read again if a sync came in between
+    static int64_t frameAt() {
+        uint32_t frames;
+        int64_t at;
+        do {
+            frames = data.frames;
+            at = data.syncAt;
+        } while(frames != data.frames);
+        return at;
+    }
+
+    static int64_t linkAt(int64_t at) {
+        return at;
+    }
+
+    static void notify(TaskHandle_t handle) {
+        task = handle;
+    }
+
+    // the first width after re-attaching is the whole pause, it reads as failsafe until the next sync
+    static void sleep(bool on) {
+        if(on) detachInterrupt(PIN);
+        else attachInterrupt(PIN, isr, RISING);
+    }
+};
+
+template<uint8_t PIN> volatile PPMData PpmReceiver<PIN>::data;
+template<uint8_t PIN> uint32_t PpmReceiver<PIN>::lastFrames = 0;
+template<uint8_t PIN> TaskHandle_t PpmReceiver<PIN>::task = NULL;
+
+// SBUS on hardware serial UART (1, or 2 for a second receiver), RX on PIN. Each instance has its
+// own UART, parser and idle time, two of them never wait on each other.
+template<uint8_t PIN, uint8_t UART = 1>
+struct SbusReceiver {
+    static SBUS bus;
+    static volatile int64_t lastIdle;
+    static TaskHandle_t task;
+    static const uint32_t staticBytes = sizeof(SBUS) + sizeof(int64_t) + sizeof(TaskHandle_t);
+
+    static HardwareSerial& port() {
+        return UART == 2 ? Serial2 : Serial1;
+    }
+
+    static void begin() {
+        bus.begin(PIN, UART == 2 ? -1 : 5, true);     // RX only on the second UART
+        port().onReceive(onIdle, true);     // line idle after a frame, ~0.25 ms past its last byte
+        Serial.println("SBUS Receiver ready");
+    }
+
+    // UART event task: a frame is complete
+    static void onIdle() {
+        lastIdle = esp_timer_get_time();
+        if(task != NULL) xTaskNotifyGive(task);
+    }
 
-        frysky.throttle = throttle_us;
-        frysky.steeringAngle = map(steering_us, 1000, 2000, 0, 180);
+    static bool get(SBUSData& data) {
+        if(bus.readCal(data.channelsCal, &data.failSafe, &data.lostFrame)){
+            for(byte i = 0; i < RX_MAX_CHANNELS; i++){
+                data.channels[i] = data.channelsCal[i] * 1000 / 2 + 1500;    // convert channel values to 1000 - 2000
+                data.channels[i] = constrain(data.channels[i], 1000, 2000);
+            }
+            return 1;
+        }
+        return 0;
+    }
 
-    } else if(rxMode == SBUS_MODE){
+    static bool read(uint16_t& throttle, uint16_t& steering, bool& failsafe, bool& lost) {
         SBUSData sbus_data;
-        data_available = getSbusData(sbus_data);  // Get SBUS data
+        bool fresh = get(sbus_data);
         failsafe = sbus_data.failSafe;
+        lost = sbus_data.lostFrame;     // the receiver repeated its last frame
+        throttle = sbus_data.channels[RX_THROTTLE_CH];
+        steering = sbus_data.channels[RX_STEERING_CH];
+        return fresh;
+    }
+
+    // written from the UART event task, read again if it changed in between
+    static int64_t frameAt() {
+        int64_t at;
+        do {
+            at = lastIdle;
+        } while(at != lastIdle);
+        return at;
+    }
+
+    static int64_t linkAt(int64_t at) {
+        return at;
+    }
+
+    static void notify(TaskHandle_t handle) {
+        task = handle;
+    }
+
+    // the UART keeps its pin, the wake-up interrupt only adds a GPIO interrupt to it
+    static void sleep(bool) {}
+};
 
-        throttle_us = sbus_data.channels[RX_THROTTLE_CH];
-        steering_us = sbus_data.channels[RX_STEERING_CH];
+template<uint8_t PIN, uint8_t UART> SBUS SbusReceiver<PIN, UART>::bus(UART == 2 ? Serial2 : Serial1);
+template<uint8_t PIN, uint8_t UART> volatile int64_t SbusReceiver<PIN, UART>::lastIdle = 0;
+template<uint8_t PIN, uint8_t UART> TaskHandle_t SbusReceiver<PIN, UART>::task = NULL;
+
+// Two receivers, FIRST and SECOND any of the above, one frame stream (RXDIVERSITY.h). Both are
+// read at every poll; with notify() a one-shot timer wakes the task when the active receiver's
+// next frame is due and the other one holds a newer frame, so a rescue does not wait for the
+// next frame of either.
+template<class FIRST, class SECOND>
+struct DiversityReceiver {
+    static RXDIVSTATE state;
+    static int64_t at;
+    static TaskHandle_t task;
+    static esp_timer_handle_t timer;
+    static const uint32_t staticBytes = FIRST::staticBytes + SECOND::staticBytes + sizeof(RXDIVSTATE) +
+                                        sizeof(int64_t) + sizeof(TaskHandle_t) + sizeof(esp_timer_handle_t);
+
+    static void begin() {
+        rxDivReset(state);
+        FIRST::begin();
+        SECOND::begin();
+        esp_timer_create_args_t args = {};
+        args.callback = onDue;
+        args.name = "rx_diversity";
+        esp_timer_create(&args, &timer);
+        Serial.println("Receiver diversity ready");
+    }
+
+    static void onDue(void*) {
+        if (task != NULL) xTaskNotifyGive(task);
+    }
+
+    template<class RX>
+    static RXDIVFRAME poll() {
+        RXDIVFRAME f = RXDIVFRAME();
+        f.fresh = RX::read(f.throttle, f.steering, f.failsafe, f.lost);
+        if (f.fresh) {
+            f.at = RX::frameAt();
+            if (f.at == 0) f.at = esp_timer_get_time();   // no line idle event seen yet
+        }
+        return f;
+    }
+
+    static bool read(uint16_t& throttle, uint16_t& steering, bool& failsafe, bool& lost) {
+        RXDIVFRAME polled[RXDIV_SOURCES] = {poll<FIRST>(), poll<SECOND>()};
+        int64_t now = esp_timer_get_time();
+        int8_t pick = rxDivUpdate(state, rxDiversityConfig, rxLinkConfig, polled, now);
+        rxDivLinkPeriod(state, _rx_link);
+
+        failsafe = rxDivFailsafe(state);
+        const RXDIVFRAME& f = state.sources[pick >= 0 ? pick : state.active].frame;
+        throttle = f.throttle ? f.throttle : 1500;
+        steering = f.steering ? f.steering : 1500;
+        lost = pick >= 0 && f.lost;
+        if (pick >= 0) at = f.at;
+
+        int64_t check = task != NULL ? rxDivCheckAt(state, rxDiversityConfig) : 0;
+        if (check != 0) {
+            esp_timer_stop(timer);
+            esp_timer_start_once(timer, check > now ? check - now : 1);
+        }
+        return pick >= 0;
+    }
+
+    static int64_t frameAt() {
+        return at;
+    }
 
-        frysky.throttle = throttle_us;
-        frysky.steeringAngle = map(steering_us, 1000, 2000, 0, 180);
+    static int64_t linkAt(int64_t) {
+        return state.linkAt;
     }
 
-    if(data_available){
-        return frysky;  // Return if data is available
-    } else if(failsafe) {
+    static void notify(TaskHandle_t handle) {
+        task = handle;
+        FIRST::notify(handle);
+        SECOND::notify(handle);
+    }
+
+    static void sleep(bool on) {
+        FIRST::sleep(on);
+        SECOND::sleep(on);
+    }
+};
+
+template<class FIRST, class SECOND> RXDIVSTATE DiversityReceiver<FIRST, SECOND>::state;
+template<class FIRST, class SECOND> int64_t DiversityReceiver<FIRST, SECOND>::at = 0;
+template<class FIRST, class SECOND> TaskHandle_t DiversityReceiver<FIRST, SECOND>::task = NULL;
+template<class FIRST, class SECOND> esp_timer_handle_t DiversityReceiver<FIRST, SECOND>::timer = NULL;
+
+
+//==================================================================================//
+
+template<class Receiver>
+void setupFRYSKY () {
+    Serial.println("Initializing FrySky Pro Module");
+    Receiver::begin();
+}
+
+template<class Receiver>
+FRYSKY getData() {
+    static uint32_t last_frame_ms = 0;
+    static uint16_t throttle_us = 1500;
+    static uint16_t steering_us = 1500;
+    static int64_t frame_at = 0;
+
+    FRYSKY frysky;
+    bool failsafe = false;        // Initialize to false
+    bool lost = false;
+    uint16_t raw_throttle = 1500;
+    uint16_t raw_steering = 1500;
+
+    bool fresh = Receiver::read(raw_throttle, raw_steering, failsafe, lost);  // a frame arrived since the last call
+    int64_t now = esp_timer_get_time();
+
+    if(fresh && !failsafe){
+        last_frame_ms = millis();
+        frame_at = Receiver::frameAt();
+        if(frame_at == 0) frame_at = now;   // no line idle event seen yet
+        throttle_us = constrain(rcFilterUpdate(_rx_throttle_filter, rxThrottleFilter, raw_throttle), 1000, 2000);
+        steering_us = constrain(rcFilterUpdate(_rx_steering_filter, rxSteeringFilter, raw_steering), 1000, 2000);
+    }
+
+    // a timeout only counts as failsafe once the link was up
+    bool timeout = last_frame_ms != 0 && millis() - last_frame_ms > RX_TIMEOUT_MS;
+    rcLinkUpdate(_rx_link, rxLinkConfig, fresh, lost, failsafe || timeout, Receiver::linkAt(frame_at), now);
+
+    if(failsafe || last_frame_ms == 0 || timeout){
+        // Set failsafe values, filters restart settled on the next valid frame
+        rcFilterReset(_rx_throttle_filter, 1500);
+        rcFilterReset(_rx_steering_filter, 1500);
         frysky.throttle = 1500;
-        frysky.steeringAngle = 90;  // Set failsafe values
+        frysky.steeringAngle = 90;
+        frysky.at = 0;
         return frysky;
     }
 
-    // Default return in case neither data nor failsafe triggered
-    frysky.throttle = 1500;
-    frysky.steeringAngle = 90;  // Default failsafe values
+    // hold the last filtered frame between frames, limited on a degraded link
+    frysky.throttle = rcLinkThrottle(_rx_link, rxLinkConfig, throttle_us);
+    frysky.steeringAngle = map(steering_us, 1000, 2000, 0, 180);
+    frysky.at = frame_at;
     return frysky;
-}
\ No newline at end of file
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Wait-free single producer / single consumer handoff between tasks (triple buffer).
+// The producer always owns one slot, the consumer another and the third sits in the
+// middle. publish() and update() are a single atomic exchange each, so neither side
+// can ever block the other, no matter which core or priority they run on.
+template <typename T>
+class Handoff {
+  public:
+    Handoff() : _middle(1), _back(0), _front(2) {}
+
+    explicit Handoff(const T& initial) : _middle(1), _back(0), _front(2) {
+        for (uint8_t i = 0; i < 3; i++) _slots[i] = initial;
+    }
+
+    // producer: fill writeSlot() then publish(), or publish a complete value
+    T& writeSlot() { return _slots[_back]; }
+
+    void publish() {
+        uint8_t previous = _middle.exchange(_back | FRESH, std::memory_order_acq_rel);
+        _back = previous & INDEX;
+    }
+
+    void publish(const T& value) {
+        _slots[_back] = value;
+        publish();
+    }
+
+    // consumer: returns true if a newer value was taken over, read() holds the latest value
+    bool update() {
+        if (!(_middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        uint8_t previous = _middle.exchange(_front, std::memory_order_acq_rel);
+        _front = previous & INDEX;
+        return true;
+    }
+
+    const T& read() const { return _slots[_front]; }
+
+  private:
+    static const uint8_t INDEX = 0x03;
+    static const uint8_t FRESH = 0x04;
+
+    T _slots[3];
+    std::atomic<uint8_t> _middle;
+    uint8_t _back;     // producer side only
+    uint8_t _front;    // consumer side only
+};
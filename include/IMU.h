@@ -0,0 +1,267 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <atomic>
+#include <HANDOFF.h>
+#include <YAWRATE.h>
+
+// IMU input for the yaw-rate feedback steering (VCU_YAW_CONTROL=1, controller in YAWRATE.h).
+// An MPU-6050 class IMU on I2C samples its gyro at 1 kHz into its FIFO (z axis only, 2 bytes a
+// sample, the 1 KiB FIFO holds half a second); the IMU task empties it every IMU_BURST_MS in one
+// burst read, with a fixed period from vTaskDelayUntil, and publishes the burst's yaw rate. The
+// task runs on the control core below the control task. An overflowed FIFO is reset and its
+// samples dropped; I2C errors mark the IMU down (no correction) and it is set up again once a
+// second. The control task applies the correction through the output decorator below, on the
+// steering only, in the drive modes of yawConfig.modes.
+//
+// Wiring: SDA GPIO 21, SCL GPIO 22, 400 kHz, address 0x68 (AD0 low). IMU_GYRO_SIGN flips the
+// axis for a board mounted upside down.
+
+#define IMU_SDA_PIN             21
+#define IMU_SCL_PIN             22
+#define IMU_I2C_HZ              400000
+#define IMU_ADDRESS             0x68
+#define IMU_GYRO_SIGN           1           // -1: z axis pointing down
+#define IMU_BURST_MS            10          // 10 samples a burst
+#define IMU_BURST_MAX           64          // samples read per burst, more is an overflow
+#define IMU_RETRY_MS            1000
+#define IMU_RESET_MS            100         // device reset to the first register write
+#define IMU_STACK_SIZE          3072
+#define IMU_STILL_SPEED         50          // mm/s, below this with neutral throttle the car stands
+#define IMU_STALE_MS            50          // no burst for this long: no correction
+
+#define IMU_REG_SMPLRT_DIV      0x19
+#define IMU_REG_CONFIG          0x1A
+#define IMU_REG_GYRO_CONFIG     0x1B
+#define IMU_REG_FIFO_EN         0x23
+#define IMU_REG_INT_STATUS      0x3A
+#define IMU_REG_USER_CTRL       0x6A
+#define IMU_REG_PWR_MGMT_1      0x6B
+#define IMU_REG_FIFO_COUNT_H    0x72
+#define IMU_REG_FIFO_R_W        0x74
+#define IMU_REG_WHO_AM_I        0x75
+
+#define IMU_WHO_AM_I            0x68
+#define IMU_DLPF_98HZ           0x02        // gyro sampled at 1 kHz
+#define IMU_GYRO_500DPS         0x08
+#define IMU_FIFO_ZG             0x10
+#define IMU_USER_FIFO_EN        0x40
+#define IMU_USER_FIFO_RESET     0x04
+#define IMU_INT_FIFO_OFLOW      0x10
+#define IMU_PWR_RESET           0x80
+#define IMU_PWR_CLOCK_PLL_X     0x01
+
+const YAWCONFIG yawConfig = {
+  (1 << 0) | (1 << 3) | (1 << 6),   // CAN steering, radio receiver, curvature; not the path and trajectory modes
+  384,      // gainP Q8: 1.5 times the curvature error
+  1280,     // gainI Q8: 5 per second, the steady-state error gone within about half a second
+  500,      // max correction: 5 deg wheel angle
+  800,      // min speed mm/s
+  6000,     // max lateral acceleration mm/s^2
+  140       // reference response ms: servo and tire lag
+};
+
+struct YAWSAMPLE {
+  bool valid;                       // IMU up and the bias calibrated
+  int32_t rate;                     // mdeg/s
+  int64_t at;                       // local us of the burst
+};
+
+static YAWESTIMATE _imu_estimate;                   // IMU task
+static int16_t _imu_burst[IMU_BURST_MAX];
+static std::atomic<bool> _imu_up(false);
+static Handoff<YAWSAMPLE> _imu_sample;              // IMU task -> control task
+static std::atomic<bool> _imu_still(true);          // control task -> IMU task
+static std::atomic<int32_t> _imu_bias(0);           // for the diagnostics
+static std::atomic<uint32_t> _imu_overflows(0);
+static std::atomic<uint32_t> _imu_errors(0);
+
+static YAWCONTROL _yaw_control;                     // control task
+static STEERGEOMETRY _yaw_geometry;
+static int32_t _yaw_speed_per_us = 0;               // mm/s per us of throttle without a measured speed
+static bool _yaw_enabled = false;
+static int64_t _yaw_written_at = 0;
+static portMUX_TYPE _yaw_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint32_t imuStaticBytes = sizeof(YAWESTIMATE) + sizeof(_imu_burst) + 2 * sizeof(std::atomic<bool>) +
+                                       sizeof(_imu_sample) + sizeof(std::atomic<int32_t>) + 2 * sizeof(std::atomic<uint32_t>);
+static const uint32_t yawStaticBytes = sizeof(YAWCONTROL) + sizeof(STEERGEOMETRY) + sizeof(int32_t) + sizeof(bool) +
+                                       sizeof(int64_t);
+
+
+//==================================================================================//
+
+static bool imuWrite(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(IMU_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static bool imuRead(uint8_t reg, uint8_t* data, uint8_t length) {
+  Wire.beginTransmission(IMU_ADDRESS);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom((uint8_t)IMU_ADDRESS, length) != length) return false;
+  for (uint8_t i = 0; i < length; i++) data[i] = Wire.read();
+  return true;
+}
+
+static bool imuFifoReset() {
+  return imuWrite(IMU_REG_USER_CTRL, IMU_USER_FIFO_RESET) && imuWrite(IMU_REG_USER_CTRL, IMU_USER_FIFO_EN);
+}
+
+// IMU found and reset, IMU_RESET_MS before imuSetup()
+static bool imuReset() {
+  uint8_t who = 0;
+  if (!imuRead(IMU_REG_WHO_AM_I, &who, 1) || who != IMU_WHO_AM_I) return false;
+  return imuWrite(IMU_REG_PWR_MGMT_1, IMU_PWR_RESET);
+}
+
+// gyro at 1 kHz, +-500 deg/s, z axis into the FIFO
+static bool imuSetup() {
+  return imuWrite(IMU_REG_PWR_MGMT_1, IMU_PWR_CLOCK_PLL_X) &&
+         imuWrite(IMU_REG_CONFIG, IMU_DLPF_98HZ) &&
+         imuWrite(IMU_REG_SMPLRT_DIV, 0) &&
+         imuWrite(IMU_REG_GYRO_CONFIG, IMU_GYRO_500DPS) &&
+         imuWrite(IMU_REG_FIFO_EN, IMU_FIFO_ZG) &&
+         imuFifoReset();
+}
+
+static bool imuConfigure() {
+  if (!imuReset()) return false;
+  vTaskDelay(IMU_RESET_MS / portTICK_PERIOD_MS);
+  return imuSetup();
+}
+
+// setup(), before the heap is sealed (the I2C driver allocates); 'speedPerUs' estimates the
+// speed from the throttle where the output measures none
+bool imuBegin(const STEERGEOMETRY& geometry, int32_t speedPerUs) {
+  _yaw_geometry = geometry;
+  _yaw_speed_per_us = speedPerUs;
+  yawEstimateReset(_imu_estimate);
+  yawControlReset(_yaw_control);
+
+  if (!Wire.begin(IMU_SDA_PIN, IMU_SCL_PIN, IMU_I2C_HZ)) return false;
+  _imu_up = imuConfigure();
+  if (!_imu_up.load()) Serial.println("IMU not found, steering without yaw-rate feedback");
+  return _imu_up.load();
+}
+
+// one burst: every complete sample in the FIFO
+static bool imuBurst(uint16_t& count) {
+  uint8_t status, bytes[2];
+  if (!imuRead(IMU_REG_INT_STATUS, &status, 1) || !imuRead(IMU_REG_FIFO_COUNT_H, bytes, 2)) return false;
+  uint16_t available = (bytes[0] << 8 | bytes[1]) / 2;
+  if ((status & IMU_INT_FIFO_OFLOW) || available > IMU_BURST_MAX) {
+    _imu_overflows.fetch_add(1, std::memory_order_relaxed);
+    count = 0;
+    return imuFifoReset();
+  }
+
+  count = 0;
+  while (count < available) {
+    uint8_t chunk = min(available - count, 16);         // 32 bytes a transfer, inside the Wire buffer
+    uint8_t data[32];
+    if (!imuRead(IMU_REG_FIFO_R_W, data, chunk * 2)) return false;
+    for (uint8_t i = 0; i < chunk; i++) {
+      _imu_burst[count++] = IMU_GYRO_SIGN * (int16_t)(data[2 * i] << 8 | data[2 * i + 1]);
+    }
+  }
+  return true;
+}
+
+// one burst, its yaw rate handed to the control task; an I2C error marks the IMU down
+static void imuPublishBurst() {
+  uint16_t count = 0;
+  if (!imuBurst(count)) {
+    _imu_errors.fetch_add(1, std::memory_order_relaxed);
+    _imu_up = false;
+    _imu_sample.publish(YAWSAMPLE{false, 0, esp_timer_get_time()});
+    return;
+  }
+  if (count == 0) return;
+
+  int32_t rate = yawBurst(_imu_estimate, _imu_burst, count, _imu_still.load(std::memory_order_relaxed));
+  _imu_bias.store(_imu_estimate.bias, std::memory_order_relaxed);
+  _imu_sample.publish(YAWSAMPLE{yawCalibrated(_imu_estimate), rate, esp_timer_get_time()});
+}
+
+// IMU task: fixed period bursts
+void IMUTASK(void * pvParameters) {
+  TickType_t wake = xTaskGetTickCount();
+  TickType_t retryAt = wake;
+  while (1) {
+    vTaskDelayUntil(&wake, IMU_BURST_MS / portTICK_PERIOD_MS);
+
+    if (!_imu_up) {
+      if ((int32_t)(xTaskGetTickCount() - retryAt) < 0) continue;
+      retryAt = xTaskGetTickCount() + IMU_RETRY_MS / portTICK_PERIOD_MS;
+      _imu_up = imuConfigure();
+      if (!_imu_up) continue;
+    }
+    imuPublishBurst();
+  }
+}
+
+
+//==================================================================================//
+
+// control task, top of the loop: correction on in this drive mode
+inline void yawMode(int8_t driveMode) {
+  _yaw_enabled = driveMode >= 0 && driveMode < 8 && (yawConfig.modes & (1 << driveMode));
+}
+
+// output policy decorator: the steering command corrected toward the target yaw rate
+template<class OUT>
+struct YawOutput {
+    static const uint32_t staticBytes = OUT::staticBytes;
+
+    static void begin() {
+        OUT::begin();
+    }
+
+    static void write(int16_t throttle, uint8_t steeringAngle) {
+        int64_t now = esp_timer_get_time();
+        uint32_t dt = _yaw_written_at ? now - _yaw_written_at : 0;
+        _yaw_written_at = now;
+
+        int32_t speed;
+        if (!OUT::speed(speed)) speed = (throttle - 1500) * _yaw_speed_per_us;
+        _imu_still.store(speed < IMU_STILL_SPEED && speed > -IMU_STILL_SPEED && throttle == 1500,
+                         std::memory_order_relaxed);
+
+        _imu_sample.update();
+        const YAWSAMPLE& sample = _imu_sample.read();
+        int32_t servo = ((int32_t)steeringAngle - centerSteeringAngle) * 100;
+        portENTER_CRITICAL(&_yaw_mux);
+        bool fresh = sample.valid && now - sample.at < IMU_STALE_MS * 1000LL;
+        int32_t correction = yawUpdate(_yaw_control, yawConfig, _yaw_geometry, yawWheelAngle(_yaw_geometry, servo),
+                                       speed, sample.rate, _yaw_enabled && fresh, dt);
+        portEXIT_CRITICAL(&_yaw_mux);
+
+        if (correction != 0) {
+            int32_t corrected = centerSteeringAngle + steerCalDegrees(servo + yawServoOffset(_yaw_geometry, correction));
+            steeringAngle = constrain(corrected, centerSteeringAngle - steeringOffset, centerSteeringAngle + steeringOffset);
+        }
+        OUT::write(throttle, steeringAngle);
+    }
+
+    static void stop() {
+        OUT::stop();
+    }
+
+    static bool speed(int32_t& mmPerS) {
+        return OUT::speed(mmPerS);
+    }
+};
+
+// CANBUS task, with the diagnostics
+void yawDiagRecord(uint8_t record[8], uint8_t type) {
+  uint8_t flags = (_imu_up ? YAW_FLAG_IMU : 0) | (_yaw_enabled ? YAW_FLAG_ENABLED : 0);
+  portENTER_CRITICAL(&_yaw_mux);
+  yawRecord(record, type, flags, _yaw_control, _imu_bias.load(std::memory_order_relaxed),
+            _imu_overflows.exchange(0, std::memory_order_relaxed), _imu_errors.exchange(0, std::memory_order_relaxed));
+  portEXIT_CRITICAL(&_yaw_mux);
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+
+// Cooperative jobs (VCU_JOBS): many periodic and event released jobs share one task and one
+// stack. A job is a function run to its next wait point; the protothread macros below keep its
+// place in 'line' between runs, so a job holds no stack while it waits and its locals do not
+// survive a wait (state lives in the job's context). No hardware access and no allocation, the
+// host benchmarks it against one thread per job (vcu_host bench-jobs).
+//
+// Releases: a periodic job is released every periodUs, an event job by jobsSignal() with one of
+// its event bits; a release while the previous one is still open is dropped and counted as a
+// miss. Among the released jobs that are not sleeping the one with the earliest absolute
+// deadline (release + deadlineUs) runs next, one run per jobsRunOne(). A run returns
+//   JOB_DONE       the release is complete (JOB_END, JOB_EXIT): response time and deadline are accounted
+//   JOB_YIELDED    more to do (JOB_YIELD), a job with an earlier deadline goes first
+//   JOB_WAITING    sleeping inside the release (JOB_SLEEP), the deadline keeps running
+// Per job, for the window: completions, run time (sum and longest single run), longest
+// response (release to completion), deadline misses.
+//
+// Diagnostics record (once a second with the others, one per job):
+//   job: [0x08 | job] [completions, saturating] [avg run us x2] [longest run us x2]
+//        [longest response ms, saturating] [deadline misses, saturating], window cleared once sent
+
+#define JOBS_MAX                8
+
+#define JOB_WAITING             0
+#define JOB_YIELDED             1
+#define JOB_DONE                2
+
+// protothread wait points, at most one per source line
+#define JOB_BEGIN(job)          switch ((job).line) { case 0:
+#define JOB_END(job)            } (job).line = 0; return JOB_DONE
+#define JOB_EXIT(job)           do { (job).line = 0; return JOB_DONE; } while (0)
+#define JOB_YIELD(job)          do { (job).line = __LINE__; return JOB_YIELDED; case __LINE__:; } while (0)
+#define JOB_SLEEP(job, now, us) do { (job).wakeAt = (now) + (us); (job).line = __LINE__; return JOB_WAITING; \
+                                     case __LINE__:; } while (0)
+
+struct JOB;
+typedef uint8_t (*JOBFUNC)(JOB& job, int64_t now);
+
+struct JOB {
+    const char* name;
+    JOBFUNC run;
+    void* context;
+    uint32_t periodUs;                      // 0 = released by events only
+    uint32_t deadlineUs;                    // from the release
+    uint32_t events;                        // bits of jobsSignal() that release it
+
+    uint16_t line;                          // wait point, 0 = start of a release
+    bool released;
+    int64_t releaseAt;
+    int64_t nextRelease;                    // periodic
+    int64_t wakeAt;                         // JOB_SLEEP, 0 = not sleeping
+
+    // window
+    uint32_t completions;
+    uint32_t runs;
+    uint32_t runSum;                        // us
+    uint32_t runMax;
+    uint32_t responseMax;
+    uint32_t misses;
+};
+
+struct JOBSCHED {
+    JOB jobs[JOBS_MAX];
+    uint8_t count;
+    int64_t (*clock)();                     // local us, run time accounting
+    uint32_t dispatches;                    // since boot
+};
+
+
+//==================================================================================//
+
+inline void jobsReset(JOBSCHED& sched, int64_t (*clock)()) {
+    sched = JOBSCHED();
+    sched.clock = clock;
+}
+
+// before the first jobsRunOne(); deadline 0 = the period; returns the job index, -1 when full
+inline int8_t jobsAdd(JOBSCHED& sched, const char* name, JOBFUNC run, void* context, uint32_t periodUs,
+                      uint32_t deadlineUs, uint32_t events, int64_t now) {
+    if (sched.count >= JOBS_MAX || run == 0 || (periodUs == 0 && events == 0)) return -1;
+    JOB& job = sched.jobs[sched.count];
+    job = JOB();
+    job.name = name;
+    job.run = run;
+    job.context = context;
+    job.periodUs = periodUs;
+    job.deadlineUs = deadlineUs ? deadlineUs : periodUs;
+    job.events = events;
+    job.nextRelease = now;
+    return sched.count++;
+}
+
+inline void jobsRelease(JOB& job, int64_t at) {
+    if (job.released) {
+        job.misses++;                       // the previous release is still open
+        return;
+    }
+    job.released = true;
+    job.releaseAt = at;
+}
+
+// events from the hosting task (interrupts and other tasks hand their bits to it first)
+inline void jobsSignal(JOBSCHED& sched, uint32_t bits, int64_t now) {
+    for (uint8_t i = 0; i < sched.count; i++) {
+        if (sched.jobs[i].events & bits) jobsRelease(sched.jobs[i], now);
+    }
+}
+
+inline void jobsPeriodic(JOBSCHED& sched, int64_t now) {
+    for (uint8_t i = 0; i < sched.count; i++) {
+        JOB& job = sched.jobs[i];
+        if (job.periodUs == 0 || now < job.nextRelease) continue;
+        // behind by whole periods: those releases are lost, the latest one is made
+        uint32_t behind = (now - job.nextRelease) / job.periodUs;
+        job.misses += behind;
+        jobsRelease(job, job.nextRelease + (int64_t)behind * job.periodUs);
+        job.nextRelease += (int64_t)(behind + 1) * job.periodUs;
+    }
+}
+
+inline bool jobsRunnable(const JOB& job, int64_t now) {
+    return job.released && (job.wakeAt == 0 || now >= job.wakeAt);
+}
+
+// one run of the runnable job with the earliest deadline; returns its index, -1 for none
+inline int8_t jobsRunOne(JOBSCHED& sched, int64_t now) {
+    jobsPeriodic(sched, now);
+    int8_t pick = -1;
+    int64_t earliest = 0;
+    for (uint8_t i = 0; i < sched.count; i++) {
+        const JOB& job = sched.jobs[i];
+        if (!jobsRunnable(job, now)) continue;
+        int64_t deadline = job.releaseAt + job.deadlineUs;
+        if (pick < 0 || deadline < earliest) {
+            pick = i;
+            earliest = deadline;
+        }
+    }
+    if (pick < 0) return -1;
+
+    JOB& job = sched.jobs[pick];
+    job.wakeAt = 0;
+    uint8_t result = job.run(job, now);
+    int64_t end = sched.clock();
+    uint32_t run = end - now;
+    sched.dispatches++;
+    job.runs++;
+    job.runSum += run;
+    if (run > job.runMax) job.runMax = run;
+
+    if (result == JOB_DONE) {
+        job.released = false;
+        job.wakeAt = 0;
+        job.completions++;
+        uint32_t response = end - job.releaseAt;
+        if (response > job.responseMax) job.responseMax = response;
+        if (response > job.deadlineUs) job.misses++;
+    }
+    return pick;
+}
+
+// local us the next job becomes runnable, 'now' if one is, 0 = only events can release one
+inline int64_t jobsNextAt(const JOBSCHED& sched, int64_t now) {
+    int64_t next = 0;
+    for (uint8_t i = 0; i < sched.count; i++) {
+        const JOB& job = sched.jobs[i];
+        int64_t at = 0;
+        if (job.released) at = job.wakeAt ? job.wakeAt : now;
+        else if (job.periodUs) at = job.nextRelease;
+        if (at != 0 && (next == 0 || at < next)) next = at;
+    }
+    return next != 0 && next < now ? now : next;
+}
+
+
+//==================================================================================//
+
+inline uint8_t jobsSaturate(uint32_t value) {
+    return value < 255 ? value : 255;
+}
+
+inline void jobsRecord(uint8_t record[8], uint8_t type, JOB& job) {
+    uint32_t average = job.runs ? job.runSum / job.runs : 0;
+    uint16_t avg = average < 0xFFFF ? average : 0xFFFF;
+    uint16_t longest = job.runMax < 0xFFFF ? job.runMax : 0xFFFF;
+
+    record[0] = type;
+    record[1] = jobsSaturate(job.completions);
+    record[2] = avg >> 8;
+    record[3] = avg & 0xFF;
+    record[4] = longest >> 8;
+    record[5] = longest & 0xFF;
+    record[6] = jobsSaturate(job.responseMax / 1000);
+    record[7] = jobsSaturate(job.misses);
+
+    job.completions = 0;
+    job.runs = 0;
+    job.runSum = 0;
+    job.runMax = 0;
+    job.responseMax = 0;
+    job.misses = 0;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <HANDOFF.h>
+#include <JOBS.h>
+#include <BATTERYADC.h>
+#if VCU_YAW_CONTROL
+#include <IMU.h>
+#endif
+
+// Cooperative job task (VCU_JOBS), scheduler and record layout in JOBS.h. The background
+// subsystems that used a task each run as jobs in the one JOBS task on the control core, below
+// the control task: the battery filter (in place of the BATTERY task) and with VCU_YAW_CONTROL
+// the IMU bursts (in place of the IMU task), plus the report job that closes the accounting
+// window. One stack sized for the deepest job replaces one stack per subsystem; a job must not
+// block, it sleeps or yields through JOBS.h, and the task sleeps in ulTaskNotifyTake() until the
+// next release or an event.
+//
+// Jobs:
+//   battery    every JOB_BATTERY_MS, reads the DMA blocks that are ready without waiting (the
+//              driver's ring holds 4 blocks of 12.8 ms), yielding between blocks
+//   imu        every IMU_BURST_MS, one FIFO burst; while the IMU is down it is set up again
+//              once a second, the device reset sleeps IMU_RESET_MS inside the release (the
+//              bursts released meanwhile count as misses)
+//   report     released by the CANBUS task with each diagnostics window (JOB_EVENT_REPORT): the
+//              window's records handed back, sent with the next one
+// Events from interrupts and other tasks go through jobsSignalFromTask() / jobsSignalFromISR().
+
+#define JOBS_STACK_SIZE         3072        // the deepest job: IMU burst over I2C
+#define JOB_BATTERY_MS          10
+#define JOB_REPORT_DEADLINE_MS  100
+
+#define JOB_EVENT_REPORT        (1 << 0)
+
+static_assert(JOBS_MAX <= 8, "the job index goes in the low 3 bits of DIAG_RECORD_JOB");
+
+struct JOBSREPORT {
+  uint8_t count;
+  uint8_t records[JOBS_MAX][8];
+};
+
+static JOBSCHED _jobs;                              // JOBS task
+static TaskHandle_t _jobs_task = NULL;             // set by setup()
+static std::atomic<uint32_t> _jobs_events(0);       // anyone -> JOBS task
+static Handoff<JOBSREPORT> _jobs_report;            // JOBS task -> CANBUS task
+
+static const uint32_t jobsStaticBytes = sizeof(_jobs) + sizeof(_jobs_task) + sizeof(_jobs_events) + sizeof(_jobs_report);
+
+
+//==================================================================================//
+
+static int64_t jobsClock() {
+  return esp_timer_get_time();
+}
+
+static uint8_t batteryJob(JOB& job, int64_t) {
+  JOB_BEGIN(job);
+  while (batteryRead(0)) JOB_YIELD(job);
+  JOB_END(job);
+}
+
+#if VCU_YAW_CONTROL
+static int64_t _imu_retry_at = 0;                   // IMU job
+
+static uint8_t imuJob(JOB& job, int64_t now) {
+  JOB_BEGIN(job);
+  if (!_imu_up) {
+    if (now < _imu_retry_at) JOB_EXIT(job);
+    _imu_retry_at = now + IMU_RETRY_MS * 1000LL;
+    if (!imuReset()) JOB_EXIT(job);
+    JOB_SLEEP(job, now, IMU_RESET_MS * 1000);
+    _imu_up = imuSetup();
+    JOB_EXIT(job);                                  // first burst with the next release
+  }
+  imuPublishBurst();
+  JOB_END(job);
+}
+#endif
+
+static uint8_t reportJob(JOB&, int64_t) {
+  JOBSREPORT& report = _jobs_report.writeSlot();
+  report.count = _jobs.count;
+  for (uint8_t i = 0; i < _jobs.count; i++) {
+    jobsRecord(report.records[i], i, _jobs.jobs[i]);     // type filled in by jobsDiagRecords()
+  }
+  _jobs_report.publish();
+  return JOB_DONE;
+}
+
+// setup(), before the JOBS task starts; 'battery' false without the ADC driver
+void jobsBegin(bool battery) {
+  int64_t now = esp_timer_get_time();
+  jobsReset(_jobs, jobsClock);
+  jobsAdd(_jobs, "report", reportJob, NULL, 0, JOB_REPORT_DEADLINE_MS * 1000, JOB_EVENT_REPORT, now);
+#if VCU_YAW_CONTROL
+  jobsAdd(_jobs, "imu", imuJob, NULL, IMU_BURST_MS * 1000, 0, 0, now);
+#endif
+  if (battery) jobsAdd(_jobs, "battery", batteryJob, NULL, JOB_BATTERY_MS * 1000, 0, 0, now);
+}
+
+// another task: release the jobs waiting for 'bits'
+void jobsSignalFromTask(uint32_t bits) {
+  _jobs_events.fetch_or(bits, std::memory_order_relaxed);
+  if (_jobs_task) xTaskNotifyGive(_jobs_task);
+}
+
+// interrupt handler: release the jobs waiting for 'bits'
+void IRAM_ATTR jobsSignalFromISR(uint32_t bits) {
+  _jobs_events.fetch_or(bits, std::memory_order_relaxed);
+  if (!_jobs_task) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(_jobs_task, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+// JOBS task: every runnable job, then asleep until the next release or an event
+void JOBS(void * pvParameters) {
+  while (1) {
+    int64_t now = esp_timer_get_time();
+    uint32_t events = _jobs_events.exchange(0, std::memory_order_relaxed);
+    if (events) jobsSignal(_jobs, events, now);
+    while (jobsRunOne(_jobs, now) >= 0) now = esp_timer_get_time();
+
+    int64_t next = jobsNextAt(_jobs, now);
+    TickType_t wait = portMAX_DELAY;
+    if (next) wait = max((TickType_t)((next - now + 999) / 1000 / portTICK_PERIOD_MS), (TickType_t)1);
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+// CANBUS task, with the diagnostics: the records of the window before as 'type' | job, returns
+// how many; the report job then closes this window
+uint8_t jobsDiagRecords(uint8_t records[JOBS_MAX][8], uint8_t type) {
+  uint8_t count = 0;
+  if (_jobs_report.update()) {
+    const JOBSREPORT& report = _jobs_report.read();
+    for (; count < report.count; count++) {
+      memcpy(records[count], report.records[count], 8);
+      records[count][0] = type | count;
+    }
+  }
+  jobsSignalFromTask(JOB_EVENT_REPORT);
+  return count;
+}
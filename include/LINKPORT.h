@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SERIALLINK.h>
+
+// SERIALLINK.h on the USB serial port. The UART driver collects received bytes in its ring
+// buffer; the CANBUS task is notified when data arrives (FIFO threshold or line idle) and
+// takes it out in chunks of up to LINK_CHUNK bytes, which go through the decoder in one pass.
+// Frames are written with a single Serial.write(), so log lines from other tasks never end
+// up inside a frame.
+
+#define LINK_RX_BUFFER        1024        // UART driver ring, ~11 ms at 921600 baud
+#define LINK_CHUNK            256
+#define LINK_STATS_MS         1000
+
+static LINKRX _link_rx;
+static uint8_t _link_chunk[LINK_CHUNK];
+static uint16_t _link_chunk_length = 0;
+static uint16_t _link_chunk_at = 0;
+static uint8_t _link_tx_sequence = 0;
+static TaskHandle_t _link_task = NULL;
+
+static const uint32_t linkStaticBytes = sizeof(_link_rx) + sizeof(_link_chunk) + 3 * sizeof(uint16_t) +
+                                        sizeof(TaskHandle_t);
+
+
+//==================================================================================//
+
+// UART event task: wake the consumer
+void linkOnReceive() {
+  if (_link_task != NULL) xTaskNotifyGive(_link_task);
+}
+
+// instead of Serial.begin(), the receive buffer has to be sized before the driver starts
+void linkBegin(unsigned long baud) {
+  Serial.setRxBufferSize(LINK_RX_BUFFER);
+  Serial.begin(baud);
+  linkRxReset(_link_rx);
+}
+
+// 'task' is notified whenever bytes arrive and reads them with linkReceive()
+void linkAttach(TaskHandle_t task) {
+  _link_task = task;
+  Serial.onReceive(linkOnReceive);
+}
+
+// bytes left in the current chunk or in the driver
+bool linkPending() {
+  return _link_chunk_at < _link_chunk_length || Serial.available() > 0;
+}
+
+// next CAN frame from the link, not received if none is complete yet
+CANRECIEVER linkReceive() {
+  CANRECIEVER msg = CANRECIEVER();
+  while (true) {
+    if (_link_chunk_at >= _link_chunk_length) {
+      int available = Serial.available();
+      if (available <= 0) return msg;
+      _link_chunk_length = Serial.read(_link_chunk, min(available, LINK_CHUNK));
+      _link_chunk_at = 0;
+    }
+
+    bool complete;
+    _link_chunk_at += linkParse(_link_rx, _link_chunk + _link_chunk_at, _link_chunk_length - _link_chunk_at, complete);
+    if (complete && linkToCan(_link_rx, msg)) {
+      msg.at = esp_timer_get_time();
+      return msg;
+    }
+  }
+}
+
+void linkSend(uint32_t id, const uint8_t data[8], uint8_t dlc) {
+  uint8_t out[LINK_MAX_ENCODED];
+  size_t length = linkCanFrame(out, _link_tx_sequence++, id, id > 0x7FF, false, data, dlc);
+  Serial.write(out, length);
+}
+
+void linkSendStats() {
+  uint8_t out[LINK_MAX_ENCODED];
+  size_t length = linkStatsFrame(out, _link_tx_sequence++, _link_rx);
+  Serial.write(out, length);
+}
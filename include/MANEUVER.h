@@ -7,31 +7,71 @@ const uint8_t steeringOffset = 30; // Steering offset to prevent servo damage
 const uint8_t centerSteeringAngle = 90; // Center angle for steering (to account for joystick drift)
 const uint8_t centerSteeringTolerance = 3; // Tolerance for centering the steering (to account for joystick drift)
 
-Servo absimaServo; // Servo object for steering
-Servo absimaMotor; // Servo object for motor control
-
 struct MANEUVER {
     uint8_t steeringAngle;
     int16_t throttle;
 };
 
+static MANEUVER _maneuver_written = {centerSteeringAngle, 1500};   // latest drive() command, control task
+
+
+//==================================================================================/
+
+// Output policies, selected per build environment in VCUCONFIG.h
+//   begin()                         attach the outputs, motor at neutral
+//   write(throttle, steeringAngle)  throttle in us (1000 - 2000), steering angle in servo degrees
+//   speed(mmPerS)                   measured vehicle speed, false if the output has no feedback
+//   stop()                          motor to neutral until the next write(), interrupt safe (VCU_ESTOP)
+
+// steering servo and motor controller on PWM pins - the Absima motor controller allows the motor to be treated as a servo
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN>
+struct ServoOutput {
+    static Servo steering; // Servo object for steering
+    static Servo motor;    // Servo object for motor control
+    static const uint32_t staticBytes = 2 * sizeof(Servo);
+
+    static void begin() {
+        // Steering Servo setup
+        steering.attach(STEERING_PIN);
+        steering.write(centerSteeringAngle); // Centered before anything else runs
+        Serial.println("Steering Setup Done!");
+
+        // Motor setup
+        motor.attach(MOTOR_PIN);
+        motor.writeMicroseconds(1500); // Neutral position for the motor
+        Serial.println("Motor Setup Done!");
+    }
+
+    static void write(int16_t throttle, uint8_t steeringAngle) {
+        steering.write(steeringAngle); // Set servo to steering angle
+        motor.writeMicroseconds(throttle); // Set motor throttle
+    }
+
+    // LEDC duty only, the ESC sees it from the next PWM period
+    static void stop() {
+        motor.writeMicroseconds(1500);
+    }
+
+    static bool speed(int32_t&) {
+        return false;
+    }
+};
+
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN> Servo ServoOutput<STEERING_PIN, MOTOR_PIN>::steering;
+template<uint8_t STEERING_PIN, uint8_t MOTOR_PIN> Servo ServoOutput<STEERING_PIN, MOTOR_PIN>::motor;
+
 
 //==================================================================================/
 
+template<class Output>
 void setupMANEUVER () {
-    // Steering Servo setup
-    absimaServo.attach(steeringPin);
-    Serial.println("Steering Setup Done!");
-
-    // Motor setup - the Absima motor controller allows the motor to be treated as a servo
-    absimaMotor.attach(motorPin);
-    absimaMotor.writeMicroseconds(1500); // Neutral position for the motor
-    Serial.println("Motor Setup Done!");
+    Output::begin();
 }
 
 
 //==================================================================================/
 
+template<class Output>
 MANEUVER drive(int16_t throttle, uint8_t steeringAngle){
     MANEUVER maneuver;
 
@@ -43,8 +83,8 @@ MANEUVER drive(int16_t throttle, uint8_t steeringAngle){
     maneuver.steeringAngle = steeringAngle;
     maneuver.throttle = throttle;
 
-    absimaServo.write(steeringAngle); // Set servo to steering angle
-    absimaMotor.writeMicroseconds(throttle); // Set motor throttle
+    Output::write(throttle, steeringAngle);
+    _maneuver_written = maneuver;
 
     return maneuver;
 }
\ No newline at end of file
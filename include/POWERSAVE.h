@@ -0,0 +1,198 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <hal/gpio_ll.h>
+#include <CANBUS.h>
+#include <POWERSTATE.h>
+#include <WAKEUP.h>
+#include <BATTERYADC.h>
+
+// Power management (VCU_POWER_SAVE=1, levels in POWERSTATE.h). The ESP-IDF power manager scales
+// the CPU clock between POWER_MAX_MHZ and POWER_MIN_MHZ and, where the build has tickless idle,
+// puts the chip into light sleep whenever every task is blocked. PM locks held by the control
+// task keep it from doing so:
+//   POWER_DRIVE    CPU_FREQ_MAX and NO_LIGHT_SLEEP held
+//   POWER_IDLE     NO_LIGHT_SLEEP held, the clock drops to 80 MHz; the APB clock stays at 80 MHz,
+//                  so the CAN bit timing, UARTs, servo PWM and RMT are not affected
+//   POWER_PARKED   no lock: light sleep between the tasks' timeouts (POWER_PARKED_TIMEOUT_MS)
+// In light sleep the CAN controller, UARTs and the PPM interrupt do not run. While parked the
+// idle level of every input pin (CAN RX, the receiver, the serial link RX) is a wake-up source
+// and interrupt: the first edge wakes the chip, the interrupt takes a lock of its own and
+// notifies the control task, which goes back to POWER_IDLE for at least holdMs. The frame
+// behind that edge is lost (a CAN controller waking inside it may flag it, the sender then
+// repeats it); the next one is received and applied, the time from the edge to that is the
+// wake-up latency. The servo pulses stop in light sleep, the outputs are at neutral then.
+// Limitation: the CAN RX pin wakes the chip for any frame, there is no acceptance filter in
+// light sleep. On a shared bus every other node's frame ends the parked phase and holds the VCU
+// awake for holdMs, so with regular foreign traffic it hardly parks (vcu_host sim-power, shared
+// bus row), and the reported wake-up latency then also runs from foreign edges to the next own
+// input. Parking pays only on a bus that goes quiet with the master.
+// The ADC driver of the battery voltage is stopped while parked, it holds a lock as well.
+// Needs VCU_EVENT_DRIVEN: the fixed 5 / 12 ms polls would never let the chip sleep. Light sleep
+// only with the servo output and without the slot timer, clock sync, IMU or Xbox task, whose
+// periodic timers, bursts and BLE stack would keep it awake anyway (POWER_LIGHT_SLEEP); frequency
+// scaling always.
+// Builds without CONFIG_PM_ENABLE run at full clock and report it at boot.
+
+#define POWER_MAX_MHZ             240
+#define POWER_MIN_MHZ             80      // not lower: the APB clock would follow
+#define POWER_PARKED_TIMEOUT_MS   500     // task waits while parked
+#define POWER_LINK_RX_PIN         3       // UART0 RX, the serial link
+#define POWER_WAKE_PINS           4
+
+#define POWER_LIGHT_SLEEP         (VCU_OUTPUT == OUTPUT_SERVO && !VCU_CAN_TT && !VCU_CLOCK_SYNC && !VCU_XBOX && !VCU_YAW_CONTROL)
+
+const POWERCONFIG powerConfig = {
+  10,       // us around neutral throttle
+  3,        // degrees of steering movement
+  2000,     // ms at neutral to POWER_IDLE
+  30000,    // ms at neutral without input to POWER_PARKED
+  500       // ms awake after a wake-up
+};
+
+static POWERSTATE _power_state;                     // control task, the record under _power_mux
+static esp_pm_lock_handle_t _power_cpu = NULL;
+static esp_pm_lock_handle_t _power_awake = NULL;
+static esp_pm_lock_handle_t _power_wake = NULL;     // taken by the wake-up interrupt
+static uint8_t _power_pins[POWER_WAKE_PINS];
+static uint8_t _power_pin_count = 0;
+static volatile bool _power_armed = false;
+static int64_t _power_woke_at = 0;                  // wake-up interrupt -> control task
+static bool _power_pm = false;                      // power manager configured
+static portMUX_TYPE _power_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint32_t powerStaticBytes = sizeof(POWERSTATE) + 3 * sizeof(esp_pm_lock_handle_t) + sizeof(_power_pins) +
+                                         sizeof(uint8_t) + 2 * sizeof(bool) + sizeof(int64_t);
+
+
+//==================================================================================//
+
+// setup(), before the heap is sealed (the locks are allocated)
+bool powerBegin() {
+  esp_pm_config_esp32_t config = {};
+  config.max_freq_mhz = POWER_MAX_MHZ;
+  config.min_freq_mhz = POWER_MIN_MHZ;
+  config.light_sleep_enable = POWER_LIGHT_SLEEP;
+  bool sleep = POWER_LIGHT_SLEEP;
+  if (esp_pm_configure(&config) != ESP_OK) {
+    // no tickless idle in this build: frequency scaling only
+    config.light_sleep_enable = false;
+    sleep = false;
+    if (esp_pm_configure(&config) != ESP_OK) {
+      Serial.println("Power: no power management in this build (CONFIG_PM_ENABLE), full clock");
+      powerReset(_power_state, false, esp_timer_get_time());
+      return false;
+    }
+  }
+
+  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "drive", &_power_cpu);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "awake", &_power_awake);
+  esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "wake", &_power_wake);
+  esp_pm_lock_acquire(_power_cpu);
+  esp_pm_lock_acquire(_power_awake);
+  _power_pm = true;
+
+  _power_pins[_power_pin_count++] = RX_GPIO_NUM;
+#if VCU_RX != RX_NONE
+  _power_pins[_power_pin_count++] = RX_RECEIVER_PIN;
+#endif
+#if VCU_RX2 != RX_NONE
+  _power_pins[_power_pin_count++] = RX_RECEIVER2_PIN;
+#endif
+#if VCU_SERIAL_LINK
+  _power_pins[_power_pin_count++] = POWER_LINK_RX_PIN;
+#endif
+  if (sleep) {
+    gpio_install_isr_service(ESP_INTR_FLAG_IRAM);   // shared with attachInterrupt(), may be there already
+    esp_sleep_enable_gpio_wakeup();
+  }
+
+  powerReset(_power_state, sleep, esp_timer_get_time());
+  Serial.println(sleep ? "Power: frequency scaling and light sleep" : "Power: frequency scaling, no light sleep");
+  return true;
+}
+
+// first edge on any input pin while parked
+static void IRAM_ATTR powerWakeIsr(void*) {
+  if (!_power_armed) return;
+  _power_armed = false;
+  for (uint8_t i = 0; i < _power_pin_count; i++) gpio_ll_intr_disable(&GPIO, (gpio_num_t)_power_pins[i]);
+
+  portENTER_CRITICAL_ISR(&_power_mux);
+  _power_woke_at = esp_timer_get_time();
+  portEXIT_CRITICAL_ISR(&_power_mux);
+  esp_pm_lock_acquire(_power_wake);
+
+  BaseType_t woken = pdFALSE;
+  if (_wake_control_task != NULL) xTaskNotifyFromISR(_wake_control_task, WAKE_POWER, eSetBits, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// every input pin wakes on the level its idle line leaves to; the PPM receiver hands its pin over
+template<class Receiver>
+void powerArm() {
+  Receiver::sleep(true);
+  for (uint8_t i = 0; i < _power_pin_count; i++) {
+    gpio_num_t pin = (gpio_num_t)_power_pins[i];
+    gpio_int_type_t level = gpio_get_level(pin) ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+    gpio_isr_handler_add(pin, powerWakeIsr, NULL);
+    gpio_wakeup_enable(pin, level);
+    gpio_intr_enable(pin);
+  }
+  batteryPause(true);
+  _power_armed = true;
+}
+
+template<class Receiver>
+void powerDisarm() {
+  _power_armed = false;
+  for (uint8_t i = 0; i < _power_pin_count; i++) {
+    gpio_num_t pin = (gpio_num_t)_power_pins[i];
+    gpio_wakeup_disable(pin);
+    gpio_intr_disable(pin);
+    gpio_isr_handler_remove(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+  }
+  Receiver::sleep(false);
+  batteryPause(false);
+}
+
+// control task, once per loop after the actuators were written: 'inputAt' the receive time of
+// the input applied this loop, 0 = none
+template<class Receiver>
+void powerControl(int64_t inputAt) {
+  portENTER_CRITICAL(&_power_mux);
+  int64_t woke = _power_woke_at;
+  _power_woke_at = 0;
+  uint8_t from = _power_state.level;
+  uint8_t to = powerUpdate(_power_state, powerConfig, _maneuver_written.throttle, _maneuver_written.steeringAngle,
+                           inputAt, woke, esp_timer_get_time());
+  portEXIT_CRITICAL(&_power_mux);
+  if (!_power_pm || (from == to && woke == 0)) return;
+
+  if (from == POWER_PARKED && to != POWER_PARKED) {
+    esp_pm_lock_acquire(_power_awake);
+    powerDisarm<Receiver>();
+  }
+  if (to == POWER_DRIVE) esp_pm_lock_acquire(_power_cpu);
+  if (from == POWER_DRIVE) esp_pm_lock_release(_power_cpu);
+  if (to == POWER_PARKED && from != POWER_PARKED) {
+    powerArm<Receiver>();
+    esp_pm_lock_release(_power_awake);
+  }
+  if (woke != 0) esp_pm_lock_release(_power_wake);
+}
+
+inline bool powerParked() {
+  return _power_state.level == POWER_PARKED;
+}
+
+// CANBUS task, with the diagnostics
+void powerDiagRecord(uint8_t record[8], uint8_t type) {
+  portENTER_CRITICAL(&_power_mux);
+  powerRecord(record, type, _power_state);
+  portEXIT_CRITICAL(&_power_mux);
+}
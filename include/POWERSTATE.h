@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+// Power levels of the VCU (VCU_POWER_SAVE), chosen by the control task once per loop from what
+// it wrote to the actuators and when it last had an input. No hardware access, the host models
+// the wake-up latency and the current with the same code (vcu_host sim-power).
+//   POWER_DRIVE    full CPU clock, no light sleep: the outputs moved within idleMs
+//   POWER_IDLE     CPU clock at its minimum (80 MHz, the peripheral clock stays): outputs at
+//                  neutral for idleMs, inputs may still come in
+//   POWER_PARKED   automatic light sleep between events as well: outputs at neutral and no
+//                  input frame for parkMs; an edge on an input pin wakes the VCU, it then stays
+//                  awake for at least holdMs
+// Wake-up latency: from the edge that woke the VCU (that frame is lost, the peripherals were
+// asleep) to the control loop that applied the first input received after it, the actuation
+// then follows the input again.
+//
+// Diagnostics record (once a second with the others):
+//   power: [0xD0] [level] [drive % of the window] [parked % of the window] [wake-ups, saturating]
+//          [average wake-up latency ms] [longest wake-up latency ms x2], wake-ups of the window
+
+#define POWER_DRIVE             0
+#define POWER_IDLE              1
+#define POWER_PARKED            2
+#define POWER_LEVELS            3
+
+struct POWERCONFIG {
+    uint16_t neutralBand;                   // us around 1500 that count as neutral throttle
+    uint8_t steeringBand;                   // degrees of steering movement that count as driving
+    uint32_t idleMs;
+    uint32_t parkMs;
+    uint32_t holdMs;                        // awake after a wake-up, input or not
+};
+
+struct POWERSTATE {
+    uint8_t level;
+    bool sleepAllowed;                      // light sleep configured, else never parked
+    int64_t activeAt;                       // last loop with the outputs away from neutral
+    int64_t inputAt;                        // last input frame
+    int64_t holdUntil;
+    int64_t wokeAt;                         // wake-up edge waiting for its first input, 0 = none
+    uint8_t steering;                       // reference for the steering band
+
+    // window
+    int64_t sampleAt;                       // previous update
+    uint32_t residencyUs[POWER_LEVELS];
+    uint32_t wakes;
+    uint32_t latencyCount;
+    uint32_t latencySumUs;
+    uint32_t latencyMaxUs;
+};
+
+
+//==================================================================================//
+
+inline void powerReset(POWERSTATE& state, bool sleepAllowed, int64_t now) {
+    state = POWERSTATE();
+    state.level = POWER_DRIVE;
+    state.sleepAllowed = sleepAllowed;
+    state.activeAt = now;
+    state.inputAt = now;
+    state.sampleAt = now;
+    state.steering = 90;
+}
+
+// control task, after the actuators were written: 'inputAt' the receive time of the input this
+// loop applied (0 = none fresh), 'wokeAt' a wake-up edge since the last update (0 = none)
+inline uint8_t powerUpdate(POWERSTATE& state, const POWERCONFIG& config, int16_t throttle, uint8_t steering,
+                           int64_t inputAt, int64_t wokeAt, int64_t now) {
+    state.residencyUs[state.level] += now - state.sampleAt;
+    state.sampleAt = now;
+
+    if (wokeAt != 0) {
+        state.wakes++;
+        state.wokeAt = wokeAt;
+        state.holdUntil = wokeAt + config.holdMs * 1000LL;
+    }
+    if (inputAt != 0) {
+        if (inputAt > state.inputAt) state.inputAt = inputAt;
+        if (state.wokeAt != 0 && inputAt >= state.wokeAt) {
+            uint32_t latency = now - state.wokeAt;
+            state.latencyCount++;
+            state.latencySumUs += latency;
+            if (latency > state.latencyMaxUs) state.latencyMaxUs = latency;
+            state.wokeAt = 0;
+        }
+    }
+
+    int32_t moved = (int32_t)steering - state.steering;
+    bool steered = moved > config.steeringBand || -moved > config.steeringBand;
+    if (steered) state.steering = steering;
+    if (steered || throttle > 1500 + config.neutralBand || throttle < 1500 - config.neutralBand) state.activeAt = now;
+
+    if (now - state.activeAt < config.idleMs * 1000LL) {
+        state.level = POWER_DRIVE;
+    } else if (state.sleepAllowed && now - state.activeAt >= config.parkMs * 1000LL &&
+               now - state.inputAt >= config.parkMs * 1000LL && now >= state.holdUntil) {
+        state.level = POWER_PARKED;
+        state.wokeAt = 0;                   // woken by something that was no input
+    } else {
+        state.level = POWER_IDLE;
+    }
+    return state.level;
+}
+
+
+//==================================================================================//
+
+inline void powerRecord(uint8_t record[8], uint8_t type, POWERSTATE& state) {
+    uint32_t window = state.residencyUs[POWER_DRIVE] + state.residencyUs[POWER_IDLE] + state.residencyUs[POWER_PARKED];
+    uint32_t average = state.latencyCount ? state.latencySumUs / state.latencyCount / 1000 : 0;
+    uint32_t longest = state.latencyMaxUs / 1000;
+
+    record[0] = type;
+    record[1] = state.level;
+    record[2] = window ? (uint64_t)state.residencyUs[POWER_DRIVE] * 100 / window : 0;
+    record[3] = window ? (uint64_t)state.residencyUs[POWER_PARKED] * 100 / window : 0;
+    record[4] = state.wakes < 255 ? state.wakes : 255;
+    record[5] = average < 255 ? average : 255;
+    record[6] = longest < 0xFFFF ? longest >> 8 : 0xFF;
+    record[7] = longest < 0xFFFF ? longest & 0xFF : 0xFF;
+
+    for (uint8_t i = 0; i < POWER_LEVELS; i++) state.residencyUs[i] = 0;
+    state.wakes = 0;
+    state.latencyCount = 0;
+    state.latencySumUs = 0;
+    state.latencyMaxUs = 0;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdint.h>
+#include <FIXEDPOINT.h>
+
+// Onboard pure-pursuit path tracking. The CAN master sends a short list of waypoints
+// (mm, in the vehicle frame at the moment the path starts), the VCU dead-reckons its pose
+// from measured speed and the curvature it applied and steers toward a lookahead point
+// at its own control rate. Integer only, the same code runs in the host simulation.
+//
+// Path frame (id PATH_CAN_BASE + CANBUS_ID), one waypoint per frame:
+//   [0] bit7 = first waypoint of a new path, bit6 = last waypoint (commit), bits0-5 = index
+//   [1..2] x mm, [3..4] y mm (int16, big endian, x forward, y left)
+
+#define PATH_CAN_BASE         0x200
+#define PATH_MAX_WAYPOINTS    32
+#define PATH_FLAG_START       0x80
+#define PATH_FLAG_COMMIT      0x40
+#define PATH_INDEX_MASK       0x3F
+
+struct WAYPOINT {
+    int16_t x;                // mm
+    int16_t y;
+};
+
+struct PATH {
+    uint8_t count;
+    uint8_t id;               // increments with every committed path
+    WAYPOINT points[PATH_MAX_WAYPOINTS];
+};
+
+struct PURSUITCONFIG {
+    int32_t wheelbase;        // mm
+    int32_t lookaheadBase;    // mm at standstill
+    int32_t lookaheadGain;    // mm of lookahead per m/s
+    int32_t lookaheadMin;     // mm
+    int32_t lookaheadMax;     // mm
+    int32_t maxCurvature;     // Q24 1/mm, from the steering limit
+    int32_t goalTolerance;    // mm around the last waypoint
+};
+
+struct PURSUITSTATE {
+    int32_t x;                // um, path frame
+    int32_t y;
+    uint32_t heading;         // binary angle, 0 = path x axis
+    int32_t curvature;        // Q24 1/mm, last output
+    uint8_t target;           // current target waypoint
+    bool active;
+    bool done;
+};
+
+
+//==================================================================================//
+
+inline void pursuitStart(PURSUITSTATE& state) {
+    state.x = 0;
+    state.y = 0;
+    state.heading = 0;
+    state.curvature = 0;
+    state.target = 0;
+    state.active = true;
+    state.done = false;
+}
+
+// dead reckoning over one control step with the curvature applied during that step (see pursuitApply)
+inline void pursuitPredict(PURSUITSTATE& state, int32_t speed, uint32_t dt_us) {
+    int64_t ds = (int64_t)speed * dt_us / 1000;                        // um
+    int64_t turn = ds * state.curvature / 1000;                         // rad Q24
+    int32_t dHeading = (int32_t)((turn * 10430) >> 8);                 // rad Q24 -> binary angle
+
+    uint32_t mid = state.heading + dHeading / 2;
+    state.x += (int32_t)((ds * fixedCos(mid)) >> 14);
+    state.y += (int32_t)((ds * fixedSin(mid)) >> 14);
+    state.heading += dHeading;
+}
+
+// lookahead distance from speed (mm/s)
+inline int32_t pursuitLookahead(const PURSUITCONFIG& config, int32_t speed) {
+    int32_t lookahead = config.lookaheadBase + (int32_t)((int64_t)config.lookaheadGain * speed / 1000);
+    if (lookahead < config.lookaheadMin) lookahead = config.lookaheadMin;
+    if (lookahead > config.lookaheadMax) lookahead = config.lookaheadMax;
+    return lookahead;
+}
+
+// one control step: returns the curvature to steer (Q24 1/mm, positive = left)
+inline int32_t pursuitUpdate(PURSUITSTATE& state, const PURSUITCONFIG& config, const PATH& path, int32_t speed) {
+    if (!state.active || state.done || path.count == 0) {
+        state.curvature = 0;
+        return 0;
+    }
+
+    int64_t lookahead = pursuitLookahead(config, speed);
+    int64_t lookahead2 = lookahead * lookahead;
+
+    // walk forward to the first waypoint at least one lookahead away
+    int32_t dx, dy;
+    int64_t distance2;
+    while (true) {
+        const WAYPOINT& wp = path.points[state.target];
+        dx = ((int32_t)wp.x * 1000 - state.x) / 1000;                   // mm
+        dy = ((int32_t)wp.y * 1000 - state.y) / 1000;
+        distance2 = (int64_t)dx * dx + (int64_t)dy * dy;
+        if (distance2 >= lookahead2 || state.target + 1 >= path.count) break;
+        state.target++;
+    }
+
+    if (state.target + 1 >= path.count && distance2 <= (int64_t)config.goalTolerance * config.goalTolerance) {
+        state.done = true;
+        state.curvature = 0;
+        return 0;
+    }
+
+    // target in the vehicle frame, only the lateral offset is needed
+    int32_t s = fixedSin(state.heading);
+    int32_t c = fixedCos(state.heading);
+    int64_t lateral = ((int64_t)dy * c - (int64_t)dx * s) >> 14;       // mm
+
+    // kappa = 2 y / L^2
+    int64_t curvature = distance2 > 0 ? (lateral << 25) / distance2 : 0;
+    if (curvature > config.maxCurvature) curvature = config.maxCurvature;
+    if (curvature < -config.maxCurvature) curvature = -config.maxCurvature;
+
+    state.curvature = (int32_t)curvature;
+    return state.curvature;
+}
+
+// front wheel angle for a curvature, centidegrees (bicycle model: tan delta = wheelbase * kappa)
+inline int32_t pursuitWheelAngle(const PURSUITCONFIG& config, int32_t curvature) {
+    int32_t ratio = (int32_t)(((int64_t)config.wheelbase * curvature) >> 10);   // Q24 -> Q14
+    return fixedAtan(ratio);
+}
+
+// record the wheel angle that was actually commanded (after limits and servo rounding),
+// dead reckoning must integrate what the car does, not what the tracker asked for
+inline void pursuitApply(PURSUITSTATE& state, const PURSUITCONFIG& config, int32_t wheelAngle) {
+    uint32_t angle = (uint32_t)((int64_t)wheelAngle * (int64_t)FIXED_BAM_PER_DEG / 100);
+    int64_t c = fixedCos(angle);
+    state.curvature = c > 0 ? (int32_t)(((int64_t)fixedSin(angle) << 24) / (c * config.wheelbase)) : 0;
+}
+
+
+//==================================================================================//
+
+// collects path frames, returns true when a path was committed to 'path'
+inline bool pathReceive(PATH& building, PATH& path, const uint8_t* data, uint8_t length) {
+    if (length < 5) return false;
+
+    uint8_t index = data[0] & PATH_INDEX_MASK;
+    if (data[0] & PATH_FLAG_START) building.count = 0;
+    if (index != building.count || index >= PATH_MAX_WAYPOINTS) {
+        building.count = 0;    // lost a frame, wait for the next start
+        return false;
+    }
+
+    building.points[index].x = (int16_t)((data[1] << 8) | data[2]);
+    building.points[index].y = (int16_t)((data[3] << 8) | data[4]);
+    building.count++;
+
+    if (!(data[0] & PATH_FLAG_COMMIT)) return false;
+
+    building.id = path.id + 1;
+    path = building;
+    building.count = 0;
+    return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+
+// Per channel input filter for RC pulse widths, fixed point, one update per received frame.
+// Stages, in order, with their settled lag behind a ramp:
+//   median   median of the last 3 samples, removes single frame spikes.          ramp lag: 1 frame
+//   smooth   one pole:   y += alpha * (x - y)                                     ramp lag: (1 - alpha) / alpha frames
+//            alpha-beta: tracks value and rate, noise gain set by alpha/beta     ramp lag: 0
+//   lead     adds lead * rate to the output to win back delay, amplifies noise  ramp lag: minus lead frames
+// rcFilterDelay() returns that ramp lag, vcu_host rcfilter checks it against a clean ramp. On
+// steps and jitter the delay is another figure: the report's cross correlation delay on its
+// synthetic trace is 0.5 frames for one pole 0.5 and for alpha-beta (0.5, 0.1), 1.6 for the
+// median with one pole 0.5 and 1.4 for the median with alpha-beta and lead 1, which wins back
+// lag on ramps only. Run the report on a recorded trace for the figures of a given receiver.
+
+#define RC_FILTER_NONE        0
+#define RC_FILTER_ONE_POLE    1
+#define RC_FILTER_ALPHA_BETA  2
+
+#define RC_FILTER_Q           8         // internal values are us << 8
+
+struct RCFILTERCONFIG {
+    bool median;
+    uint8_t smooth;           // RC_FILTER_*
+    uint16_t alpha;           // Q16 (65536 = 1.0)
+    uint16_t beta;            // Q16, alpha-beta only
+    uint16_t lead;            // Q8 frames of predictive lead
+};
+
+struct RCFILTERSTATE {
+    int32_t history[3];       // raw samples, us
+    uint8_t samples;
+    int32_t value;            // us Q8
+    int32_t rate;             // us Q8 per frame
+};
+
+
+//==================================================================================//
+
+inline void rcFilterReset(RCFILTERSTATE& state, int32_t us) {
+    state.history[0] = state.history[1] = state.history[2] = us;
+    state.samples = 0;
+    state.value = us << RC_FILTER_Q;
+    state.rate = 0;
+}
+
+inline int32_t rcMedian3(int32_t a, int32_t b, int32_t c) {
+    if (a > b) { int32_t t = a; a = b; b = t; }
+    if (b > c) b = c;
+    return a > b ? a : b;
+}
+
+// one new frame in, filtered pulse width (us) out
+inline int32_t rcFilterUpdate(RCFILTERSTATE& state, const RCFILTERCONFIG& config, int32_t us) {
+    state.history[2] = state.history[1];
+    state.history[1] = state.history[0];
+    state.history[0] = us;
+
+    // first frame: start settled on it instead of ramping up from the reset value
+    if (state.samples == 0) {
+        rcFilterReset(state, us);
+        state.samples = 1;
+        return us;
+    }
+
+    int32_t x = (config.median ? rcMedian3(state.history[0], state.history[1], state.history[2]) : us) << RC_FILTER_Q;
+
+    switch (config.smooth) {
+        case RC_FILTER_ONE_POLE: {
+            int32_t previous = state.value;
+            state.value += (int32_t)(((int64_t)(x - state.value) * config.alpha) >> 16);
+            state.rate = state.value - previous;
+            break;
+        }
+        case RC_FILTER_ALPHA_BETA: {
+            int32_t predicted = state.value + state.rate;
+            int32_t residual = x - predicted;
+            state.value = predicted + (int32_t)(((int64_t)residual * config.alpha) >> 16);
+            state.rate += (int32_t)(((int64_t)residual * config.beta) >> 16);
+            break;
+        }
+        default:
+            state.rate = x - state.value;
+            state.value = x;
+            break;
+    }
+
+    int32_t out = state.value + (int32_t)(((int64_t)state.rate * config.lead) >> 8);
+    return (out + (1 << (RC_FILTER_Q - 1))) >> RC_FILTER_Q;
+}
+
+// settled lag behind a ramp in frames, Q8 (negative = the output leads)
+inline int32_t rcFilterDelay(const RCFILTERCONFIG& config) {
+    int32_t delay = config.median ? 256 : 0;
+    if (config.smooth == RC_FILTER_ONE_POLE && config.alpha > 0) {
+        delay += (int32_t)(((int64_t)(65536 - config.alpha) << 8) / config.alpha);
+    }
+    return delay - config.lead;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdint.h>
+
+// Radio link quality per receiver. Every receiver frame (and every poll without one, for the
+// failsafe timing) goes through rcLinkUpdate(), which is O(1): the windows are a bit ring and
+// per second buckets, each bounded no matter how long the gap before the frame was.
+//   frame period    tracked from the shortest regular inter-frame gap
+//   lost frames     frames the receiver flags as lost (SBUS) plus frames missing in a gap
+//                   longer than 1.5 periods (PPM has no flag)
+//   lost %          over the last RCLINK_SHORT_FRAMES frame slots and the last
+//                   RCLINK_LONG_SECONDS seconds
+//   failsafe        receiver failsafe flag or no frame for RX_TIMEOUT_MS: episodes, longest
+//                   and total duration
+//   gap histogram   RCLINK_GAP_BINS bins of RCLINK_GAP_BIN_US, the last one open ended
+// With the lost % of the short window at or above the configured threshold the link counts as
+// degraded and the throttle offset is scaled down until it recovers (hysteresis). Integer only,
+// the same code runs in the host report (vcu_host rclink).
+//
+// Diagnostics records (once a second with the others):
+//   link: [0x90] [frames in the last second] [lost % short window] [lost % long window]
+//         [failsafe episodes, saturating] [longest failsafe, 100 ms steps] [failsafe total, s]
+//         [bit0 failsafe now, bit1 degraded]
+//   gaps: [0xA0 | part] [7 bins of the histogram, frames since the last record, saturating],
+//         part 0 = bins 0 - 6, part 1 = bins 7 - 13
+
+#define RCLINK_SHORT_FRAMES     32          // bit ring, one bit per frame slot
+#define RCLINK_LONG_SECONDS     10
+#define RCLINK_GAP_BINS         14
+#define RCLINK_GAP_BIN_US       5000        // 0-5 ms, 5-10 ms, ... 65 ms and longer
+
+struct RCLINKCONFIG {
+    uint8_t degradePercent;                 // lost % (short window) that limits the throttle, 0 = never
+    uint8_t recoverPercent;                 // lost % at which the limit is lifted again
+    uint16_t throttleScale;                 // Q8 factor on the throttle offset from neutral while degraded
+};
+
+struct RCLINKSTATS {
+    // short window
+    uint32_t slots;                         // bit ring, 1 = lost
+    uint8_t slotsFilled;
+    uint8_t shortLost;
+
+    // long window, per second buckets
+    uint16_t bucketFrames[RCLINK_LONG_SECONDS];
+    uint16_t bucketLost[RCLINK_LONG_SECONDS];
+    uint8_t bucket;
+    int64_t bucketStart;
+    uint32_t longFrames;
+    uint32_t longLost;
+    uint16_t lastSecondFrames;
+
+    // timing
+    int64_t lastFrameAt;                    // local us
+    uint32_t periodUs;                      // 0 = not known yet
+    uint32_t gaps[RCLINK_GAP_BINS];         // since the last record
+
+    // failsafe
+    bool failsafe;
+    int64_t failsafeStart;
+    uint32_t failsafeEpisodes;
+    uint32_t failsafeLongestMs;
+    uint32_t failsafeTotalMs;
+
+    uint32_t frames;                        // totals since boot
+    uint32_t lost;
+    bool degraded;
+};
+
+
+//==================================================================================//
+
+inline void rcLinkReset(RCLINKSTATS& stats) {
+    stats = RCLINKSTATS();
+}
+
+// one frame slot into the short window
+inline void rcLinkSlot(RCLINKSTATS& stats, bool lost) {
+    uint8_t dropped = (stats.slotsFilled == RCLINK_SHORT_FRAMES) ? (stats.slots >> (RCLINK_SHORT_FRAMES - 1)) & 1 : 0;
+    stats.slots = (stats.slots << 1) | (lost ? 1 : 0);
+    if (stats.slotsFilled < RCLINK_SHORT_FRAMES) stats.slotsFilled++;
+    stats.shortLost += (lost ? 1 : 0) - dropped;
+}
+
+// moves the long window on to 'now', at most one full turn of buckets
+inline void rcLinkAdvance(RCLINKSTATS& stats, int64_t now) {
+    if (stats.bucketStart == 0) stats.bucketStart = now;
+    for (uint8_t i = 0; i < RCLINK_LONG_SECONDS && now - stats.bucketStart >= 1000000; i++) {
+        stats.lastSecondFrames = stats.bucketFrames[stats.bucket];
+        stats.bucket = (stats.bucket + 1) % RCLINK_LONG_SECONDS;
+        stats.longFrames -= stats.bucketFrames[stats.bucket];
+        stats.longLost -= stats.bucketLost[stats.bucket];
+        stats.bucketFrames[stats.bucket] = 0;
+        stats.bucketLost[stats.bucket] = 0;
+        stats.bucketStart += 1000000;
+    }
+    if (now - stats.bucketStart >= 1000000) {
+        // longer than the whole window: it only holds what comes from now on
+        stats.lastSecondFrames = 0;
+        stats.bucketStart = now;
+    }
+}
+
+inline uint8_t rcLinkShortPercent(const RCLINKSTATS& stats) {
+    return stats.slotsFilled ? stats.shortLost * 100 / stats.slotsFilled : 0;
+}
+
+inline uint8_t rcLinkLongPercent(const RCLINKSTATS& stats) {
+    uint32_t slots = stats.longFrames + stats.longLost;
+    return slots ? (uint8_t)(stats.longLost * 100 / slots) : 0;
+}
+
+// every poll of the receiver: 'fresh' a frame completed at 'frameAt' ('lostFlag' set by the
+// receiver), 'failsafe' the receiver is in failsafe or timed out, 'now' the poll time
+inline void rcLinkUpdate(RCLINKSTATS& stats, const RCLINKCONFIG& config, bool fresh, bool lostFlag, bool failsafe,
+                         int64_t frameAt, int64_t now) {
+    rcLinkAdvance(stats, now);
+
+    if (fresh && !failsafe) {
+        uint32_t missing = 0;
+        if (stats.lastFrameAt != 0) {
+            uint32_t gap = frameAt - stats.lastFrameAt;
+            uint32_t bin = gap / RCLINK_GAP_BIN_US;
+            stats.gaps[bin < RCLINK_GAP_BINS ? bin : RCLINK_GAP_BINS - 1]++;
+
+            // the period follows the shortest regular gap, longer gaps hold missing frames
+            if (stats.periodUs == 0 || gap < stats.periodUs * 3 / 4) {
+                stats.periodUs = gap;
+            } else if (gap <= stats.periodUs * 3 / 2) {
+                stats.periodUs += ((int32_t)gap - (int32_t)stats.periodUs) / 8;
+            } else if (!stats.failsafe) {
+                missing = (gap + stats.periodUs / 2) / stats.periodUs - 1;
+            }
+        }
+        stats.lastFrameAt = frameAt;
+
+        // a whole window of missing frames fills it, so the loop is bounded
+        uint32_t slots = missing < RCLINK_SHORT_FRAMES ? missing : RCLINK_SHORT_FRAMES;
+        for (uint32_t i = 0; i < slots; i++) rcLinkSlot(stats, true);
+        rcLinkSlot(stats, lostFlag);
+
+        uint32_t lost = missing + (lostFlag ? 1 : 0);
+        stats.frames++;
+        stats.lost += lost;
+        stats.bucketFrames[stats.bucket]++;
+        stats.longFrames++;
+        stats.bucketLost[stats.bucket] += lost;
+        stats.longLost += lost;
+    }
+
+    // failsafe episodes
+    if (failsafe && !stats.failsafe) {
+        stats.failsafe = true;
+        stats.failsafeStart = now;
+        stats.failsafeEpisodes++;
+    } else if (!failsafe && stats.failsafe) {
+        uint32_t duration = (now - stats.failsafeStart) / 1000;
+        stats.failsafe = false;
+        stats.failsafeTotalMs += duration;
+        if (duration > stats.failsafeLongestMs) stats.failsafeLongestMs = duration;
+    }
+
+    // degradation with hysteresis
+    uint8_t lostPercent = rcLinkShortPercent(stats);
+    if (config.degradePercent && !stats.degraded && lostPercent >= config.degradePercent) stats.degraded = true;
+    else if (stats.degraded && lostPercent <= config.recoverPercent) stats.degraded = false;
+}
+
+// throttle in us with the degradation limit applied
+inline uint16_t rcLinkThrottle(const RCLINKSTATS& stats, const RCLINKCONFIG& config, uint16_t throttle) {
+    if (!stats.degraded) return throttle;
+    int32_t offset = ((int32_t)throttle - 1500) * config.throttleScale / 256;
+    return (uint16_t)(1500 + offset);
+}
+
+
+//==================================================================================//
+
+inline void rcLinkRecord(uint8_t record[8], uint8_t type, const RCLINKSTATS& stats, int64_t now) {
+    uint32_t longest = stats.failsafeLongestMs;
+    uint32_t total = stats.failsafeTotalMs;
+    if (stats.failsafe) {
+        uint32_t running = (now - stats.failsafeStart) / 1000;
+        if (running > longest) longest = running;
+        total += running;
+    }
+
+    record[0] = type;
+    record[1] = stats.lastSecondFrames < 255 ? stats.lastSecondFrames : 255;
+    record[2] = rcLinkShortPercent(stats);
+    record[3] = rcLinkLongPercent(stats);
+    record[4] = stats.failsafeEpisodes < 255 ? stats.failsafeEpisodes : 255;
+    record[5] = longest / 100 < 255 ? longest / 100 : 255;
+    record[6] = total / 1000 < 255 ? total / 1000 : 255;
+    record[7] = (stats.failsafe ? 0x01 : 0) | (stats.degraded ? 0x02 : 0);
+}
+
+// histogram part 0 or 1, the bins are cleared once sent
+inline void rcLinkGapRecord(uint8_t record[8], uint8_t type, RCLINKSTATS& stats, uint8_t part) {
+    record[0] = type | part;
+    for (uint8_t i = 0; i < 7; i++) {
+        uint32_t& bin = stats.gaps[part * 7 + i];
+        record[1 + i] = bin < 255 ? bin : 255;
+        bin = 0;
+    }
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <stdint.h>
+#include <RCLINK.h>
+
+// Receiver diversity (VCU_RX2): two receivers bound to the same transmitter, one frame stream to
+// getData(). Integer only and without hardware access, the host replays dropout traces through
+// it (vcu_host rx-diversity).
+//
+// Each poll hands over what both receivers have (fresh frame, failsafe, lost flag, frame time).
+// Every receiver keeps its own link statistics (RCLINK.h) and its latest frame that was not
+// failsafe. One receiver is active and delivers its frames; the other one only fills in:
+//   rescue        the active receiver is overdue (missPercent of its period past its last
+//                 frame) or its new frame is one it repeated (lost flag): the other receiver's
+//                 newest frame is delivered instead, the active one stays
+//   switch over   the active receiver is down (failsafe, or no frame for timeoutMs) or its lost %
+//                 (short window) is lostMargin above the other's, and the other one is up
+// A frame is only delivered when it is newer than the last one delivered, so the stream never
+// goes back in time or repeats a frame. Switching needs no hand-over: both receivers carry the
+// same stick positions, the filters carry on, and failsafe is only reported while neither
+// receiver is up. The two receivers run at their own phase, a rescued frame can come a fraction
+// of a period after the last one; RCLINK.h would take that gap for the period and count the
+// next ones as lost. The link statistics behind getData() therefore get the frames at linkAt:
+// the frame time, but no closer to the previous one than 3/4 of the active receiver's period;
+// after a switch over they carry on at the new receiver's period (rxDivLinkPeriod).
+//
+// Diagnostics record (once a second with the others):
+//   diversity: [0xA8] [active receiver, 0 first 1 second] [switches, saturating]
+//              [share of the frames delivered from the second receiver, %] [rescued frames, saturating]
+//              [lost % short window, first] [lost % short window, second] [bit0 first up, bit1 second up]
+//              window counts cleared once sent
+
+#define RXDIV_SOURCES           2
+
+struct RXDIVCONFIG {
+    uint16_t missPercent;                   // of the period past the last frame: the active receiver missed one
+    uint8_t lostMargin;                     // lost % points above the other receiver's that switch over
+    uint16_t timeoutMs;                     // no frame for this long: the receiver is down (RX_TIMEOUT_MS)
+};
+
+// one receiver at one poll
+struct RXDIVFRAME {
+    bool fresh;                             // a frame arrived since the last poll
+    bool failsafe;
+    bool lost;                              // the receiver repeated its last frame
+    int64_t at;                             // local us the frame was complete
+    uint16_t throttle;                      // us
+    uint16_t steering;
+};
+
+struct RXDIVSOURCE {
+    RCLINKSTATS link;
+    RXDIVFRAME frame;                       // latest frame that was not failsafe, at 0 = none yet
+    bool failsafe;
+    bool up;
+};
+
+struct RXDIVSTATE {
+    RXDIVSOURCE sources[RXDIV_SOURCES];
+    uint8_t active;
+    bool switched;                          // in the last update
+    int64_t deliveredAt;                    // frame time of the last delivered frame
+    int64_t linkAt;                         // its time for the link statistics
+
+    // window
+    uint32_t switches;
+    uint32_t delivered;
+    uint32_t second;                        // delivered from the second receiver
+    uint32_t rescued;                       // delivered from the inactive receiver
+
+    uint32_t totalSwitches;                 // since boot
+};
+
+
+//==================================================================================//
+
+inline void rxDivReset(RXDIVSTATE& state) {
+    state = RXDIVSTATE();
+}
+
+inline bool rxDivUp(const RXDIVSOURCE& source, const RXDIVCONFIG& config, int64_t now) {
+    return source.frame.at != 0 && !source.failsafe && now - source.frame.at <= (int64_t)config.timeoutMs * 1000;
+}
+
+// local us when 'source' counts as having missed its next frame, 0 = period not known yet
+inline int64_t rxDivDueAt(const RXDIVSOURCE& source, const RXDIVCONFIG& config) {
+    if (source.frame.at == 0 || source.link.periodUs == 0) return 0;
+    return source.frame.at + (int64_t)source.link.periodUs * config.missPercent / 100;
+}
+
+inline bool rxDivOverdue(const RXDIVSOURCE& source, const RXDIVCONFIG& config, int64_t now) {
+    int64_t due = rxDivDueAt(source, config);
+    return !source.up || (due != 0 && now > due);
+}
+
+inline bool rxDivNew(const RXDIVSTATE& state, const RXDIVSOURCE& source) {
+    return source.up && source.frame.at > state.deliveredAt;
+}
+
+// every poll: 'polled' as read from both receivers; returns the receiver whose frame
+// (sources[i].frame) is delivered now, -1 for none
+inline int8_t rxDivUpdate(RXDIVSTATE& state, const RXDIVCONFIG& config, const RCLINKCONFIG& linkConfig,
+                          const RXDIVFRAME polled[RXDIV_SOURCES], int64_t now) {
+    state.switched = false;
+    for (uint8_t i = 0; i < RXDIV_SOURCES; i++) {
+        RXDIVSOURCE& source = state.sources[i];
+        const RXDIVFRAME& f = polled[i];
+        bool timeout = source.frame.at != 0 && now - source.frame.at > (int64_t)config.timeoutMs * 1000;
+        rcLinkUpdate(source.link, linkConfig, f.fresh, f.lost, f.failsafe || timeout, f.at, now);
+        source.failsafe = f.failsafe;
+        if (f.fresh && !f.failsafe) source.frame = f;
+        source.up = rxDivUp(source, config, now);
+    }
+
+    // switch over: the active receiver is down or clearly worse, compared once both windows are full
+    RXDIVSOURCE* active = &state.sources[state.active];
+    RXDIVSOURCE* other = &state.sources[1 - state.active];
+    bool compared = active->link.slotsFilled == RCLINK_SHORT_FRAMES && other->link.slotsFilled == RCLINK_SHORT_FRAMES;
+    bool worse = compared && rcLinkShortPercent(active->link) >= rcLinkShortPercent(other->link) + config.lostMargin;
+    if (other->up && (!active->up || worse)) {
+        state.active = 1 - state.active;
+        state.switched = true;
+        state.switches++;
+        state.totalSwitches++;
+        RXDIVSOURCE* swap = active;
+        active = other;
+        other = swap;
+    }
+
+    // no rescue before the active receiver's period is known, the link statistics learn it first
+    bool activeNew = rxDivNew(state, *active);
+    bool otherNew = rxDivNew(state, *other) && !other->frame.lost && active->link.periodUs != 0;
+    int8_t pick = -1;
+    if (activeNew && !active->frame.lost) {
+        pick = state.active;
+    } else if (otherNew && (activeNew || rxDivOverdue(*active, config, now))) {
+        pick = 1 - state.active;
+        state.rescued++;
+    } else if (activeNew) {
+        pick = state.active;                // only a repeated frame, as with one receiver
+    }
+
+    if (pick >= 0) {
+        int64_t at = state.sources[pick].frame.at;
+        uint32_t period = active->link.periodUs ? active->link.periodUs : other->link.periodUs;
+        int64_t earliest = state.linkAt + (int64_t)period * 3 / 4;
+        state.linkAt = state.linkAt != 0 && at < earliest ? earliest : at;
+        state.deliveredAt = at;
+        state.delivered++;
+        if (pick == 1) state.second++;
+    }
+    return pick;
+}
+
+// getData()'s link statistics after a switch over: the period is the new receiver's, a PPM and
+// an SBUS receiver differ, and RCLINK.h would count the longer gaps as lost frames
+inline void rxDivLinkPeriod(const RXDIVSTATE& state, RCLINKSTATS& link) {
+    uint32_t period = state.sources[state.active].link.periodUs;
+    if (state.switched && period != 0) link.periodUs = period;
+}
+
+// failsafe for getData(): neither receiver is up and one of them says so
+inline bool rxDivFailsafe(const RXDIVSTATE& state) {
+    bool failsafe = false;
+    for (uint8_t i = 0; i < RXDIV_SOURCES; i++) {
+        if (state.sources[i].up) return false;
+        failsafe |= state.sources[i].failsafe;
+    }
+    return failsafe;
+}
+
+// local us of the next poll that could rescue a frame: the active receiver's next frame is due
+// and the other one holds a newer frame; 0 = nothing to wait for
+inline int64_t rxDivCheckAt(const RXDIVSTATE& state, const RXDIVCONFIG& config) {
+    const RXDIVSOURCE& active = state.sources[state.active];
+    const RXDIVSOURCE& other = state.sources[1 - state.active];
+    if (!rxDivNew(state, other) || other.frame.lost) return 0;
+    return rxDivDueAt(active, config);
+}
+
+
+//==================================================================================//
+
+inline uint8_t rxDivSaturate(uint32_t value) {
+    return value < 255 ? value : 255;
+}
+
+inline void rxDivRecord(uint8_t record[8], uint8_t type, RXDIVSTATE& state) {
+    record[0] = type;
+    record[1] = state.active;
+    record[2] = rxDivSaturate(state.switches);
+    record[3] = state.delivered ? state.second * 100 / state.delivered : 0;
+    record[4] = rxDivSaturate(state.rescued);
+    record[5] = rcLinkShortPercent(state.sources[0].link);
+    record[6] = rcLinkShortPercent(state.sources[1].link);
+    record[7] = (state.sources[0].up ? 0x01 : 0) | (state.sources[1].up ? 0x02 : 0);
+
+    state.switches = 0;
+    state.delivered = 0;
+    state.second = 0;
+    state.rescued = 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+
+// SBUS frame encoding, no hardware access so the host build can check it byte for byte.
+// Frame: [0x0F] [16 channels x 11 bit, LSB first, 22 bytes] [flags] [0x00], 100000 baud 8E2 inverted.
+// Channel values 0 - 2047, the common servo mapping is us = 880 + value * 5 / 8
+// (172 = 987 us, 992 = 1500 us, 1811 = 2012 us).
+
+#define SBUS_FRAME_SIZE       25
+#define SBUS_CHANNELS         16
+#define SBUS_HEADER           0x0F
+#define SBUS_FOOTER           0x00
+#define SBUS_FLAG_CH17        0x01
+#define SBUS_FLAG_CH18        0x02
+#define SBUS_FLAG_LOST_FRAME  0x04
+#define SBUS_FLAG_FAILSAFE    0x08
+
+#define SBUS_VALUE_MAX        2047
+#define SBUS_VALUE_NEUTRAL    992
+
+// linear map of one VCU output onto an SBUS channel
+struct SBUSCHANNELMAP {
+    uint8_t channel;          // 0 - 15
+    int16_t inMin;            // VCU units (steering degrees, throttle us)
+    int16_t inMax;
+    uint16_t outMin;          // SBUS value at inMin
+    uint16_t outMax;          // SBUS value at inMax
+};
+
+
+//==================================================================================//
+
+inline void sbusEncode(const uint16_t channels[SBUS_CHANNELS], uint8_t flags, uint8_t frame[SBUS_FRAME_SIZE]) {
+    frame[0] = SBUS_HEADER;
+
+    uint32_t bits = 0;        // bit accumulator, LSB first
+    uint8_t count = 0;
+    uint8_t index = 1;
+    for (uint8_t i = 0; i < SBUS_CHANNELS; i++) {
+        bits |= (uint32_t)(channels[i] & 0x07FF) << count;
+        count += 11;
+        while (count >= 8) {
+            frame[index++] = bits & 0xFF;
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    frame[23] = flags;
+    frame[24] = SBUS_FOOTER;
+}
+
+// false if header or footer do not match
+inline bool sbusDecode(const uint8_t frame[SBUS_FRAME_SIZE], uint16_t channels[SBUS_CHANNELS], uint8_t& flags) {
+    if (frame[0] != SBUS_HEADER || frame[24] != SBUS_FOOTER) return false;
+
+    uint32_t bits = 0;
+    uint8_t count = 0;
+    uint8_t index = 1;
+    for (uint8_t i = 0; i < SBUS_CHANNELS; i++) {
+        while (count < 11) {
+            bits |= (uint32_t)frame[index++] << count;
+            count += 8;
+        }
+        channels[i] = bits & 0x07FF;
+        bits >>= 11;
+        count -= 11;
+    }
+
+    flags = frame[23];
+    return true;
+}
+
+// VCU value to SBUS value, clamped to the map's output range
+inline uint16_t sbusMapValue(const SBUSCHANNELMAP& map, int16_t value) {
+    if (map.inMax == map.inMin) return map.outMin;
+    int32_t out = map.outMin + (int32_t)(value - map.inMin) * (map.outMax - map.outMin) / (map.inMax - map.inMin);
+    int32_t low = map.outMin < map.outMax ? map.outMin : map.outMax;
+    int32_t high = map.outMin < map.outMax ? map.outMax : map.outMin;
+    if (out < low) out = low;
+    if (out > high) out = high;
+    return (uint16_t)out;
+}
+
+// pulse width (us) to SBUS value with the common servo mapping
+inline uint16_t sbusFromMicros(int16_t us) {
+    int32_t value = ((int32_t)us - 880) * 8 / 5;
+    if (value < 0) value = 0;
+    if (value > SBUS_VALUE_MAX) value = SBUS_VALUE_MAX;
+    return (uint16_t)value;
+}
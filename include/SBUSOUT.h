@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Arduino.h>
+#include <HANDOFF.h>
+#include <SBUSFRAME.h>
+
+// SBUS output policy (VCU_OUTPUT=OUTPUT_SBUS): steering and throttle go out as channels of one
+// SBUS stream on Serial2 instead of two PWM pins. drive() only hands the channel values over;
+// an esp_timer sends a frame every PERIOD_MS (7 or 14 ms, the two SBUS frame rates) and never
+// waits on the UART: when the TX FIFO has no room for a whole frame the frame is skipped and
+// counted. If drive() stops delivering for SBUS_OUT_FAILSAFE_MS the frames carry the failsafe
+// flag, so the servos and ESC fall back to their own failsafe positions.
+
+#define SBUS_OUT_TX_PIN         27      // inverted SBUS out, Serial1 belongs to the SBUS receiver
+#define SBUS_OUT_FAILSAFE_MS    100
+
+// VCU outputs to channels: servo degrees and throttle us onto 1000 - 2000 us equivalent
+const SBUSCHANNELMAP sbusSteeringMap = {0, 0, 180, 192, 1792};
+const SBUSCHANNELMAP sbusThrottleMap = {1, 1000, 2000, 192, 1792};
+
+struct SBUSOUTFRAME {
+    uint16_t channels[SBUS_CHANNELS];
+};
+
+struct SBUSOUTSTATS {
+    uint32_t frames;          // frames sent
+    uint32_t skipped;         // frames dropped, TX FIFO still busy
+    uint32_t failsafe;        // frames sent with the failsafe flag
+};
+
+template<uint8_t TX_PIN, uint8_t PERIOD_MS>
+struct SbusOutput {
+    static_assert(PERIOD_MS == 7 || PERIOD_MS == 14, "SBUS frame period must be 7 or 14 ms");
+
+    static Handoff<SBUSOUTFRAME> pending;     // drive() -> frame timer
+    static SBUSOUTFRAME latest;               // drive() side copy of all channels
+    static uint8_t frame[SBUS_FRAME_SIZE];
+    static uint32_t idleFrames;               // frames since drive() last delivered
+    static volatile bool stopped;             // throttle channel at neutral until the next write()
+    static SBUSOUTSTATS stats;
+    static esp_timer_handle_t timer;
+    static const uint32_t staticBytes = sizeof(Handoff<SBUSOUTFRAME>) + sizeof(SBUSOUTFRAME) + SBUS_FRAME_SIZE + sizeof(uint32_t) +
+                                        sizeof(bool) + sizeof(SBUSOUTSTATS) + sizeof(esp_timer_handle_t);
+
+    static void begin() {
+        for (uint8_t i = 0; i < SBUS_CHANNELS; i++) latest.channels[i] = SBUS_VALUE_NEUTRAL;
+        latest.channels[sbusSteeringMap.channel] = sbusMapValue(sbusSteeringMap, centerSteeringAngle);
+        latest.channels[sbusThrottleMap.channel] = sbusMapValue(sbusThrottleMap, 1500);
+        pending.publish(latest);
+
+        Serial2.begin(100000, SERIAL_8E2, -1, TX_PIN, true);    // TX only, inverted
+        sendFrame(NULL);                                        // neutral right away
+
+        esp_timer_create_args_t args = {};
+        args.callback = sendFrame;
+        args.name = "sbus out";
+        esp_timer_create(&args, &timer);
+        esp_timer_start_periodic(timer, PERIOD_MS * 1000UL);
+        Serial.println("SBUS Output Setup Done!");
+    }
+
+    static void write(int16_t throttle, uint8_t steeringAngle) {
+        latest.channels[sbusSteeringMap.channel] = sbusMapValue(sbusSteeringMap, steeringAngle);
+        latest.channels[sbusThrottleMap.channel] = sbusMapValue(sbusThrottleMap, throttle);
+        pending.publish(latest);
+        stopped = false;
+    }
+
+    // the next frame carries neutral throttle, nothing else is touched from the interrupt
+    static void stop() {
+        stopped = true;
+    }
+
+    static bool speed(int32_t&) {
+        return false;
+    }
+
+    // esp_timer task, every PERIOD_MS
+    static void sendFrame(void*) {
+        if (pending.update()) {
+            idleFrames = 0;
+        } else if (idleFrames < 0xFFFF) {
+            idleFrames++;
+        }
+
+        uint8_t flags = 0;
+        if (idleFrames * PERIOD_MS >= SBUS_OUT_FAILSAFE_MS) {
+            flags = SBUS_FLAG_FAILSAFE;
+            stats.failsafe++;
+        }
+        SBUSOUTFRAME out = pending.read();
+        if (stopped) out.channels[sbusThrottleMap.channel] = sbusMapValue(sbusThrottleMap, 1500);
+        sbusEncode(out.channels, flags, frame);
+
+        if (Serial2.availableForWrite() < SBUS_FRAME_SIZE) {
+            stats.skipped++;
+            return;
+        }
+        Serial2.write(frame, SBUS_FRAME_SIZE);
+        stats.frames++;
+    }
+};
+
+template<uint8_t TX_PIN, uint8_t PERIOD_MS> Handoff<SBUSOUTFRAME> SbusOutput<TX_PIN, PERIOD_MS>::pending;
+template<uint8_t TX_PIN, uint8_t PERIOD_MS> SBUSOUTFRAME SbusOutput<TX_PIN, PERIOD_MS>::latest;
+template<uint8_t TX_PIN, uint8_t PERIOD_MS> uint8_t SbusOutput<TX_PIN, PERIOD_MS>::frame[SBUS_FRAME_SIZE];
+template<uint8_t TX_PIN, uint8_t PERIOD_MS> uint32_t SbusOutput<TX_PIN, PERIOD_MS>::idleFrames = 0;
+template<uint8_t TX_PIN, uint8_t PERIOD_MS> volatile bool SbusOutput<TX_PIN, PERIOD_MS>::stopped = false;
+template<uint8_t TX_PIN, uint8_t PERIOD_MS> SBUSOUTSTATS SbusOutput<TX_PIN, PERIOD_MS>::stats;
+template<uint8_t TX_PIN, uint8_t PERIOD_MS> esp_timer_handle_t SbusOutput<TX_PIN, PERIOD_MS>::timer = NULL;
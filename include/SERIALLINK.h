@@ -0,0 +1,208 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <CANBUS.h>
+
+// Binary command link to a companion computer on the USB serial port (VCU_SERIAL_LINK=1).
+// Frames are COBS encoded, so 0x00 only ever appears as the delimiter, and the VCU writes a
+// delimiter before and after each frame: log text printed in between is cut off and can be
+// told apart by the receiver (it fails the CRC, the host prints it as text). Decoded frame:
+//   [type] [sequence] [payload ...] [CRC-16/CCITT-FALSE over type .. payload, big endian x2]
+// Types:
+//   LINK_CAN     both ways, a CAN frame [flags: 1 extended, 2 rtr] [id x4] [dlc] [data x dlc],
+//                so commands, paths and status frames take exactly the CAN code path
+//   LINK_STATS   VCU -> host once a second [frames x4] [CRC errors x2] [framing errors x2]
+//                [sequence gaps x2]
+// The decoder is incremental: linkParse() takes any chunk of received bytes and stops after
+// each complete frame. Integer only, shared with the host reference (vcu_host link-*).
+
+#define LINK_CAN              0x01
+#define LINK_STATS            0x02
+
+#define LINK_MAX_FRAME        32          // decoded, header and CRC included
+#define LINK_MAX_ENCODED      (LINK_MAX_FRAME + LINK_MAX_FRAME / 254 + 3)
+#define LINK_FLAG_EXTENDED    0x01
+#define LINK_FLAG_RTR         0x02
+
+struct LINKRX {
+  uint8_t frame[LINK_MAX_FRAME];
+  uint8_t length;                 // decoded bytes so far
+  uint8_t left;                   // bytes left in the current COBS block, 0 = next is a code byte
+  uint8_t code;                   // code byte of the current block
+  bool started;
+  bool overflow;
+  uint8_t sequence;               // of the last good frame
+  uint32_t frames;
+  uint16_t crcErrors;
+  uint16_t framingErrors;         // truncated or oversized frames
+  uint16_t gaps;                  // frames lost going by the sequence numbers
+};
+
+// CRC-16/CCITT-FALSE, nibble table
+static const uint16_t _link_crc_table[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+
+//==================================================================================//
+
+inline uint16_t linkCrc(const uint8_t* data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc = (crc << 4) ^ _link_crc_table[(crc >> 12) ^ (data[i] >> 4)];
+    crc = (crc << 4) ^ _link_crc_table[(crc >> 12) ^ (data[i] & 0x0F)];
+  }
+  return crc;
+}
+
+inline void linkRxReset(LINKRX& rx) {
+  rx.length = 0;
+  rx.left = 0;
+  rx.code = 0;
+  rx.started = false;
+  rx.overflow = false;
+}
+
+// frame complete at a delimiter: COBS, length and CRC checked, counters updated
+inline bool linkRxEnd(LINKRX& rx) {
+  bool empty = !rx.started;
+  bool framed = rx.started && rx.left == 0 && !rx.overflow && rx.length >= 4;
+  bool good = framed && linkCrc(rx.frame, rx.length - 2) == ((rx.frame[rx.length - 2] << 8) | rx.frame[rx.length - 1]);
+
+  if (good) {
+    uint8_t expected = rx.sequence + 1;
+    if (rx.frames > 0 && rx.frame[1] != expected) rx.gaps += (uint8_t)(rx.frame[1] - expected);
+    rx.sequence = rx.frame[1];
+    rx.frames++;
+    rx.length -= 2;
+  } else if (!empty) {
+    if (framed) rx.crcErrors++;
+    else rx.framingErrors++;
+  }
+
+  uint8_t length = rx.length;
+  linkRxReset(rx);
+  rx.length = good ? length : 0;
+  return good;
+}
+
+// consumes bytes up to and including the end of the next good frame, which is then in
+// rx.frame[0 .. rx.length) without the CRC until the next call; returns the bytes consumed
+inline size_t linkParse(LINKRX& rx, const uint8_t* data, size_t size, bool& complete) {
+  complete = false;
+  for (size_t i = 0; i < size; i++) {
+    uint8_t b = data[i];
+    if (b == 0) {
+      if (linkRxEnd(rx)) {
+        complete = true;
+        return i + 1;
+      }
+      continue;
+    }
+
+    // first byte after a completed frame starts a new one
+    if (!rx.started) rx.length = 0;
+
+    if (rx.left == 0) {
+      // code byte: the previous block ended in a zero unless it was a full 254 byte block
+      if (rx.started && rx.code != 0xFF) {
+        if (rx.length < LINK_MAX_FRAME) rx.frame[rx.length++] = 0;
+        else rx.overflow = true;
+      }
+      rx.started = true;
+      rx.code = b;
+      rx.left = b - 1;
+    } else {
+      if (rx.length < LINK_MAX_FRAME) rx.frame[rx.length++] = b;
+      else rx.overflow = true;
+      rx.left--;
+    }
+  }
+  return size;
+}
+
+
+//==================================================================================//
+
+// COBS with a delimiter on both sides, returns the encoded size
+inline size_t linkEncode(uint8_t* out, const uint8_t* frame, size_t length) {
+  size_t n = 0;
+  out[n++] = 0;
+  size_t codeAt = n++;
+  uint8_t code = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (frame[i] == 0) {
+      out[codeAt] = code;
+      codeAt = n++;
+      code = 1;
+    } else {
+      out[n++] = frame[i];
+      if (++code == 0xFF) {
+        out[codeAt] = code;
+        codeAt = n++;
+        code = 1;
+      }
+    }
+  }
+  out[codeAt] = code;
+  out[n++] = 0;
+  return n;
+}
+
+// header, payload and CRC, COBS encoded into out (LINK_MAX_ENCODED bytes)
+inline size_t linkFrame(uint8_t* out, uint8_t type, uint8_t sequence, const uint8_t* payload, uint8_t length) {
+  uint8_t frame[LINK_MAX_FRAME];
+  if (length > LINK_MAX_FRAME - 4) return 0;
+  frame[0] = type;
+  frame[1] = sequence;
+  for (uint8_t i = 0; i < length; i++) frame[2 + i] = payload[i];
+  uint16_t crc = linkCrc(frame, 2 + length);
+  frame[2 + length] = crc >> 8;
+  frame[3 + length] = crc & 0xFF;
+  return linkEncode(out, frame, 4 + length);
+}
+
+inline size_t linkCanFrame(uint8_t* out, uint8_t sequence, uint32_t id, bool extended, bool rtr,
+                           const uint8_t* data, uint8_t dlc) {
+  uint8_t payload[14];
+  dlc = dlc > 8 ? 8 : dlc;
+  payload[0] = (extended ? LINK_FLAG_EXTENDED : 0) | (rtr ? LINK_FLAG_RTR : 0);
+  payload[1] = id >> 24;
+  payload[2] = (id >> 16) & 0xFF;
+  payload[3] = (id >> 8) & 0xFF;
+  payload[4] = id & 0xFF;
+  payload[5] = dlc;
+  uint8_t length = rtr ? 0 : dlc;
+  for (uint8_t i = 0; i < length; i++) payload[6 + i] = data[i];
+  return linkFrame(out, LINK_CAN, sequence, payload, 6 + length);
+}
+
+inline size_t linkStatsFrame(uint8_t* out, uint8_t sequence, const LINKRX& rx) {
+  uint8_t payload[10] = {
+    (uint8_t)(rx.frames >> 24), (uint8_t)(rx.frames >> 16), (uint8_t)(rx.frames >> 8), (uint8_t)rx.frames,
+    (uint8_t)(rx.crcErrors >> 8), (uint8_t)rx.crcErrors,
+    (uint8_t)(rx.framingErrors >> 8), (uint8_t)rx.framingErrors,
+    (uint8_t)(rx.gaps >> 8), (uint8_t)rx.gaps
+  };
+  return linkFrame(out, LINK_STATS, sequence, payload, sizeof(payload));
+}
+
+// a received LINK_CAN frame as if it came from the CAN controller
+inline bool linkToCan(const LINKRX& rx, CANRECIEVER& msg) {
+  if (rx.length < 8 || rx.frame[0] != LINK_CAN) return false;
+  const uint8_t* p = rx.frame + 2;
+  uint8_t dlc = p[5];
+  bool rtr = p[0] & LINK_FLAG_RTR;
+  if (dlc > 8 || rx.length != 8 + (rtr ? 0 : dlc)) return false;
+
+  msg = CANRECIEVER();
+  msg.recieved = true;
+  msg.extended = p[0] & LINK_FLAG_EXTENDED;
+  msg.rtr = rtr;
+  msg.id = ((uint32_t)p[1] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 8) | p[4];
+  if (rtr) msg.reqLength = dlc;
+  else canDecode(msg, p + 6, dlc);
+  return true;
+}
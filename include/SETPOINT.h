@@ -0,0 +1,254 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Timed setpoint queue (drive mode 5). The master streams a throttle/steering trajectory
+// ahead of time; the control task plays it back at its own rate, interpolating between the
+// setpoints, so the timing of the CAN frames no longer shows up at the actuators. Integer
+// only, the same code runs in the host simulation (vcu_host sim-setpoint).
+//
+// Setpoint frame (id SETPOINT_CAN_BASE + CANBUS_ID), two setpoints per frame:
+//   [0]     bit7 = start of a new trajectory (drops what is queued), bit6 = last frame of it,
+//           bits0-5 = frame sequence
+//   [1..2]  time of the first setpoint, ms since the trajectory start (uint16, big endian)
+//   [3]     ms from the first to the second setpoint, 0 = the frame holds only the first
+//   [4..5]  first setpoint, [6..7] second: throttle offset from 1500 us in 2 us steps (9 bit
+//           signed, bits 15-7) and steering offset from 90 degrees (7 bit signed, bits 6-0),
+//           26 - 153 degrees, more than the servo's 30 - 150
+// The trajectory starts SETPOINT_LEAD_MS after its start frame arrived, the lead absorbs
+// the bus delay of the following frames. When the queue runs dry before the last setpoint
+// the output holds for SETPOINT_HOLD_MS (a late frame), then ramps the throttle to neutral.
+// After the last setpoint the throttle ramps to neutral right away, the steering stays.
+
+#define SETPOINT_CAN_BASE       0x300
+#define SETPOINT_QUEUE          64          // power of two, 0.64 s at 10 ms spacing
+#define SETPOINT_LEAD_MS        40
+#define SETPOINT_HOLD_MS        50
+#define SETPOINT_RAMP_US        2           // throttle us per ms back to neutral, underrun and end
+#define SETPOINT_FLAG_START     0x80
+#define SETPOINT_FLAG_END       0x40
+#define SETPOINT_SEQUENCE_MASK  0x3F
+#define SETPOINT_STEERING_CENTER 90
+
+enum setpoint_state_enum{
+  SETPOINT_IDLE = 0,                  // nothing queued
+  SETPOINT_WAITING,                   // queued, first setpoint still ahead
+  SETPOINT_RUNNING,                   // interpolating
+  SETPOINT_HOLD,                      // queue dry, holding the last setpoint
+  SETPOINT_FALLBACK,                  // underrun, throttle ramping to neutral
+  SETPOINT_DONE                       // past the last setpoint, throttle ramping to neutral
+};
+
+struct SETPOINT {
+  int64_t at;                         // local us
+  int16_t throttle;                   // us
+  uint8_t steeringAngle;
+  uint8_t generation;                 // trajectory it belongs to
+  bool last;
+};
+
+// CANBUS task -> control task, single producer, single consumer
+struct SETPOINTQUEUE {
+  SETPOINT items[SETPOINT_QUEUE];
+  std::atomic<uint8_t> head;          // producer
+  std::atomic<uint8_t> tail;          // consumer
+  std::atomic<uint8_t> generation;    // current trajectory, older entries are skipped
+};
+
+// producer side
+struct SETPOINTRX {
+  bool open;                          // a trajectory has started
+  int64_t start;                      // local us of trajectory time 0
+  uint32_t lastMs;                    // trajectory time of the newest queued setpoint
+  bool queued;
+  uint8_t sequence;
+  uint8_t generation;
+  uint32_t lost;                      // frames missing going by the sequence
+  uint32_t late;                      // setpoints already due on arrival
+  uint32_t overflows;
+};
+
+// consumer side
+struct SETPOINTPLAYER {
+  uint8_t generation;
+  bool started;
+  SETPOINT previous;
+  uint8_t state;
+  int16_t throttle;                   // output
+  uint8_t steeringAngle;
+  uint32_t underruns;
+};
+
+
+//==================================================================================//
+
+inline void setpointUnpack(const uint8_t* data, int16_t& throttle, uint8_t& steeringAngle) {
+  uint16_t v = (data[0] << 8) | data[1];
+  int16_t offset = (int16_t)(v >> 7);
+  if (offset & 0x100) offset -= 0x200;
+  throttle = 1500 + 2 * offset;
+  int8_t steering = v & 0x7F;
+  if (steering & 0x40) steering -= 0x80;
+  steeringAngle = SETPOINT_STEERING_CENTER + steering;
+}
+
+inline void setpointPack(uint8_t* data, int16_t throttle, uint8_t steeringAngle) {
+  int16_t offset = (throttle - 1500) / 2;
+  offset = offset < -256 ? -256 : (offset > 255 ? 255 : offset);
+  int16_t steering = steeringAngle - SETPOINT_STEERING_CENTER;
+  steering = steering < -64 ? -64 : (steering > 63 ? 63 : steering);
+  uint16_t v = ((uint16_t)(offset & 0x1FF) << 7) | (steering & 0x7F);
+  data[0] = v >> 8;
+  data[1] = v & 0xFF;
+}
+
+// master side of a frame, shared with the host tools
+inline void setpointFrame(uint8_t data[8], uint8_t flags, uint8_t sequence, uint16_t timeMs, uint8_t intervalMs,
+                          int16_t throttle0, uint8_t steering0, int16_t throttle1, uint8_t steering1) {
+  data[0] = flags | (sequence & SETPOINT_SEQUENCE_MASK);
+  data[1] = timeMs >> 8;
+  data[2] = timeMs & 0xFF;
+  data[3] = intervalMs;
+  setpointPack(data + 4, throttle0, steering0);
+  setpointPack(data + 6, throttle1, steering1);
+}
+
+inline void setpointBegin(SETPOINTQUEUE& queue, SETPOINTRX& rx, SETPOINTPLAYER& player) {
+  queue.head.store(0);
+  queue.tail.store(0);
+  queue.generation.store(0);
+  rx = SETPOINTRX();
+  player = SETPOINTPLAYER();
+  player.throttle = 1500;
+  player.steeringAngle = 90;
+}
+
+inline bool setpointPush(SETPOINTQUEUE& queue, SETPOINTRX& rx, const SETPOINT& setpoint) {
+  uint8_t head = queue.head.load(std::memory_order_relaxed);
+  uint8_t next = (head + 1) & (SETPOINT_QUEUE - 1);
+  if (next == queue.tail.load(std::memory_order_acquire)) {
+    rx.overflows++;
+    return false;
+  }
+  queue.items[head] = setpoint;
+  queue.head.store(next, std::memory_order_release);
+  return true;
+}
+
+// CANBUS task: one setpoint frame received at local time 'now', true if anything was queued
+inline bool setpointReceive(SETPOINTQUEUE& queue, SETPOINTRX& rx, const uint8_t* data, uint8_t length, int64_t now) {
+  if (length < 8) return false;
+  uint8_t sequence = data[0] & SETPOINT_SEQUENCE_MASK;
+
+  if (data[0] & SETPOINT_FLAG_START) {
+    rx.open = true;
+    rx.start = now + SETPOINT_LEAD_MS * 1000LL;
+    rx.queued = false;
+    rx.generation++;
+    queue.generation.store(rx.generation, std::memory_order_release);
+  } else if (!rx.open) {
+    return false;
+  } else if (sequence != ((rx.sequence + 1) & SETPOINT_SEQUENCE_MASK)) {
+    rx.lost += (sequence - rx.sequence - 1) & SETPOINT_SEQUENCE_MASK;
+  }
+  rx.sequence = sequence;
+
+  uint16_t first = (data[1] << 8) | data[2];
+  uint8_t count = data[3] ? 2 : 1;
+  bool pushed = false;
+  for (uint8_t i = 0; i < count; i++) {
+    // trajectory time, unwrapped against the newest setpoint
+    uint16_t ms16 = first + i * data[3];
+    uint32_t ms = rx.queued ? rx.lastMs + (int16_t)(ms16 - (uint16_t)rx.lastMs) : ms16;
+    if (rx.queued && (int32_t)(ms - rx.lastMs) <= 0) continue;      // repeated or out of order
+
+    SETPOINT setpoint;
+    setpoint.at = rx.start + ms * 1000LL;
+    setpointUnpack(data + 4 + 2 * i, setpoint.throttle, setpoint.steeringAngle);
+    setpoint.generation = rx.generation;
+    setpoint.last = (data[0] & SETPOINT_FLAG_END) && i == count - 1;
+    if (setpoint.at <= now) rx.late++;
+
+    if (setpointPush(queue, rx, setpoint)) {
+      rx.lastMs = ms;
+      rx.queued = true;
+      pushed = true;
+    }
+  }
+  if (data[0] & SETPOINT_FLAG_END) rx.open = false;
+  return pushed;
+}
+
+
+//==================================================================================//
+
+// a + (b - a) * into / span, rounded to nearest
+inline int32_t setpointLerp(int32_t a, int32_t b, int64_t into, int64_t span) {
+  int64_t scaled = (int64_t)(b - a) * into;
+  return a + (int32_t)((scaled >= 0 ? scaled + span / 2 : scaled - span / 2) / span);
+}
+
+// throttle moved toward neutral by 'ramp' us, never past it
+inline int16_t setpointRamp(int16_t throttle, int32_t ramp) {
+  int32_t offset = throttle - 1500;
+  offset = offset > 0 ? (offset > ramp ? offset - ramp : 0) : (-offset > ramp ? offset + ramp : 0);
+  return 1500 + offset;
+}
+
+// control task: output for local time 'now' in player.throttle / player.steeringAngle
+inline uint8_t setpointSample(SETPOINTQUEUE& queue, SETPOINTPLAYER& player, int64_t now) {
+  uint8_t generation = queue.generation.load(std::memory_order_acquire);
+  if (generation != player.generation) {
+    player.generation = generation;
+    player.started = false;
+  }
+
+  // consume everything that is due, skipping what is left of older trajectories
+  const SETPOINT* next = NULL;
+  uint8_t tail = queue.tail.load(std::memory_order_relaxed);
+  while (tail != queue.head.load(std::memory_order_acquire)) {
+    const SETPOINT& front = queue.items[tail];
+    if (front.generation == generation && front.at > now) {
+      next = &front;
+      break;
+    }
+    if (front.generation == generation) {
+      player.previous = front;
+      player.started = true;
+    }
+    tail = (tail + 1) & (SETPOINT_QUEUE - 1);
+    queue.tail.store(tail, std::memory_order_release);
+  }
+
+  if (!player.started) {
+    player.state = next ? SETPOINT_WAITING : SETPOINT_IDLE;
+    return player.state;
+  }
+
+  const SETPOINT& previous = player.previous;
+  if (next) {
+    int64_t span = next->at - previous.at;
+    int64_t into = now - previous.at;
+    player.throttle = setpointLerp(previous.throttle, next->throttle, into, span);
+    player.steeringAngle = setpointLerp(previous.steeringAngle, next->steeringAngle, into, span);
+    player.state = SETPOINT_RUNNING;
+    return player.state;
+  }
+
+  player.steeringAngle = previous.steeringAngle;
+  int64_t dry = now - previous.at;
+  if (previous.last) {
+    // nothing follows the trajectory, no reason to hold its last throttle
+    player.throttle = setpointRamp(previous.throttle, (int32_t)(dry / 1000 * SETPOINT_RAMP_US));
+    player.state = SETPOINT_DONE;
+  } else if (dry <= SETPOINT_HOLD_MS * 1000LL) {
+    player.throttle = previous.throttle;
+    player.state = SETPOINT_HOLD;
+  } else {
+    if (player.state != SETPOINT_FALLBACK) player.underruns++;
+    player.throttle = setpointRamp(previous.throttle, (int32_t)((dry / 1000 - SETPOINT_HOLD_MS) * SETPOINT_RAMP_US));
+    player.state = SETPOINT_FALLBACK;
+  }
+  return player.state;
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+// Linux SocketCAN backend with the same interface as the Arduino CAN library, so
+// CANBUS.h runs unchanged in a host process (build with -DCAN_BACKEND_SOCKETCAN).
+// Reception and transmission are batched with recvmmsg/sendmmsg. Receive time stamps come from
+// the kernel (SO_TIMESTAMPNS, CLOCK_REALTIME) and are moved to CLOCK_MONOTONIC, the timebase of
+// the host esp_timer_get_time().
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SOCKETCAN_BATCH
+#define SOCKETCAN_BATCH 32      // frames per recvmmsg/sendmmsg call
+#endif
+
+struct SOCKETCANSTATS {
+    uint64_t framesRx;
+    uint64_t framesTx;
+    uint64_t batchesRx;         // recvmmsg calls that returned frames
+    uint64_t batchesTx;         // sendmmsg calls
+    uint64_t txDropped;         // frames the kernel did not accept
+};
+
+class SocketCANClass {
+  public:
+    SocketCANClass() : _fd(-1), _rxCount(0), _rxIndex(0), _txCount(0), _txOpen(false), _readIndex(0) {
+        strcpy(_ifname, "vcan0");
+        memset(&_stats, 0, sizeof(_stats));
+        memset(&_rxFrame, 0, sizeof(_rxFrame));
+    }
+
+    void setInterface(const char* ifname) {
+        snprintf(_ifname, sizeof(_ifname), "%s", ifname);
+    }
+
+    // no pins on a host
+    void setPins(int rx, int tx) { (void)rx; (void)tx; }
+
+    // the bit rate belongs to the interface (ip link set ... bitrate), it is ignored here
+    int begin(long baudRate) {
+        (void)baudRate;
+        _fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+        if (_fd < 0) return 0;
+
+        struct ifreq ifr;
+        memset(&ifr, 0, sizeof(ifr));
+        snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", _ifname);
+        if (ioctl(_fd, SIOCGIFINDEX, &ifr) < 0) {
+            end();
+            return 0;
+        }
+
+        int on = 1;
+        setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+
+        struct sockaddr_can addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = ifr.ifr_ifindex;
+        if (bind(_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            end();
+            return 0;
+        }
+        return 1;
+    }
+
+    void end() {
+        if (_fd >= 0) close(_fd);
+        _fd = -1;
+    }
+
+    //==================================================================================//
+
+    int beginPacket(int id, int dlc = -1, bool rtr = false) {
+        if (id < 0 || id > 0x7FF) return 0;
+        return openFrame(id, dlc, rtr);
+    }
+
+    int beginExtendedPacket(long id, int dlc = -1, bool rtr = false) {
+        if (id < 0 || id > 0x1FFFFFFF) return 0;
+        return openFrame((canid_t)id | CAN_EFF_FLAG, dlc, rtr);
+    }
+
+    size_t write(uint8_t byte) { return write(&byte, 1); }
+
+    size_t write(const uint8_t* buffer, size_t size) {
+        if (!_txOpen) return 0;
+        struct can_frame& frame = _tx[_txCount];
+        if (size > (size_t)(CAN_MAX_DLEN - frame.can_dlc)) size = CAN_MAX_DLEN - frame.can_dlc;
+        memcpy(&frame.data[frame.can_dlc], buffer, size);
+        frame.can_dlc += size;
+        return size;
+    }
+
+    // queues the frame, it goes out with the next full batch or flush()
+    int endPacket() {
+        if (!_txOpen) return 0;
+        _txOpen = false;
+        if (_txDlc >= 0) _tx[_txCount].can_dlc = _txDlc;
+        _txCount++;
+        if (_txCount == SOCKETCAN_BATCH) flush();
+        return 1;
+    }
+
+    // sendmmsg all queued frames, returns the number the kernel accepted
+    int flush() {
+        if (_txCount == 0 || _fd < 0) return 0;
+
+        struct mmsghdr msgs[SOCKETCAN_BATCH];
+        struct iovec iovs[SOCKETCAN_BATCH];
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < _txCount; i++) {
+            iovs[i].iov_base = &_tx[i];
+            iovs[i].iov_len = sizeof(struct can_frame);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int sent = sendmmsg(_fd, msgs, _txCount, 0);
+        if (sent < 0) sent = 0;
+        _stats.batchesTx++;
+        _stats.framesTx += sent;
+        _stats.txDropped += _txCount - sent;
+        _txCount = 0;
+        return sent;
+    }
+
+    //==================================================================================//
+
+    // returns the dlc of the next frame, 0 if nothing is pending (same as the Arduino library)
+    int parsePacket() {
+        if (_rxIndex == _rxCount && fill() == 0) return 0;
+
+        const struct can_frame& frame = _rx[_rxIndex];
+        _rxFrame = frame;
+        _rxStamp = _rxStamps[_rxIndex];
+        _rxIndex++;
+        _readIndex = 0;
+        return _rxFrame.can_dlc;
+    }
+
+    long packetId() { return _rxFrame.can_id & (packetExtended() ? CAN_EFF_MASK : CAN_SFF_MASK); }
+    bool packetExtended() { return _rxFrame.can_id & CAN_EFF_FLAG; }
+    bool packetRtr() { return _rxFrame.can_id & CAN_RTR_FLAG; }
+    int packetDlc() { return _rxFrame.can_dlc; }
+
+    // kernel receive time of the current packet, ns on CLOCK_MONOTONIC, 0 = not stamped
+    int64_t packetTimestamp() { return _rxStamp; }
+
+    int available() { return packetRtr() ? 0 : _rxFrame.can_dlc - _readIndex; }
+    int read() { return available() ? _rxFrame.data[_readIndex++] : -1; }
+    int peek() { return available() ? _rxFrame.data[_readIndex] : -1; }
+
+    // blocks until a frame is pending or the timeout expires, the host stand-in for vTaskDelay
+    bool waitForPacket(int timeoutMs) {
+        if (_rxIndex < _rxCount) return true;
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        return poll(&pfd, 1, timeoutMs) > 0;
+    }
+
+    const SOCKETCANSTATS& stats() const { return _stats; }
+
+  private:
+    int openFrame(canid_t id, int dlc, bool rtr) {
+        if (_fd < 0 || dlc > CAN_MAX_DLEN) return 0;
+        struct can_frame& frame = _tx[_txCount];
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = id | (rtr ? CAN_RTR_FLAG : 0);
+        _txDlc = dlc;
+        _txOpen = true;
+        return 1;
+    }
+
+    // recvmmsg as many frames as are waiting, without blocking
+    int fill() {
+        if (_fd < 0) return 0;
+
+        struct mmsghdr msgs[SOCKETCAN_BATCH];
+        struct iovec iovs[SOCKETCAN_BATCH];
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < SOCKETCAN_BATCH; i++) {
+            iovs[i].iov_base = &_rx[i];
+            iovs[i].iov_len = sizeof(struct can_frame);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = _control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(_control[i]);
+        }
+
+        int count = recvmmsg(_fd, msgs, SOCKETCAN_BATCH, MSG_DONTWAIT, NULL);
+        if (count <= 0) {
+            _rxCount = _rxIndex = 0;
+            return 0;
+        }
+
+        // realtime stamps to the monotonic clock, one offset per batch
+        struct timespec realtime, monotonic;
+        clock_gettime(CLOCK_REALTIME, &realtime);
+        clock_gettime(CLOCK_MONOTONIC, &monotonic);
+        int64_t offset = (int64_t)(realtime.tv_sec - monotonic.tv_sec) * 1000000000LL + realtime.tv_nsec - monotonic.tv_nsec;
+
+        for (int i = 0; i < count; i++) {
+            _rxStamps[i] = 0;
+            for (struct cmsghdr* c = CMSG_FIRSTHDR(&msgs[i].msg_hdr); c != NULL; c = CMSG_NXTHDR(&msgs[i].msg_hdr, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    _rxStamps[i] = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - offset;
+                }
+            }
+        }
+
+        _stats.batchesRx++;
+        _stats.framesRx += count;
+        _rxCount = count;
+        _rxIndex = 0;
+        return count;
+    }
+
+    char _ifname[IFNAMSIZ];
+    int _fd;
+
+    struct can_frame _rx[SOCKETCAN_BATCH];
+    int64_t _rxStamps[SOCKETCAN_BATCH];
+    char _control[SOCKETCAN_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+    int _rxCount;
+    int _rxIndex;
+
+    struct can_frame _tx[SOCKETCAN_BATCH];
+    int _txCount;
+    int _txDlc;
+    bool _txOpen;
+
+    struct can_frame _rxFrame;      // current packet, consumed with read()
+    int64_t _rxStamp;
+    int _readIndex;
+
+    SOCKETCANSTATS _stats;
+};
+
+extern SocketCANClass CAN;
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+// Static allocation mode (VCU_STATIC_ALLOC=1): task stacks and control blocks are static
+// (xTaskCreateStaticPinnedToCore) and every subsystem lives in fixed buffers listed in one
+// MEMBLOCK table, which is checked against VCU_STATIC_RAM_BUDGET at compile time and printed
+// at boot. When init is done the heap is sealed; from then on a new live allocation or a drop
+// of the minimum free heap (a transient one) is reported on Serial and in the memory
+// diagnostics record. Without the mode the same report runs, tasks are created on the heap.
+
+#ifndef VCU_STATIC_ALLOC
+#define VCU_STATIC_ALLOC        0
+#endif
+
+#ifndef VCU_STATIC_RAM_BUDGET
+#define VCU_STATIC_RAM_BUDGET   40960     // bytes, all MEMBLOCK entries together
+#endif
+
+struct MEMBLOCK {
+    const char* name;
+    uint32_t bytes;
+};
+
+// stack (bytes on the ESP32 port) and control block of a task, empty unless static
+template<uint32_t STACK_SIZE>
+struct TASKMEMORY {
+#if VCU_STATIC_ALLOC
+    StackType_t stack[STACK_SIZE];
+    StaticTask_t tcb;
+#endif
+    static const uint32_t bytes = STACK_SIZE + sizeof(StaticTask_t);
+};
+
+struct MEMSEAL {
+    bool sealed;
+    size_t blocks;            // allocated heap blocks at seal time
+    size_t allocated;         // allocated heap bytes at seal time
+    size_t minimumFree;       // lowest free heap seen at seal time
+    int32_t lastBlocks;       // growth already reported
+    int32_t lastBytes;
+    uint32_t violations;      // checks that found new heap growth since the seal
+};
+
+static MEMSEAL _mem_seal;
+
+
+//==================================================================================//
+
+constexpr uint32_t memTotal(const MEMBLOCK* blocks, size_t count) {
+    return count == 0 ? 0 : blocks[0].bytes + memTotal(blocks + 1, count - 1);
+}
+
+template<uint32_t STACK_SIZE>
+TaskHandle_t memCreateTask(TaskFunction_t function, const char* name, TASKMEMORY<STACK_SIZE>& memory,
+                           UBaseType_t priority, BaseType_t core) {
+#if VCU_STATIC_ALLOC
+    return xTaskCreateStaticPinnedToCore(function, name, STACK_SIZE, NULL, priority, memory.stack, &memory.tcb, core);
+#else
+    (void)memory;
+    TaskHandle_t handle = NULL;
+    xTaskCreatePinnedToCore(function, name, STACK_SIZE, NULL, priority, &handle, core);
+    return handle;
+#endif
+}
+
+void memReport(const MEMBLOCK* blocks, size_t count) {
+    Serial.println(VCU_STATIC_ALLOC ? "Static RAM (static allocation mode):" : "Static RAM (task stacks on heap):");
+    for (size_t i = 0; i < count; i++) {
+        Serial.printf("  %-28s %6u\n", blocks[i].name, (unsigned)blocks[i].bytes);
+    }
+    Serial.printf("  %-28s %6u of %u\n", "total", (unsigned)memTotal(blocks, count), (unsigned)VCU_STATIC_RAM_BUDGET);
+    Serial.printf("Heap: %u free, %u largest block\n", (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                  (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+// end of init: from here on the heap must not grow
+void memSeal() {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+    _mem_seal.blocks = info.allocated_blocks;
+    _mem_seal.allocated = info.total_allocated_bytes;
+    _mem_seal.minimumFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    _mem_seal.lastBlocks = 0;
+    _mem_seal.lastBytes = 0;
+    _mem_seal.violations = 0;
+    _mem_seal.sealed = true;
+    Serial.printf("Heap sealed: %u blocks, %u bytes allocated\n", (unsigned)info.allocated_blocks,
+                  (unsigned)info.total_allocated_bytes);
+}
+
+// heap growth since the seal in blocks and bytes, true (and logged) when it grew since the last check
+bool memCheck(int32_t& blocks, int32_t& bytes) {
+    blocks = 0;
+    bytes = 0;
+    if (!_mem_seal.sealed) return false;
+
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+    blocks = (int32_t)info.allocated_blocks - (int32_t)_mem_seal.blocks;
+    bytes = (int32_t)info.total_allocated_bytes - (int32_t)_mem_seal.allocated;
+    size_t minimumFree = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+    bool grown = blocks > _mem_seal.lastBlocks || bytes > _mem_seal.lastBytes;
+    bool transient = minimumFree < _mem_seal.minimumFree;
+    if (!grown && !transient) return false;
+
+    // report every new high and every new low once
+    _mem_seal.violations++;
+    _mem_seal.lastBlocks = max(blocks, _mem_seal.lastBlocks);
+    _mem_seal.lastBytes = max(bytes, _mem_seal.lastBytes);
+    _mem_seal.minimumFree = minimumFree;
+    Serial.printf("HEAP USE AFTER INIT: %+d blocks, %+d bytes live, minimum free %u\n",
+                  (int)blocks, (int)bytes, (unsigned)minimumFree);
+    return true;
+}
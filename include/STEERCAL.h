@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+// Curvature steering (drive mode 6). The master sends the path curvature it wants, the VCU
+// turns it into a servo angle through a per-vehicle calibration table, so masters no longer
+// need to know the servo linkage. One branch per direction (linkages are rarely symmetric),
+// each STEERCAL_POINTS servo offsets at evenly spaced curvatures from straight ahead to the
+// steering limit, linearly interpolated. The lookup is integer only, the same code runs in
+// the host reference (vcu_host steercal).
+//
+// Curvature is in 1/km (= milli 1/m, 1 / turn radius), positive = left, as int16 in bytes
+// [4..5] of a mode 6 drive command (big endian, where the status frame has the voltage).
+// Servo offsets are centidegrees from centerSteeringAngle, signed, the sign is the servo
+// direction.
+//
+// The built-in table is precomputed at boot from the vehicle geometry (bicycle model,
+// tan delta = wheelbase * curvature, times the linkage ratio of each side), once and in
+// floating point, so it is exact at the points. A measured table
+// replaces it at runtime with calibration frames (id STEERCAL_CAN_BASE + CANBUS_ID):
+//   [0]     bit7 = right branch, bit6 = commit (check and apply everything loaded since the
+//           last commit), bits0-5 = index of the first point
+//   [1..2]  curvature step between points of this branch, 1/km (uint16, big endian)
+//   [3..4]  servo offset of point index, [5..6] of point index + 1 (int16, big endian)
+//   [7]     points in this frame, 1 or 2
+// A branch is taken over only complete and monotonic, with both branches meeting at the same
+// center offset; otherwise the commit is rejected and the previous table stays.
+
+#define STEERCAL_CAN_BASE     0x400
+#define STEERCAL_POINTS       17
+#define STEERCAL_MAX_OFFSET   9000        // centidegrees
+#define STEERCAL_FLAG_RIGHT   0x80
+#define STEERCAL_FLAG_COMMIT  0x40
+#define STEERCAL_INDEX_MASK   0x3F
+#define STEERCAL_LEFT         0
+#define STEERCAL_RIGHT        1
+
+struct STEERBRANCH {
+    uint16_t step;                          // 1/km between points
+    int16_t servo[STEERCAL_POINTS];         // centidegrees from center
+};
+
+struct STEERCAL {
+    STEERBRANCH branch[2];                  // STEERCAL_LEFT, STEERCAL_RIGHT
+    uint8_t id;                             // increments with every table taken over
+};
+
+// built-in table
+struct STEERGEOMETRY {
+    int32_t wheelbase;                      // mm
+    uint16_t maxCurvature;                  // 1/km, at the steering limit
+    int32_t linkage[2];                     // servo degrees per wheel degree, Q8, left / right
+    int8_t direction;                       // -1 if steering left means servo angles below center
+};
+
+// CANBUS side of the calibration frames
+struct STEERCALRX {
+    STEERCAL building;
+    uint32_t received[2];                   // bit per point loaded since the last commit
+    uint16_t loaded;
+    uint16_t rejected;
+};
+
+
+//==================================================================================//
+
+// built-in table from the geometry, at boot
+inline void steerCalDefault(STEERCAL& cal, const STEERGEOMETRY& geometry) {
+    uint16_t step = (geometry.maxCurvature + STEERCAL_POINTS - 2) / (STEERCAL_POINTS - 1);
+    for (uint8_t side = 0; side < 2; side++) {
+        int32_t sign = (side == STEERCAL_LEFT ? 1 : -1) * geometry.direction;
+        cal.branch[side].step = step;
+        for (uint8_t i = 0; i < STEERCAL_POINTS; i++) {
+            double wheel = atan(geometry.wheelbase * (double)(i * step) / 1e6) * 18000 / M_PI;      // centidegrees
+            int32_t servo = (int32_t)lround(wheel * geometry.linkage[side] / 256);
+            if (servo > STEERCAL_MAX_OFFSET) servo = STEERCAL_MAX_OFFSET;
+            cal.branch[side].servo[i] = (int16_t)(sign * servo);
+        }
+    }
+    cal.id = 0;
+}
+
+// servo offset for a curvature, centidegrees; beyond the last point the branch saturates
+inline int32_t steerCalServo(const STEERCAL& cal, int32_t curvature, bool& saturated) {
+    const STEERBRANCH& branch = cal.branch[curvature >= 0 ? STEERCAL_LEFT : STEERCAL_RIGHT];
+    uint32_t k = curvature >= 0 ? curvature : -curvature;
+    uint32_t last = (uint32_t)branch.step * (STEERCAL_POINTS - 1);
+    saturated = k > last;
+    if (saturated || branch.step == 0) return branch.servo[STEERCAL_POINTS - 1];
+
+    uint32_t i = k / branch.step;
+    if (i >= STEERCAL_POINTS - 1) return branch.servo[STEERCAL_POINTS - 1];
+    int32_t scaled = (branch.servo[i + 1] - branch.servo[i]) * (int32_t)(k - i * branch.step);
+    int32_t half = branch.step / 2;
+    return branch.servo[i] + (scaled >= 0 ? scaled + half : scaled - half) / (int32_t)branch.step;
+}
+
+// centidegree offset to whole servo degrees, rounded
+inline int32_t steerCalDegrees(int32_t offset) {
+    return offset >= 0 ? (offset + 50) / 100 : (offset - 50) / 100;
+}
+
+// complete, within range and moving away from the center without turning back
+inline bool steerCalValid(const STEERBRANCH& branch) {
+    if (branch.step == 0) return false;
+    int32_t direction = branch.servo[STEERCAL_POINTS - 1] - branch.servo[0];
+    for (uint8_t i = 0; i < STEERCAL_POINTS; i++) {
+        if (branch.servo[i] > STEERCAL_MAX_OFFSET || branch.servo[i] < -STEERCAL_MAX_OFFSET) return false;
+        if (i > 0 && (int32_t)(branch.servo[i] - branch.servo[i - 1]) * direction < 0) return false;
+    }
+    return true;
+}
+
+
+//==================================================================================//
+
+// master side of a frame, shared with the host tools
+inline void steerCalFrame(uint8_t data[8], uint8_t side, bool commit, uint8_t index, const STEERBRANCH& branch) {
+    uint8_t count = index + 1 < STEERCAL_POINTS ? 2 : 1;
+    int16_t second = count == 2 ? branch.servo[index + 1] : 0;
+    data[0] = (side == STEERCAL_RIGHT ? STEERCAL_FLAG_RIGHT : 0) | (commit ? STEERCAL_FLAG_COMMIT : 0) |
+              (index & STEERCAL_INDEX_MASK);
+    data[1] = branch.step >> 8;
+    data[2] = branch.step & 0xFF;
+    data[3] = (uint16_t)branch.servo[index] >> 8;
+    data[4] = (uint16_t)branch.servo[index] & 0xFF;
+    data[5] = (uint16_t)second >> 8;
+    data[6] = (uint16_t)second & 0xFF;
+    data[7] = count;
+}
+
+inline void steerCalRxBegin(STEERCALRX& rx, const STEERCAL& current) {
+    rx.building = current;
+    rx.received[0] = rx.received[1] = 0;
+    rx.loaded = 0;
+    rx.rejected = 0;
+}
+
+// collects calibration frames on top of 'current', returns true when a commit was taken
+// over into 'current'
+inline bool steerCalReceive(STEERCALRX& rx, STEERCAL& current, const uint8_t* data, uint8_t length) {
+    if (length < 8) return false;
+    uint8_t side = (data[0] & STEERCAL_FLAG_RIGHT) ? STEERCAL_RIGHT : STEERCAL_LEFT;
+    uint8_t index = data[0] & STEERCAL_INDEX_MASK;
+    uint8_t count = data[7];
+    STEERBRANCH& branch = rx.building.branch[side];
+
+    if (count >= 1 && count <= 2 && index + count <= STEERCAL_POINTS) {
+        if (index == 0) rx.received[side] = 0;      // branch sent again from the start
+        branch.step = (data[1] << 8) | data[2];
+        branch.servo[index] = (int16_t)((data[3] << 8) | data[4]);
+        if (count == 2) branch.servo[index + 1] = (int16_t)((data[5] << 8) | data[6]);
+        rx.received[side] |= ((1UL << count) - 1) << index;
+    }
+    if (!(data[0] & STEERCAL_FLAG_COMMIT)) return false;
+
+    // a branch that was touched has to be complete, the other one stays as it is
+    const uint32_t all = (1UL << STEERCAL_POINTS) - 1;
+    bool valid = rx.received[0] || rx.received[1];
+    for (uint8_t s = 0; s < 2; s++) {
+        if (rx.received[s] && (rx.received[s] != all || !steerCalValid(rx.building.branch[s]))) valid = false;
+    }
+    const STEERBRANCH& left = rx.building.branch[STEERCAL_LEFT];
+    const STEERBRANCH& right = rx.building.branch[STEERCAL_RIGHT];
+    int32_t center = left.servo[0];
+    if (right.servo[0] != center) valid = false;
+    if ((int32_t)(left.servo[STEERCAL_POINTS - 1] - center) * (right.servo[STEERCAL_POINTS - 1] - center) >= 0) {
+        valid = false;     // both branches steer the same way
+    }
+
+    rx.received[0] = rx.received[1] = 0;
+    if (!valid) {
+        rx.building = current;
+        rx.rejected++;
+        return false;
+    }
+    rx.building.id = current.id + 1;
+    current = rx.building;
+    rx.loaded++;
+    return true;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stdint.h>
+
+// Time-triggered CAN schedule (VCU_CAN_TT=1) for several VCUs on one bus.
+// The time master (CAN master / test rig PC) sends the reference message at the start of
+// every cycle. Each node takes the end of the reference frame as its time base and
+// transmits only in the slots the shared schedule table gives it, so frames of different
+// nodes never meet in arbitration and the bus latency of every message has a fixed bound.
+//
+//   | ref | cmd 0x15 | status 0x15 | queue 0x15 | cmd 0x16 | ... | arbitration ... |
+//   0     slotUs                                                          cycleUs
+//
+// Reference frame (TT_REFERENCE_ID, from the master): [0] cycle counter
+// Command frames for a node go out on TT_COMMAND_BASE + node ID, the status frame stays on
+// the node ID, queue slots carry the node's other frames (diagnostics) one per slot.
+// A node that misses TT_MAX_MISSED references in a row stops transmitting until the
+// next reference. Everything here is integer logic shared with the host simulation.
+
+#define TT_REFERENCE_ID       0x001     // highest priority frame on the bus
+#define TT_COMMAND_BASE       0x100     // master -> node commands on TT_COMMAND_BASE + node
+#define TT_MASTER             0         // node value of the time master in slot tables
+#define TT_BITRATE            1000000
+#define TT_GUARD_US           60        // slot time beyond the worst case frame, absorbs sync error
+#define TT_MAX_MISSED         2
+#define TT_MAX_SLOTS          64
+
+enum tt_slot_enum{
+  TT_SLOT_REFERENCE = 0,          // master: reference message
+  TT_SLOT_COMMAND,                // master: command to the slot's node
+  TT_SLOT_STATUS,                 // node: status frame
+  TT_SLOT_QUEUE,                  // node: next queued frame (diagnostics)
+  TT_SLOT_ARBITRATION             // free for event traffic (paths, RTR), normal arbitration
+};
+
+struct TTSLOT {
+  uint8_t slot;                   // index in the cycle
+  uint16_t node;                  // VCU CAN ID, TT_MASTER for the master
+  uint8_t kind;                   // TT_SLOT_*
+};
+
+struct TTSCHEDULE {
+  uint32_t cycleUs;
+  uint32_t slotUs;
+  const TTSLOT* slots;
+  uint8_t count;
+};
+
+struct TTSTATE {
+  bool synced;
+  int64_t cycleStart;             // local us of the current cycle start
+  uint8_t cycle;                  // reference cycle counter
+  uint8_t missed;                 // cycles since the last reference
+  uint32_t references;
+  uint32_t lostSync;              // times sync was lost
+  int32_t phaseMax;               // largest |reference arrival - expected|, us
+};
+
+
+//==================================================================================//
+
+// worst case frame length on the wire with bit stuffing and interframe space, us
+// (standard: 34 + 8 dlc bits stuffable, 13 not; extended: 54 + 8 dlc)
+inline uint32_t ttFrameTimeUs(uint8_t dlc, bool extended, uint32_t bitrate) {
+  uint32_t stuffable = (extended ? 54 : 34) + 8 * dlc;
+  uint32_t bits = stuffable + 13 + (stuffable - 1) / 4;
+  return (bits * 1000000UL + bitrate - 1) / bitrate;
+}
+
+inline uint8_t ttSlotCount(const TTSCHEDULE& schedule) {
+  return schedule.slotUs ? schedule.cycleUs / schedule.slotUs : 0;
+}
+
+// schedule errors, each reported through 'report' (may be NULL), returns the error count
+typedef void (*TTREPORT)(const char* message, uint8_t slot, uint16_t node);
+
+inline uint16_t ttValidate(const TTSCHEDULE& schedule, TTREPORT report) {
+  uint16_t errors = 0;
+  uint8_t slots = ttSlotCount(schedule);
+
+#define TT_ERROR(message, slot, node) do { errors++; if (report) report(message, slot, node); } while (0)
+
+  if (schedule.slotUs < ttFrameTimeUs(8, true, TT_BITRATE) + TT_GUARD_US)
+    TT_ERROR("slot shorter than an extended 8 byte frame plus guard", 0, 0);
+  if (slots == 0 || schedule.cycleUs % schedule.slotUs != 0)
+    TT_ERROR("cycle is not a whole number of slots", 0, 0);
+  if (slots > TT_MAX_SLOTS)
+    TT_ERROR("more slots than TT_MAX_SLOTS", 0, 0);
+
+  uint8_t references = 0;
+  for (uint8_t i = 0; i < schedule.count; i++) {
+    const TTSLOT& s = schedule.slots[i];
+    if (s.slot >= slots) TT_ERROR("slot outside the cycle", s.slot, s.node);
+    if (s.kind > TT_SLOT_ARBITRATION) TT_ERROR("unknown slot kind", s.slot, s.node);
+
+    if (s.kind == TT_SLOT_REFERENCE) {
+      references++;
+      if (s.slot != 0 || s.node != TT_MASTER) TT_ERROR("reference must be slot 0 of the master", s.slot, s.node);
+    }
+    if ((s.kind == TT_SLOT_STATUS || s.kind == TT_SLOT_QUEUE) && s.node == TT_MASTER)
+      TT_ERROR("node slot without a node", s.slot, s.node);
+    if (s.kind == TT_SLOT_STATUS && s.node < TT_REFERENCE_ID + 1)
+      TT_ERROR("node ID does not leave the reference the highest priority", s.slot, s.node);
+
+    for (uint8_t j = 0; j < i; j++) {
+      if (schedule.slots[j].slot == s.slot) TT_ERROR("slot used twice", s.slot, s.node);
+    }
+  }
+  if (references != 1) TT_ERROR("schedule needs exactly one reference slot", 0, 0);
+
+  // every node with a command slot also needs a status slot
+  for (uint8_t i = 0; i < schedule.count; i++) {
+    if (schedule.slots[i].kind != TT_SLOT_COMMAND) continue;
+    bool status = false;
+    for (uint8_t j = 0; j < schedule.count; j++) {
+      status |= schedule.slots[j].kind == TT_SLOT_STATUS && schedule.slots[j].node == schedule.slots[i].node;
+    }
+    if (!status) TT_ERROR("node has a command slot but no status slot", schedule.slots[i].slot, schedule.slots[i].node);
+  }
+
+#undef TT_ERROR
+  return errors;
+}
+
+// worst case from a frame being ready to it being completely on the bus, us: waiting for
+// the next slot of that kind (largest gap between two of them) plus the send offset and frame
+inline uint32_t ttLatencyBound(const TTSCHEDULE& schedule, uint16_t node, uint8_t kind) {
+  uint8_t first = 0xFF, previous = 0xFF;
+  uint32_t gap = 0;
+  for (uint8_t slot = 0; slot < ttSlotCount(schedule); slot++) {
+    for (uint8_t i = 0; i < schedule.count; i++) {
+      if (schedule.slots[i].slot != slot || schedule.slots[i].node != node || schedule.slots[i].kind != kind) continue;
+      if (first == 0xFF) first = slot;
+      if (previous != 0xFF && (uint32_t)(slot - previous) * schedule.slotUs > gap) gap = (slot - previous) * schedule.slotUs;
+      previous = slot;
+    }
+  }
+  if (first == 0xFF) return 0;
+  uint32_t wrap = (ttSlotCount(schedule) - previous + first) * schedule.slotUs;
+  if (wrap > gap) gap = wrap;
+  return gap + TT_GUARD_US / 2 + ttFrameTimeUs(8, kind == TT_SLOT_QUEUE, TT_BITRATE);
+}
+
+
+//==================================================================================//
+
+inline void ttReset(TTSTATE& state) {
+  state = TTSTATE();
+}
+
+// reference received, 'at' = local us when its reception completed
+inline void ttOnReference(TTSTATE& state, const TTSCHEDULE& schedule, int64_t at, uint8_t cycle) {
+  int64_t start = at - ttFrameTimeUs(1, false, TT_BITRATE);
+  if (state.synced) {
+    int64_t expected = state.cycleStart + schedule.cycleUs;
+    while (expected + (int64_t)schedule.cycleUs / 2 < start) expected += schedule.cycleUs;
+    int32_t phase = (int32_t)(start - expected);
+    if (phase < 0) phase = -phase;
+    if (phase > state.phaseMax) state.phaseMax = phase;
+  }
+  state.cycleStart = start;
+  state.cycle = cycle;
+  state.missed = 0;
+  state.synced = true;
+  state.references++;
+}
+
+// carries the time base over cycles without a reference, drops sync after TT_MAX_MISSED
+inline void ttAdvance(TTSTATE& state, const TTSCHEDULE& schedule, int64_t now) {
+  while (state.synced && now >= state.cycleStart + (int64_t)schedule.cycleUs * 3 / 2) {
+    state.cycleStart += schedule.cycleUs;
+    state.cycle++;
+    if (++state.missed > TT_MAX_MISSED) {
+      state.synced = false;
+      state.lostSync++;
+    }
+  }
+}
+
+// next transmit time (local us) of one of 'node's own slots (status, queue) at or after 'now',
+// kind of that slot in 'kind'; -1 when not synced or the node has no slot
+inline int64_t ttNextSlot(const TTSTATE& state, const TTSCHEDULE& schedule, uint16_t node, int64_t now, uint8_t& kind) {
+  if (!state.synced) return -1;
+  int64_t best = -1;
+  for (uint8_t i = 0; i < schedule.count; i++) {
+    const TTSLOT& s = schedule.slots[i];
+    if (s.node != node || (s.kind != TT_SLOT_STATUS && s.kind != TT_SLOT_QUEUE)) continue;
+    int64_t at = state.cycleStart + (int64_t)s.slot * schedule.slotUs + TT_GUARD_US / 2;
+    while (at < now) at += schedule.cycleUs;
+    if (best < 0 || at < best) {
+      best = at;
+      kind = s.kind;
+    }
+  }
+  return best;
+}
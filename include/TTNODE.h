@@ -0,0 +1,184 @@
+#pragma once
+
+#include <Arduino.h>
+#include <CANRX.h>
+#include <CANMONITOR.h>
+#include <atomic>
+#include <TTSCHEDULE.h>
+
+// Firmware side of the time-triggered CAN mode (VCU_CAN_TT=1, schedule logic in TTCAN.h).
+// Frames come time stamped from the receive interrupt (CANRX.h), so the reference time does
+// not depend on when the CANBUS task runs. A one shot esp_timer fires at each of the node's own slots and sends the latest
+// status frame (status slot) or one frame of the transmit queue (queue slot, diagnostics).
+// Outside its slots the node does not transmit at all, and without a reference for
+// TT_MAX_MISSED cycles it stays silent until the next one arrives, as it does while the
+// controller is off the bus (CANMONITOR.h).
+
+#define TT_TX_QUEUE       32      // frames, power of two, holds a whole diagnostics window (main.cpp)
+
+struct TTSTATS {
+  uint32_t txDropped;             // frames not queued, transmit queue full
+  uint32_t slotsSent;
+  uint32_t slotsLate;             // slot timer too late for the frame to end inside the slot
+};
+
+// status slot payload and frame ID (extended above 0x7FF), false while there is nothing to report
+typedef bool (*TTSTATUSFRAME)(uint8_t data[8], uint32_t& id);
+
+static CANFRAME _tt_tx[TT_TX_QUEUE];
+static std::atomic<uint8_t> _tt_tx_head(0);     // CANBUS task (diagnostics)
+static std::atomic<uint8_t> _tt_tx_tail(0);     // slot timer
+static TTSTATE _tt_state;
+static TTSTATS _tt_stats;
+static portMUX_TYPE _tt_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t _tt_timer = NULL;
+static TTSTATUSFRAME _tt_status = NULL;
+static uint16_t _tt_node;
+static bool _tt_armed = false;                  // slot timer running, under _tt_mux
+static uint8_t _tt_kind;                        // kind of the armed slot
+static int64_t _tt_slot_at;                     // transmit time of the armed slot
+
+static const uint32_t ttStaticBytes = sizeof(_tt_tx) + 2 * sizeof(std::atomic<uint8_t>) + sizeof(TTSTATE) + sizeof(TTSTATS) +
+                                      sizeof(portMUX_TYPE) + sizeof(esp_timer_handle_t) + sizeof(TTSTATUSFRAME) +
+                                      sizeof(uint16_t) + 2 * sizeof(bool) + sizeof(int64_t);
+
+
+//==================================================================================//
+
+// CANBUS task: queue a frame for the node's next queue slot, false when the queue is full
+bool ttQueueFrame(uint32_t id, const uint8_t* data, uint8_t dlc) {
+  uint8_t head = _tt_tx_head.load(std::memory_order_relaxed);
+  uint8_t next = (head + 1) & (TT_TX_QUEUE - 1);
+  if (next == _tt_tx_tail.load(std::memory_order_acquire)) {
+    _tt_stats.txDropped++;
+    return false;
+  }
+
+  CANFRAME& frame = _tt_tx[head];
+  frame.id = id;
+  frame.extended = id > 0x7FF;
+  frame.rtr = false;
+  frame.dlc = dlc > 8 ? 8 : dlc;
+  memcpy(frame.data, data, frame.dlc);
+  _tt_tx_head.store(next, std::memory_order_release);
+  return true;
+}
+
+static void ttTransmit(uint32_t id, bool extended, const uint8_t* data, uint8_t dlc) {
+  if (extended) CAN.beginExtendedPacket(id);
+  else CAN.beginPacket(id);
+  CAN.write(data, dlc);
+  CAN.endPacket();
+  _tt_stats.slotsSent++;
+}
+
+// sets the slot timer to the node's first slot at or after 'from', stops when out of sync
+static void ttArm(int64_t now, int64_t from) {
+  uint8_t kind = 0;
+  portENTER_CRITICAL(&_tt_mux);
+  int64_t at = ttNextSlot(_tt_state, ttSchedule, _tt_node, from, kind);
+  _tt_armed = at >= 0;
+  _tt_kind = kind;
+  _tt_slot_at = at;
+  portEXIT_CRITICAL(&_tt_mux);
+
+  if (at >= 0) esp_timer_start_once(_tt_timer, at > now ? at - now : 1);
+}
+
+// esp_timer task, at the node's slots
+static void ttSlot(void*) {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&_tt_mux);
+  ttAdvance(_tt_state, ttSchedule, now);
+  bool synced = _tt_state.synced;
+  uint8_t kind = _tt_kind;
+  int64_t slotAt = _tt_slot_at;
+  portEXIT_CRITICAL(&_tt_mux);
+
+  CANFRAME frame;
+  bool send = false;
+  uint8_t tail = _tt_tx_tail.load(std::memory_order_relaxed);
+
+  if (!synced || !canMonitorTransmit()) {
+  } else if (kind == TT_SLOT_STATUS) {
+    frame.id = _tt_node;
+    frame.dlc = 8;
+    send = _tt_status(frame.data, frame.id);
+    frame.extended = frame.id > 0x7FF;
+  } else if (kind == TT_SLOT_QUEUE && tail != _tt_tx_head.load(std::memory_order_acquire)) {
+    frame = _tt_tx[tail];
+    _tt_tx_tail.store((tail + 1) & (TT_TX_QUEUE - 1), std::memory_order_release);
+    send = true;
+  }
+
+  // a frame started this late would run into the next slot
+  if (send && now > slotAt + ttSchedule.slotUs - TT_GUARD_US - ttFrameTimeUs(frame.dlc, frame.extended, TT_BITRATE)) {
+    _tt_stats.slotsLate++;
+  } else if (send) {
+    ttTransmit(frame.id, frame.extended, frame.data, frame.dlc);
+  }
+
+  // past the middle of this slot: a reference in between may have moved the time base a few us
+  now = esp_timer_get_time();
+  ttArm(now, max(now, slotAt + (int64_t)ttSchedule.slotUs / 2));
+}
+
+static void ttReport(const char* message, uint8_t slot, uint16_t node) {
+  Serial.printf("TT schedule: %s (slot %u, node 0x%X)\n", message, slot, node);
+}
+
+// CANBUS task, once: schedule check and slot timer; false leaves the node off the bus
+bool ttBegin(uint16_t node, TTSTATUSFRAME status) {
+  uint16_t errors = ttValidate(ttSchedule, ttReport);
+  uint32_t statusBound = ttLatencyBound(ttSchedule, node, TT_SLOT_STATUS);
+  if (errors || statusBound == 0) {
+    Serial.printf("TT schedule: %u errors, status slot for 0x%X: %s, staying off the bus\n", errors, node,
+                  statusBound ? "yes" : "no");
+    return false;
+  }
+
+  _tt_node = node;
+  _tt_status = status;
+  ttReset(_tt_state);
+
+  esp_timer_create_args_t args = {};
+  args.callback = ttSlot;
+  args.name = "tt slot";
+  esp_timer_create(&args, &_tt_timer);
+
+  Serial.printf("TT schedule: %u slots of %u us, node 0x%X latency bound status %u us, queue %u us, command %u us\n",
+                ttSlotCount(ttSchedule), ttSchedule.slotUs, node, statusBound,
+                ttLatencyBound(ttSchedule, node, TT_SLOT_QUEUE), ttLatencyBound(ttSchedule, node, TT_SLOT_COMMAND));
+  return true;
+}
+
+// CANBUS task: true for a reference frame, which is consumed here and sets the time base
+bool ttReceive(const CANRECIEVER& msg) {
+  if (msg.id != TT_REFERENCE_ID || msg.extended || msg.rtr) return false;
+
+  portENTER_CRITICAL(&_tt_mux);
+  ttOnReference(_tt_state, ttSchedule, msg.at, msg.data[0]);
+  bool arm = !_tt_armed;
+  _tt_armed = true;
+  portEXIT_CRITICAL(&_tt_mux);
+  if (arm) ttArm(esp_timer_get_time(), esp_timer_get_time());     // first reference, or back in sync
+  return true;
+}
+
+// [0x60] [synced] [lost sync] [largest phase error us x2] [late slots] [tx dropped] [rx overflow]
+void ttRecord(uint8_t record[8], uint8_t type) {
+  portENTER_CRITICAL(&_tt_mux);
+  TTSTATE state = _tt_state;
+  portEXIT_CRITICAL(&_tt_mux);
+
+  uint16_t phase = min(state.phaseMax, (int32_t)0xFFFF);
+  record[0] = type;
+  record[1] = state.synced;
+  record[2] = min(state.lostSync, (uint32_t)0xFF);
+  record[3] = phase >> 8;
+  record[4] = phase & 0xFF;
+  record[5] = min(_tt_stats.slotsLate, (uint32_t)0xFF);
+  record[6] = min(_tt_stats.txDropped, (uint32_t)0xFF);
+  record[7] = min(_can_rx_overflow, (uint32_t)0xFF);
+}
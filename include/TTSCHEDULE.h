@@ -0,0 +1,35 @@
+#pragma once
+
+#include <TTCAN.h>
+
+// Slot table of the test rig bus: master plus the VCUs 0x15 - 0x18, 1 Mbps.
+// 10 ms cycle of 40 slots x 250 us (an extended 8 byte frame with worst case stuffing is
+// 160 us, plus TT_GUARD_US). Each VCU gets a command slot (master -> VCU) followed by its
+// status and queue slots; slots not listed here are free for event traffic under normal
+// arbitration (paths, RTR, anything of nodes in event mode). Every node on the bus must be
+// built with the same table, the host simulation uses it as well (vcu_host sim-ttcan).
+
+#define TT_CYCLE_US   10000
+#define TT_SLOT_US    250
+
+const TTSLOT ttSlots[] = {
+  {0, TT_MASTER, TT_SLOT_REFERENCE},
+
+  {1, 0x15, TT_SLOT_COMMAND},
+  {2, 0x15, TT_SLOT_STATUS},
+  {3, 0x15, TT_SLOT_QUEUE},
+
+  {4, 0x16, TT_SLOT_COMMAND},
+  {5, 0x16, TT_SLOT_STATUS},
+  {6, 0x16, TT_SLOT_QUEUE},
+
+  {7, 0x17, TT_SLOT_COMMAND},
+  {8, 0x17, TT_SLOT_STATUS},
+  {9, 0x17, TT_SLOT_QUEUE},
+
+  {10, 0x18, TT_SLOT_COMMAND},
+  {11, 0x18, TT_SLOT_STATUS},
+  {12, 0x18, TT_SLOT_QUEUE},
+};
+
+const TTSCHEDULE ttSchedule = {TT_CYCLE_US, TT_SLOT_US, ttSlots, sizeof(ttSlots) / sizeof(ttSlots[0])};
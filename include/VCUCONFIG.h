@@ -0,0 +1,253 @@
+#pragma once
+
+// Compile time VCU configuration. Every PlatformIO environment in platformio.ini picks its
+// input source, output driver, CAN ID and options through build flags:
+//   -DVCU_RX=RX_PPM | RX_SBUS | RX_NONE    radio receiver
+//   -DVCU_RX2=RX_NONE | RX_PPM | RX_SBUS   second receiver on RX_RECEIVER2_PIN, diversity (RXDIVERSITY.h); SBUS on Serial2
+//   -DVCU_OUTPUT=OUTPUT_SERVO | OUTPUT_SBUS | OUTPUT_DSHOT  steering and motor driver (PWM pins, one SBUS
+//                                           stream or a servo and a DShot ESC)
+//   -DVCU_SBUS_PERIOD_MS=14 | 7             SBUS output frame period
+//   -DVCU_DSHOT_SPEED=600 | 300 | 150       DShot bit rate, kbit/s (DSHOTOUT.h)
+//   -DVCU_DSHOT_TELEMETRY=0 | 1             bidirectional DShot, the ESC's eRPM becomes the vehicle speed
+//   -DVCU_DSHOT_PERIOD_US=0                 DShot frame period, 0 = one frame per control loop
+//   -DVCU_CANBUS_ID=0x15                    own CAN ID (status frame, path and diagnostics IDs derive from it)
+//   -DVCU_XBOX=0 | 1                        Xbox controller over BLE
+//   -DVCU_STATIC_ALLOC=0 | 1                static task stacks and buffers, no heap after init (STATICMEM.h)
+//   -DVCU_CAN_TT=0 | 1                      time-triggered CAN, transmit only in own slots (TTCAN.h, TTSCHEDULE.h)
+//   -DVCU_CLOCK_SYNC=0 | 1                  master timebase over CAN, stamped command and status frames (CLOCKSYNC.h)
+//   -DVCU_BATTERY_DERATE=0 | 1              limit the throttle at low pack voltage (BATTERY.h), -DBATTERY_CELLS=4
+//   -DVCU_SERIAL_LINK=0 | 1                 binary command link on the USB serial port (SERIALLINK.h), no frame logging
+//   -DVCU_SERIAL_BAUD=921600                USB serial baud rate (default 921600 with the link, 115200 without)
+//   -DVCU_EVENT_DRIVEN=0 | 1                control loop woken by fresh input instead of a fixed period (WAKEUP.h)
+//   -DVCU_POWER_SAVE=0 | 1                  CPU frequency scaling and light sleep while parked (POWERSAVE.h), event driven only
+//   -DVCU_YAW_CONTROL=0 | 1                 steering corrected toward a target yaw rate from an I2C IMU (IMU.h, YAWRATE.h)
+//   -DVCU_ESTOP=0 | 1                       emergency stop on CAN ID 0x000, taken in the receive interrupt (ESTOP.h, ESTOPOUT.h)
+//   -DVCU_JOBS=0 | 1                        battery and IMU as cooperative jobs sharing one task (JOBS.h, JOBTASK.h)
+// The choices become the policy types in Vcu below. Subsystems that are not selected are not
+// instantiated (receivers, outputs) or not included at all (Xbox), so they cost no flash, RAM
+// or runtime branches. The footprint of each environment is written by scripts/footprint.py.
+
+#define RX_NONE           0
+#define RX_PPM            1
+#define RX_SBUS           2
+
+#define OUTPUT_SERVO      0
+#define OUTPUT_SBUS       1
+#define OUTPUT_DSHOT      2
+
+#ifndef VCU_RX
+#define VCU_RX            RX_PPM
+#endif
+
+#ifndef VCU_RX2
+#define VCU_RX2           RX_NONE
+#endif
+
+#ifndef VCU_OUTPUT
+#define VCU_OUTPUT        OUTPUT_SERVO
+#endif
+
+#ifndef VCU_SBUS_PERIOD_MS
+#define VCU_SBUS_PERIOD_MS  14
+#endif
+
+#ifndef VCU_DSHOT_SPEED
+#define VCU_DSHOT_SPEED   600
+#endif
+
+#ifndef VCU_DSHOT_TELEMETRY
+#define VCU_DSHOT_TELEMETRY 0
+#endif
+
+#ifndef VCU_DSHOT_PERIOD_US
+#define VCU_DSHOT_PERIOD_US 0
+#endif
+
+#ifndef VCU_CANBUS_ID
+#define VCU_CANBUS_ID     0x15    // put your CAN ID here
+#endif
+
+#ifndef VCU_XBOX
+#define VCU_XBOX          0
+#endif
+
+#ifndef VCU_CAN_TT
+#define VCU_CAN_TT        0
+#endif
+
+#ifndef VCU_CLOCK_SYNC
+#define VCU_CLOCK_SYNC    0
+#endif
+
+#ifndef VCU_BATTERY_DERATE
+#define VCU_BATTERY_DERATE 0
+#endif
+
+#ifndef VCU_SERIAL_LINK
+#define VCU_SERIAL_LINK   0
+#endif
+
+#ifndef VCU_POWER_SAVE
+#define VCU_POWER_SAVE    0
+#endif
+
+#ifndef VCU_YAW_CONTROL
+#define VCU_YAW_CONTROL   0
+#endif
+
+#ifndef VCU_ESTOP
+#define VCU_ESTOP         0
+#endif
+
+#ifndef VCU_JOBS
+#define VCU_JOBS          0
+#endif
+
+#ifndef VCU_SERIAL_BAUD
+#define VCU_SERIAL_BAUD   (VCU_SERIAL_LINK ? 921600 : 115200)
+#endif
+
+// frames time stamped in the CAN receive interrupt (CANRX.h), event driven: the interrupt wakes the CANBUS task
+#define CAN_RX_ISR        (VCU_CAN_TT || VCU_CLOCK_SYNC || VCU_EVENT_DRIVEN || VCU_ESTOP)
+
+#define RX_RECEIVER_PIN   4       // radio receiver pin
+#define RX_RECEIVER2_PIN  13      // second radio receiver pin (VCU_RX2)
+
+#include <FrySky.h>
+#include <MANEUVER.h>
+#if VCU_OUTPUT == OUTPUT_SBUS
+#include <SBUSOUT.h>
+#elif VCU_OUTPUT == OUTPUT_DSHOT
+#include <DSHOTOUT.h>
+#endif
+#include <STATICMEM.h>
+#include <BATTERYADC.h>
+#include <WAKEUP.h>
+#include <CANMONITOR.h>
+#if VCU_POWER_SAVE
+#include <POWERSAVE.h>
+#endif
+#if VCU_YAW_CONTROL
+#include <IMU.h>
+#endif
+#if VCU_ESTOP
+#include <ESTOPOUT.h>
+#endif
+#if VCU_JOBS
+#include <JOBTASK.h>
+#endif
+#if CAN_RX_ISR
+#include <CANRX.h>
+#endif
+#if VCU_CAN_TT
+#include <TTNODE.h>
+#endif
+#if VCU_CLOCK_SYNC
+#include <CLOCKSYNC.h>
+#endif
+#if VCU_SERIAL_LINK
+#include <LINKPORT.h>
+#endif
+
+// no radio receiver: getData() / setupFRYSKY() are never instantiated
+struct NoReceiver {
+    static void sleep(bool) {}
+};
+
+template<class RX, class OUT, uint16_t CAN_ID>
+struct VcuPolicy {
+    typedef RX Receiver;
+    typedef OUT Output;
+    static const uint16_t canId = CAN_ID;
+};
+
+
+//==================================================================================//
+
+#if VCU_RX == RX_PPM
+typedef PpmReceiver<RX_RECEIVER_PIN> VcuFirstReceiver;
+#elif VCU_RX == RX_SBUS
+typedef SbusReceiver<RX_RECEIVER_PIN> VcuFirstReceiver;
+#elif VCU_RX == RX_NONE
+typedef NoReceiver VcuFirstReceiver;
+#else
+#error "VCU_RX must be RX_PPM, RX_SBUS or RX_NONE"
+#endif
+
+#if VCU_RX2 == RX_PPM
+typedef DiversityReceiver<VcuFirstReceiver, PpmReceiver<RX_RECEIVER2_PIN> > VcuReceiver;
+#elif VCU_RX2 == RX_SBUS
+typedef DiversityReceiver<VcuFirstReceiver, SbusReceiver<RX_RECEIVER2_PIN, 2> > VcuReceiver;
+#elif VCU_RX2 == RX_NONE
+typedef VcuFirstReceiver VcuReceiver;
+#else
+#error "VCU_RX2 must be RX_PPM, RX_SBUS or RX_NONE"
+#endif
+
+#if VCU_OUTPUT == OUTPUT_SERVO
+typedef ServoOutput<steeringPin, motorPin> VcuDriver;
+#elif VCU_OUTPUT == OUTPUT_SBUS
+typedef SbusOutput<SBUS_OUT_TX_PIN, VCU_SBUS_PERIOD_MS> VcuDriver;
+#elif VCU_OUTPUT == OUTPUT_DSHOT
+typedef DshotOutput<steeringPin, motorPin, VCU_DSHOT_SPEED, VCU_DSHOT_TELEMETRY, VCU_DSHOT_PERIOD_US> VcuDriver;
+#else
+#error "VCU_OUTPUT must be OUTPUT_SERVO, OUTPUT_SBUS or OUTPUT_DSHOT"
+#endif
+
+#if VCU_BATTERY_DERATE
+typedef DeratedOutput<VcuDriver> VcuLimited;
+#else
+typedef VcuDriver VcuLimited;
+#endif
+
+#if VCU_YAW_CONTROL
+typedef YawOutput<VcuLimited> VcuSteered;
+#else
+typedef VcuLimited VcuSteered;
+#endif
+
+#if VCU_ESTOP
+typedef EstopOutput<VcuSteered> VcuOutput;
+#else
+typedef VcuSteered VcuOutput;
+#endif
+
+#if VCU_STATIC_ALLOC && VCU_XBOX
+#error "VCU_STATIC_ALLOC: the BLE stack behind VCU_XBOX allocates at runtime"
+#endif
+
+#if VCU_POWER_SAVE && !VCU_EVENT_DRIVEN
+#error "VCU_POWER_SAVE needs VCU_EVENT_DRIVEN: the fixed period loops would keep the CPU awake"
+#endif
+
+#if VCU_POWER_SAVE && VCU_JOBS
+#error "VCU_POWER_SAVE: the periodic battery job (VCU_JOBS) would keep the CPU awake while parked"
+#endif
+
+#if VCU_RX2 != RX_NONE && VCU_RX == RX_NONE
+#error "VCU_RX2: the second receiver needs a first one in VCU_RX"
+#endif
+
+#if VCU_RX2 == RX_SBUS && VCU_OUTPUT == OUTPUT_SBUS
+#error "VCU_RX2=RX_SBUS: Serial2 carries the SBUS output"
+#endif
+
+#if VCU_STATIC_ALLOC && (VCU_RX == RX_SBUS || VCU_RX2 == RX_SBUS) && !defined(SBUS_STATIC_CAL)
+#error "VCU_STATIC_ALLOC with RX_SBUS needs -DSBUS_STATIC_CAL=<coefficients> (SBUS calibration without malloc)"
+#endif
+
+// status frame on the ID itself, commands on COMMAND_CAN_BASE + ID (0x100), paths on PATH_CAN_BASE + ID (0x200),
+// diagnostics on 0x600 + ID, none of them may overlap
+static_assert(VCU_CANBUS_ID > 0 && VCU_CANBUS_ID < 0x100, "VCU_CANBUS_ID must be 0x001 - 0x0FF");
+
+#if VCU_CAN_TT
+// the reference outranks all
+static_assert(VCU_CANBUS_ID > TT_REFERENCE_ID, "VCU_CAN_TT: VCU_CANBUS_ID must be 0x002 - 0x0FF");
+static_assert(TT_COMMAND_BASE == COMMAND_CAN_BASE, "VCU_CAN_TT: commands on the regular command IDs");
+#endif
+
+#if VCU_CLOCK_SYNC
+static_assert(VCU_CANBUS_ID != CLOCK_SYNC_ID && VCU_CANBUS_ID != CLOCK_FOLLOWUP_ID, "VCU_CLOCK_SYNC: 0x080/0x081 carry the sync");
+#endif
+
+typedef VcuPolicy<VcuReceiver, VcuOutput, VCU_CANBUS_ID> Vcu;
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Input triggered control (VCU_EVENT_DRIVEN=1). Instead of the fixed 5 ms / 12 ms task delays
+// every input completion wakes the tasks that depend on it:
+//   CAN frame received    CAN receive interrupt -> CANBUS task (CANRX.h)
+//   PPM frame sync        pin interrupt -> CANBUS task (FrySky.h)
+//   SBUS frame complete   UART line idle after the frame -> CANBUS task (FrySky.h)
+//   serial link frame     UART event -> CANBUS task (LINKPORT.h)
+// and the CANBUS task, once a fresh command or receiver frame is published, notifies the VCU
+// task with the input's bit, so the control loop runs once per new command. Both waits time
+// out (WAKE_INPUT_TIMEOUT_MS / WAKE_CONTROL_TIMEOUT_MS): the receiver timeout, the CAN command
+// timeout (neutral throttle) and the diagnostics still run on a silent bus.
+//
+// In both modes the VCU task counts its wake-ups and the time from input arrival (receive
+// interrupt or frame sync) to the actuator write, published once a second:
+//   wake-up: [0x80] [control wake-ups x2] [avg input latency us x2] [max input latency us x2]
+//            [wake-ups by timeout, saturating]
+
+#ifndef VCU_EVENT_DRIVEN
+#define VCU_EVENT_DRIVEN          0
+#endif
+
+#define WAKE_INPUT_TIMEOUT_MS     30      // CANBUS task on a silent bus, well inside RX_TIMEOUT_MS
+#define WAKE_CONTROL_TIMEOUT_MS   30      // VCU task without fresh input, longer than a PPM frame (22.5 ms)
+#define WAKE_COMMAND_TIMEOUT_MS   100     // CAN command age -> neutral throttle (event driven only)
+
+// VCU task notification bits
+#define WAKE_CAN                  0x01
+#define WAKE_RC                   0x02
+#define WAKE_POWER                0x04    // edge on an input pin while parked (POWERSAVE.h)
+#define WAKE_ESTOP                0x08    // emergency stop taken in the CAN interrupt (ESTOPOUT.h)
+
+struct WAKESTATS {
+  uint32_t wakeups;
+  uint32_t timeouts;
+  uint32_t applied;                       // fresh inputs written to the actuators
+  uint32_t latencySum;                    // us
+  uint32_t latencyMax;
+};
+
+static TaskHandle_t _wake_control_task = NULL;
+static WAKESTATS _wake_stats;
+static portMUX_TYPE _wake_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint32_t wakeStaticBytes = sizeof(_wake_control_task) + sizeof(_wake_stats);
+
+
+//==================================================================================//
+
+// VCU task, before its first wait
+void wakeAttachControl(TaskHandle_t task) {
+  _wake_control_task = task;
+}
+
+// CANBUS task: fresh input published
+void wakeControl(uint32_t bits) {
+#if VCU_EVENT_DRIVEN
+  if (_wake_control_task != NULL) xTaskNotify(_wake_control_task, bits, eSetBits);
+#else
+  (void)bits;
+#endif
+}
+
+// interrupt: wakes the VCU task with 'bits' right away
+void wakeControlFromISR(uint32_t bits) {
+#if VCU_EVENT_DRIVEN
+  if (_wake_control_task == NULL) return;
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(_wake_control_task, bits, eSetBits, &woken);
+  portYIELD_FROM_ISR(woken);
+#else
+  (void)bits;
+#endif
+}
+
+// VCU task, end of the loop: with 'event' the next input or at most timeoutMs, otherwise a
+// fixed delay; returns the input bits that woke it, 0 on a timeout
+uint32_t wakeWait(bool event, uint32_t timeoutMs) {
+  uint32_t bits = 0;
+#if VCU_EVENT_DRIVEN
+  if (event) xTaskNotifyWait(0, 0xFFFFFFFF, &bits, timeoutMs / portTICK_PERIOD_MS);
+  else vTaskDelay(timeoutMs / portTICK_PERIOD_MS);
+#else
+  (void)event;
+  vTaskDelay(timeoutMs / portTICK_PERIOD_MS);
+#endif
+
+  portENTER_CRITICAL(&_wake_mux);
+  _wake_stats.wakeups++;
+  if (event && bits == 0) _wake_stats.timeouts++;
+  portEXIT_CRITICAL(&_wake_mux);
+  return bits;
+}
+
+// VCU task: an input that arrived at local time 'at' was just written to the actuators
+void wakeApplied(int64_t at) {
+  if (at == 0) return;
+  uint32_t latency = esp_timer_get_time() - at;
+
+  portENTER_CRITICAL(&_wake_mux);
+  _wake_stats.applied++;
+  _wake_stats.latencySum += latency;
+  if (latency > _wake_stats.latencyMax) _wake_stats.latencyMax = latency;
+  portEXIT_CRITICAL(&_wake_mux);
+}
+
+// CANBUS task, with the diagnostics: counters of the window that just closed
+void wakeRecord(uint8_t record[8], uint8_t type) {
+  portENTER_CRITICAL(&_wake_mux);
+  WAKESTATS stats = _wake_stats;
+  _wake_stats = WAKESTATS();
+  portEXIT_CRITICAL(&_wake_mux);
+
+  uint16_t wakeups = min(stats.wakeups, (uint32_t)0xFFFF);
+  uint16_t average = stats.applied ? min(stats.latencySum / stats.applied, (uint32_t)0xFFFF) : 0;
+  uint16_t maximum = min(stats.latencyMax, (uint32_t)0xFFFF);
+
+  record[0] = type;
+  record[1] = wakeups >> 8;
+  record[2] = wakeups & 0xFF;
+  record[3] = average >> 8;
+  record[4] = average & 0xFF;
+  record[5] = maximum >> 8;
+  record[6] = maximum & 0xFF;
+  record[7] = min(stats.timeouts, (uint32_t)0xFF);
+}
@@ -1,4 +1,7 @@
 #include <XboxSeriesXControllerESP32_asukiaaa.hpp>  // Xbox controller library for ESP32
+#include <NimBLEDevice.h>
+#include <HANDOFF.h>
+#include <XBOXHID.h>
 
 struct XBOX {
     bool isConnected;
@@ -21,10 +24,25 @@ struct XBOX {
     bool buttonCrossRIGHT;
 };
 
+// latest decoded report, written from the BLE notification callback
+struct XBOXSNAPSHOT {
+    int64_t receivedAt;     // esp_timer us, 0 = nothing received yet
+    XBOXREPORT report;
+};
+
 XboxSeriesXControllerESP32_asukiaaa::Core xboxController;   // Xbox controller object
 
 const int ledPin = 2;   // Pin for built-in LED
-int flag = 0;           // handling for the first connection 
+int flag = 0;           // handling for the first connection
+
+#define XBOX_SERVICE_MS       20      // BLE connection housekeeping period
+#define XBOX_MAX_FAILED       2       // failed connections before backing off
+#define XBOX_BACKOFF_MS       2000    // pause between reconnect attempts after repeated failures
+
+static Handoff<XBOXSNAPSHOT> _xbox_snapshot;    // BLE host -> VCU
+static XBOXSNAPSHOT _xbox_latest;               // BLE host side only
+static std::atomic<bool> _xbox_hooked(false);   // notification callback installed on current connection
+static uint32_t _xbox_failed_seen = 0;
 
 
 //==================================================================================//
@@ -33,7 +51,7 @@ void setupXBOX () {
     // Initialize serial communication
     Serial.println("\nInitializing Vehicle...");
     Serial.println("Starting NimBLE Client...");
-    
+
     // Setting up XBOX controller connection
     xboxController.begin();
 
@@ -59,69 +77,128 @@ void demoVibration() {
     xboxController.writeHIDReport(repo); // Send vibration report to controller
 }
 
+// runs in the NimBLE host task for every HID notification: decode and publish, nothing else
+void xboxNotifyCB(NimBLERemoteCharacteristic* characteristic, uint8_t* data, size_t length, bool isNotify) {
+    if (!decodeXboxReport(data, length, _xbox_latest.report)) return;
 
-XBOX getXboxData() {
-    xboxController.onLoop(); // Process controller loop
+    _xbox_latest.receivedAt = esp_timer_get_time();
+    _xbox_snapshot.publish(_xbox_latest);
+}
+
+// take the HID input report notifications over from the library on the connected client
+bool xboxHookNotifications() {
+    std::list<NimBLEClient*>* clients = NimBLEDevice::getClientList();
 
-    XBOX data; // Create an instance of the struct to hold the return values
+    for (NimBLEClient* client : *clients) {
+        if (!client->isConnected()) continue;
 
-    if (xboxController.isConnected()) { // Check if controller is connected
-        if (xboxController.isWaitingForFirstNotification()) {
-            Serial.println("waiting for first notification");
+        NimBLERemoteService* hid = client->getService(NimBLEUUID((uint16_t)0x1812));
+        if (hid == nullptr) continue;
 
-            return data;
-        } else {
-            if (flag == 0) {
+        bool hooked = false;
+        std::vector<NimBLERemoteCharacteristic*>* characteristics = hid->getCharacteristics(true);
+        for (NimBLERemoteCharacteristic* characteristic : *characteristics) {
+            if (characteristic->getUUID() == NimBLEUUID((uint16_t)0x2A4D) && characteristic->canNotify()) {
+                hooked |= characteristic->subscribe(true, xboxNotifyCB, true);
+            }
+        }
+        return hooked;
+    }
+    return false;
+}
+
+// connection housekeeping, call periodically from a low priority task (never from the control loop)
+void xboxService() {
+    xboxController.onLoop();
+
+    if (xboxController.isConnected()) {
+        if (!_xbox_hooked && !xboxController.isWaitingForFirstNotification()) {
+            _xbox_hooked = xboxHookNotifications();
+
+            if (_xbox_hooked && flag == 0) {
                 demoVibration(); // Demonstrate vibration on first connection
                 digitalWrite(LED_BUILTIN, HIGH); // Turn on built-in LED
-                Serial.println("Address: " + xboxController.buildDeviceAddressStr()); // Print controller address
-                Serial.println("battery " + String(xboxController.battery) + "%"); // Print battery status
+                Serial.printf("Address: %s\n", xboxController.buildDeviceAddressStr().c_str()); // Print controller address
+                Serial.printf("battery %d%%\n", xboxController.battery); // Print battery status
                 flag += 1;
-
-                data.isConnected = true;
-                //sendCanData(driverReady);
             }
-
-            // Read trigger and joaystick values
-            data.joyLHoriValue = (float)xboxController.xboxNotif.joyLHori;
-            data.rightTrigger = (float)xboxController.xboxNotif.trigRT;
-            data.leftTrigger = (float)xboxController.xboxNotif.trigLT;
-
-            // Read button states
-            data.buttonA = xboxController.xboxNotif.btnA;
-            data.buttonB = xboxController.xboxNotif.btnB;
-            data.buttonX = xboxController.xboxNotif.btnX;
-            data.buttonY = xboxController.xboxNotif.btnY;
-            data.buttonLB = xboxController.xboxNotif.btnLB;
-            data.buttonRB = xboxController.xboxNotif.btnRB;
-            data.buttonStart = xboxController.xboxNotif.btnStart;
-            data.buttonSelect = xboxController.xboxNotif.btnSelect;
-            data.buttonLStick = xboxController.xboxNotif.btnLS;
-            data.buttonRStick = xboxController.xboxNotif.btnRS;
-            data.buttonCrossUP = xboxController.xboxNotif.btnRS;
-            data.buttonCrossDOWN = xboxController.xboxNotif.btnRS;
-            data.buttonCrossLEFT = xboxController.xboxNotif.btnRS;
-            data.buttonCrossRIGHT = xboxController.xboxNotif.btnRS;
-
-            data.isConnected = true;
-
-            return data;
         }
-    } else {
-        data.isConnected = false;
+        return;
+    }
 
-        // Restart ESP if connection failed multiple times
-        if (xboxController.getCountFailedConnection() > 2) {
-            ESP.restart();
-        }
+    // Handle disconnection (reports only arrive on change, so the link state decides, not report age)
+    if (_xbox_hooked) {
+        // drop the last report: after a reconnect a trigger held before the link went down must not
+        // drive again until the controller reports it. No notifications arrive without a connection,
+        // so this task is the only producer here.
+        _xbox_hooked = false;
+        _xbox_latest = XBOXSNAPSHOT();
+        _xbox_snapshot.publish(_xbox_latest);
+    }
 
-        // Handle disconnection
-        if (flag >= 1){
-            digitalWrite(LED_BUILTIN, LOW); // Turn off built-in LED
-            Serial.println("not connected");
-            flag = 0;
-        }
+    if (flag >= 1){
+        digitalWrite(LED_BUILTIN, LOW); // Turn off built-in LED
+        Serial.println("not connected");
+        flag = 0;
+    }
+
+    // back off after repeated failed connections instead of restarting the ESP
+    uint32_t failed = xboxController.getCountFailedConnection();
+    if (failed > XBOX_MAX_FAILED && failed != _xbox_failed_seen) {
+        _xbox_failed_seen = failed;
+        Serial.println("Xbox connection failed, retrying");
+        vTaskDelay(XBOX_BACKOFF_MS / portTICK_PERIOD_MS);
+    }
+}
+
+void XBOXTASK (void * pvParameters) {
+    setupXBOX();
 
+    while (1) {
+        xboxService();
+        vTaskDelay(XBOX_SERVICE_MS / portTICK_PERIOD_MS);
+    }
+}
+
+
+//==================================================================================//
+
+// non-blocking: returns the latest decoded report, never touches BLE
+XBOX getXboxData() {
+    _xbox_snapshot.update();
+    const XBOXSNAPSHOT& snapshot = _xbox_snapshot.read();
+
+    XBOX data = XBOX(); // Create an instance of the struct to hold the return values
+
+    if (!_xbox_hooked || snapshot.receivedAt == 0) {
+        data.isConnected = false;
         return data;
     }
+
+    const XBOXREPORT& report = snapshot.report;
+
+    // Read trigger and joaystick values
+    data.joyLHoriValue = (float)report.joyLHori;
+    data.rightTrigger = (float)report.trigRT;
+    data.leftTrigger = (float)report.trigLT;
+
+    // Read button states
+    data.buttonA = report.buttons & XBOX_BTN_A;
+    data.buttonB = report.buttons & XBOX_BTN_B;
+    data.buttonX = report.buttons & XBOX_BTN_X;
+    data.buttonY = report.buttons & XBOX_BTN_Y;
+    data.buttonLB = report.buttons & XBOX_BTN_LB;
+    data.buttonRB = report.buttons & XBOX_BTN_RB;
+    data.buttonStart = report.buttons & XBOX_BTN_START;
+    data.buttonSelect = report.buttons & XBOX_BTN_SELECT;
+    data.buttonLStick = report.buttons & XBOX_BTN_LSTICK;
+    data.buttonRStick = report.buttons & XBOX_BTN_RSTICK;
+    data.buttonCrossUP = report.buttons & XBOX_BTN_DPAD_UP;
+    data.buttonCrossDOWN = report.buttons & XBOX_BTN_DPAD_DOWN;
+    data.buttonCrossLEFT = report.buttons & XBOX_BTN_DPAD_LEFT;
+    data.buttonCrossRIGHT = report.buttons & XBOX_BTN_DPAD_RIGHT;
+
+    data.isConnected = true;
+
+    return data;
 }
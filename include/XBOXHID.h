@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Decoder for the Xbox Series X|S controller BLE HID input report (16 bytes, no report id).
+// Kept free of Arduino/NimBLE so reports can be decoded on the host (vcu_host xbox-reports).
+//
+//   [0..1] left stick X    [2..3] left stick Y    [4..5] right stick X   [6..7] right stick Y
+//   [8..9] left trigger    [10..11] right trigger                        (all little endian)
+//   [12] d-pad hat: 0 = released, 1 = up, then clockwise in 45 degree steps up to 8 = up-left
+//   [13] A 0x01, B 0x02, X 0x08, Y 0x10, LB 0x40, RB 0x80
+//   [14] view 0x04, menu 0x08, xbox 0x10, LS 0x20, RS 0x40
+//   [15] share 0x01
+
+#define XBOX_REPORT_LENGTH  16
+
+enum xbox_button_enum{
+  XBOX_BTN_A          = 1 << 0,
+  XBOX_BTN_B          = 1 << 1,
+  XBOX_BTN_X          = 1 << 2,
+  XBOX_BTN_Y          = 1 << 3,
+  XBOX_BTN_LB         = 1 << 4,
+  XBOX_BTN_RB         = 1 << 5,
+  XBOX_BTN_SELECT     = 1 << 6,
+  XBOX_BTN_START      = 1 << 7,
+  XBOX_BTN_XBOX       = 1 << 8,
+  XBOX_BTN_LSTICK     = 1 << 9,
+  XBOX_BTN_RSTICK     = 1 << 10,
+  XBOX_BTN_SHARE      = 1 << 11,
+  XBOX_BTN_DPAD_UP    = 1 << 12,
+  XBOX_BTN_DPAD_RIGHT = 1 << 13,
+  XBOX_BTN_DPAD_DOWN  = 1 << 14,
+  XBOX_BTN_DPAD_LEFT  = 1 << 15
+};
+
+struct XBOXREPORT {
+    uint16_t joyLHori;      // 0 - 65535, center 32768
+    uint16_t joyLVert;
+    uint16_t joyRHori;
+    uint16_t joyRVert;
+    uint16_t trigLT;        // 0 - 1023
+    uint16_t trigRT;
+    uint16_t buttons;       // xbox_button_enum bits
+};
+
+
+//==================================================================================//
+
+inline uint16_t xboxReadU16(const uint8_t* data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+// hat position 1..8 to d-pad bits, 0 (released) and out of range map to none
+inline uint16_t xboxDecodeHat(uint8_t hat) {
+    static const uint16_t directions[9] = {
+        0,
+        XBOX_BTN_DPAD_UP,
+        XBOX_BTN_DPAD_UP | XBOX_BTN_DPAD_RIGHT,
+        XBOX_BTN_DPAD_RIGHT,
+        XBOX_BTN_DPAD_DOWN | XBOX_BTN_DPAD_RIGHT,
+        XBOX_BTN_DPAD_DOWN,
+        XBOX_BTN_DPAD_DOWN | XBOX_BTN_DPAD_LEFT,
+        XBOX_BTN_DPAD_LEFT,
+        XBOX_BTN_DPAD_UP | XBOX_BTN_DPAD_LEFT
+    };
+    return hat <= 8 ? directions[hat] : 0;
+}
+
+// returns false and leaves report untouched if the notification is too short
+inline bool decodeXboxReport(const uint8_t* data, size_t length, XBOXREPORT& report) {
+    if (data == NULL || length < XBOX_REPORT_LENGTH) return false;
+
+    report.joyLHori = xboxReadU16(&data[0]);
+    report.joyLVert = xboxReadU16(&data[2]);
+    report.joyRHori = xboxReadU16(&data[4]);
+    report.joyRVert = xboxReadU16(&data[6]);
+    report.trigLT = xboxReadU16(&data[8]) & 0x03FF;
+    report.trigRT = xboxReadU16(&data[10]) & 0x03FF;
+
+    uint16_t buttons = xboxDecodeHat(data[12]);
+    if (data[13] & 0x01) buttons |= XBOX_BTN_A;
+    if (data[13] & 0x02) buttons |= XBOX_BTN_B;
+    if (data[13] & 0x08) buttons |= XBOX_BTN_X;
+    if (data[13] & 0x10) buttons |= XBOX_BTN_Y;
+    if (data[13] & 0x40) buttons |= XBOX_BTN_LB;
+    if (data[13] & 0x80) buttons |= XBOX_BTN_RB;
+    if (data[14] & 0x04) buttons |= XBOX_BTN_SELECT;
+    if (data[14] & 0x08) buttons |= XBOX_BTN_START;
+    if (data[14] & 0x10) buttons |= XBOX_BTN_XBOX;
+    if (data[14] & 0x20) buttons |= XBOX_BTN_LSTICK;
+    if (data[14] & 0x40) buttons |= XBOX_BTN_RSTICK;
+    if (data[15] & 0x01) buttons |= XBOX_BTN_SHARE;
+    report.buttons = buttons;
+
+    return true;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <stdint.h>
+#include <FIXEDPOINT.h>
+#include <STEERCAL.h>
+
+// Yaw-rate feedback steering (VCU_YAW_CONTROL), integer only and without hardware access, the
+// host runs it against a vehicle model (vcu_host sim-yaw).
+//
+// Estimator: the IMU task reads the gyro's z axis from the IMU FIFO in bursts (IMU.h), the mean
+// of a burst less the bias is the measured yaw rate. The bias is the mean of the first
+// YAW_BIAS_BURSTS bursts at standstill, then tracked slowly while the car stands still (neutral
+// throttle, no speed, no rotation beyond YAW_STILL_MDPS).
+//
+// Controller: the commanded servo angle gives a wheel angle through the steering geometry
+// (STEERCAL.h), the target yaw rate is speed * tan(wheel angle) / wheelbase, bounded by
+// maxLateral / speed, and passed through a reference of two first order stages of responseMs / 2
+// (servo and tire lag of a neutral steering car), so a car that follows the command is not
+// corrected while it turns in. The difference of the measured rate to the reference, over the
+// speed, is a curvature error; the wheel angle that removes it (wheelbase * curvature) is the
+// error scaled into the wheel angle domain, so the gains are dimensionless and hold at any speed:
+//   correction = gainP * error + gainI * integral of error, limited to maxCorrection
+// Off below minSpeed (no usable curvature at walking pace, reversing) and in drive modes not set
+// in 'modes'; the integral is dropped whenever it is off and held while the output saturates.
+// Angles are centidegrees, positive = left, yaw rates millidegrees per second, counterclockwise
+// from above positive.
+//
+// Diagnostics record (once a second with the others):
+//   yaw: [0xE0] [flags: 1 IMU up, 2 on in this drive mode, 4 correcting, 8 saturated in the window]
+//        [mean |yaw-rate error| while correcting, deg/s] [largest |correction|, 0.1 deg wheel angle]
+//        [gyro bias, 0.01 deg/s, signed x2] [FIFO overflows] [I2C errors], window counts saturating
+
+#define YAW_GYRO_MDPS_Q8        3908        // mdeg/s per LSB, Q8: +-500 deg/s range, 65.5 LSB per deg/s
+#define YAW_BIAS_BURSTS         64          // bursts averaged into the bias at boot
+#define YAW_BIAS_SHIFT          7           // bias tracking at standstill, 1/128 per burst
+#define YAW_STILL_MDPS          3000        // above this the car is being moved, no bias update
+#define YAW_MDEG_PER_RAD        57296
+#define YAW_MAX_DT_US           50000       // integration step cap, after a pause of the writes
+
+#define YAW_FLAG_IMU            0x01
+#define YAW_FLAG_ENABLED        0x02
+#define YAW_FLAG_ACTIVE         0x04
+#define YAW_FLAG_SATURATED      0x08
+
+struct YAWCONFIG {
+    uint8_t modes;                          // bit per drive mode that gets the correction
+    uint16_t gainP;                         // Q8, share of the curvature error corrected at once
+    uint16_t gainI;                         // Q8, per second
+    int32_t maxCorrection;                  // centidegrees wheel angle
+    int32_t minSpeed;                       // mm/s
+    int32_t maxLateral;                     // mm/s^2, bound of the target
+    uint16_t responseMs;                    // reference lag, sum of both stages
+};
+
+struct YAWESTIMATE {
+    int32_t bias;                           // LSB Q8
+    uint16_t biasBursts;                    // bursts in the boot average, YAW_BIAS_BURSTS when done
+    int32_t rate;                           // mdeg/s, bias removed
+    uint32_t bursts;
+};
+
+struct YAWCONTROL {
+    int32_t integral;                       // centidegrees Q8
+    int32_t target;                         // mdeg/s
+    int32_t turnIn;                         // first stage of the reference
+    int32_t reference;                      // target as a neutral car would follow it
+    int32_t measured;
+    int32_t correction;                     // centidegrees wheel angle
+    bool active;
+
+    // window
+    uint32_t activeLoops;
+    uint32_t errorSum;                      // |error| mdeg/s while active
+    uint32_t correctionMax;                 // |centidegrees|
+    bool saturated;
+};
+
+
+//==================================================================================//
+
+inline void yawEstimateReset(YAWESTIMATE& estimate) {
+    estimate = YAWESTIMATE();
+}
+
+// bias known: the rate can be used
+inline bool yawCalibrated(const YAWESTIMATE& estimate) {
+    return estimate.biasBursts >= YAW_BIAS_BURSTS;
+}
+
+inline int32_t yawRate(int32_t lsbQ8) {
+    return (int32_t)(((int64_t)lsbQ8 * YAW_GYRO_MDPS_Q8) >> 16);
+}
+
+// IMU task: one FIFO burst of z axis samples, 'still' while the car stands (control task)
+inline int32_t yawBurst(YAWESTIMATE& estimate, const int16_t* samples, uint16_t count, bool still) {
+    if (count == 0) return estimate.rate;
+    int32_t sum = 0;
+    for (uint16_t i = 0; i < count; i++) sum += samples[i];
+    int32_t mean = (int32_t)(((int64_t)sum << 8) / count);
+
+    if (still) {
+        if (!yawCalibrated(estimate)) {
+            estimate.biasBursts++;
+            estimate.bias += (mean - estimate.bias) / estimate.biasBursts;
+        } else {
+            int32_t rate = yawRate(mean - estimate.bias);
+            if (rate < YAW_STILL_MDPS && rate > -YAW_STILL_MDPS) {
+                estimate.bias += (mean - estimate.bias) >> YAW_BIAS_SHIFT;
+            }
+        }
+    }
+    estimate.rate = yawRate(mean - estimate.bias);
+    estimate.bursts++;
+    return estimate.rate;
+}
+
+
+//==================================================================================//
+
+// servo offset from center (centidegrees, the servo's sign) to the wheel angle, and back
+inline int32_t yawWheelAngle(const STEERGEOMETRY& geometry, int32_t servoOffset) {
+    int32_t offset = servoOffset * geometry.direction;
+    int32_t linkage = geometry.linkage[offset >= 0 ? STEERCAL_LEFT : STEERCAL_RIGHT];
+    return linkage > 0 ? offset * 256 / linkage : 0;
+}
+
+inline int32_t yawServoOffset(const STEERGEOMETRY& geometry, int32_t wheelAngle) {
+    int32_t linkage = geometry.linkage[wheelAngle >= 0 ? STEERCAL_LEFT : STEERCAL_RIGHT];
+    return wheelAngle * linkage / 256 * geometry.direction;
+}
+
+// speed * tan(wheel angle) / wheelbase, bounded by the lateral acceleration
+inline int32_t yawTarget(const STEERGEOMETRY& geometry, const YAWCONFIG& config, int32_t wheelAngle, int32_t speed) {
+    if (speed <= 0 || geometry.wheelbase <= 0) return 0;
+    uint32_t angle = (uint32_t)((int64_t)wheelAngle * (int64_t)FIXED_BAM_PER_DEG / 100);
+    int32_t cosine = fixedCos(angle);
+    if (cosine <= 0) return 0;
+    int64_t tangent = ((int64_t)fixedSin(angle) << 14) / cosine;                   // Q14
+    int64_t target = (int64_t)speed * tangent * YAW_MDEG_PER_RAD / ((int64_t)geometry.wheelbase << 14);
+    int64_t limit = (int64_t)config.maxLateral * YAW_MDEG_PER_RAD / speed;
+    if (target > limit) target = limit;
+    if (target < -limit) target = -limit;
+    return (int32_t)target;
+}
+
+inline void yawControlReset(YAWCONTROL& control) {
+    control.integral = 0;
+    control.correction = 0;
+    control.active = false;
+}
+
+// control task, once per actuator write: the wheel angle correction (centidegrees) to add to the
+// commanded 'wheelAngle'; 'dtUs' since the previous write, capped at YAW_MAX_DT_US
+inline int32_t yawUpdate(YAWCONTROL& control, const YAWCONFIG& config, const STEERGEOMETRY& geometry,
+                         int32_t wheelAngle, int32_t speed, int32_t measured, bool enabled, uint32_t dtUs) {
+    if (dtUs > YAW_MAX_DT_US) dtUs = YAW_MAX_DT_US;
+    control.measured = measured;
+    control.target = yawTarget(geometry, config, wheelAngle, speed);
+    int64_t tau = config.responseMs * 500LL;
+    control.turnIn += (int32_t)((int64_t)(control.target - control.turnIn) * dtUs / (tau + dtUs));
+    control.reference += (int32_t)((int64_t)(control.turnIn - control.reference) * dtUs / (tau + dtUs));
+    if (!enabled || speed < config.minSpeed || speed <= 0) {
+        yawControlReset(control);
+        return 0;
+    }
+
+    // curvature error as a wheel angle: wheelbase * (rate error / speed), mdeg to centidegrees
+    int32_t rateError = control.reference - measured;
+    int32_t error = (int32_t)((int64_t)geometry.wheelbase * rateError / (10LL * speed));
+
+    int32_t limit = config.maxCorrection;
+    int32_t proportional = (int32_t)(((int64_t)error * config.gainP) >> 8);
+    int32_t step = (int32_t)((int64_t)error * config.gainI * dtUs / 1000000);          // Q8
+    int32_t output = proportional + (control.integral >> 8);
+    bool windup = (output >= limit && step > 0) || (output <= -limit && step < 0);
+    if (!windup) {
+        control.integral += step;
+        if (control.integral > (limit << 8)) control.integral = limit << 8;
+        if (control.integral < -(limit << 8)) control.integral = -(limit << 8);
+    }
+
+    output = proportional + (control.integral >> 8);
+    if (output > limit || output < -limit) {
+        output = output > 0 ? limit : -limit;
+        control.saturated = true;
+    }
+    control.correction = output;
+    control.active = true;
+
+    control.activeLoops++;
+    control.errorSum += rateError >= 0 ? rateError : -rateError;
+    uint32_t magnitude = output >= 0 ? output : -output;
+    if (magnitude > control.correctionMax) control.correctionMax = magnitude;
+    return output;
+}
+
+
+//==================================================================================//
+
+inline uint8_t yawSaturate(uint32_t value) {
+    return value < 255 ? value : 255;
+}
+
+// window of the control task with the IMU task's counts, cleared once sent
+inline void yawRecord(uint8_t record[8], uint8_t type, uint8_t flags, YAWCONTROL& control, int32_t biasLsbQ8,
+                      uint32_t overflows, uint32_t errors) {
+    int32_t bias = yawRate(biasLsbQ8) / 10;                 // 0.01 deg/s
+    if (bias > 32767) bias = 32767;
+    if (bias < -32768) bias = -32768;
+
+    record[0] = type;
+    record[1] = flags | (control.active ? YAW_FLAG_ACTIVE : 0) | (control.saturated ? YAW_FLAG_SATURATED : 0);
+    record[2] = yawSaturate(control.activeLoops ? control.errorSum / control.activeLoops / 1000 : 0);
+    record[3] = yawSaturate(control.correctionMax / 10);
+    record[4] = (uint16_t)bias >> 8;
+    record[5] = (uint16_t)bias & 0xFF;
+    record[6] = yawSaturate(overflows);
+    record[7] = yawSaturate(errors);
+
+    control.activeLoops = 0;
+    control.errorSum = 0;
+    control.correctionMax = 0;
+    control.saturated = false;
+}
@@ -148,7 +148,8 @@ bool SBUS::readCal(float* calChannels, bool* failsafe, bool* lostFrame)
 /* write SBUS packets */
 void SBUS::write(uint16_t* channels)
 {
-	static uint8_t packet[25];
+	// per instance, two SBUS outputs must not share one frame buffer
+	uint8_t* packet = _txPacket;
 	/* assemble the SBUS packet */
 	// SBUS header
 	packet[0] = _sbusHeader;
@@ -185,7 +186,7 @@ void SBUS::write(uint16_t* channels)
 		// use ISR to send byte at a time,
 		// 130 us between bytes to emulate 2 stop bits
 		noInterrupts();
-		memcpy(&PACKET,&packet,sizeof(packet));
+		memcpy(PACKET,_txPacket,sizeof(_txPacket));
 		interrupts();
 		serialTimer.priority(255);
 		serialTimer.begin(sendByte,130);
@@ -228,6 +229,18 @@ void SBUS::getEndPoints(uint8_t channel,uint16_t *min,uint16_t *max)
 
 void SBUS::setReadCal(uint8_t channel,float *coeff,uint8_t len)
 {
+#ifdef SBUS_STATIC_CAL
+	if (coeff) {
+		if (len > SBUS_STATIC_CAL) {
+			len = SBUS_STATIC_CAL;
+		}
+		for (uint8_t i = 0; i < len; i++) {
+			_readCoeff[channel][i] = coeff[i];
+		}
+		_readLen[channel] = len;
+		_useReadCoeff[channel] = true;
+	}
+#else
 	if (coeff) {
 		if (!_readCoeff) {
 			_readCoeff = (float**) malloc(sizeof(float*)*_numChannels);
@@ -244,6 +257,7 @@ void SBUS::setReadCal(uint8_t channel,float *coeff,uint8_t len)
 		_readLen[channel] = len;
 		_useReadCoeff[channel] = true;
 	}
+#endif
 }
 
 void SBUS::getReadCal(uint8_t channel,float *coeff,uint8_t len)
@@ -257,6 +271,18 @@ void SBUS::getReadCal(uint8_t channel,float *coeff,uint8_t len)
 
 void SBUS::setWriteCal(uint8_t channel,float *coeff,uint8_t len)
 {
+#ifdef SBUS_STATIC_CAL
+	if (coeff) {
+		if (len > SBUS_STATIC_CAL) {
+			len = SBUS_STATIC_CAL;
+		}
+		for (uint8_t i = 0; i < len; i++) {
+			_writeCoeff[channel][i] = coeff[i];
+		}
+		_writeLen[channel] = len;
+		_useWriteCoeff[channel] = true;
+	}
+#else
 	if (coeff) {
 		if (!_writeCoeff) {
 			_writeCoeff = (float**) malloc(sizeof(float*)*_numChannels);
@@ -273,6 +299,7 @@ void SBUS::setWriteCal(uint8_t channel,float *coeff,uint8_t len)
 		_writeLen[channel] = len;
 		_useWriteCoeff[channel] = true;
 	}
+#endif
 }
 
 void SBUS::getWriteCal(uint8_t channel,float *coeff,uint8_t len)
@@ -287,6 +314,7 @@ void SBUS::getWriteCal(uint8_t channel,float *coeff,uint8_t len)
 /* destructor, free dynamically allocated memory */
 SBUS::~SBUS()
 {
+#ifndef SBUS_STATIC_CAL
 	if (_readCoeff) {
 		for (uint8_t i = 0; i < _numChannels; i++) {
 			if (_readCoeff[i]) {
@@ -303,13 +331,13 @@ SBUS::~SBUS()
 		}
 		free(_writeCoeff);
 	}
+#endif
 }
 
 /* parse the SBUS data */
 bool SBUS::parse()
 {
 	// reset the parser state if too much time has passed
-	static elapsedMicros _sbusTime = 0;
 	if (_sbusTime > SBUS_TIMEOUT_US) {_parserState = 0;}
 	// see if serial data is available
 	while (_bus->available() > 0) {
@@ -62,8 +62,10 @@ class SBUS{
 		const uint8_t _sbus2Mask = 0x0F;
 		const uint32_t SBUS_TIMEOUT_US = 7000;
 		uint8_t _parserState, _prevByte = _sbusFooter, _curByte;
+		elapsedMicros _sbusTime;	// per bus: a shared timer let one bus reset the other's parser
 		static const uint8_t _payloadSize = 24;
 		uint8_t _payload[_payloadSize];
+		uint8_t _txPacket[25] = {0};
 		const uint8_t _sbusLostFrame = 0x04;
 		const uint8_t _sbusFailSafe = 0x08;
 		const uint16_t _defaultMin = 220;
@@ -72,7 +74,12 @@ class SBUS{
 		uint16_t _sbusMax[_numChannels];
 		float _sbusScale[_numChannels];
 		float _sbusBias[_numChannels];
+#ifdef SBUS_STATIC_CAL
+		// fixed calibration storage, SBUS_STATIC_CAL = max polynomial coefficients per channel (no malloc)
+		float _readCoeff[_numChannels][SBUS_STATIC_CAL], _writeCoeff[_numChannels][SBUS_STATIC_CAL];
+#else
 		float **_readCoeff, **_writeCoeff;
+#endif
 		uint8_t _readLen[_numChannels],_writeLen[_numChannels];
 		bool _useReadCoeff[_numChannels], _useWriteCoeff[_numChannels];
 		HardwareSerial* _bus;
@@ -0,0 +1,38 @@
+# Flash/RAM footprint per build environment, run after linking (extra_scripts = post:...).
+# Keeps one line per environment in footprint.txt so the configurations can be compared:
+#   pio run -e esp32doit-devkit-v1 -e vcu-sbus -e vcu-can -e vcu-xbox -e vcu-sbus-out -e vcu-static -e vcu-tt -e vcu-clock -e vcu-link -e vcu-event -e vcu-dshot -e vcu-power -e vcu-yaw -e vcu-diversity -e vcu-estop -e vcu-jobs && cat footprint.txt
+
+import os
+import subprocess
+
+Import("env")
+
+FOOTPRINT_FILE = os.path.join(env.subst("$PROJECT_DIR"), "footprint.txt")
+HEADER = "%-24s %10s %10s %10s   %s" % ("environment", "flash", "ram", "bss", "build flags")
+
+
+def footprint(source, target, env):
+    elf = str(target[0])
+    output = subprocess.check_output([env.subst("$SIZETOOL"), "-B", elf]).decode()
+    text, data, bss = [int(v) for v in output.splitlines()[1].split()[:3]]
+    flags = " ".join(f for f in env.get("BUILD_FLAGS", []) if f.startswith("-DVCU_"))
+    line = "%-24s %10d %10d %10d   %s" % (env["PIOENV"], text + data, data + bss, bss, flags)
+
+    lines = {}
+    if os.path.exists(FOOTPRINT_FILE):
+        with open(FOOTPRINT_FILE) as f:
+            for row in f.read().splitlines()[1:]:
+                if row.strip():
+                    lines[row.split()[0]] = row
+    lines[env["PIOENV"]] = line
+
+    with open(FOOTPRINT_FILE, "w") as f:
+        f.write(HEADER + "\n")
+        for name in sorted(lines):
+            f.write(lines[name] + "\n")
+
+    print(HEADER)
+    print(line)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", footprint)
@@ -0,0 +1,11 @@
+#pragma once
+
+// Pass / fail lines of the host reports and simulations, the check names aligned in one
+// column. hostCheck() returns 'ok' so the checks can be and-ed into the exit code.
+
+#include <stdio.h>
+
+inline bool hostCheck(const char* name, bool ok, int indent = 2) {
+  printf("%*s%-*s %s\n", indent, "", 64 - indent, name, ok ? "ok" : "FAILED");
+  return ok;
+}
@@ -0,0 +1,153 @@
+/* Battery voltage chain against a simulated pack and ADC (include/BATTERY.h).
+
+The pack discharges from 16.8 V to 13.0 V over the run and sags by 1.2 V under load bursts.
+The ADC sees it through the divider with the nonlinear 11 dB transfer curve of the default
+calibration table, 6 LSB rms noise and occasional 200 LSB spikes, at BATTERY_SAMPLE_HZ.
+Each DMA block goes through batteryUpdate() like in the BATTERY task. Reported are:
+  - the error of a single raw sample read as a straight 0 - 3.3 V line (an analogRead())
+  - the error of the oversampled and calibrated block against the block's true mean
+  - the filtered output against the true voltage filtered with the same time constant
+  - the step response to a 2 V drop, and the derating curve over the cell voltage
+Exit code 1 if the calibrated block error exceeds 5 cV or the filter misses its time constant.
+
+  vcu_host battery */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <BATTERY.h>
+
+#define SIM_SECONDS         60
+#define SIM_NOISE_LSB       6.0
+#define SIM_SPIKE_PER_MIL   2               // samples in a thousand
+#define SIM_SPIKE_LSB       200
+
+static double simGauss() {
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// inverse of the calibration table: the code the ADC produces for a pin voltage
+static double simCode(double pinMv) {
+  const BATTERYCAL& cal = batteryDefaultCal;
+  for (int i = 0; i < BATTERY_CAL_POINTS - 1; i++) {
+    if (pinMv <= cal.mv[i + 1] || i == BATTERY_CAL_POINTS - 2) {
+      double f = (pinMv - cal.mv[i]) / (cal.mv[i + 1] - cal.mv[i]);
+      return fmin(fmax((i + f) * 512, 0), 4095);
+    }
+  }
+  return 4095;
+}
+
+static uint32_t simSample(double packV) {
+  double pinMv = packV * 1000 * BATTERY_DIVIDER_BOTTOM / (BATTERY_DIVIDER_TOP + BATTERY_DIVIDER_BOTTOM);
+  double code = simCode(pinMv) + SIM_NOISE_LSB * simGauss();
+  if (rand() % 1000 < SIM_SPIKE_PER_MIL) code += (rand() & 1 ? 1 : -1) * SIM_SPIKE_LSB;
+  return (uint32_t)fmin(fmax(lround(code), 0), 4095);
+}
+
+// discharge plus load bursts: 300 ms at full load every 2 s
+static double simPack(double t) {
+  double resting = 16.8 - 3.8 * t / SIM_SECONDS;
+  return resting - (fmod(t, 2.0) < 0.3 ? 1.2 : 0);
+}
+
+namespace {
+
+struct SIMERROR {
+  uint32_t count;
+  double sumSquares;
+  double max;
+};
+
+}  // namespace
+
+static void simError(SIMERROR& e, double error) {
+  e.count++;
+  e.sumSquares += error * error;
+  e.max = fmax(e.max, fabs(error));
+}
+
+static void simPrint(const char* name, const SIMERROR& e) {
+  printf("  %-38s rms %7.2f  max %7.2f cV  (%u)\n", name, sqrt(e.sumSquares / e.count), e.max, e.count);
+}
+
+
+//==================================================================================//
+
+int batteryReport(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  srand(3);
+  const uint32_t blockHz = BATTERY_SAMPLE_HZ / BATTERY_BLOCK_SAMPLES;
+  const double dt = 1.0 / BATTERY_SAMPLE_HZ;
+  const double alpha = batteryAlpha(blockHz, BATTERY_FILTER_MS) / 65536.0;
+
+  printf("battery: %d kOhm / %d kOhm divider, %u Hz sampling, %u samples per block (%u Hz), filter %u ms "
+         "(alpha %.4f), %d cells\n\n", BATTERY_DIVIDER_TOP, BATTERY_DIVIDER_BOTTOM, BATTERY_SAMPLE_HZ,
+         BATTERY_BLOCK_SAMPLES, blockHz, BATTERY_FILTER_MS, alpha, BATTERY_CELLS);
+
+  BATTERYFILTER filter;
+  batteryFilterReset(filter, batteryAlpha(blockHz, BATTERY_FILTER_MS));
+  SIMERROR raw = SIMERROR(), block = SIMERROR(), filtered = SIMERROR();
+  double reference = 0;
+  bool primed = false;
+
+  uint32_t blocks = SIM_SECONDS * blockHz;
+  for (uint32_t b = 0; b < blocks; b++) {
+    uint32_t sum = 0;
+    double trueSum = 0;
+    for (uint32_t i = 0; i < BATTERY_BLOCK_SAMPLES; i++) {
+      double t = (b * BATTERY_BLOCK_SAMPLES + i) * dt;
+      double pack = simPack(t);
+      uint32_t code = simSample(pack);
+      sum += code;
+      trueSum += pack;
+      if (i == 0) {
+        double analogRead = code * 3300.0 / 4095 * (BATTERY_DIVIDER_TOP + BATTERY_DIVIDER_BOTTOM) / BATTERY_DIVIDER_BOTTOM;
+        simError(raw, analogRead / 10 - pack * 100);
+      }
+    }
+    double trueMean = trueSum / BATTERY_BLOCK_SAMPLES * 100;
+
+    // the block alone, and through the filter against the same filter on the true voltage
+    uint32_t code = batteryOversample(sum, BATTERY_BLOCK_SAMPLES);
+    simError(block, batteryCentivolts(batteryPinMv(batteryDefaultCal, code)) - trueMean);
+    int16_t cv = batteryUpdate(filter, batteryDefaultCal, sum, BATTERY_BLOCK_SAMPLES);
+    reference = primed ? reference + alpha * (trueMean - reference) : trueMean;
+    primed = true;
+    if (b > blockHz) simError(filtered, cv - reference);
+  }
+
+  simPrint("single sample, linear 0 - 3.3 V", raw);
+  simPrint("block, oversampled and calibrated", block);
+  simPrint("filtered, against the ideal filter", filtered);
+
+  // step response: settled at 16 V, then 14 V
+  BATTERYFILTER step;
+  batteryFilterReset(step, batteryAlpha(blockHz, BATTERY_FILTER_MS));
+  uint32_t settle = 0, tau = 0;
+  for (uint32_t b = 0; b < 5 * blockHz; b++) {
+    double pack = b < blockHz ? 16.0 : 14.0;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < BATTERY_BLOCK_SAMPLES; i++) sum += simSample(pack);
+    int16_t cv = batteryUpdate(step, batteryDefaultCal, sum, BATTERY_BLOCK_SAMPLES);
+    if (b >= blockHz && tau == 0 && cv <= 1600 - 0.632 * 200) tau = b - blockHz + 1;
+    if (b >= blockHz && settle == 0 && cv <= 1400 + 5) settle = b - blockHz + 1;
+  }
+  double tauMs = tau * 1000.0 / blockHz;
+  printf("\n  step 16 V -> 14 V: 63 %% after %.0f ms (time constant %u ms), within 5 cV after %.0f ms\n", tauMs,
+         BATTERY_FILTER_MS, settle * 1000.0 / blockHz);
+
+  printf("\n  derating (per cell V: throttle deflection left)\n   ");
+  for (int cell = 300; cell <= 380; cell += 10) {
+    int16_t cv = cell * BATTERY_CELLS;
+    printf(" %.2f: %3.0f %%", cell / 100.0, batteryDerate(cv) * 100.0 / 256);
+  }
+  printf("\n    2000 us at 3.45 V/cell -> %d us, 1000 us -> %d us\n",
+         batteryLimit(2000, batteryDerate(345 * BATTERY_CELLS)), batteryLimit(1000, batteryDerate(345 * BATTERY_CELLS)));
+
+  bool pass = block.max <= 5 && tau > 0 && fabs(tauMs - BATTERY_FILTER_MS) <= 0.1 * BATTERY_FILTER_MS;
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
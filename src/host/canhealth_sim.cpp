@@ -0,0 +1,347 @@
+/* CAN health monitor against a mock controller (include/CANHEALTH.h).
+
+The mock follows the fault confinement of an SJA1000 type controller at 10 us steps: the VCU
+sends a status frame every 10 ms (a failed frame is repeated straight away, +8 on the TEC, -1
+per frame that goes through), the master's commands arrive every 10 ms (+1 / -1 on the REC).
+Over 255 it goes bus-off and into reset mode; released, it rejoins after 128 x 11 recessive
+bits unless the bus is stuck dominant. Faults of one scenario each:
+  noise       the given share of frames destroyed (bit errors sending, stuff errors receiving)
+  stuck       bus held dominant: bus-off, the recovery never completes
+  unplugged   no acknowledge: error passive, the TEC stops at 128, never bus-off
+  no start    the controller drops into reset and does not start again until the fault ends
+The CANBUS task is modelled as in CANBUS(): every 5 ms a sample through canHealthUpdate() and
+the action carried out on the mock. The control task takes the throttle of the last command
+or the failsafe throttle while canHealthDown(). Checked per scenario:
+  bus-offs    counted as the mock went bus-off
+  outages     one per stretch off the bus (stretches less than CAN_STABLE_MS apart are one),
+              duration within one sample period of the mock's
+  recovery    back on the bus within the bound once the fault is gone
+  failsafe    at every sample that found the controller off the bus
+  errors      counted when the mock made any, per type no more than it made (a lower bound)
+Exit code 1 if a check fails.
+
+  vcu_host sim-canhealth */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <CANHEALTH.h>
+#include <HOSTCHECK.h>
+
+#define SIM_STEP_US         10
+#define SIM_POLL_US         5000          // CANBUS task
+#define SIM_FRAME_PERIOD_US 10000         // status frames and commands
+#define SIM_FRAME_US        130           // one frame and the gap before it is repeated, 1 Mbps
+#define SIM_RECOVERY_US     1408          // 128 x 11 recessive bits
+#define SIM_DURATION_US     10000000LL
+#define SIM_THROTTLE        1700          // commanded
+#define SIM_FAILSAFE        1500          // CAN_DOWN_THROTTLE
+
+#define FAULT_NONE          0
+#define FAULT_NOISE         1
+#define FAULT_STUCK         2
+#define FAULT_UNPLUGGED     3
+#define FAULT_NO_START      4
+
+// error code capture as the controller stores it: type in bits 7-6, bit 5 set when receiving
+#define ECC_TX_BIT          0x00
+#define ECC_RX_BIT          0x20
+#define ECC_RX_STUFF        0xA0
+#define ECC_TX_ACK          0xD9
+
+namespace {
+
+struct SIMSCENARIO {
+  const char* name;
+  uint8_t fault;
+  double start;                         // s
+  double length;
+  double errorPercent;                  // noise: frames destroyed
+  uint32_t recoveryBoundMs;             // back on the bus after the fault, at the latest
+};
+
+struct MOCKCAN {
+  bool started;                         // what the driver knows: begin() went through
+  bool reset;                           // reset mode
+  bool busOff;
+  uint32_t recoveryUs;
+  int tec;
+  int rec;
+  uint8_t code;
+  int64_t statusAt;
+  int64_t commandAt;
+  int64_t retryAt;
+  bool pending;
+
+  // truth
+  uint32_t busOffs;
+  uint32_t txErrors;
+  uint32_t rxErrors;
+  uint32_t errorTypes[4];
+};
+
+struct SIMOUTAGE {
+  int64_t start;
+  int64_t end;
+};
+
+}  // namespace
+
+static double simRandom() {
+  return 100.0 * rand() / ((double)RAND_MAX + 1);
+}
+
+
+//==================================================================================//
+
+static bool mockBegin(MOCKCAN& m, bool fails, int64_t now) {
+  m.started = !fails;
+  m.reset = fails;
+  m.busOff = false;
+  m.tec = 0;
+  m.rec = 0;
+  m.pending = false;
+  m.statusAt = now + SIM_FRAME_PERIOD_US;
+  m.retryAt = 0;
+  return m.started;
+}
+
+static bool mockOffBus(const MOCKCAN& m) {
+  return !m.started || m.reset || m.busOff;
+}
+
+// what canSample() reads from the registers
+static CANSAMPLE mockSample(const MOCKCAN& m, bool started) {
+  CANSAMPLE sample = CANSAMPLE();
+  if (!started) return sample;
+  sample.running = !m.reset;
+  sample.busOff = m.busOff;
+  sample.tec = m.tec < 255 ? m.tec : 255;
+  sample.rec = m.rec < 255 ? m.rec : 255;
+  sample.errorCode = m.code;
+  return sample;
+}
+
+static void mockError(MOCKCAN& m, uint8_t code, bool transmit) {
+  m.code = code;
+  m.errorTypes[code >> 6]++;
+  if (transmit) m.txErrors++;
+  else m.rxErrors++;
+}
+
+static void mockStep(MOCKCAN& m, uint8_t fault, double errorPercent, int64_t now) {
+  if (!m.started) return;
+  if (m.busOff) {
+    if (!m.reset && fault != FAULT_STUCK) {
+      m.recoveryUs += SIM_STEP_US;
+      if (m.recoveryUs >= SIM_RECOVERY_US) {
+        m.busOff = false;
+        m.tec = 0;
+        m.rec = 0;
+      }
+    }
+    return;
+  }
+  if (m.reset) return;
+
+  // status frame
+  if (now >= m.statusAt) {
+    m.pending = true;
+    m.statusAt += SIM_FRAME_PERIOD_US;
+  }
+  if (m.pending && now >= m.retryAt) {
+    if (fault == FAULT_UNPLUGGED) {
+      // no acknowledge: counted up to error passive only, the library aborts the frame
+      if (m.tec < 128) {
+        m.tec += 8;
+        mockError(m, ECC_TX_ACK, true);
+      }
+      m.pending = false;
+    } else if (fault == FAULT_STUCK || (fault == FAULT_NOISE && simRandom() < errorPercent)) {
+      m.tec += 8;
+      mockError(m, ECC_TX_BIT, true);
+      m.retryAt = now + SIM_FRAME_US;
+      if (m.tec > 255) {
+        m.busOff = true;
+        m.reset = true;
+        m.recoveryUs = 0;
+        m.pending = false;
+        m.busOffs++;
+      }
+    } else {
+      if (m.tec > 0) m.tec--;
+      m.pending = false;
+    }
+  }
+
+  // command from the master
+  if (now >= m.commandAt) {
+    m.commandAt += SIM_FRAME_PERIOD_US;
+    if (fault == FAULT_STUCK) {
+      if (m.rec < 255) m.rec++;
+      mockError(m, ECC_RX_BIT, false);
+    } else if (fault == FAULT_NOISE && simRandom() < errorPercent) {
+      if (m.rec < 255) m.rec++;
+      mockError(m, ECC_RX_STUFF, false);
+    } else if (fault != FAULT_UNPLUGGED && m.rec > 0) {
+      m.rec--;
+    }
+  }
+}
+
+
+//==================================================================================//
+
+static bool simRun(const SIMSCENARIO& scenario) {
+  int64_t faultStart = scenario.start * 1e6;
+  int64_t faultEnd = (scenario.start + scenario.length) * 1e6;
+
+  MOCKCAN m = MOCKCAN();
+  CANHEALTH health;
+  canHealthReset(health);
+  bool canUp = mockBegin(m, false, 0);
+
+  std::vector<SIMOUTAGE> truth;
+  std::vector<uint32_t> measured;
+  int64_t offSince = -1, backAfterFault = -1;
+  uint32_t polls = 0, offPolls = 0, failsafeMissed = 0, failsafeLate = 0, reported = 0;
+  uint8_t worstState = CAN_STATE_ACTIVE;
+  uint32_t txEstimate = 0, rxEstimate = 0, typeEstimate[4] = {0, 0, 0, 0};
+
+  for (int64_t now = 0; now < SIM_DURATION_US; now += SIM_STEP_US) {
+    bool inFault = now >= faultStart && now < faultEnd;
+    uint8_t fault = inFault ? scenario.fault : FAULT_NONE;
+    if (scenario.fault == FAULT_NO_START && now == faultStart) m.reset = true;
+
+    if (now % SIM_POLL_US == 0) {
+      bool offBus = mockOffBus(m);
+      uint8_t action = canHealthUpdate(health, mockSample(m, canUp), now);
+      if (action == CAN_ACTION_RECOVER) {
+        m.reset = false;
+        m.recoveryUs = 0;
+      } else if (action == CAN_ACTION_REINIT) {
+        canUp = mockBegin(m, fault == FAULT_NO_START, now);
+      }
+
+      // control task: failsafe while the monitor reports the bus down
+      int16_t throttle = canHealthDown(health) ? SIM_FAILSAFE : SIM_THROTTLE;
+      polls++;
+      if (offBus) {
+        offPolls++;
+        if (throttle != SIM_FAILSAFE) failsafeMissed++;
+      } else if (offSince < 0 && throttle == SIM_FAILSAFE && !truth.empty() &&
+                 now - truth.back().end > (CAN_STABLE_MS * 1000LL + 2 * SIM_POLL_US)) {
+        failsafeLate++;
+      }
+      if (health.state > worstState && health.state <= CAN_STATE_BUS_OFF) worstState = health.state;
+
+      // window counters as the records hand them out
+      if (now % 1000000 == 0) {
+        uint8_t record[8];
+        canHealthErrorRecord(record, 0xC0, health);
+        for (uint8_t i = 0; i < 4; i++) typeEstimate[i] += record[1 + i];
+        txEstimate += record[5];
+        rxEstimate += record[6];
+      }
+      if (health.outages > 0 && health.outageStart == 0 && reported < health.outages) {
+        measured.push_back(health.lastOutageMs);
+        reported = health.outages;
+      }
+    }
+
+    mockStep(m, fault, scenario.errorPercent, now);
+
+    // truth: stretches off the bus, less than CAN_STABLE_MS apart merged
+    bool off = mockOffBus(m);
+    if (off && offSince < 0) {
+      offSince = now;
+      if (!truth.empty() && now - truth.back().end < CAN_STABLE_MS * 1000LL) {
+        offSince = truth.back().start;
+        truth.pop_back();
+      }
+    } else if (!off && offSince >= 0) {
+      truth.push_back(SIMOUTAGE{offSince, now});
+      offSince = -1;
+    }
+    if (!off && now >= faultEnd && backAfterFault < 0) backAfterFault = now;
+  }
+  uint8_t record[8];
+  canHealthErrorRecord(record, 0xC0, health);
+  for (uint8_t i = 0; i < 4; i++) typeEstimate[i] += record[1 + i];
+  txEstimate += record[5];
+  rxEstimate += record[6];
+
+  printf("  %s\n", scenario.name);
+  printf("    mock: %u bus-offs, %u transmit / %u receive errors (bit %u form %u stuff %u other %u)\n", m.busOffs,
+         m.txErrors, m.rxErrors, m.errorTypes[0], m.errorTypes[1], m.errorTypes[2], m.errorTypes[3]);
+  printf("    monitor: %u bus-offs, %u restarts, %u transmit / %u receive errors (bit %u form %u stuff %u other %u)\n",
+         health.busOffs, health.restarts, txEstimate, rxEstimate, typeEstimate[0], typeEstimate[1], typeEstimate[2],
+         typeEstimate[3]);
+  printf("    outages: %zu (mock %zu)", measured.size(), truth.size());
+  for (size_t i = 0; i < truth.size() && i < measured.size(); i++) {
+    printf("  %u ms (%lld)", measured[i], (long long)((truth[i].end - truth[i].start) / 1000));
+  }
+  printf("\n    back on the bus %.1f ms after the fault, %u of %u samples off the bus\n",
+         backAfterFault >= 0 ? (backAfterFault - faultEnd) / 1000.0 : -1.0, offPolls, polls);
+
+  bool durations = measured.size() == truth.size();
+  for (size_t i = 0; durations && i < truth.size(); i++) {
+    int64_t error = (int64_t)measured[i] * 1000 - (truth[i].end - truth[i].start);
+    durations &= error <= SIM_POLL_US && error >= -SIM_POLL_US;
+  }
+
+  bool pass = true;
+  pass &= hostCheck("bus-offs counted", health.busOffs == m.busOffs, 4);
+  pass &= hostCheck("outages counted and timed", durations && health.outages == truth.size(), 4);
+  pass &= hostCheck("back on the bus within the bound",
+                    backAfterFault >= 0 && backAfterFault - faultEnd <= scenario.recoveryBoundMs * 1000LL, 4);
+  pass &= hostCheck("failsafe throttle at every sample off the bus, released after", failsafeMissed == 0 &&
+                                                                                      failsafeLate == 0, 4);
+  pass &= hostCheck("errors by type, none the mock did not make",
+                    txEstimate <= m.txErrors && rxEstimate <= m.rxErrors &&
+                    (m.txErrors + m.rxErrors == 0) == (txEstimate + rxEstimate == 0) &&
+                    typeEstimate[0] <= m.errorTypes[0] && typeEstimate[1] <= m.errorTypes[1] &&
+                    typeEstimate[2] <= m.errorTypes[2] && typeEstimate[3] <= m.errorTypes[3], 4);
+  if (scenario.fault == FAULT_UNPLUGGED) {
+    pass &= hostCheck("error passive, no outage", worstState == CAN_STATE_PASSIVE && health.outages == 0, 4);
+  }
+  if (scenario.fault == FAULT_STUCK || scenario.fault == FAULT_NO_START) {
+    // backoff doubling from CAN_RESTART_MIN_MS, then one per CAN_RESTART_MAX_MS
+    uint32_t limit = 8 + scenario.length * 1000 / CAN_RESTART_MAX_MS;
+    printf("    %u restarts, at most %u with the backoff\n", health.restarts, limit);
+    pass &= hostCheck("restarts held off by the backoff", health.restarts > 0 && health.restarts <= limit, 4);
+  }
+  return pass;
+}
+
+
+//==================================================================================//
+
+int canHealthSim(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  srand(7);
+
+  // bound: the sample that finds it off, then the recovery; after a restart the backoff
+  const SIMSCENARIO scenarios[] = {
+    {"no fault", FAULT_NONE, 2, 1, 0, 0},
+    {"noise, 2 % of frames for 3 s", FAULT_NOISE, 2, 3, 2, 0},
+    {"noise, every frame for 50 ms", FAULT_NOISE, 2, 0.05, 100, 8},
+    {"noise, 60 % of frames for 2 s", FAULT_NOISE, 2, 2, 60, 8},
+    {"bus stuck dominant for 3 s", FAULT_STUCK, 2, 3, 0, CAN_RESTART_MAX_MS + CAN_RECOVER_MS + 2 * SIM_POLL_US / 1000},
+    {"bus stuck dominant for 30 ms", FAULT_STUCK, 2, 0.03, 0, 60 + 2 * SIM_POLL_US / 1000},
+    {"unplugged for 2 s", FAULT_UNPLUGGED, 2, 2, 0, 0},
+    {"controller does not start for 1.5 s", FAULT_NO_START, 2, 1.5, 0, CAN_RESTART_MAX_MS + SIM_POLL_US / 1000},
+  };
+
+  printf("CAN health against a mock controller: sampled every %d ms, recovery %d ms before a restart,\n"
+         "restart backoff %d - %d ms, back on the bus for %d ms ends an outage\n\n",
+         SIM_POLL_US / 1000, CAN_RECOVER_MS, CAN_RESTART_MIN_MS, CAN_RESTART_MAX_MS, CAN_STABLE_MS);
+
+  bool pass = true;
+  for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) pass &= simRun(scenarios[s]);
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
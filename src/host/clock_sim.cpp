@@ -0,0 +1,182 @@
+/* CAN clock synchronization against simulated clocks (include/CLOCKSYNC.h).
+
+The master clock is the reference timebase. The VCU clock starts at an offset and runs fast
+by a given drift, which steps by another +20 ppm halfway through, like a board warming up.
+Every CLOCK_SYNC_MS the master sends SYNC, takes its bus time and sends FOLLOW_UP. Both
+frames go through clockReceive() exactly as the CANBUS task sees them. The SYNC reception
+stamp has interrupt latency jitter, and 2 % of the follow-ups are lost.
+
+Between syncs the estimate is compared with the true master time. This gives the offset
+error and the drift estimate error once locked. The mean reception latency of the SYNC
+cannot be observed by the VCU and remains as an offset bias. Stamped command frames with
+a known bus latency then check that clockAge() measures one way latency to within the
+offset error. Exit code 1 if the clock does not lock, or if the error is larger than the
+SYNC reception latency plus SIM_RESIDUAL_US.
+
+  vcu_host sim-clock [offset us] [drift ppm] [jitter us] */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <CLOCKSYNC.h>
+
+#define SIM_SECONDS         60
+#define SIM_DRIFT_STEP_PPM  20          // added halfway through
+#define SIM_FOLLOWUP_LOSS   2           // %
+#define SIM_PROBES          7           // error probes between two syncs
+#define SIM_BUS_MIN_US      130         // command latency: one frame at 1 Mbps ...
+#define SIM_BUS_MAX_US      4000        // ... up to a busy bus and a late CANBUS task
+#define SIM_RESIDUAL_US     10          // servo error allowed beyond the reception latency
+
+namespace {
+
+struct SIMCLOCK {
+  double offsetUs;                      // local - master at master time 0
+  double driftPpm;                      // local runs fast by this much
+  double stepAt;                        // master us of the drift step
+  double stepPpm;
+};
+
+}  // namespace
+
+// local time of the VCU at master time t
+static int64_t simLocal(const SIMCLOCK& c, double t) {
+  double local = c.offsetUs + t * (1.0 + c.driftPpm * 1e-6);
+  if (t > c.stepAt) local += (t - c.stepAt) * c.stepPpm * 1e-6;
+  return (int64_t)floor(local);
+}
+
+static double simDriftPpm(const SIMCLOCK& c, double t) {
+  return c.driftPpm + (t > c.stepAt ? c.stepPpm : 0);
+}
+
+static double simUniform(double low, double high) {
+  return low + (high - low) * rand() / (double)RAND_MAX;
+}
+
+namespace {
+
+struct SIMERROR {
+  uint32_t count;
+  double sum;
+  double sumSquares;
+  double max;
+};
+
+}  // namespace
+
+static void simError(SIMERROR& e, double error) {
+  e.count++;
+  e.sum += error;
+  e.sumSquares += error * error;
+  e.max = fmax(e.max, fabs(error));
+}
+
+static void simPrint(const char* name, const SIMERROR& e, const char* unit) {
+  if (e.count == 0) {
+    printf("  %-26s no samples\n", name);
+    return;
+  }
+  printf("  %-26s mean %8.2f  rms %8.2f  max %8.2f %s  (%u)\n", name, e.sum / e.count,
+         sqrt(e.sumSquares / e.count), e.max, unit, e.count);
+}
+
+static CANRECIEVER simFrame(uint16_t id, int64_t at) {
+  CANRECIEVER msg = CANRECIEVER();
+  msg.recieved = true;
+  msg.id = id;
+  msg.at = at;
+  return msg;
+}
+
+
+//==================================================================================//
+
+int clockSim(int argc, char** argv) {
+  SIMCLOCK sim;
+  sim.offsetUs = argc >= 1 ? atof(argv[0]) : 3.7e6;
+  sim.driftPpm = argc >= 2 ? atof(argv[1]) : 40;
+  double jitterUs = argc >= 3 ? atof(argv[2]) : 20;
+  sim.stepAt = SIM_SECONDS * 1e6 / 2;
+  sim.stepPpm = SIM_DRIFT_STEP_PPM;
+  srand(7);
+
+  printf("clock sync: offset %.0f us, drift %+.1f ppm (%+d ppm at %d s), SYNC jitter 0 - %.0f us, "
+         "%d %% follow-ups lost, %d s\n\n", sim.offsetUs, sim.driftPpm, SIM_DRIFT_STEP_PPM, SIM_SECONDS / 2,
+         jitterUs, SIM_FOLLOWUP_LOSS, SIM_SECONDS);
+
+  CLOCKSYNC clock = CLOCKSYNC();
+  CLOCKPENDING pending = CLOCKPENDING();
+  SIMERROR offset = SIMERROR(), offsetStep = SIMERROR(), drift = SIMERROR(), latency = SIMERROR();
+  int lockedAt = -1, relockAt = -1;
+  uint32_t lost = 0, unlocked = 0;
+
+  int syncs = SIM_SECONDS * 1000 / CLOCK_SYNC_MS;
+  for (int n = 0; n < syncs; n++) {
+    double t = n * CLOCK_SYNC_MS * 1000.0;
+    uint8_t sequence = n & 0xFF;
+
+    // SYNC on the bus at master time t, stamped by the VCU's receive interrupt
+    CANRECIEVER sync = simFrame(CLOCK_SYNC_ID, simLocal(sim, t + simUniform(2, 2 + jitterUs)));
+    sync.length = 1;
+    sync.data[0] = sequence;
+    clockReceive(clock, pending, sync);
+
+    // FOLLOW_UP with the master time of that SYNC, a few hundred us later
+    if (rand() % 100 < SIM_FOLLOWUP_LOSS) {
+      lost++;
+    } else {
+      CANRECIEVER followUp = simFrame(CLOCK_FOLLOWUP_ID, simLocal(sim, t + 400));
+      followUp.length = 8;
+      followUp.data[0] = sequence;
+      int64_t master = (int64_t)t;
+      for (uint8_t i = 0; i < 7; i++) followUp.data[7 - i] = (master >> (8 * i)) & 0xFF;
+      clockReceive(clock, pending, followUp);
+    }
+
+    if (clock.state == CLOCK_LOCKED && lockedAt < 0) lockedAt = n;
+    if (clock.state == CLOCK_LOCKED && relockAt < 0 && t > sim.stepAt) relockAt = n;
+    if (lockedAt >= 0 && clock.state != CLOCK_LOCKED) unlocked++;
+    if (clock.state < CLOCK_TRACKING) continue;
+
+    bool settled = lockedAt >= 0 && n > lockedAt + 10;
+    bool stepping = t > sim.stepAt && t < sim.stepAt + 10e6;
+    if (settled) simError(drift, clock.driftPpb / 1000.0 - simDriftPpm(sim, t));
+
+    // offset error and latency measurement until the next sync
+    for (int p = 1; p <= SIM_PROBES; p++) {
+      double at = t + 500 + p * (CLOCK_SYNC_MS * 1000.0 - 1000) / SIM_PROBES;
+      double error = clockToMaster(clock, simLocal(sim, at)) - at;
+      if (settled) simError(stepping ? offsetStep : offset, error);
+
+      // command stamped by the master, received after a known bus latency
+      double bus = simUniform(SIM_BUS_MIN_US, SIM_BUS_MAX_US);
+      uint32_t stamp = (uint32_t)(int64_t)(at - bus) & CLOCK_STAMP_MASK;
+      CANRECIEVER command = simFrame(0, simLocal(sim, at));
+      command.extended = true;
+      command.id = clockStampedId(0x115, stamp);
+      clockUnstamp(command);
+      if (command.id != 0x115 || !command.stamped) {
+        printf("stamped ID 0x%X did not round trip\n", command.id);
+        return 1;
+      }
+      if (settled && !stepping) simError(latency, clockAge(clock, command.at, command.stamp) - bus);
+    }
+  }
+
+  printf("  locked after %d syncs (%.1f s), %u steps, %u follow-ups lost\n", lockedAt,
+         lockedAt * CLOCK_SYNC_MS / 1000.0, clock.steps, lost);
+  printf("  drift step: locked again after %.1f s, %u syncs unlocked in total\n",
+         relockAt >= 0 ? (relockAt * CLOCK_SYNC_MS * 1000.0 - sim.stepAt) / 1e6 : -1.0, unlocked);
+  printf("  final drift estimate %+.3f ppm, true %+.3f ppm\n\n", clock.driftPpb / 1000.0,
+         simDriftPpm(sim, SIM_SECONDS * 1e6));
+  simPrint("offset error, locked", offset, "us");
+  simPrint("offset error, drift step", offsetStep, "us");
+  simPrint("drift estimate error", drift, "ppm");
+  simPrint("latency measurement error", latency, "us");
+
+  double bound = 2 + jitterUs + SIM_RESIDUAL_US;
+  bool pass = lockedAt >= 0 && relockAt >= 0 && offset.max <= bound && latency.max <= bound;
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
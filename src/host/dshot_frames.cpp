@@ -0,0 +1,241 @@
+/* Bit for bit check of the DShot frames and eRPM replies (include/DSHOTFRAME.h).
+
+Packets of fixed values are compared with frames worked out by hand (1046 is the example of
+the DShot documentation), the RMT timing of each speed with the protocol's bit times, then
+every value with and without telemetry request, plain and inverted, at all three speeds is
+encoded to RMT items and compared with a bit by bit reference. The 3D throttle map is checked
+at its end points and for monotony. eRPM replies are generated the way an ESC sends them (GCR,
+a level change per 1, 5/4 bit rate) with timing jitter and decoded again. Replies with a run
+lost or stretched may only pass the GCR code and CRC as often as a 4 bit CRC lets them (1/16),
+and our own inverted frames, which the receiver on the same pin also captures, never.
+Exit code 0 when everything matches.
+
+  vcu_host dshot-frames */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <DSHOTFRAME.h>
+#include <HOSTCHECK.h>
+
+namespace {
+
+struct DSHOTVECTOR {
+  uint16_t value;
+  bool telemetry;
+  uint16_t packet;            // plain
+  uint16_t inverted;          // bidirectional, CRC inverted
+};
+
+}  // namespace
+
+static const DSHOTVECTOR vectors[] = {
+  {0, false, 0x0000, 0x000F},
+  {48, false, 0x0606, 0x0609},
+  {1046, false, 0x82C6, 0x82C9},
+  {1047, true, 0x82F5, 0x82FA},
+  {1048, false, 0x830B, 0x8304},
+  {2047, true, 0xFFFF, 0xFFF0},
+};
+
+namespace {
+
+struct DSHOTTIMING {
+  uint16_t speed;
+  uint16_t bit;               // ticks of 12.5 ns
+  uint16_t one;
+  uint16_t zero;
+  uint16_t reply;
+};
+
+}  // namespace
+
+// 1.667 / 1.25 / 0.625 us at DShot600, scaled for the others
+static const DSHOTTIMING timings[] = {
+  {600, 133, 100, 50, 106},
+  {300, 267, 200, 100, 214},
+  {150, 533, 400, 200, 426},
+};
+
+static const uint8_t gcrCode[16] = {
+  0x19, 0x1B, 0x12, 0x13, 0x1D, 0x15, 0x16, 0x17, 0x1A, 0x09, 0x0A, 0x0B, 0x1E, 0x0D, 0x0E, 0x0F
+};
+
+static const DSHOTDRIVETRAIN simDrivetrain = {1, 8 * 256, 204};
+
+// one bit at a time from the protocol definition
+static void referenceItems(uint16_t packet, const DSHOTTIMING& t, bool inverted, uint32_t items[DSHOT_ITEMS]) {
+  for (int bit = 0; bit < DSHOT_FRAME_BITS; bit++) {
+    uint32_t active = (packet & (0x8000 >> bit)) ? t.one : t.zero;
+    uint32_t rest = t.bit - active;
+    uint32_t activeLevel = inverted ? 0 : 1;
+    items[bit] = active | (activeLevel << 15) | (rest << 16) | ((1 - activeLevel) << 31);
+  }
+  items[DSHOT_FRAME_BITS] = 0;
+}
+
+// ESC side: period to the run lengths of the reply, first run low
+static void escReply(uint32_t periodUs, std::vector<uint8_t>& runs) {
+  uint8_t exponent = 0;
+  while (periodUs > 0x01FF && exponent < 7) {
+    periodUs >>= 1;
+    exponent++;
+  }
+  if (periodUs > 0x01FF) periodUs = 0x01FF;
+  uint16_t e = (exponent << 9) | periodUs;
+  uint16_t crc = ~(e ^ (e >> 4) ^ (e >> 8)) & 0x0F;
+  uint16_t value = (e << 4) | crc;
+
+  uint32_t gcr = 0;
+  for (int8_t n = 3; n >= 0; n--) gcr = (gcr << 5) | gcrCode[(value >> (4 * n)) & 0x0F];
+
+  // level change per 1: bit 20 is the start of the frame
+  uint32_t line = 1UL << 20;
+  for (int8_t i = 19; i >= 0; i--) line |= (((gcr >> i) ^ (line >> (i + 1))) & 1UL) << i;
+
+  runs.clear();
+  int8_t start = 20;
+  for (int8_t i = 19; i >= 0; i--) {
+    if (line & (1UL << i)) {
+      runs.push_back(start - i);
+      start = i;
+    }
+  }
+  runs.push_back(start + 1);
+}
+
+// runs to RMT receive items: durations with jitter, the last run of high level ends in idle
+static void captureItems(const std::vector<uint8_t>& runs, uint16_t ticks, double jitter, std::vector<uint32_t>& items) {
+  std::vector<uint16_t> durations;
+  for (size_t i = 0; i < runs.size(); i++) {
+    bool last = i + 1 == runs.size();
+    bool high = i & 1;
+    if (last && high) break;          // idle
+    double scale = 1 + jitter * (2.0 * rand() / RAND_MAX - 1);
+    durations.push_back((uint16_t)(runs[i] * ticks * scale));
+  }
+  durations.push_back(0);
+  if (durations.size() & 1) durations.push_back(0);
+
+  items.clear();
+  for (size_t i = 0; i < durations.size(); i += 2) {
+    items.push_back(durations[i] | (0UL << 15) | ((uint32_t)durations[i + 1] << 16) | (1UL << 31));
+  }
+}
+
+static uint32_t quantized(uint32_t periodUs) {
+  uint8_t exponent = 0;
+  while (periodUs > 0x01FF && exponent < 7) {
+    periodUs >>= 1;
+    exponent++;
+  }
+  if (periodUs > 0x01FF) periodUs = 0x01FF;
+  return periodUs << exponent;
+}
+
+
+//==================================================================================//
+
+int dshotFrameCheck(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  bool pass = true;
+  srand(5);
+
+  bool packets = true;
+  for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+    const DSHOTVECTOR& v = vectors[i];
+    uint16_t plain = dshotPacket(v.value, v.telemetry, false);
+    uint16_t inverted = dshotPacket(v.value, v.telemetry, true);
+    printf("  value %4u%s  %04X  inverted %04X\n", v.value, v.telemetry ? " T" : "  ", plain, inverted);
+    packets &= plain == v.packet && inverted == v.inverted;
+  }
+  pass &= hostCheck("packets against the hand worked frames", packets);
+
+  bool timing = true, frames = true;
+  uint32_t compared = 0;
+  for (size_t s = 0; s < sizeof(timings) / sizeof(timings[0]); s++) {
+    const DSHOTTIMING& t = timings[s];
+    for (uint8_t inverted = 0; inverted < 2; inverted++) {
+      DSHOTSYMBOLS symbols;
+      dshotSymbols(symbols, t.speed, inverted);
+      timing &= symbols.bitTicks == t.bit && symbols.replyTicks == t.reply;
+      timing &= (symbols.nibble[0x0F][0] & 0x7FFF) == t.one && (symbols.nibble[0][0] & 0x7FFF) == t.zero;
+
+      for (uint16_t value = 0; value <= DSHOT_VALUE_MAX; value++) {
+        for (uint8_t telemetry = 0; telemetry < 2; telemetry++) {
+          uint16_t packet = dshotPacket(value, telemetry, inverted);
+          uint32_t items[DSHOT_ITEMS], reference[DSHOT_ITEMS];
+          dshotEncode(symbols, packet, items);
+          referenceItems(packet, t, inverted, reference);
+          frames &= memcmp(items, reference, sizeof(items)) == 0;
+          compared++;
+        }
+      }
+    }
+  }
+  pass &= hostCheck("RMT bit times of DShot150 / 300 / 600", timing);
+  char name[80];
+  snprintf(name, sizeof(name), "%u frames against the bit by bit reference", compared);
+  pass &= hostCheck(name, frames);
+
+  bool monotonic = true;
+  for (int16_t us = 1511; us < 2000; us++) monotonic &= dshotThrottle(us + 1, 10) >= dshotThrottle(us, 10);
+  for (int16_t us = 1489; us > 1000; us--) monotonic &= dshotThrottle(us - 1, 10) >= dshotThrottle(us, 10);
+  pass &= hostCheck("3D throttle: neutral band stops, full range, monotonic",
+                    monotonic && dshotThrottle(1500, 10) == 0 && dshotThrottle(1510, 10) == 0 &&
+                    dshotThrottle(1490, 10) == 0 && dshotThrottle(1511, 10) == DSHOT_3D_FORWARD &&
+                    dshotThrottle(2000, 10) == DSHOT_VALUE_MAX && dshotThrottle(1489, 10) == DSHOT_VALUE_MIN &&
+                    dshotThrottle(1000, 10) == DSHOT_3D_FORWARD - 1 && dshotThrottle(2100, 10) == DSHOT_VALUE_MAX);
+
+  // eRPM replies at DShot600 timing, 10 % jitter per run
+  DSHOTSYMBOLS symbols;
+  dshotSymbols(symbols, 600, true);
+  uint32_t decoded = 0, wrong = 0, replies = 0, damagedAccepted = 0, damaged = 0;
+  std::vector<uint8_t> runs;
+  std::vector<uint32_t> items;
+  for (uint32_t period = 20; period < 70000; period = period * 21 / 20 + 1) {
+    for (uint8_t k = 0; k < 20; k++) {
+      escReply(period, runs);
+      captureItems(runs, symbols.replyTicks, 0.10, items);
+      uint32_t measured = 0;
+      replies++;
+      if (dshotTelemetryDecode(&items[0], items.size(), symbols.replyTicks, measured)) {
+        decoded++;
+        if (measured != quantized(period)) wrong++;
+      }
+
+      // one run lost or doubled
+      std::vector<uint8_t> broken(runs);
+      if (broken.size() > 3) {
+        if (k & 1) broken.erase(broken.begin() + 1 + k % (broken.size() - 2));
+        else broken[1 + k % (broken.size() - 2)] += 1;
+        captureItems(broken, symbols.replyTicks, 0.10, items);
+        damaged++;
+        if (dshotTelemetryDecode(&items[0], items.size(), symbols.replyTicks, measured)) damagedAccepted++;
+      }
+    }
+  }
+  printf("  %u replies, %u decoded, %u wrong; %u damaged, %u accepted\n", replies, decoded, wrong, damaged,
+         damagedAccepted);
+  pass &= hostCheck("eRPM replies decoded to the period the ESC sent", decoded == replies && wrong == 0);
+  pass &= hostCheck("damaged replies: at most 1 in 16 accepted (4 bit CRC)", damagedAccepted * 16 <= damaged);
+
+  // the receiver also captures our own frame on the pin
+  uint32_t ownAccepted = 0;
+  for (uint16_t value = 0; value <= DSHOT_VALUE_MAX; value++) {
+    uint32_t frame[DSHOT_ITEMS];
+    uint32_t measured;
+    dshotEncode(symbols, dshotPacket(value, false, true), frame);
+    if (dshotTelemetryDecode(frame, DSHOT_ITEMS, symbols.replyTicks, measured)) ownAccepted++;
+  }
+  pass &= hostCheck("own frames not taken for replies", ownAccepted == 0);
+
+  pass &= hostCheck("speed from the period: 2550 us = 10 m/s, sign, stopped",
+                    dshotSpeed(2550, simDrivetrain, 1) == 10000 && dshotSpeed(2550, simDrivetrain, -1) == -10000 &&
+                    dshotSpeed(DSHOT_PERIOD_STOPPED, simDrivetrain, 1) == 0 && dshotSpeed(0, simDrivetrain, 1) == 0);
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+/* Emergency stop over CAN: re-arm sequences and stop latency (include/ESTOP.h).
+
+Sequences: stop and re-arm frames and control task writes replayed through estopFrame() and
+estopGate() for node 0x15, each step checked against the action, the state and whether the
+throttle passes.
+
+Latency: stop frames at random times against the task timing of include/WAKEUP.h on a 1 ms tick,
+from the end of the frame on the bus to the motor output written to neutral:
+  polling    CANBUS polls every 5 ms, the VCU task applies it in its 12 ms loop
+  event      the receive interrupt wakes CANBUS, which wakes VCU (VCU_EVENT_DRIVEN); VCU may
+             still be in a loop for a command
+  interrupt  the receive interrupt writes the output itself (VCU_ESTOP); another handler or a
+             critical section on the comms core may hold it off first
+Task wake-up and loop times are those of vcu_host sim-wakeup; the interrupt figures (entry with
+the frame read out of the controller, the stop itself, interrupts masked) are estimates, the
+e-stop diagnostics record reports the real stop latency of a unit. The output's next frame
+follows the write: up to a period of servo PWM at 50 Hz, SBUS at 14 ms and DShot at
+VCU_DSHOT_PERIOD_US 500. Exit code 1 if a sequence check fails or the interrupt path is not
+below 1 ms worst case.
+
+  vcu_host sim-estop [stops] */
+
+#include <ESTOP.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#define SIM_TICK_US           1000
+#define SIM_NOTIFY_US         15        // sim-wakeup
+#define SIM_CANBUS_BUSY_US    60
+#define SIM_VCU_BUSY_US       150
+#define SIM_VCU_WRITE_US      40
+#define SIM_CANBUS_PERIOD_MS  5
+#define SIM_VCU_PERIOD_MS     12
+#define SIM_COMMAND_MS        20        // CAN commands keeping the event driven VCU task busy
+#define SIM_ISR_ENTRY_US      4         // estimate: interrupt entry, frame read out of the controller
+#define SIM_ISR_STOP_US       6         // estimate: decode, latch, output written
+#define SIM_MASKED_US         50        // estimate: longest other handler or critical section
+#define SIM_MASKED_SHARE      0.05      // of the time the comms core has interrupts held off
+#define SIM_MAX_STOP_US       1000
+#define SIM_NODE              0x15
+
+static const ESTOPCONFIG simConfig = {SIM_NODE, 500, 25};   // estopConfig in ESTOPOUT.h
+
+namespace {
+
+struct SIMSTOPSTEP {
+  const char* what;
+  int64_t atMs;
+  int8_t dlc;                           // -1 = control task write of 'throttle'
+  uint8_t data[4];
+  int16_t throttle;
+  uint8_t action;                       // expected, frames
+  uint8_t state;                        // expected after the step
+  bool pass;                            // expected, writes
+};
+
+struct SIMSTOPRESULT {
+  double mean;                          // us
+  double p99;
+  double max;
+  double wireMax[3];                    // ms, servo / SBUS / DShot
+};
+
+}  // namespace
+
+static const double simOutputPeriodUs[3] = {20000, 14000, 500};
+
+static double simUniform() {
+  return rand() / ((double)RAND_MAX + 1);
+}
+
+
+//==================================================================================//
+
+static bool simSequences() {
+  const uint8_t S = ESTOP_CMD_STOP, R = ESTOP_CMD_REARM;
+  const SIMSTOPSTEP steps[] = {
+    {"running, throttle passes", 10, -1, {0}, 1600, 0, ESTOP_RUN, true},
+    {"stop for node 0x16", 20, 3, {S, 0x00, 0x16}, 0, ESTOP_IGNORED, ESTOP_RUN, false},
+    {"unknown command", 25, 3, {0x00, 0x00, 0x15}, 0, ESTOP_IGNORED, ESTOP_RUN, false},
+    {"re-arm while running", 30, 4, {R, 0x00, 0x15, 0}, 0, ESTOP_REJECTED, ESTOP_RUN, false},
+    {"stop, one byte", 40, 1, {S}, 0, ESTOP_LATCHED, ESTOP_STOPPED, false},
+    {"throttle held at neutral", 50, -1, {0}, 1600, 0, ESTOP_STOPPED, false},
+    {"stop repeated", 60, 3, {S, 0x00, 0x15}, 0, ESTOP_REPEATED, ESTOP_STOPPED, false},
+    {"re-arm, stale sequence", 70, 4, {R, 0x00, 0x15, 0}, 0, ESTOP_REJECTED, ESTOP_STOPPED, false},
+    {"re-arm for node 0x16", 80, 4, {R, 0x00, 0x16, 1}, 0, ESTOP_IGNORED, ESTOP_STOPPED, false},
+    {"re-arm without sequence", 90, 3, {R, 0x00, 0x15}, 0, ESTOP_IGNORED, ESTOP_STOPPED, false},
+    {"neutral while stopped", 100, -1, {0}, 1500, 0, ESTOP_STOPPED, false},
+    {"re-arm, sequence 1", 110, 4, {R, 0x00, 0x15, 1}, 0, ESTOP_REARMING, ESTOP_ARMING, false},
+    {"throttle still applied", 120, -1, {0}, 1600, 0, ESTOP_ARMING, false},
+    {"neutral", 200, -1, {0}, 1500, 0, ESTOP_ARMING, false},
+    {"neutral 400 ms", 600, -1, {0}, 1510, 0, ESTOP_ARMING, false},
+    {"throttle, neutral broken", 650, -1, {0}, 1530, 0, ESTOP_ARMING, false},
+    {"neutral again", 700, -1, {0}, 1490, 0, ESTOP_ARMING, false},
+    {"neutral 450 ms", 1150, -1, {0}, 1500, 0, ESTOP_ARMING, false},
+    {"stop while arming", 1160, 3, {S, 0x00, 0x00}, 0, ESTOP_LATCHED, ESTOP_STOPPED, false},
+    {"re-arm, sequence 1 again", 1170, 4, {R, 0x00, 0x00, 1}, 0, ESTOP_REJECTED, ESTOP_STOPPED, false},
+    {"re-arm all, sequence 2", 1180, 4, {R, 0x00, 0x00, 2}, 0, ESTOP_REARMING, ESTOP_ARMING, false},
+    {"neutral", 1200, -1, {0}, 1500, 0, ESTOP_ARMING, false},
+    {"neutral 499 ms", 1699, -1, {0}, 1500, 0, ESTOP_ARMING, false},
+    {"neutral 500 ms, running", 1700, -1, {0}, 1500, 0, ESTOP_RUN, true},
+    {"throttle passes", 1710, -1, {0}, 1700, 0, ESTOP_RUN, true},
+  };
+
+  ESTOPSTATE state;
+  estopReset(state);
+  bool pass = true;
+  printf("re-arm sequences, node 0x%02X, %u ms at neutral (+-%u us)\n", SIM_NODE, simConfig.rearmMs,
+         simConfig.neutralUs);
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    const SIMSTOPSTEP& step = steps[i];
+    int64_t now = step.atMs * 1000;
+    bool ok;
+    if (step.dlc < 0) {
+      bool passed = estopGate(state, simConfig, step.throttle, now);
+      ok = passed == step.pass && state.state == step.state;
+      printf("  %6lld ms  write %4d us %-10s %-26s %s\n", (long long)step.atMs, step.throttle,
+             passed ? "passes" : "neutral", step.what, ok ? "ok" : "FAIL");
+    } else {
+      uint8_t action = estopFrame(state, simConfig, step.data, step.dlc);
+      ok = action == step.action && state.state == step.state;
+      printf("  %6lld ms  frame %-15s sequence %u   %-26s %s\n", (long long)step.atMs,
+             action == ESTOP_LATCHED ? "latched" : action == ESTOP_REPEATED ? "repeated" :
+             action == ESTOP_REARMING ? "re-arming" : action == ESTOP_REJECTED ? "rejected" : "ignored",
+             state.sequence, step.what, ok ? "ok" : "FAIL");
+    }
+    pass &= ok;
+  }
+  pass &= state.stops == 2 && state.rejected == 3;
+  printf("  stops %u, rejected re-arms %u\n\n", state.stops, state.rejected);
+  return pass;
+}
+
+
+//==================================================================================//
+
+// the first loop of a task on a 'periodMs' tick grid starting at 'phase' that starts at or after 't'
+static int64_t simNextLoop(int64_t t, int64_t phase, int periodMs) {
+  int64_t period = periodMs * SIM_TICK_US;
+  if (t <= phase) return phase;
+  return phase + (t - phase + period - 1) / period * period;
+}
+
+// frame end to the motor output written to neutral
+static double simStop(uint8_t path) {
+  int64_t arrival = 100000 + (int64_t)(simUniform() * 1000000);
+
+  if (path == 0) {
+    int64_t canbusPhase = (int64_t)(simUniform() * SIM_CANBUS_PERIOD_MS) * SIM_TICK_US;
+    int64_t vcuPhase = (int64_t)(simUniform() * SIM_VCU_PERIOD_MS) * SIM_TICK_US;
+    int64_t published = simNextLoop(arrival, canbusPhase, SIM_CANBUS_PERIOD_MS) + SIM_CANBUS_BUSY_US;
+    return simNextLoop(published, vcuPhase, SIM_VCU_PERIOD_MS) + SIM_VCU_WRITE_US - arrival;
+  }
+
+  int64_t entry = arrival + SIM_ISR_ENTRY_US;
+  if (simUniform() < SIM_MASKED_SHARE) entry += (int64_t)(simUniform() * SIM_MASKED_US);
+  if (path == 2) return entry + SIM_ISR_STOP_US - arrival;
+
+  // event driven: CANBUS and then VCU, each possibly still busy with the last command
+  int64_t command = arrival - (int64_t)(simUniform() * SIM_COMMAND_MS * 1000);
+  int64_t canbusFree = command + SIM_NOTIFY_US + SIM_CANBUS_BUSY_US;
+  int64_t vcuFree = canbusFree + SIM_NOTIFY_US + SIM_VCU_BUSY_US;
+  int64_t canbus = std::max(entry + SIM_NOTIFY_US, canbusFree);
+  int64_t vcu = std::max(canbus + SIM_CANBUS_BUSY_US + SIM_NOTIFY_US, vcuFree);
+  return vcu + SIM_VCU_WRITE_US - arrival;
+}
+
+static SIMSTOPRESULT simPath(uint8_t path, int stops) {
+  std::vector<double> latencies;
+  SIMSTOPRESULT r = SIMSTOPRESULT();
+  double sum = 0;
+  for (int i = 0; i < stops; i++) {
+    double latency = simStop(path);
+    latencies.push_back(latency);
+    sum += latency;
+    for (uint8_t o = 0; o < 3; o++) {
+      r.wireMax[o] = std::max(r.wireMax[o], (latency + simUniform() * simOutputPeriodUs[o]) / 1000);
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  r.mean = sum / stops;
+  r.p99 = latencies[latencies.size() * 99 / 100];
+  r.max = latencies.back();
+  return r;
+}
+
+
+//==================================================================================//
+
+int estopSim(int argc, char** argv) {
+  int stops = argc >= 1 ? atoi(argv[0]) : 100000;
+  if (stops < 100) stops = 100;
+  srand(11);
+
+  bool pass = simSequences();
+
+  printf("stop latency: %d stops per path, frame end to the motor output written to neutral\n", stops);
+  printf("    %-10s %9s %9s %9s   %s\n", "", "mean us", "p99 us", "max us", "max to the wire, ms");
+  printf("    %-10s %9s %9s %9s   %8s %8s %9s\n", "", "", "", "", "servo", "SBUS", "DShot");
+  const char* names[3] = {"polling", "event", "interrupt"};
+  for (uint8_t path = 0; path < 3; path++) {
+    SIMSTOPRESULT r = simPath(path, stops);
+    printf("    %-10s %9.0f %9.0f %9.0f   %8.1f %8.1f %9.2f\n", names[path], r.mean, r.p99, r.max, r.wireMax[0],
+           r.wireMax[1], r.wireMax[2]);
+    if (path == 2) pass &= r.max < SIM_MAX_STOP_US;
+  }
+  printf("    (polling: a drive mode in a vTaskDelay holds the stop for as long as that lasts)\n");
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,638 @@
+/* Cooperative jobs against one thread per subsystem (include/JOBS.h, include/JOBTASK.h).
+
+Sequences: a job set on a simulated clock, each check against the scheduler: earliest deadline
+first, yields, a sleep inside a release, event releases, releases lost while behind, the
+diagnostics record and a full job table.
+
+Job set: the jobs of JOBTASK.h with the workloads of the real code, run in real time for
+[seconds] twice: once as jobs in one thread, once as one thread per subsystem as the firmware
+without VCU_JOBS (fixed period sleeps, a blocking wait for the next DMA block or the event):
+  battery   DMA blocks of 256 samples every 12.8 ms through the filter of BATTERY.h, the job
+            every JOB_BATTERY_MS takes what is ready
+  imu       every IMU_BURST_MS a burst of 10 gyro samples through YAWRATE.h after BENCH_I2C_US of
+            bus time (spun, the I2C driver waits for the bus)
+  report    once a second from the main thread standing in for CANBUS, the diagnostics records
+Response times run from the release (block ready, period start, event) to the job done.
+
+RAM: every thread's stack is painted before it starts and its high-water mark read after the
+join, less that of an empty thread (glibc keeps the thread descriptor at the top of the stack).
+These are x86-64 figures and only compare the two layouts; the firmware's stacks are the fixed
+sizes in the boot memory report, one JOBS stack in place of the BATTERY and IMU ones.
+
+Switches: a dispatch of jobsRunOne() over 8 released jobs with the time stamps the firmware
+takes, against a handover between two threads on one CPU through a pair of semaphores.
+
+Exit code 1 if a sequence check fails, a job misses more deadlines than its thread by over 1 %
+of its releases, the shared stack is not below the per-thread stacks together or a dispatch is
+not cheaper than a thread switch.
+
+  vcu_host bench-jobs [seconds] [switches] */
+
+#include <BATTERY.h>
+#include <DIAGRECORD.h>
+#include <HOSTCHECK.h>
+#include <JOBS.h>
+#include <YAWRATE.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <atomic>
+
+#define BENCH_BLOCK_US        12800     // 256 samples at 20 kHz
+#define BENCH_BATTERY_MS      10        // JOB_BATTERY_MS
+#define BENCH_IMU_MS          10        // IMU_BURST_MS
+#define BENCH_IMU_SAMPLES     10
+#define BENCH_I2C_US          600       // estimate: status, count and FIFO reads at 400 kHz
+#define BENCH_REPORT_MS       100       // JOB_REPORT_DEADLINE_MS
+#define BENCH_EVENT_REPORT    (1 << 0)
+#define BENCH_STACK_BYTES     (256 * 1024)
+#define BENCH_PAINT           0xA5
+#define BENCH_SWITCH_JOBS     8
+#define BENCH_MISS_SHARE      0.01
+
+#define BENCH_BATTERY         0
+#define BENCH_IMU             1
+#define BENCH_REPORT          2
+#define BENCH_SUBSYSTEMS      3
+
+static const char* benchNames[BENCH_SUBSYSTEMS] = {"battery", "imu", "report"};
+
+namespace {
+
+struct BENCHTHREAD {
+  pthread_t thread;
+  uint8_t* stack;
+  int64_t cpuUs;                        // thread CPU time, set by the thread at its end
+  long switches;                        // context switches of the thread
+};
+
+struct BENCHRESULT {
+  JOB jobs[BENCH_SUBSYSTEMS];           // accounting only, the whole run
+  size_t stack[BENCH_SUBSYSTEMS];       // bytes, net of an empty thread; one entry for the jobs
+  uint8_t threads;
+  int64_t cpuUs;
+  long switches;
+};
+
+}  // namespace
+
+static int64_t benchNowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void benchSleepUntil(int64_t us) {
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {}
+}
+
+// a semaphore wait with a deadline on the monotonic clock, 0 = none
+static void benchWait(sem_t* sem, int64_t until) {
+  if (until == 0) {
+    while (sem_wait(sem) != 0) {}
+    return;
+  }
+  int64_t left = until - benchNowUs();
+  if (left <= 0) return;
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  int64_t ns = ts.tv_nsec + (left % 1000000) * 1000;
+  ts.tv_sec += left / 1000000 + ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  sem_timedwait(sem, &ts);
+}
+
+
+//==================================================================================//
+
+static int64_t benchSeqNow;
+static char benchSeqOrder[32];
+static uint8_t benchSeqLength;
+
+static int64_t benchSeqClock() {
+  return benchSeqNow;
+}
+
+static void benchSeqLog(const JOB& job) {
+  if (benchSeqLength < sizeof(benchSeqOrder) - 1) benchSeqOrder[benchSeqLength++] = job.name[0];
+  benchSeqOrder[benchSeqLength] = 0;
+}
+
+static uint8_t benchSeqShort(JOB& job, int64_t) {
+  benchSeqLog(job);
+  benchSeqNow += 500;
+  return JOB_DONE;
+}
+
+static uint8_t benchSeqYield(JOB& job, int64_t) {
+  JOB_BEGIN(job);
+  benchSeqLog(job);
+  benchSeqNow += 200;
+  JOB_YIELD(job);
+  benchSeqLog(job);
+  benchSeqNow += 200;
+  JOB_YIELD(job);
+  benchSeqLog(job);
+  benchSeqNow += 200;
+  JOB_END(job);
+}
+
+static uint8_t benchSeqSleep(JOB& job, int64_t now) {
+  JOB_BEGIN(job);
+  benchSeqLog(job);
+  JOB_SLEEP(job, now, 3000);
+  benchSeqLog(job);
+  JOB_END(job);
+}
+
+static void benchSeqRun(JOBSCHED& sched) {
+  benchSeqLength = 0;
+  benchSeqOrder[0] = 0;
+  while (jobsRunOne(sched, benchSeqNow) >= 0) {}
+}
+
+static bool benchSequences() {
+  JOBSCHED sched;
+  jobsReset(sched, benchSeqClock);
+  benchSeqNow = 0;
+  jobsAdd(sched, "a", benchSeqShort, NULL, 10000, 0, 0, 0);          // deadline 10 ms
+  jobsAdd(sched, "b", benchSeqShort, NULL, 5000, 2000, 0, 0);
+  jobsAdd(sched, "y", benchSeqYield, NULL, 20000, 5000, 0, 0);
+  jobsAdd(sched, "s", benchSeqSleep, NULL, 0, 1000, 1 << 1, 0);
+  JOB& a = sched.jobs[0];
+  JOB& y = sched.jobs[2];
+  JOB& s = sched.jobs[3];
+
+  bool pass = true;
+  printf("sequences, simulated clock: a 10 ms, b 5 ms deadline 2 ms, y 20 ms yielding deadline 5 ms,\n"
+         "s by event sleeping 3 ms deadline 1 ms\n");
+  benchSeqRun(sched);
+  pass &= hostCheck("t 0: earliest deadline first, y yields twice (byyya)", strcmp(benchSeqOrder, "byyya") == 0);
+  pass &= hostCheck("y: 3 runs, 1 completion", y.runs == 3 && y.completions == 1);
+
+  jobsSignal(sched, 1 << 2, benchSeqNow);
+  pass &= hostCheck("event for no job: nothing runs, next at b's release 5 ms",
+                    jobsRunOne(sched, benchSeqNow) < 0 && jobsNextAt(sched, benchSeqNow) == 5000);
+
+  jobsSignal(sched, 1 << 1, benchSeqNow);
+  benchSeqRun(sched);
+  pass &= hostCheck("event at 1.6 ms: s runs and sleeps, next at its wake-up 4.6 ms",
+                    strcmp(benchSeqOrder, "s") == 0 && s.released && jobsNextAt(sched, benchSeqNow) == 4600);
+
+  benchSeqNow = 4600;
+  benchSeqRun(sched);
+  pass &= hostCheck("4.6 ms: s completes, 3 ms response misses its 1 ms deadline",
+                    strcmp(benchSeqOrder, "s") == 0 && s.completions == 1 && s.misses == 1 && s.responseMax == 3000);
+
+  benchSeqNow = 6000;
+  jobsSignal(sched, 1 << 1, benchSeqNow);
+  jobsSignal(sched, 1 << 1, benchSeqNow);
+  pass &= hostCheck("6 ms: a second event while s is released is a miss", s.misses == 2);
+  benchSeqRun(sched);
+  pass &= hostCheck("b released at 5 ms runs before s", strcmp(benchSeqOrder, "bs") == 0);
+
+  benchSeqNow = 40000;
+  benchSeqRun(sched);
+  pass &= hostCheck("40 ms, behind: a loses the 10, 20 and 30 ms releases", a.misses == 3 && a.releaseAt == 40000);
+  pass &= hostCheck("... and runs the one of 40 ms", a.completions == 2 && a.nextRelease == 50000);
+
+  uint8_t record[8];
+  JOB window = y;
+  jobsRecord(record, DIAG_RECORD_JOB | 2, window);
+  const uint8_t expected[8] = {0x0A, 2, 0, 200, 0, 200, 1, 1};
+  pass &= hostCheck("record of y: 2 completions, 200 us runs, 1 ms response, 1 lost",
+                    memcmp(record, expected, 8) == 0 && window.completions == 0 && window.runs == 0);
+
+  for (uint8_t i = sched.count; i < JOBS_MAX; i++) jobsAdd(sched, "x", benchSeqShort, NULL, 1000, 0, 0, 0);
+  bool full = jobsAdd(sched, "x", benchSeqShort, NULL, 1000, 0, 0, 0) < 0 && sched.count == JOBS_MAX;
+  JOBSCHED empty;
+  jobsReset(empty, benchSeqClock);
+  bool idle = jobsAdd(empty, "x", benchSeqShort, NULL, 0, 0, 0, 0) < 0;
+  pass &= hostCheck("full job table, no job without a period or an event", full && idle);
+  printf("\n");
+  return pass;
+}
+
+
+//==================================================================================//
+
+// the subsystems' work, the same in both layouts
+static int64_t benchStart;
+static std::atomic<bool> benchRunning(false);
+static uint32_t benchBlocksTaken;
+static BATTERYFILTER benchFilter;
+static YAWESTIMATE benchEstimate;
+static uint32_t benchNoise = 1;
+static sem_t benchReportSem;
+static std::atomic<uint32_t> benchEvents(0);
+static uint8_t benchRecords[JOBS_MAX][8];
+
+static uint32_t benchRandom() {
+  benchNoise = benchNoise * 1103515245 + 12345;
+  return benchNoise >> 16;
+}
+
+static int64_t benchBlockAt(uint32_t block) {
+  return benchStart + (int64_t)(block + 1) * BENCH_BLOCK_US;
+}
+
+static void benchBatteryBlock() {
+  uint16_t samples[BATTERY_BLOCK_SAMPLES];
+  for (uint16_t i = 0; i < BATTERY_BLOCK_SAMPLES; i++) samples[i] = 2400 + benchRandom() % 64;
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < BATTERY_BLOCK_SAMPLES; i++) sum += samples[i];
+  batteryUpdate(benchFilter, batteryDefaultCal, sum, BATTERY_BLOCK_SAMPLES);
+  benchBlocksTaken++;
+}
+
+static void benchImuBurst() {
+  int64_t bus = benchNowUs() + BENCH_I2C_US;
+  while (benchNowUs() < bus) {}
+  int16_t burst[BENCH_IMU_SAMPLES];
+  for (uint8_t i = 0; i < BENCH_IMU_SAMPLES; i++) burst[i] = (int16_t)(benchRandom() % 40) - 20;
+  yawBurst(benchEstimate, burst, BENCH_IMU_SAMPLES, true);
+}
+
+static void benchReset() {
+  benchBlocksTaken = 0;
+  batteryFilterReset(benchFilter, batteryAlpha(BATTERY_SAMPLE_HZ / BATTERY_BLOCK_SAMPLES, BATTERY_FILTER_MS));
+  yawEstimateReset(benchEstimate);
+  benchEvents = 0;
+  sem_init(&benchReportSem, 0, 0);
+}
+
+static void benchThreadEnd(BENCHTHREAD* thread) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  thread->cpuUs = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  thread->switches = usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// the accounting of JOBS.h for a thread's own loop
+static void benchAccount(JOB& job, int64_t release, int64_t start, int64_t end) {
+  uint32_t run = end - start;
+  uint32_t response = end - release;
+  job.runs++;
+  job.completions++;
+  job.runSum += run;
+  if (run > job.runMax) job.runMax = run;
+  if (response > job.responseMax) job.responseMax = response;
+  if (response > job.deadlineUs) job.misses++;
+}
+
+static bool benchStartThread(BENCHTHREAD& thread, void* (*function)(void*), void* arg) {
+  void* stack = NULL;
+  if (posix_memalign(&stack, 4096, BENCH_STACK_BYTES) != 0) return false;
+  memset(stack, BENCH_PAINT, BENCH_STACK_BYTES);
+  thread.stack = (uint8_t*)stack;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack, BENCH_STACK_BYTES);
+  bool started = pthread_create(&thread.thread, &attr, function, arg) == 0;
+  pthread_attr_destroy(&attr);
+  return started;
+}
+
+// joins the thread, returns the bytes of its stack ever used
+static size_t benchJoinThread(BENCHTHREAD& thread) {
+  pthread_join(thread.thread, NULL);
+  size_t untouched = 0;
+  while (untouched < BENCH_STACK_BYTES && thread.stack[untouched] == BENCH_PAINT) untouched++;
+  free(thread.stack);
+  return BENCH_STACK_BYTES - untouched;
+}
+
+static void* benchEmptyThread(void* arg) {
+  return arg;
+}
+
+
+//==================================================================================//
+
+static JOBSCHED benchJobs;
+static sem_t benchJobsSem;
+
+static int64_t benchJobsClock() {
+  return benchNowUs();
+}
+
+static uint8_t benchBatteryJob(JOB& job, int64_t) {
+  JOB_BEGIN(job);
+  while (benchBlockAt(benchBlocksTaken) <= benchNowUs()) {
+    benchBatteryBlock();
+    JOB_YIELD(job);
+  }
+  JOB_END(job);
+}
+
+static uint8_t benchImuJob(JOB&, int64_t) {
+  benchImuBurst();
+  return JOB_DONE;
+}
+
+static uint8_t benchReportJob(JOB&, int64_t) {
+  for (uint8_t i = 0; i < benchJobs.count; i++) {
+    JOB window = benchJobs.jobs[i];                 // the run keeps its own totals
+    jobsRecord(benchRecords[i], DIAG_RECORD_JOB | i, window);
+  }
+  return JOB_DONE;
+}
+
+// the JOBS task of JOBTASK.h
+static void* benchJobsThread(void* arg) {
+  while (benchRunning) {
+    int64_t now = benchNowUs();
+    uint32_t events = benchEvents.exchange(0);
+    if (events) jobsSignal(benchJobs, events, now);
+    while (jobsRunOne(benchJobs, now) >= 0) now = benchNowUs();
+    int64_t next = jobsNextAt(benchJobs, now);
+    benchWait(&benchJobsSem, next);
+  }
+  benchThreadEnd((BENCHTHREAD*)arg);
+  return NULL;
+}
+
+namespace {
+
+// a thread with the accounting of its subsystem
+struct BENCHTASK {
+  BENCHTHREAD thread;
+  JOB job;
+};
+
+}  // namespace
+
+static BENCHTASK benchTasks[BENCH_SUBSYSTEMS];
+
+static void* benchBatteryThread(void* arg) {
+  JOB& job = ((BENCHTASK*)arg)->job;
+  while (benchRunning) {
+    int64_t ready = benchBlockAt(benchBlocksTaken);
+    benchSleepUntil(ready);                         // adc_digi_read_bytes() waiting for the block
+    int64_t start = benchNowUs();
+    benchBatteryBlock();
+    benchAccount(job, ready, start, benchNowUs());
+  }
+  benchThreadEnd(&((BENCHTASK*)arg)->thread);
+  return NULL;
+}
+
+static void* benchImuThread(void* arg) {
+  JOB& job = ((BENCHTASK*)arg)->job;
+  int64_t wake = benchStart;
+  while (benchRunning) {
+    wake += BENCH_IMU_MS * 1000;
+    benchSleepUntil(wake);                          // vTaskDelayUntil()
+    int64_t start = benchNowUs();
+    benchImuBurst();
+    benchAccount(job, wake, start, benchNowUs());
+  }
+  benchThreadEnd(&((BENCHTASK*)arg)->thread);
+  return NULL;
+}
+
+static int64_t benchReportAt;
+
+static void* benchReportThread(void* arg) {
+  JOB& job = ((BENCHTASK*)arg)->job;
+  while (1) {
+    benchWait(&benchReportSem, 0);
+    if (!benchRunning) break;
+    int64_t start = benchNowUs();
+    for (uint8_t i = 0; i < BENCH_SUBSYSTEMS; i++) {
+      JOB window = benchTasks[i].job;
+      jobsRecord(benchRecords[i], DIAG_RECORD_JOB | i, window);
+    }
+    benchAccount(job, benchReportAt, start, benchNowUs());
+  }
+  benchThreadEnd(&((BENCHTASK*)arg)->thread);
+  return NULL;
+}
+
+// the main thread standing in for CANBUS: the report event once a second until the end
+static void benchDrive(int seconds, bool jobs) {
+  for (int s = 1; s <= seconds; s++) {
+    benchSleepUntil(benchStart + s * 1000000LL);
+    benchReportAt = benchNowUs();
+    if (jobs) {
+      benchEvents.fetch_or(BENCH_EVENT_REPORT);
+      sem_post(&benchJobsSem);
+    } else {
+      sem_post(&benchReportSem);
+    }
+  }
+  benchSleepUntil(benchStart + seconds * 1000000LL + 200000);
+  benchRunning = false;
+  sem_post(&benchJobsSem);
+  sem_post(&benchReportSem);
+}
+
+static bool benchJobSet(int seconds, BENCHRESULT& r) {
+  r = BENCHRESULT();
+  benchReset();
+  sem_init(&benchJobsSem, 0, 0);
+  benchStart = benchNowUs();
+  jobsReset(benchJobs, benchJobsClock);
+  jobsAdd(benchJobs, "report", benchReportJob, NULL, 0, BENCH_REPORT_MS * 1000, BENCH_EVENT_REPORT, benchStart);
+  jobsAdd(benchJobs, "imu", benchImuJob, NULL, BENCH_IMU_MS * 1000, 0, 0, benchStart);
+  jobsAdd(benchJobs, "battery", benchBatteryJob, NULL, BENCH_BATTERY_MS * 1000, 0, 0, benchStart);
+
+  BENCHTHREAD thread = BENCHTHREAD();
+  benchRunning = true;
+  if (!benchStartThread(thread, benchJobsThread, &thread)) return false;
+  benchDrive(seconds, true);
+  r.stack[0] = benchJoinThread(thread);
+  r.threads = 1;
+  r.cpuUs = thread.cpuUs;
+  r.switches = thread.switches;
+  r.jobs[BENCH_BATTERY] = benchJobs.jobs[2];
+  r.jobs[BENCH_IMU] = benchJobs.jobs[1];
+  r.jobs[BENCH_REPORT] = benchJobs.jobs[0];
+  sem_destroy(&benchJobsSem);
+  sem_destroy(&benchReportSem);
+  return true;
+}
+
+static bool benchTaskSet(int seconds, BENCHRESULT& r) {
+  r = BENCHRESULT();
+  benchReset();
+  sem_init(&benchJobsSem, 0, 0);
+  benchStart = benchNowUs();
+  void* (*functions[BENCH_SUBSYSTEMS])(void*) = {benchBatteryThread, benchImuThread, benchReportThread};
+  const uint32_t deadlines[BENCH_SUBSYSTEMS] = {BENCH_BATTERY_MS * 1000, BENCH_IMU_MS * 1000, BENCH_REPORT_MS * 1000};
+
+  BENCHTASK* tasks = benchTasks;
+  benchRunning = true;
+  for (uint8_t i = 0; i < BENCH_SUBSYSTEMS; i++) {
+    tasks[i] = BENCHTASK();
+    tasks[i].job.deadlineUs = deadlines[i];
+    if (!benchStartThread(tasks[i].thread, functions[i], &tasks[i])) return false;
+  }
+  benchDrive(seconds, false);
+  r.threads = BENCH_SUBSYSTEMS;
+  for (uint8_t i = 0; i < BENCH_SUBSYSTEMS; i++) {
+    r.stack[i] = benchJoinThread(tasks[i].thread);
+    r.cpuUs += tasks[i].thread.cpuUs;
+    r.switches += tasks[i].thread.switches;
+    r.jobs[i] = tasks[i].job;
+  }
+  sem_destroy(&benchJobsSem);
+  sem_destroy(&benchReportSem);
+  return true;
+}
+
+
+//==================================================================================//
+
+static double benchDispatchNs(long rounds) {
+  static uint32_t dispatched = 0;
+  struct BENCHNOP {
+    static uint8_t run(JOB&, int64_t) {
+      dispatched++;
+      return JOB_DONE;
+    }
+  };
+  JOBSCHED sched;
+  jobsReset(sched, benchJobsClock);
+  for (uint8_t i = 0; i < BENCH_SWITCH_JOBS; i++) jobsAdd(sched, "nop", BENCHNOP::run, NULL, 0, 1000, 1, 0);
+
+  int64_t start = benchNowUs();
+  for (long i = 0; i < rounds; i++) {
+    int64_t now = benchNowUs();
+    jobsSignal(sched, 1, now);
+    for (uint8_t j = 0; j < BENCH_SWITCH_JOBS; j++) jobsRunOne(sched, benchNowUs());
+  }
+  int64_t elapsed = benchNowUs() - start;
+  return dispatched ? elapsed * 1000.0 / dispatched : 0;
+}
+
+static sem_t benchPing, benchPong;
+static long benchPingRounds;
+
+static void benchPin() {
+  int cpu = sched_getcpu();
+  if (cpu < 0) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void* benchPongThread(void* arg) {
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t*)arg);
+  for (long i = 0; i < benchPingRounds; i++) {
+    while (sem_wait(&benchPing) != 0) {}
+    sem_post(&benchPong);
+  }
+  return NULL;
+}
+
+static double benchSwitchNs(long rounds) {
+  benchPin();
+  cpu_set_t set;
+  pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+  sem_init(&benchPing, 0, 0);
+  sem_init(&benchPong, 0, 0);
+  benchPingRounds = rounds;
+  pthread_t pong;
+  if (pthread_create(&pong, NULL, benchPongThread, &set) != 0) return 0;
+
+  int64_t start = benchNowUs();
+  for (long i = 0; i < rounds; i++) {
+    sem_post(&benchPing);
+    while (sem_wait(&benchPong) != 0) {}
+  }
+  int64_t elapsed = benchNowUs() - start;
+  pthread_join(pong, NULL);
+  sem_destroy(&benchPing);
+  sem_destroy(&benchPong);
+  return elapsed * 1000.0 / (2.0 * rounds);
+}
+
+
+//==================================================================================//
+
+static bool benchPrint(const char* title, const BENCHRESULT& r, int seconds, size_t baseline) {
+  bool pass = true;
+  printf("%s\n", title);
+  printf("    %-8s %11s %11s %11s %13s %7s\n", "", "releases", "avg run us", "max run us", "max resp. us", "misses");
+  for (uint8_t i = 0; i < BENCH_SUBSYSTEMS; i++) {
+    const JOB& job = r.jobs[i];
+    printf("    %-8s %11u %11u %11u %13u %7u\n", benchNames[i], job.completions, job.runs ? job.runSum / job.runs : 0,
+           job.runMax, job.responseMax, job.misses);
+    pass &= job.completions > 0;
+  }
+  size_t total = 0;
+  printf("    stack used, net of an empty thread's %u bytes:", (unsigned)baseline);
+  for (uint8_t i = 0; i < r.threads; i++) {
+    size_t net = r.stack[i] > baseline ? r.stack[i] - baseline : 0;
+    total += net;
+    printf(" %s%u", i ? "+ " : "", (unsigned)net);
+  }
+  printf(" = %u bytes in %u thread%s\n", (unsigned)total, r.threads, r.threads > 1 ? "s" : "");
+  printf("    CPU %.2f %% of one core, %.0f context switches per second\n\n", r.cpuUs / (seconds * 1e4),
+         (double)r.switches / seconds);
+  return pass;
+}
+
+static size_t benchNetStack(const BENCHRESULT& r, size_t baseline) {
+  size_t total = 0;
+  for (uint8_t i = 0; i < r.threads; i++) total += r.stack[i] > baseline ? r.stack[i] - baseline : 0;
+  return total;
+}
+
+int jobsBench(int argc, char** argv) {
+  int seconds = argc >= 1 ? atoi(argv[0]) : 3;
+  long switches = argc >= 2 ? atol(argv[1]) : 200000;
+  if (seconds < 1) seconds = 1;
+  if (switches < 1000) switches = 1000;
+
+  bool pass = benchSequences();
+
+  BENCHTHREAD empty = BENCHTHREAD();
+  if (!benchStartThread(empty, benchEmptyThread, NULL)) return 1;
+  size_t baseline = benchJoinThread(empty);
+
+  printf("job set, %d s in real time: battery blocks every %.1f ms, IMU bursts every %d ms with %d us of\n"
+         "I2C, the report once a second\n", seconds, BENCH_BLOCK_US / 1000.0, BENCH_IMU_MS, BENCH_I2C_US);
+  BENCHRESULT jobs, tasks;
+  if (!benchJobSet(seconds, jobs) || !benchTaskSet(seconds, tasks)) {
+    printf("threads could not be started\n");
+    return 1;
+  }
+  pass &= benchPrint("  cooperative jobs, one thread (VCU_JOBS)", jobs, seconds, baseline);
+  pass &= benchPrint("  one thread per subsystem", tasks, seconds, baseline);
+
+  // host scheduling noise hits both layouts, the jobs must not miss more than the threads
+  for (uint8_t i = 0; i < BENCH_SUBSYSTEMS; i++) {
+    const JOB& job = jobs.jobs[i];
+    pass &= job.misses <= tasks.jobs[i].misses + BENCH_MISS_SHARE * (job.completions + job.misses);
+  }
+
+  size_t shared = benchNetStack(jobs, baseline), separate = benchNetStack(tasks, baseline);
+  pass &= shared < separate;
+  printf("  scheduler state %u bytes (%u a job), host pointers; firmware: one %u byte stack and task control\n"
+         "  block in place of two 3072 byte ones with VCU_YAW_CONTROL (boot memory report)\n\n",
+         (unsigned)sizeof(JOBSCHED), (unsigned)sizeof(JOB), 3072u);
+
+  double dispatch = benchDispatchNs(switches / BENCH_SWITCH_JOBS);
+  double handover = benchSwitchNs(switches);
+  printf("switches, %ld each:\n", switches);
+  printf("    job dispatch, %d jobs, with time stamps    %8.1f ns\n", BENCH_SWITCH_JOBS, dispatch);
+  printf("    thread handover, semaphores, one CPU      %8.1f ns\n", handover);
+  pass &= dispatch > 0 && handover > 0 && dispatch < handover;
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
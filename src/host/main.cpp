@@ -0,0 +1,455 @@
+/* Host build of the hardware independent VCU code (PlatformIO environment "native").
+
+Runs canReceiver/canSender from include/CANBUS.h and the frame dispatch of the CANBUS task
+(include/CANROUTE.h) against a Linux SocketCAN interface:
+
+  vcu_host run <ifname>                         CANBUS task loop as VCU 0x15, answers every command (0x115)
+                                                with a status frame
+  vcu_host replay <candump.log> <ifname> [speed] replays a candump -l log onto <ifname> and decodes it,
+                                                speed 1 = original timing, 0 = as fast as possible
+  vcu_host xbox-reports                         Xbox controller HID reports through the decoder (xbox_reports.cpp)
+  vcu_host sim-pursuit [path] [speed] [error]   closed loop path tracking simulation (pursuit_sim.cpp)
+  vcu_host rcfilter [trace.txt]                 RC input filter attenuation and delay (rcfilter_report.cpp)
+  vcu_host sbus-frames                          SBUS output frames checked byte for byte (sbus_frames.cpp)
+  vcu_host sim-ttcan [nodes] [seconds] [loss %]  shared bus, event driven against time-triggered (ttcan_sim.cpp)
+  vcu_host sim-clock [offset] [drift] [jitter]  CAN clock sync servo and stamped latency (clock_sim.cpp)
+  vcu_host clock-master <ifname>                sends the SYNC / FOLLOW_UP pairs of include/CLOCKSYNC.h
+  vcu_host battery                              battery voltage oversampling, calibration and filter (battery_report.cpp)
+  vcu_host link <tty> [rate] [seconds] [baud]   serial command link, companion computer end (serial_link.cpp)
+  vcu_host link-vcu <tty> [baud]                serial command link, VCU end
+  vcu_host link-test [frames]                   both link ends over a pseudo-terminal
+  vcu_host sim-setpoint [jitter ms] [loss %]    timed setpoint queue against bus jitter (setpoint_sim.cpp)
+  vcu_host steercal                             curvature steering table against its reference (steercal_report.cpp)
+  vcu_host sim-wakeup [seconds]                 input triggered against polled control tasks (wakeup_sim.cpp)
+  vcu_host rclink [seconds]                     receiver link quality statistics (rclink_report.cpp)
+  vcu_host dshot-frames                         DShot frames and eRPM replies checked bit for bit (dshot_frames.cpp)
+  vcu_host sim-canhealth                        CAN bus-off recovery against a mock controller (canhealth_sim.cpp)
+  vcu_host sim-power [cycles]                   power levels, wake-up latency and current estimate (power_sim.cpp)
+  vcu_host sim-yaw [speed error %]              yaw-rate feedback steering against a vehicle model (yaw_sim.cpp)
+  vcu_host rx-diversity [seconds]               two receivers against dropout traces (rxdiversity_sim.cpp)
+  vcu_host sim-estop [stops]                    e-stop re-arm sequences and stop latency (estop_sim.cpp)
+  vcu_host estop <ifname> stop|rearm [sequence] [node]  sends an e-stop frame, prints the VCU's e-stop record
+  vcu_host bench-jobs [seconds] [switches]      cooperative jobs against one thread per subsystem (jobs_bench.cpp)
+
+Set up a virtual bus with:
+  sudo modprobe vcan && sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0 */
+
+#include <Arduino.h>
+#include <CANBUS.h>
+#include <CANROUTE.h>
+#include <DIAGRECORD.h>
+#include <ESTOP.h>
+#include <signal.h>
+#include <vector>
+
+#define CANBUS_ID 0x15
+
+SocketCANClass CAN;
+
+// simulations and checks, separate translation units
+int xboxReportCheck(int argc, char** argv);
+int pursuitSim(int argc, char** argv);
+int rcFilterReport(int argc, char** argv);
+int sbusFrameCheck(int argc, char** argv);
+int ttcanSim(int argc, char** argv);
+int clockSim(int argc, char** argv);
+int batteryReport(int argc, char** argv);
+int linkHost(int argc, char** argv);
+int linkVcu(int argc, char** argv);
+int linkTest(int argc, char** argv);
+int setpointSim(int argc, char** argv);
+int steerCalReport(int argc, char** argv);
+int wakeupSim(int argc, char** argv);
+int rcLinkReport(int argc, char** argv);
+int dshotFrameCheck(int argc, char** argv);
+int canHealthSim(int argc, char** argv);
+int powerSim(int argc, char** argv);
+int yawSim(int argc, char** argv);
+int rxDiversitySim(int argc, char** argv);
+int estopSim(int argc, char** argv);
+int jobsBench(int argc, char** argv);
+
+static volatile bool running = true;
+
+static void onSignal(int) { running = false; }
+
+static int64_t monotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void printStats(const char* name, const SOCKETCANSTATS& stats) {
+  printf("%s: rx %llu frames in %llu batches, tx %llu frames in %llu batches, tx dropped %llu\n", name,
+         (unsigned long long)stats.framesRx, (unsigned long long)stats.batchesRx,
+         (unsigned long long)stats.framesTx, (unsigned long long)stats.batchesTx,
+         (unsigned long long)stats.txDropped);
+}
+
+
+//==================================================================================//
+
+// the CANBUS task's frame handling: every frame through canRoute() and logged, the command
+// taken over the way the control task does and answered with a status frame
+static int runBus(const char* ifname) {
+  CAN.setInterface(ifname);
+  if (!setupCANBUS()) return 1;
+
+  static Handoff<CANCOMMAND> command;
+  static PATH pathBuilding, pathLatest;
+  static Handoff<PATH> path;
+  static SETPOINTQUEUE setpoints;
+  static SETPOINTRX setpointRx;
+  static STEERCAL steerCalLatest;
+  static STEERCALRX steerCalRx;
+  static Handoff<STEERCAL> steerCal;
+  steerCalRxBegin(steerCalRx, steerCalLatest);
+  CANROUTES routes = {CANBUS_ID, &command, &pathBuilding, &pathLatest, &path, NULL, &setpoints, &setpointRx,
+                      &steerCalLatest, &steerCalRx, &steerCal};
+
+  while (running) {
+    CAN.waitForPacket(5);
+
+    CANRECIEVER msg = canReceiver();
+    while (msg.recieved) {
+      uint8_t route = canRoute(routes, msg);
+      canRouteLog(routes, msg, route);
+
+      if (route == CAN_ROUTE_COMMAND && command.update()) {
+        const CANCOMMAND& c = command.read();
+        canSender(CANBUS_ID, c.driveMode, c.throttle, c.steeringAngle, 0, 0, 1);
+      }
+      if (route == CAN_ROUTE_PATH && path.update()) {
+        printf("path of %u waypoints\n", path.read().count);
+      }
+      msg = canReceiver();
+    }
+
+    CAN.flush();
+  }
+
+  printStats(ifname, CAN.stats());
+  return 0;
+}
+
+
+//==================================================================================//
+
+// timebase master for VCU_CLOCK_SYNC nodes, the host's monotonic clock in us
+static int clockMaster(const char* ifname) {
+  CAN.setInterface(ifname);
+  if (!setupCANBUS()) return 1;
+
+  uint8_t sequence = 0;
+  uint32_t pairs = 0;
+  while (running) {
+    CAN.beginPacket(CLOCK_SYNC_ID);
+    CAN.write(sequence);
+    CAN.endPacket();
+    CAN.flush();
+
+    // taken when the SYNC has been handed to the driver, the queueing delay of the
+    // interface remains as an offset on every node alike
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t master = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    uint8_t data[8];
+    data[0] = sequence;
+    for (uint8_t i = 0; i < 7; i++) data[7 - i] = (master >> (8 * i)) & 0xFF;
+    CAN.beginPacket(CLOCK_FOLLOWUP_ID);
+    CAN.write(data, 8);
+    CAN.endPacket();
+    CAN.flush();
+
+    sequence++;
+    if (++pairs % 100 == 0) printf("%u sync pairs, master time %lld us\n", pairs, (long long)master);
+    usleep(CLOCK_SYNC_MS * 1000);
+  }
+
+  printStats(ifname, CAN.stats());
+  return 0;
+}
+
+
+//==================================================================================//
+
+// stop or re-arm frame on ESTOP_CAN_ID, then the next e-stop diagnostics record of the node
+static int estopSend(const char* ifname, bool rearm, uint8_t sequence, uint16_t node) {
+  CAN.setInterface(ifname);
+  if (!setupCANBUS()) return 1;
+
+  uint8_t command = rearm ? ESTOP_CMD_REARM : ESTOP_CMD_STOP;
+  uint8_t data[4] = {command, (uint8_t)(node >> 8), (uint8_t)(node & 0xFF), sequence};
+  CAN.beginPacket(ESTOP_CAN_ID);
+  CAN.write(data, rearm ? 4 : 3);
+  CAN.endPacket();
+  CAN.flush();
+  printf("%s sent to %s\n", rearm ? "re-arm" : "stop", node == ESTOP_ALL ? "every VCU" : "the VCU");
+
+  // records go out once a second
+  int64_t until = monotonicNs() + 2500000000LL;
+  while (running && monotonicNs() < until) {
+    CAN.waitForPacket(10);
+    while (CAN.parsePacket()) {
+      long id = CAN.packetId();
+      bool own = node == ESTOP_ALL ? id > DIAG_CAN_BASE && id < DIAG_CAN_BASE + 0x200 : id == DIAG_CAN_BASE + node;
+      if (!own || CAN.packetExtended() || CAN.packetRtr() || CAN.packetDlc() != 8 || CAN.peek() != DIAG_RECORD_ESTOP) {
+        continue;
+      }
+      uint8_t r[8];
+      for (uint8_t i = 0; i < 8; i++) r[i] = CAN.read();
+      const char* states[3] = {"running", "stopped", "arming"};
+      printf("VCU 0x%03lX: %s, sequence %u, last stop latency %u us, longest %u us, rejected re-arms %u\n",
+             id - DIAG_CAN_BASE, r[1] < 3 ? states[r[1]] : "?", r[2], (r[3] << 8) | r[4], (r[5] << 8) | r[6], r[7]);
+      if (node != ESTOP_ALL) return 0;
+    }
+  }
+  return node == ESTOP_ALL ? 0 : 1;
+}
+
+
+//==================================================================================//
+
+namespace {
+
+struct LOGFRAME {
+  int64_t offsetNs;   // from the first frame in the log
+  canid_t id;
+  bool extended;
+  bool rtr;
+  uint8_t dlc;
+  uint8_t data[8];
+};
+
+}  // namespace
+
+// candump -l format: (1436509052.249713) vcan0 123#DEADBEEF, 8 hex digit ids are extended, #R marks rtr
+static bool parseLogLine(const char* line, LOGFRAME& frame, double& stamp) {
+  char iface[IFNAMSIZ + 1];
+  char payload[64];
+  if (sscanf(line, " (%lf) %16s %63s", &stamp, iface, payload) != 3) return false;
+
+  char* hash = strchr(payload, '#');
+  if (hash == NULL || hash[1] == '#') return false;     // CAN FD frames are not supported
+
+  *hash = 0;
+  frame.extended = strlen(payload) > 3;
+  frame.id = strtoul(payload, NULL, 16);
+  frame.rtr = hash[1] == 'R';
+  frame.dlc = 0;
+
+  if (frame.rtr) {
+    frame.dlc = hash[2] ? atoi(&hash[2]) : 0;
+    return true;
+  }
+
+  for (const char* p = hash + 1; p[0] && p[1] && frame.dlc < 8; p += 2) {
+    char hex[3] = {p[0], p[1], 0};
+    frame.data[frame.dlc++] = strtoul(hex, NULL, 16);
+  }
+  return true;
+}
+
+static bool loadLog(const char* path, std::vector<LOGFRAME>& frames) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return false;
+
+  char line[256];
+  double first = -1;
+  while (fgets(line, sizeof(line), file)) {
+    LOGFRAME frame;
+    double stamp;
+    if (!parseLogLine(line, frame, stamp)) continue;
+    if (first < 0) first = stamp;
+    frame.offsetNs = (int64_t)((stamp - first) * 1e9);
+    frames.push_back(frame);
+  }
+  fclose(file);
+  return true;
+}
+
+// replays the log on a second socket and decodes it through canReceiver on the VCU socket
+static int replayLog(const char* path, const char* ifname, double speed) {
+  std::vector<LOGFRAME> frames;
+  if (!loadLog(path, frames) || frames.empty()) {
+    fprintf(stderr, "could not read frames from %s\n", path);
+    return 1;
+  }
+
+  SocketCANClass player;
+  player.setInterface(ifname);
+  CAN.setInterface(ifname);
+  if (!player.begin(1E6) || !CAN.begin(1E6)) {
+    fprintf(stderr, "could not open %s\n", ifname);
+    return 1;
+  }
+
+  std::vector<int64_t> latencies;
+  latencies.reserve(frames.size());
+  uint64_t decoded = 0;
+
+  int64_t start = monotonicNs();
+  int64_t lastRx = start;
+  size_t next = 0;
+
+  while (running && (next < frames.size() || decoded < player.stats().framesTx)) {
+    // queue everything that is due, sendmmsg goes out per batch
+    int64_t now = monotonicNs();
+    while (next < frames.size() && (speed <= 0 || frames[next].offsetNs / speed <= now - start)) {
+      const LOGFRAME& f = frames[next++];
+      if (f.extended) player.beginExtendedPacket(f.id, f.rtr ? f.dlc : -1, f.rtr);
+      else player.beginPacket(f.id, f.rtr ? f.dlc : -1, f.rtr);
+      if (!f.rtr) player.write(f.data, f.dlc);
+      player.endPacket();
+    }
+    player.flush();
+
+    CAN.waitForPacket(1);
+    CANRECIEVER msg = canReceiver();
+    while (msg.recieved) {
+      lastRx = monotonicNs();
+      latencies.push_back(lastRx - CAN.packetTimestamp());
+      decoded++;
+      msg = canReceiver();
+    }
+
+    // nothing arrived for a while after the last frame was sent: the rest is lost
+    if (next == frames.size() && monotonicNs() - lastRx > 500000000LL) break;
+  }
+
+  double seconds = (lastRx - start) / 1e9;
+  printf("replayed %zu frames, decoded %llu in %.3f s: %.0f frames/s\n", next, (unsigned long long)decoded, seconds,
+         seconds > 0 ? decoded / seconds : 0.0);
+
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    int64_t sum = 0;
+    for (size_t i = 0; i < latencies.size(); i++) sum += latencies[i];
+    printf("kernel rx to decoded latency (us): min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+           latencies.front() / 1e3, sum / 1e3 / latencies.size(), latencies[latencies.size() / 2] / 1e3,
+           latencies[latencies.size() * 99 / 100] / 1e3, latencies.back() / 1e3);
+  }
+
+  printStats("player", player.stats());
+  printStats("vcu", CAN.stats());
+  return 0;
+}
+
+
+//==================================================================================//
+
+int main(int argc, char** argv) {
+  signal(SIGINT, onSignal);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  if (argc >= 3 && strcmp(argv[1], "run") == 0) {
+    return runBus(argv[2]);
+  }
+  if (argc >= 4 && strcmp(argv[1], "replay") == 0) {
+    return replayLog(argv[2], argv[3], argc >= 5 ? atof(argv[4]) : 1.0);
+  }
+  if (argc >= 2 && strcmp(argv[1], "xbox-reports") == 0) {
+    return xboxReportCheck(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-pursuit") == 0) {
+    return pursuitSim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "rcfilter") == 0) {
+    return rcFilterReport(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sbus-frames") == 0) {
+    return sbusFrameCheck(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-ttcan") == 0) {
+    return ttcanSim(argc - 2, argv + 2);
+  }
+  if (argc >= 3 && strcmp(argv[1], "clock-master") == 0) {
+    return clockMaster(argv[2]);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-clock") == 0) {
+    return clockSim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "battery") == 0) {
+    return batteryReport(argc - 2, argv + 2);
+  }
+  if (argc >= 3 && strcmp(argv[1], "link") == 0) {
+    return linkHost(argc - 2, argv + 2);
+  }
+  if (argc >= 3 && strcmp(argv[1], "link-vcu") == 0) {
+    return linkVcu(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "link-test") == 0) {
+    return linkTest(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-setpoint") == 0) {
+    return setpointSim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "steercal") == 0) {
+    return steerCalReport(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-wakeup") == 0) {
+    return wakeupSim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "rclink") == 0) {
+    return rcLinkReport(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "dshot-frames") == 0) {
+    return dshotFrameCheck(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-canhealth") == 0) {
+    return canHealthSim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-power") == 0) {
+    return powerSim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-yaw") == 0) {
+    return yawSim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "rx-diversity") == 0) {
+    return rxDiversitySim(argc - 2, argv + 2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "sim-estop") == 0) {
+    return estopSim(argc - 2, argv + 2);
+  }
+  if (argc >= 4 && strcmp(argv[1], "estop") == 0 && strcmp(argv[3], "stop") == 0) {
+    return estopSend(argv[2], false, 0, argc >= 5 ? strtoul(argv[4], NULL, 0) : ESTOP_ALL);
+  }
+  if (argc >= 5 && strcmp(argv[1], "estop") == 0 && strcmp(argv[3], "rearm") == 0) {
+    return estopSend(argv[2], true, atoi(argv[4]), argc >= 6 ? strtoul(argv[5], NULL, 0) : ESTOP_ALL);
+  }
+  if (argc >= 2 && strcmp(argv[1], "bench-jobs") == 0) {
+    return jobsBench(argc - 2, argv + 2);
+  }
+
+  fprintf(stderr, "usage: %s run <ifname>\n"
+                  "       %s replay <candump.log> <ifname> [speed]\n"
+                  "       %s xbox-reports\n"
+                  "       %s sim-pursuit [circle|slalom|lanechange] [speed m/s] [speed error %%]\n"
+                  "       %s rcfilter [trace.txt]\n"
+                  "       %s sbus-frames\n"
+                  "       %s sim-ttcan [nodes 1-4] [seconds] [reference loss %%]\n"
+                  "       %s sim-clock [offset us] [drift ppm] [jitter us]\n"
+                  "       %s clock-master <ifname>\n"
+                  "       %s battery\n"
+                  "       %s link <tty> [rate Hz] [seconds] [baud]\n"
+                  "       %s link-vcu <tty> [baud]\n"
+                  "       %s link-test [frames]\n"
+                  "       %s sim-setpoint [jitter ms] [loss %%]\n"
+                  "       %s steercal\n"
+                  "       %s sim-wakeup [seconds]\n"
+                  "       %s rclink [seconds]\n"
+                  "       %s dshot-frames\n"
+                  "       %s sim-canhealth\n"
+                  "       %s sim-power [cycles]\n"
+                  "       %s sim-yaw [speed error %%]\n"
+                  "       %s rx-diversity [seconds]\n"
+                  "       %s sim-estop [stops]\n"
+                  "       %s estop <ifname> stop [node]\n"
+                  "       %s estop <ifname> rearm <sequence> [node]\n"
+                  "       %s bench-jobs [seconds] [switches]\n",
+          argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+          argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+          argv[0], argv[0]);
+  return 2;
+}
@@ -0,0 +1,250 @@
+/* Power levels, wake-up latency and an estimate of the supply current (include/POWERSTATE.h).
+
+Runs powerUpdate() of the firmware on a timeline of one input source: repeated sessions of
+driving, standing at neutral with the input still coming in, and silence (transmitter off,
+master stopped) long enough to park. The control loop runs per received input frame and on
+its timeout (WAKE_CONTROL_TIMEOUT_MS, POWER_PARKED_TIMEOUT_MS while parked), with the CAN
+command timeout setting neutral throttle as in drive mode 0. While parked the chip is in
+light sleep: the first edge of the next frame wakes it (SIM_WAKE_US, the esp_pm wake-up with
+the PLL back), that frame and any started before the control loop re-armed the inputs are
+lost, and the wake-up latency runs from that edge to the control loop applying the first
+frame received. Other nodes' frames on a shared bus wake the VCU as well, the controller has
+no acceptance filter in light sleep: the latency is taken only for wake-ups by a VCU input
+(the firmware cannot tell them apart, its figure includes the others), and the shared bus row
+shows how far foreign traffic defeats parking.
+
+The current is an estimate for the ESP32 chip alone, from the time in each level and the
+datasheet figures below (SIM_*_MA); the regulator, CAN transceiver, receiver and servos come
+on top. The firmware reports the residency and wake-up latency (diagnostics record 0xD0),
+the idle current itself has to be measured with a meter in the supply. Exit code 1 if a
+wake-up by a VCU input is not followed by actuation within the source's bound (the lost frame
+plus one period, the wake-up and a loop), on every row, or the estimate is not below the full
+clock one, or a source without foreign traffic never parks.
+
+  vcu_host sim-power [cycles] */
+
+#include <POWERSTATE.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#define SIM_WAKE_US           1000      // edge to the CPU running again after light sleep
+#define SIM_LOOP_US           150       // notification, CANBUS and VCU loop to the actuator write
+#define SIM_TIMEOUT_AWAKE_US  1500      // awake per timeout wake-up while parked, both tasks
+#define SIM_CONTROL_TIMEOUT_US 30000    // WAKE_CONTROL_TIMEOUT_MS
+#define SIM_PARKED_TIMEOUT_US 500000    // POWER_PARKED_TIMEOUT_MS
+#define SIM_COMMAND_TIMEOUT_US 100000   // WAKE_COMMAND_TIMEOUT_MS
+#define SIM_DRIVE_MA          40.0      // 240 MHz, tasks mostly blocked
+#define SIM_IDLE_MA           22.0      // 80 MHz
+#define SIM_SLEEP_MA          0.8       // light sleep
+
+static const POWERCONFIG simConfig = {10, 3, 2000, 30000, 500};   // powerConfig in POWERSAVE.h
+
+namespace {
+
+struct SIMSOURCE {
+  const char* name;
+  double periodMs;
+  double jitterMs;                      // uniform, master scheduling
+  int64_t frameUs;                      // first edge to the frame complete
+  double foreignHz;                     // other nodes' frames on the same pin, 0 = none
+};
+
+struct SIMINPUT {
+  int64_t start;                        // first edge
+  int64_t end;                          // complete, time stamped
+  int16_t throttle;
+  uint8_t steering;
+  bool foreign;
+};
+
+}  // namespace
+
+static bool simByStart(const SIMINPUT& a, const SIMINPUT& b) {
+  return a.start < b.start;
+}
+
+// sessions: 5 s driving, 5 s at neutral with input, then 35 - 40 s without
+static std::vector<SIMINPUT> simFrames(const SIMSOURCE& source, int cycles, int64_t& duration) {
+  std::vector<SIMINPUT> frames;
+  int64_t t = 0;
+  for (int c = 0; c < cycles; c++) {
+    int64_t session = t + (int64_t)(source.periodMs * 1000 * rand() / (double)RAND_MAX);
+    for (double at = 0; at < 10e6; at += source.periodMs * 1000) {
+      SIMINPUT f = SIMINPUT();
+      f.end = session + (int64_t)(at + source.frameUs + source.jitterMs * 1000 * rand() / (double)RAND_MAX);
+      f.start = f.end - source.frameUs;
+      bool driving = at < 5e6;
+      f.throttle = driving ? 1600 : 1500;
+      f.steering = driving ? 90 + (int)(30 * sin(at / 1e6)) : 90;
+      frames.push_back(f);
+    }
+    t = session + 10000000LL + 35000000LL + rand() % 5000000;
+  }
+  duration = t;
+
+  if (source.foreignHz > 0) {
+    for (double at = 0; at < duration; at += 1e6 / source.foreignHz) {
+      SIMINPUT f = SIMINPUT();
+      f.start = (int64_t)at + rand() % 1000;
+      f.end = f.start + source.frameUs;
+      f.foreign = true;
+      frames.push_back(f);
+    }
+  }
+  std::sort(frames.begin(), frames.end(), simByStart);
+  return frames;
+}
+
+namespace {
+
+struct SIMRESULT {
+  double residency[POWER_LEVELS];       // share of the time
+  uint32_t wakes;
+  uint32_t foreignWakes;                // by other nodes' frames
+  uint32_t inputWakes;                  // by a VCU input
+  uint32_t actuated;                    // input wake-ups followed by an applied input
+  double latencyMeanMs;                 // input wake-ups only
+  double latencyMaxMs;
+  double timeoutWakes;                  // per second while parked
+  double currentMa;
+  double parkedMa;                      // while parked, timeout wake-ups included
+};
+
+}  // namespace
+
+static SIMRESULT simRun(const SIMSOURCE& source, int cycles) {
+  int64_t duration;
+  std::vector<SIMINPUT> frames = simFrames(source, cycles, duration);
+
+  POWERSTATE state;
+  powerReset(state, true, 0);
+  int64_t lastLoop = 0, readyAt = 0, inputAt = 0;
+  int16_t throttle = 1500;
+  uint8_t steering = 90;
+  uint32_t parkedTimeouts = 0;
+  int64_t wakeAt = 0;                   // edge of a wake-up by a VCU input, waiting for its first input
+  int64_t latencySum = 0, latencyMax = 0;
+  SIMRESULT r = SIMRESULT();
+
+  for (size_t i = 0; i <= frames.size(); i++) {
+    int64_t next = i < frames.size() ? frames[i].start : duration;
+
+    // timeout loops until the next edge; the command timeout brings the throttle to neutral
+    for (;;) {
+      int64_t timeout = state.level == POWER_PARKED ? SIM_PARKED_TIMEOUT_US : SIM_CONTROL_TIMEOUT_US;
+      if (lastLoop + timeout >= next) break;
+      lastLoop += timeout;
+      if (state.level == POWER_PARKED) parkedTimeouts++;
+      if (lastLoop - inputAt > SIM_COMMAND_TIMEOUT_US) throttle = 1500;
+      powerUpdate(state, simConfig, throttle, steering, 0, 0, lastLoop);
+    }
+    if (i == frames.size()) break;
+    const SIMINPUT& f = frames[i];
+
+    if (state.level == POWER_PARKED) {
+      // the edge wakes the chip, the control loop goes back to POWER_IDLE and re-arms the inputs
+      if (f.foreign) r.foreignWakes++;
+      else r.inputWakes++;
+      wakeAt = f.foreign ? 0 : f.start;
+      lastLoop = f.start + SIM_WAKE_US + SIM_LOOP_US;
+      readyAt = lastLoop;
+      powerUpdate(state, simConfig, throttle, steering, 0, f.start, lastLoop);
+      continue;
+    }
+    if (f.start < readyAt || f.foreign) continue;     // lost with the wake-up, or filtered out
+
+    lastLoop = f.end + SIM_LOOP_US;
+    inputAt = f.end;
+    throttle = f.throttle;
+    steering = f.steering;
+    powerUpdate(state, simConfig, throttle, steering, f.end, 0, lastLoop);
+    if (wakeAt != 0) {
+      r.actuated++;
+      latencySum += lastLoop - wakeAt;
+      latencyMax = std::max(latencyMax, lastLoop - wakeAt);
+      wakeAt = 0;
+    }
+  }
+
+  double total = 0;
+  for (uint8_t l = 0; l < POWER_LEVELS; l++) total += state.residencyUs[l];
+  for (uint8_t l = 0; l < POWER_LEVELS; l++) r.residency[l] = state.residencyUs[l] / total;
+  r.wakes = state.wakes;
+  r.latencyMeanMs = r.actuated ? latencySum / 1000.0 / r.actuated : 0;
+  r.latencyMaxMs = latencyMax / 1000.0;
+
+  double parkedUs = state.residencyUs[POWER_PARKED];
+  double awakeUs = std::min(parkedUs, (double)parkedTimeouts * SIM_TIMEOUT_AWAKE_US);
+  double parkedCharge = (parkedUs - awakeUs) * SIM_SLEEP_MA + awakeUs * SIM_IDLE_MA;
+  r.timeoutWakes = parkedUs > 0 ? parkedTimeouts / (parkedUs / 1e6) : 0;
+  r.parkedMa = parkedUs > 0 ? parkedCharge / parkedUs : 0;
+  r.currentMa = (state.residencyUs[POWER_DRIVE] * SIM_DRIVE_MA + state.residencyUs[POWER_IDLE] * SIM_IDLE_MA +
+                 parkedCharge) / total;
+  return r;
+}
+
+
+//==================================================================================//
+
+int powerSim(int argc, char** argv) {
+  int cycles = argc >= 1 ? atoi(argv[0]) : 20;
+  if (cycles < 1) cycles = 1;
+  if (cycles > 80) cycles = 80;         // residency counters of one window
+  srand(11);
+
+  const SIMSOURCE sources[] = {
+    {"CAN commands 100 Hz, 1 ms jitter", 10, 1, 130, 0},
+    {"CAN commands 50 Hz, 2 ms jitter", 20, 2, 130, 0},
+    {"PPM frames, 22.5 ms", 22.5, 0, 22500, 0},
+    {"serial link 100 Hz", 10, 0.5, 200, 0},
+    {"CAN 100 Hz, other nodes 200 Hz", 10, 1, 130, 200},
+  };
+
+  printf("power levels: %d sessions of 5 s driving, 5 s at neutral, 35 - 40 s without input\n", cycles);
+  printf("chip current estimate: %.1f mA at 240 MHz, %.1f mA at 80 MHz, %.1f mA in light sleep; full clock %.1f mA\n\n",
+         SIM_DRIVE_MA, SIM_IDLE_MA, SIM_SLEEP_MA, SIM_DRIVE_MA);
+  printf("  %-34s %6s %6s %7s %6s %8s %9s %9s %8s %9s %9s %8s\n", "", "drive", "idle", "parked", "wakes",
+         "foreign", "lat ms", "max ms", "bound", "timeout/s", "parked mA", "avg mA");
+
+  bool pass = true;
+  double quietParked = 1;
+  std::vector<const char*> sharedNames;
+  std::vector<SIMRESULT> shared;
+  for (size_t s = 0; s < sizeof(sources) / sizeof(sources[0]); s++) {
+    const SIMSOURCE& source = sources[s];
+    SIMRESULT r = simRun(source, cycles);
+    double boundMs = (source.frameUs + SIM_WAKE_US + 2 * SIM_LOOP_US) / 1000.0 + source.periodMs + source.jitterMs;
+
+    char mean[16] = "-", longest[16] = "-";
+    if (r.actuated) {
+      snprintf(mean, sizeof(mean), "%.1f", r.latencyMeanMs);
+      snprintf(longest, sizeof(longest), "%.1f", r.latencyMaxMs);
+    }
+    printf("  %-34s %5.1f%% %5.1f%% %6.1f%% %6u %8u %9s %9s %8.1f %9.1f %9.2f %8.2f\n", source.name,
+           100 * r.residency[POWER_DRIVE], 100 * r.residency[POWER_IDLE], 100 * r.residency[POWER_PARKED], r.wakes,
+           r.foreignWakes, mean, longest, boundMs, r.timeoutWakes, r.parkedMa, r.currentMa);
+
+    pass &= r.actuated == r.inputWakes && r.latencyMaxMs <= boundMs && r.currentMa < SIM_DRIVE_MA;
+    if (source.foreignHz == 0) {
+      pass &= r.residency[POWER_PARKED] > 0;
+      quietParked = std::min(quietParked, r.residency[POWER_PARKED]);
+    } else {
+      sharedNames.push_back(source.name);
+      shared.push_back(r);
+    }
+  }
+
+  // no acceptance filter in light sleep: every foreign frame ends the parked phase
+  for (size_t s = 0; s < shared.size(); s++) {
+    printf("\n  %s: %u of %u wake-ups by other nodes' frames, parked %.1f %% of the time against at least\n"
+           "  %.1f %% on a quiet bus, parking does not pay on a busy shared bus\n", sharedNames[s],
+           shared[s].foreignWakes, shared[s].wakes, 100 * shared[s].residency[POWER_PARKED], 100 * quietParked);
+  }
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
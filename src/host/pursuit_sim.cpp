@@ -0,0 +1,123 @@
+/* Closed loop host simulation of the onboard path tracker (include/PURSUIT.h).
+
+A kinematic bicycle model with a first order steering servo drives along the path while
+the tracker runs at the VCU control rate on its own dead-reckoned pose, exactly as on the car.
+The measured speed fed to the tracker can be given an error to show odometry drift.
+
+  vcu_host sim-pursuit [circle|slalom|lanechange] [speed m/s] [speed error %] */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <PURSUIT.h>
+
+#define SIM_CONTROL_US    12000     // VCU loop period
+#define SIM_PHYSICS_US    1000
+#define SIM_SERVO_TAU     0.08      // s, steering servo time constant
+#define SIM_MAX_STEER     30        // deg, steeringOffset
+#define SIM_TIMEOUT_S     60.0
+
+static const PURSUITCONFIG simConfig = {260, 300, 300, 250, 1500, 37256, 150};
+
+namespace {
+
+struct SIMVEHICLE {
+  double x, y, heading;   // m, rad
+  double steer;           // rad, actual wheel angle
+};
+
+}  // namespace
+
+static void buildPath(const char* name, PATH& path) {
+  path.count = 0;
+  path.id = 1;
+  for (int i = 0; i < PATH_MAX_WAYPOINTS; i++) {
+    double x, y;
+    if (strcmp(name, "circle") == 0) {            // half circle, 2 m radius, to the left
+      double a = M_PI * i / (PATH_MAX_WAYPOINTS - 1);
+      x = 2.0 * sin(a);
+      y = 2.0 * (1.0 - cos(a));
+    } else if (strcmp(name, "slalom") == 0) {     // +-0.5 m, 4 m wavelength
+      x = 0.5 * i;
+      y = 0.5 * sin(2.0 * M_PI * x / 4.0);
+    } else {                                      // 1 m lane change over 3 m
+      x = 0.5 * i;
+      y = x < 2.0 ? 0.0 : (x > 5.0 ? 1.0 : 0.5 - 0.5 * cos(M_PI * (x - 2.0) / 3.0));
+    }
+    path.points[path.count].x = (int16_t)lround(x * 1000);
+    path.points[path.count].y = (int16_t)lround(y * 1000);
+    path.count++;
+  }
+}
+
+// distance from a point to the waypoint polyline, m
+static double crossTrack(const PATH& path, double x, double y) {
+  double best = 1e9;
+  for (int i = 0; i + 1 < path.count; i++) {
+    double ax = path.points[i].x / 1000.0, ay = path.points[i].y / 1000.0;
+    double bx = path.points[i + 1].x / 1000.0, by = path.points[i + 1].y / 1000.0;
+    double dx = bx - ax, dy = by - ay;
+    double t = ((x - ax) * dx + (y - ay) * dy) / (dx * dx + dy * dy);
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    double ex = ax + t * dx - x, ey = ay + t * dy - y;
+    best = fmin(best, sqrt(ex * ex + ey * ey));
+  }
+  return best;
+}
+
+
+//==================================================================================//
+
+int pursuitSim(int argc, char** argv) {
+  const char* name = argc > 0 ? argv[0] : "lanechange";
+  double speed = argc > 1 ? atof(argv[1]) : 1.5;
+  double speedError = argc > 2 ? atof(argv[2]) / 100.0 : 0.0;
+
+  PATH path;
+  buildPath(name, path);
+
+  PURSUITSTATE state;
+  pursuitStart(state);
+
+  SIMVEHICLE car = {0, 0, 0, 0};
+  double wheelbase = simConfig.wheelbase / 1000.0;
+  double target = 0;
+  double sum2 = 0, worst = 0;
+  int samples = 0;
+  double t = 0;
+  int32_t measured = (int32_t)lround(speed * (1.0 + speedError) * 1000);
+
+  while (!state.done && t < SIM_TIMEOUT_S) {
+    // VCU step: dead reckoning, tracker, servo command in whole degrees like drive()
+    pursuitPredict(state, measured, t > 0 ? SIM_CONTROL_US : 0);
+    int32_t curvature = pursuitUpdate(state, simConfig, path, measured);
+    int32_t wheelAngle = pursuitWheelAngle(simConfig, curvature) / 100;
+    wheelAngle = wheelAngle > SIM_MAX_STEER ? SIM_MAX_STEER : (wheelAngle < -SIM_MAX_STEER ? -SIM_MAX_STEER : wheelAngle);
+    pursuitApply(state, simConfig, wheelAngle * 100);
+    target = wheelAngle * M_PI / 180.0;
+
+    for (int step = 0; step < SIM_CONTROL_US / SIM_PHYSICS_US; step++) {
+      double dt = SIM_PHYSICS_US / 1e6;
+      car.steer += (target - car.steer) * dt / SIM_SERVO_TAU;
+      car.heading += speed * tan(car.steer) / wheelbase * dt;
+      car.x += speed * cos(car.heading) * dt;
+      car.y += speed * sin(car.heading) * dt;
+      t += dt;
+    }
+
+    double error = crossTrack(path, car.x, car.y);
+    sum2 += error * error;
+    worst = fmax(worst, error);
+    samples++;
+  }
+
+  const WAYPOINT& goal = path.points[path.count - 1];
+  double goalError = hypot(car.x - goal.x / 1000.0, car.y - goal.y / 1000.0);
+
+  printf("path %s, %.2f m/s, speed error %.1f %%\n", name, speed, speedError * 100);
+  printf("%s after %.2f s, %d control steps\n", state.done ? "reached goal" : "timed out", t, samples);
+  printf("cross track error: rms %.1f mm, max %.1f mm, final position error %.1f mm\n",
+         sqrt(sum2 / samples) * 1000, worst * 1000, goalError * 1000);
+  return state.done ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+/* Attenuation and delay report for the RC input filters (include/RCFILTER.h).
+
+Feeds a pulse width trace through each filter preset and prints the jitter attenuation
+(first difference rms with the largest 5 % trimmed, so steps and spikes do not dominate it)
+and the delay on the trace (input/output cross correlation peak, sub-frame by parabolic
+interpolation). The nominal ramp lag from rcFilterDelay() is printed next to the lag measured
+on a clean ramp once the filter has settled, the quantity it models; the trace delay also
+holds the step response and differs from it. Exit code 1 if the nominal and the measured
+ramp lag are more than SIM_RAMP_TOLERANCE apart.
+
+  vcu_host rcfilter [trace.txt]     trace: one pulse width in us per line, one line per frame
+                                    without a trace a synthetic one with +-4 us jitter and spikes is used */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <RCFILTER.h>
+
+#define SIM_RAMP_FRAMES     200
+#define SIM_RAMP_US         3           // per frame
+#define SIM_RAMP_TOLERANCE  0.05        // frames
+
+namespace {
+
+struct RCPRESET {
+  const char* name;
+  RCFILTERCONFIG config;
+};
+
+}  // namespace
+
+static const RCPRESET presets[] = {
+  {"none",              {false, RC_FILTER_NONE, 0, 0, 0}},
+  {"median",            {true, RC_FILTER_NONE, 0, 0, 0}},
+  {"one pole 0.5",      {false, RC_FILTER_ONE_POLE, 32768, 0, 0}},
+  {"median+one pole",   {true, RC_FILTER_ONE_POLE, 32768, 0, 0}},
+  {"alpha-beta",        {false, RC_FILTER_ALPHA_BETA, 32768, 6554, 0}},
+  {"median+a-b+lead 1", {true, RC_FILTER_ALPHA_BETA, 32768, 6554, 256}},
+};
+
+static std::vector<double> syntheticTrace() {
+  std::vector<double> trace;
+  srand(1);
+  for (int i = 0; i < 3000; i++) {
+    double clean;
+    int phase = i % 600;
+    if (phase < 150) clean = 1500;
+    else if (phase < 250) clean = 1500 + 3.0 * (phase - 150);          // ramp to 1800
+    else if (phase < 400) clean = 1800;
+    else clean = 1200;                                                 // step
+    double jitter = (rand() % 9) - 4;                                  // +-4 us
+    double spike = (rand() % 100 == 0) ? ((rand() & 1) ? 60 : -60) : 0;
+    trace.push_back(clean + jitter + spike);
+  }
+  return trace;
+}
+
+// rms of the first difference with the largest 5 % dropped: the jitter level without
+// the steps and spikes dominating it
+static double jitterRms(const std::vector<double>& x) {
+  std::vector<double> d;
+  for (size_t i = 1; i < x.size(); i++) d.push_back((x[i] - x[i - 1]) * (x[i] - x[i - 1]));
+  std::sort(d.begin(), d.end());
+  size_t keep = d.size() * 95 / 100;
+  double sum = 0;
+  for (size_t i = 0; i < keep; i++) sum += d[i];
+  return sqrt(sum / keep);
+}
+
+// lag (frames) of b behind a at the cross correlation peak
+static double correlationDelay(const std::vector<double>& a, const std::vector<double>& b) {
+  double meanA = 0, meanB = 0;
+  for (size_t i = 0; i < a.size(); i++) { meanA += a[i]; meanB += b[i]; }
+  meanA /= a.size();
+  meanB /= b.size();
+
+  const int maxLag = 10;
+  double corr[2 * maxLag + 1];
+  for (int lag = -maxLag; lag <= maxLag; lag++) {
+    double sum = 0;
+    for (size_t i = maxLag; i + maxLag < a.size(); i++) sum += (a[i] - meanA) * (b[i + lag] - meanB);
+    corr[lag + maxLag] = sum;
+  }
+
+  int best = 1;
+  for (int i = 1; i < 2 * maxLag; i++) if (corr[i] > corr[best]) best = i;
+  double y0 = corr[best - 1], y1 = corr[best], y2 = corr[best + 1];
+  double offset = (y0 - 2 * y1 + y2) != 0 ? 0.5 * (y0 - y2) / (y0 - 2 * y1 + y2) : 0;
+  return best - maxLag + offset;
+}
+
+// lag (frames) behind a clean ramp, averaged over its second half
+static double rampLag(const RCFILTERCONFIG& config) {
+  RCFILTERSTATE state;
+  rcFilterReset(state, 1000);
+  double sum = 0;
+  int n = 0;
+  for (int i = 0; i < SIM_RAMP_FRAMES; i++) {
+    int32_t in = 1000 + SIM_RAMP_US * i;
+    int32_t out = rcFilterUpdate(state, config, in);
+    if (i >= SIM_RAMP_FRAMES / 2) {
+      sum += (double)(in - out) / SIM_RAMP_US;
+      n++;
+    }
+  }
+  return sum / n;
+}
+
+
+//==================================================================================//
+
+int rcFilterReport(int argc, char** argv) {
+  std::vector<double> trace;
+  if (argc > 0) {
+    FILE* file = fopen(argv[0], "r");
+    if (file == NULL) {
+      fprintf(stderr, "could not open %s\n", argv[0]);
+      return 1;
+    }
+    double us;
+    while (fscanf(file, "%lf", &us) == 1) trace.push_back(us);
+    fclose(file);
+  } else {
+    trace = syntheticTrace();
+  }
+  if (trace.size() < 50) {
+    fprintf(stderr, "trace too short\n");
+    return 1;
+  }
+
+  printf("%zu frames, input jitter %.2f us (trimmed first difference rms)\n", trace.size(), jitterRms(trace));
+  printf("%-20s %14s %14s %16s %16s\n", "filter", "ramp lag [fr]", "measured [fr]", "trace delay [fr]",
+         "jitter atten dB");
+
+  bool pass = true;
+
+  for (size_t p = 0; p < sizeof(presets) / sizeof(presets[0]); p++) {
+    RCFILTERSTATE state;
+    rcFilterReset(state, 1500);
+
+    std::vector<double> out;
+    for (size_t i = 0; i < trace.size(); i++) {
+      out.push_back(rcFilterUpdate(state, presets[p].config, (int32_t)lround(trace[i])));
+    }
+
+    double attenuation = 20 * log10(jitterRms(trace) / jitterRms(out));
+    double nominal = rcFilterDelay(presets[p].config) / 256.0;
+    double measured = rampLag(presets[p].config);
+    pass &= fabs(nominal - measured) <= SIM_RAMP_TOLERANCE;
+    printf("%-20s %14.2f %14.2f %16.2f %16.1f\n", presets[p].name, nominal, measured, correlationDelay(trace, out),
+           attenuation);
+  }
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+/* Receiver link quality statistics against the simulated link (include/RCLINK.h).
+
+Frames of a PPM (22.5 ms) and an SBUS (9 ms) receiver are generated with random loss, loss
+bursts and outages; SBUS frames the receiver repeated carry the lost frame flag, PPM loss only
+shows as a longer gap. The CANBUS task is modelled as in getData(): a poll every 5 ms takes the
+latest frame, and no frame for RX_TIMEOUT_MS is a failsafe. Every poll goes through
+rcLinkUpdate() and the result is compared with what the generator knows:
+  lost %      over the whole run and over the last ten seconds
+  failsafe    episodes, longest and total duration against the gaps between generated frames
+  gaps        one histogram entry per frame after the first
+  degradation throttle limited during a loss burst, never on the base loss, lifted after
+Exit code 1 if a check fails. Time per update is printed for the O(1) claim.
+
+  vcu_host rclink [seconds] */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include <RCLINK.h>
+#include <HOSTCHECK.h>
+
+#define SIM_POLL_US         5000          // CANBUS task
+#define SIM_TIMEOUT_US      100000        // RX_TIMEOUT_MS
+#define SIM_THROTTLE        1800          // stick position during the run
+#define SIM_MAX_ERROR_PCT   2             // statistics against the generator
+
+static const RCLINKCONFIG simConfig = {25, 10, 128};      // rxLinkConfig in FrySky.h
+
+namespace {
+
+struct SIMWINDOW {
+  double start;                         // s
+  double length;
+  double missPercent;                   // loss during the window, 100 = outage
+};
+
+struct SIMSCENARIO {
+  const char* name;
+  uint32_t periodUs;
+  uint32_t jitterUs;
+  double missPercent;                   // frames that never arrive
+  double flagPercent;                   // frames that arrive flagged lost (SBUS only)
+  SIMWINDOW windows[2];
+};
+
+struct SIMLINKFRAME {
+  int64_t at;
+  bool flagged;
+};
+
+}  // namespace
+
+static double simRandom() {
+  return 100.0 * rand() / ((double)RAND_MAX + 1);
+}
+
+static const SIMWINDOW* simWindow(const SIMSCENARIO& scenario, double t) {
+  for (uint8_t i = 0; i < 2; i++) {
+    const SIMWINDOW& w = scenario.windows[i];
+    if (w.length > 0 && t >= w.start && t < w.start + w.length) return &w;
+  }
+  return NULL;
+}
+
+//==================================================================================//
+
+static bool simRun(const SIMSCENARIO& scenario, int64_t duration) {
+  // generator: frame slots, what arrives and the truth per slot
+  std::vector<SIMLINKFRAME> frames;
+  std::vector<int64_t> slotAt;
+  std::vector<bool> slotLost;
+  for (int64_t t = scenario.periodUs; t < duration; t += scenario.periodUs) {
+    const SIMWINDOW* w = simWindow(scenario, t / 1e6);
+    if (w != NULL && w->missPercent >= 100) continue;     // outage: failsafe, not counted as lost
+    double miss = w != NULL ? w->missPercent : scenario.missPercent;
+    bool missing = simRandom() < miss;
+    bool flagged = !missing && simRandom() < scenario.flagPercent;
+    slotAt.push_back(t);
+    slotLost.push_back(missing || flagged);
+    if (!missing) frames.push_back(SIMLINKFRAME{t + (int64_t)(scenario.jitterUs * simRandom() / 100), flagged});
+  }
+
+  RCLINKSTATS stats;
+  rcLinkReset(stats);
+  size_t next = 0;
+  int64_t lastFramePoll = 0, frameAt = 0;
+  uint32_t polls = 0, degradedBase = 0, degradedBurst = 0, limited = 0;
+  int64_t degradedAt = 0, recoveredAt = 0;
+  const SIMWINDOW* burst = NULL;
+  for (uint8_t i = 0; i < 2; i++) {
+    if (scenario.windows[i].length > 0 && scenario.windows[i].missPercent < 100) burst = &scenario.windows[i];
+  }
+
+  clock_t started = clock();
+  for (int64_t poll = SIM_POLL_US; poll < duration; poll += SIM_POLL_US) {
+    bool fresh = false, flagged = false;
+    while (next < frames.size() && frames[next].at <= poll) {
+      fresh = true;
+      flagged = frames[next].flagged;
+      frameAt = frames[next].at;
+      next++;
+    }
+    if (fresh) lastFramePoll = poll;
+    bool timeout = lastFramePoll != 0 && poll - lastFramePoll > SIM_TIMEOUT_US;
+    rcLinkUpdate(stats, simConfig, fresh, flagged, timeout, frameAt, poll);
+    polls++;
+
+    // degradation against the generator's windows
+    bool inBurst = burst != NULL && poll >= burst->start * 1e6 && poll < (burst->start + burst->length + 1) * 1e6;
+    if (stats.degraded) {
+      if (inBurst) degradedBurst++;
+      else degradedBase++;
+      if (rcLinkThrottle(stats, simConfig, SIM_THROTTLE) < SIM_THROTTLE) limited++;
+      if (degradedAt == 0) degradedAt = poll;
+    } else if (degradedAt != 0 && recoveredAt == 0) {
+      recoveredAt = poll;
+    }
+  }
+  double nsPerUpdate = (clock() - started) * 1e9 / CLOCKS_PER_SEC / polls;
+
+  // truth over the run and over the long window (whole seconds, like the buckets)
+  uint32_t lostTotal = 0, slotsWindow = 0, lostWindow = 0;
+  int64_t windowStart = (duration / 1000000 - RCLINK_LONG_SECONDS + 1) * 1000000;
+  for (size_t i = 0; i < slotAt.size(); i++) {
+    lostTotal += slotLost[i];
+    if (slotAt[i] >= windowStart) {
+      slotsWindow++;
+      lostWindow += slotLost[i];
+    }
+  }
+  double truthTotal = 100.0 * lostTotal / slotAt.size();
+  double truthWindow = slotsWindow ? 100.0 * lostWindow / slotsWindow : 0;
+  double measuredTotal = 100.0 * stats.lost / (stats.frames + stats.lost);
+
+  // failsafe truth: the poll that takes a frame, then nothing for longer than the timeout
+  uint32_t episodes = 0, longest = 0, total = 0;
+  for (size_t i = 1; i < frames.size(); i++) {
+    int64_t taken = (frames[i - 1].at + SIM_POLL_US - 1) / SIM_POLL_US * SIM_POLL_US;
+    int64_t nextTaken = (frames[i].at + SIM_POLL_US - 1) / SIM_POLL_US * SIM_POLL_US;
+    if (nextTaken - taken <= SIM_TIMEOUT_US + SIM_POLL_US) continue;
+    uint32_t length = (nextTaken - taken - SIM_TIMEOUT_US - SIM_POLL_US) / 1000;
+    episodes++;
+    total += length;
+    if (length > longest) longest = length;
+  }
+
+  uint32_t gapEntries = 0;
+  for (uint8_t i = 0; i < RCLINK_GAP_BINS; i++) gapEntries += stats.gaps[i];
+
+  printf("  %s\n", scenario.name);
+  printf("    %u frames, %u lost, period %u us, %u frames in the last second, %.0f ns per update\n", stats.frames,
+         stats.lost, stats.periodUs, stats.lastSecondFrames, nsPerUpdate);
+  printf("    lost %%: run %.1f (truth %.1f), last %d s %u (truth %.1f), last %d frames %u\n", measuredTotal,
+         truthTotal, RCLINK_LONG_SECONDS, rcLinkLongPercent(stats), truthWindow, RCLINK_SHORT_FRAMES,
+         rcLinkShortPercent(stats));
+  printf("    failsafe: %u episodes (truth %u), longest %u ms (%u), total %u ms (%u)\n", stats.failsafeEpisodes, episodes,
+         stats.failsafeLongestMs, longest, stats.failsafeTotalMs, total);
+  printf("    gaps from ms:");
+  for (uint8_t i = 0; i < RCLINK_GAP_BINS; i++) {
+    if (stats.gaps[i]) printf(" %u: %u", i * RCLINK_GAP_BIN_US / 1000, stats.gaps[i]);
+  }
+  printf("\n");
+  if (burst != NULL) {
+    printf("    burst %.0f %% at %.0f s: degraded after %.0f ms, lifted %.0f ms after the burst\n", burst->missPercent,
+           burst->start, degradedAt ? (degradedAt - burst->start * 1e6) / 1000 : -1.0,
+           recoveredAt ? (recoveredAt - (burst->start + burst->length) * 1e6) / 1000 : -1.0);
+  }
+
+  bool pass = true;
+  pass &= hostCheck("lost % over the run", measuredTotal - truthTotal < SIM_MAX_ERROR_PCT &&
+                                           truthTotal - measuredTotal < SIM_MAX_ERROR_PCT, 4);
+  pass &= hostCheck("lost % over the long window", rcLinkLongPercent(stats) - truthWindow < SIM_MAX_ERROR_PCT + 1 &&
+                                                   truthWindow - rcLinkLongPercent(stats) < SIM_MAX_ERROR_PCT + 1, 4);
+  pass &= hostCheck("failsafe episodes counted and timed",
+                    stats.failsafeEpisodes == episodes && stats.failsafeLongestMs == longest &&
+                    stats.failsafeTotalMs == total, 4);
+  pass &= hostCheck("one gap per frame after the first", gapEntries == stats.frames - 1, 4);
+  pass &= hostCheck("throttle never limited on the base loss", degradedBase == 0, 4);
+  if (burst != NULL) {
+    pass &= hostCheck("throttle limited during the burst, lifted after",
+                      degradedBurst > 0 && limited == degradedBurst && !stats.degraded, 4);
+  }
+  return pass;
+}
+
+
+//==================================================================================//
+
+int rcLinkReport(int argc, char** argv) {
+  int64_t seconds = argc >= 1 ? atoi(argv[0]) : 60;
+  if (seconds < 20) seconds = 20;
+  srand(11);
+
+  const SIMSCENARIO scenarios[] = {
+    {"PPM 22.5 ms, 3 % loss, outages 1.5 s and 0.4 s", 22500, 200, 3, 0, {{8, 1.5, 100}, {14, 0.4, 100}}},
+    {"SBUS 9 ms, 1 % missing, 4 % flagged lost", 9000, 300, 1, 4, {{0, 0, 0}, {0, 0, 0}}},
+    {"SBUS 9 ms, 1 % loss, 40 % burst for 3 s", 9000, 300, 1, 0, {{10, 3, 40}, {0, 0, 0}}},
+    {"PPM 22.5 ms, 2 % loss, 50 % burst for 2 s, outage 0.3 s", 22500, 200, 2, 0, {{6, 2, 50}, {15, 0.3, 100}}},
+  };
+
+  printf("receiver link quality: %lld s per scenario, polled every %d ms, degraded from %u %% lost in %d frames\n\n",
+         (long long)seconds, SIM_POLL_US / 1000, simConfig.degradePercent, RCLINK_SHORT_FRAMES);
+
+  bool pass = true;
+  for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    pass &= simRun(scenarios[s], seconds * 1000000LL);
+  }
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
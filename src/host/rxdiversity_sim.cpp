@@ -0,0 +1,340 @@
+/* Receiver diversity against replayed dropout traces (include/RXDIVERSITY.h).
+
+Two receivers bound to the same transmitter, each with its own frame period and phase, random
+loss and fades (antenna shadowing, the receiver out of range, a wire off). An SBUS receiver keeps
+its period through a fade, repeating the last frame with the lost flag and after
+SIM_SBUS_FAILSAFE_US sending failsafe frames; a PPM receiver and a receiver without power send
+nothing. The frames carry the stick position of a 0.7 Hz steering sweep.
+
+Every scenario runs each receiver alone (as getData() with one receiver) and both through
+rxDivUpdate(), once polled every 5 ms and once event driven (woken per frame of either receiver,
+by the rescue timer at rxDivCheckAt() and at WAKE_INPUT_TIMEOUT_MS). getData() is modelled on
+top: neutral on failsafe or without a frame for RX_TIMEOUT_MS, its link statistics over what it
+was handed. Reported per run: time at neutral, the oldest frame applied while not at neutral,
+the largest steering error against the stick, lost % and time with the throttle limited as
+getData() sees it, switches and rescued frames.
+
+Exit code 1 if a diversity run delivers a frame that is not newer than the one before, is at
+neutral longer than the gaps without a good frame from either receiver allow (beyond
+RX_TIMEOUT_MS, 20 ms slack per episode), or longer than either receiver alone, or is at neutral
+or has the throttle limited longer than the better receiver alone (a receiver that is down is at
+neutral, not limited).
+
+  vcu_host rx-diversity [seconds] */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <RXDIVERSITY.h>
+
+#define SIM_POLL_US           5000      // CANBUS task without VCU_EVENT_DRIVEN
+#define SIM_WAKE_TIMEOUT_US   30000     // WAKE_INPUT_TIMEOUT_MS
+#define SIM_TIMEOUT_US        100000    // RX_TIMEOUT_MS
+#define SIM_SBUS_FAILSAFE_US  500000    // SBUS receiver: repeats, then failsafe frames
+#define SIM_SLACK_US          20000     // per neutral episode
+#define SIM_STICK_HZ          0.7
+
+static const RCLINKCONFIG simLinkConfig = {25, 10, 128};              // rxLinkConfig in FrySky.h
+static const RXDIVCONFIG simConfig = {125, 20, SIM_TIMEOUT_US / 1000};  // rxDiversityConfig in FrySky.h
+
+namespace {
+
+struct SIMFADE {
+  double start;                         // s, first fade
+  double length;
+  double every;                         // s, 0 = once
+  bool silent;                          // no frames at all (power, wire), else the receiver's own behaviour
+};
+
+struct SIMRECEIVER {
+  const char* name;
+  bool sbus;                            // repeats with the lost flag, else gaps (PPM)
+  uint32_t periodUs;
+  uint32_t phaseUs;
+  uint32_t jitterUs;
+  double missPercent;
+  SIMFADE fades[2];
+};
+
+struct SIMSCENARIO {
+  const char* name;
+  SIMRECEIVER rx[RXDIV_SOURCES];
+};
+
+struct SIMRXFRAME {
+  int64_t at;
+  bool lost;
+  bool failsafe;
+  bool good;                            // a new stick position
+  uint16_t steering;
+};
+
+struct SIMRESULT {
+  double neutralMs;
+  double maxAgeMs;
+  double maxErrorUs;
+  double lostPercent;
+  double degradedMs;
+  uint32_t delivered;
+  uint32_t backwards;
+  uint32_t switches;
+  uint32_t rescued;
+  uint32_t polls;
+};
+
+}  // namespace
+
+static double simRandom() {
+  return 100.0 * rand() / ((double)RAND_MAX + 1);
+}
+
+static uint16_t simStick(int64_t at) {
+  return (uint16_t)lround(1500 + 400 * sin(2 * M_PI * SIM_STICK_HZ * at / 1e6));
+}
+
+static const SIMFADE* simFade(const SIMRECEIVER& rx, int64_t at) {
+  double t = at / 1e6;
+  for (uint8_t i = 0; i < 2; i++) {
+    const SIMFADE& f = rx.fades[i];
+    if (f.length <= 0 || t < f.start) continue;
+    double into = f.every > 0 ? fmod(t - f.start, f.every) : t - f.start;
+    if (into < f.length) return &f;
+  }
+  return NULL;
+}
+
+static std::vector<SIMRXFRAME> simFrames(const SIMRECEIVER& rx, int64_t duration) {
+  std::vector<SIMRXFRAME> frames;
+  uint16_t held = 1500;
+  int64_t lostSince = 0;
+  for (int64_t slot = rx.phaseUs + rx.periodUs; slot < duration; slot += rx.periodUs) {
+    int64_t at = slot + (int64_t)(rx.jitterUs * simRandom() / 100);
+    const SIMFADE* fade = simFade(rx, at);
+    if (fade != NULL && fade->silent) {
+      lostSince = 0;
+      continue;
+    }
+    bool missing = fade != NULL || simRandom() < rx.missPercent;
+    if (missing && !rx.sbus) continue;
+
+    SIMRXFRAME f = SIMRXFRAME();
+    f.at = at;
+    if (missing) {
+      if (lostSince == 0) lostSince = at;
+      f.failsafe = at - lostSince >= SIM_SBUS_FAILSAFE_US;
+      f.lost = !f.failsafe;
+      f.steering = f.failsafe ? 1500 : held;
+    } else {
+      lostSince = 0;
+      f.good = true;
+      f.steering = held = simStick(at);
+    }
+    frames.push_back(f);
+  }
+  return frames;
+}
+
+// time at neutral the gaps between good frames of either receiver force, and their count
+static int64_t simUnionNeutral(const std::vector<SIMRXFRAME> frames[RXDIV_SOURCES], uint32_t& episodes) {
+  std::vector<int64_t> good;
+  for (uint8_t i = 0; i < RXDIV_SOURCES; i++) {
+    for (size_t k = 0; k < frames[i].size(); k++) {
+      if (frames[i][k].good) good.push_back(frames[i][k].at);
+    }
+  }
+  std::sort(good.begin(), good.end());
+  int64_t neutral = 0;
+  episodes = 0;
+  for (size_t k = 1; k < good.size(); k++) {
+    int64_t gap = good[k] - good[k - 1];
+    if (gap <= SIM_TIMEOUT_US) continue;
+    neutral += gap - SIM_TIMEOUT_US;
+    episodes++;
+  }
+  return neutral;
+}
+
+
+//==================================================================================//
+
+namespace {
+
+// getData() on top of the receiver: 'fresh' frame handed over this poll
+struct SIMOUTPUT {
+  RCLINKSTATS link;
+  int64_t lastFramePoll;
+  int64_t at;
+  uint16_t steering;
+};
+
+}  // namespace
+
+static bool simApply(SIMOUTPUT& out, SIMRESULT& r, bool fresh, bool failsafe, bool lost, const SIMRXFRAME& f,
+                     int64_t linkAt, int64_t now) {
+  if (fresh && !failsafe) {
+    if (f.at <= out.at) r.backwards++;
+    out.lastFramePoll = now;
+    out.at = f.at;
+    out.steering = f.steering;
+    r.delivered++;
+  }
+  bool timeout = out.lastFramePoll != 0 && now - out.lastFramePoll > SIM_TIMEOUT_US;
+  rcLinkUpdate(out.link, simLinkConfig, fresh, lost, failsafe || timeout, linkAt, now);
+  return failsafe || out.lastFramePoll == 0 || timeout;
+}
+
+// 'only' = receiver index alone, -1 = diversity
+static SIMRESULT simRun(const std::vector<SIMRXFRAME> frames[RXDIV_SOURCES], int only, bool event, int64_t duration) {
+  SIMRESULT r = SIMRESULT();
+  SIMOUTPUT out = SIMOUTPUT();
+  RXDIVSTATE state;
+  rxDivReset(state);
+  size_t next[RXDIV_SOURCES] = {0, 0};
+  int64_t lastPoll = 0, checkAt = 0, firstFrame = 0;
+  bool wasNeutral = true, wasDegraded = false;
+
+  while (true) {
+    // next poll: fixed period, or the next frame of a receiver in use, the rescue timer, the timeout
+    int64_t now = lastPoll + (event ? SIM_WAKE_TIMEOUT_US : SIM_POLL_US);
+    if (event) {
+      for (uint8_t i = 0; i < RXDIV_SOURCES; i++) {
+        if ((only < 0 || only == i) && next[i] < frames[i].size()) now = std::min(now, frames[i][next[i]].at);
+      }
+      if (checkAt > lastPoll) now = std::min(now, checkAt);
+    }
+    if (now >= duration) break;
+
+    // time since the previous poll at what it left
+    if (firstFrame != 0) {
+      if (wasNeutral) r.neutralMs += (now - lastPoll) / 1000.0;
+      if (wasDegraded) r.degradedMs += (now - lastPoll) / 1000.0;
+    }
+    lastPoll = now;
+    r.polls++;
+
+    // what each receiver has: the latest frame since the last poll
+    RXDIVFRAME polled[RXDIV_SOURCES] = {};
+    SIMRXFRAME latest[RXDIV_SOURCES] = {};
+    for (uint8_t i = 0; i < RXDIV_SOURCES; i++) {
+      while (next[i] < frames[i].size() && frames[i][next[i]].at <= now) {
+        latest[i] = frames[i][next[i]++];
+        polled[i].fresh = true;
+      }
+      polled[i].failsafe = latest[i].failsafe;
+      polled[i].lost = latest[i].lost;
+      polled[i].at = latest[i].at;
+      polled[i].steering = latest[i].steering;
+      polled[i].throttle = 1500;
+    }
+
+    bool neutral;
+    if (only >= 0) {
+      const RXDIVFRAME& p = polled[only];
+      neutral = simApply(out, r, p.fresh, p.failsafe, p.lost, latest[only], p.at, now);
+    } else {
+      int8_t pick = rxDivUpdate(state, simConfig, simLinkConfig, polled, now);
+      rxDivLinkPeriod(state, out.link);
+      SIMRXFRAME f = SIMRXFRAME();
+      if (pick >= 0) {
+        f.at = state.sources[pick].frame.at;
+        f.steering = state.sources[pick].frame.steering;
+        f.lost = state.sources[pick].frame.lost;
+      }
+      neutral = simApply(out, r, pick >= 0, rxDivFailsafe(state), f.lost, f, state.linkAt, now);
+      checkAt = rxDivCheckAt(state, simConfig);
+    }
+    if (firstFrame == 0 && out.lastFramePoll != 0) firstFrame = now;
+
+    if (!neutral) {
+      r.maxAgeMs = std::max(r.maxAgeMs, (now - out.at) / 1000.0);
+      r.maxErrorUs = std::max(r.maxErrorUs, fabs((double)out.steering - simStick(now)));
+    }
+    wasNeutral = neutral;
+    wasDegraded = out.link.degraded;
+  }
+
+  r.lostPercent = out.link.frames ? 100.0 * out.link.lost / (out.link.frames + out.link.lost) : 0;
+  r.switches = state.totalSwitches;
+  r.rescued = state.rescued;
+  return r;
+}
+
+static void simPrint(const char* name, const SIMRESULT& r, bool diversity) {
+  printf("    %-22s %9.0f %9.1f %9.0f %8.1f%% %9.0f", name, r.neutralMs, r.maxAgeMs, r.maxErrorUs, r.lostPercent,
+         r.degradedMs);
+  if (diversity) printf(" %9u %9u", r.switches, r.rescued);
+  printf("\n");
+}
+
+
+//==================================================================================//
+
+int rxDiversitySim(int argc, char** argv) {
+  int64_t seconds = argc >= 1 ? atoi(argv[0]) : 30;
+  if (seconds < 10) seconds = 10;
+  int64_t duration = seconds * 1000000LL;
+  srand(17);
+
+  const SIMSCENARIO scenarios[] = {
+    {"SBUS + SBUS, interleaved fades of 250 ms",
+     {{"SBUS 9 ms", true, 9000, 0, 300, 1, {{1.0, 0.25, 1.0, false}, {0, 0, 0, false}}},
+      {"SBUS 9 ms", true, 9000, 4000, 300, 1, {{1.5, 0.25, 1.0, false}, {0, 0, 0, false}}}}},
+    {"SBUS + SBUS, 20 % loss each",
+     {{"SBUS 9 ms", true, 9000, 0, 300, 20, {{0, 0, 0, false}, {0, 0, 0, false}}},
+      {"SBUS 9 ms", true, 9000, 6000, 300, 20, {{0, 0, 0, false}, {0, 0, 0, false}}}}},
+    {"SBUS + PPM, SBUS out of range 1.2 s",
+     {{"SBUS 14 ms", true, 14000, 0, 300, 2, {{3.0, 1.2, 6.0, false}, {0, 0, 0, false}}},
+      {"PPM 22.5 ms", false, 22500, 9000, 200, 3, {{0, 0, 0, false}, {0, 0, 0, false}}}}},
+    {"PPM + SBUS, PPM wire off 2 s, SBUS fades",
+     {{"PPM 22.5 ms", false, 22500, 0, 200, 3, {{4.0, 2.0, 8.0, true}, {0, 0, 0, false}}},
+      {"SBUS 9 ms", true, 9000, 2000, 300, 2, {{2.0, 0.15, 3.0, false}, {0, 0, 0, false}}}}},
+    {"SBUS + SBUS, overlapping fades of 400 ms",
+     {{"SBUS 9 ms", true, 9000, 0, 300, 1, {{1.0, 0.4, 2.0, false}, {0, 0, 0, false}}},
+      {"SBUS 9 ms", true, 9000, 3000, 300, 1, {{1.2, 0.4, 2.0, false}, {0, 0, 0, false}}}}},
+  };
+
+  printf("receiver diversity: %lld s per scenario, %u %% of the period to a rescue, switch over at %u %% points lost\n\n",
+         (long long)seconds, simConfig.missPercent, simConfig.lostMargin);
+
+  bool pass = true;
+  for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    const SIMSCENARIO& scenario = scenarios[s];
+    std::vector<SIMRXFRAME> frames[RXDIV_SOURCES];
+    for (uint8_t i = 0; i < RXDIV_SOURCES; i++) frames[i] = simFrames(scenario.rx[i], duration);
+    uint32_t episodes;
+    double bound = (simUnionNeutral(frames, episodes) + episodes * (int64_t)SIM_SLACK_US) / 1000.0;
+
+    SIMRESULT first = simRun(frames, 0, false, duration);
+    SIMRESULT second = simRun(frames, 1, false, duration);
+    SIMRESULT polled = simRun(frames, -1, false, duration);
+    SIMRESULT woken = simRun(frames, -1, true, duration);
+
+    printf("  %s, neutral bound %.0f ms\n", scenario.name, bound);
+    printf("    %-22s %9s %9s %9s %9s %9s %9s %9s\n", "", "neutral", "max age", "max err", "lost", "limited",
+           "switches", "rescued");
+    printf("    %-22s %9s %9s %9s %9s %9s\n", "", "ms", "ms", "us", "", "ms");
+    char name[40];
+    snprintf(name, sizeof(name), "%s alone", scenario.rx[0].name);
+    simPrint(name, first, false);
+    snprintf(name, sizeof(name), "%s alone", scenario.rx[1].name);
+    simPrint(name, second, false);
+    simPrint("diversity, 5 ms poll", polled, true);
+    simPrint("diversity, event", woken, true);
+
+    const SIMRESULT* runs[2] = {&polled, &woken};
+    for (uint8_t k = 0; k < 2; k++) {
+      const SIMRESULT& d = *runs[k];
+      pass &= d.backwards == 0;
+      pass &= d.neutralMs <= bound;
+      pass &= d.neutralMs <= first.neutralMs && d.neutralMs <= second.neutralMs;
+      pass &= d.neutralMs + d.degradedMs <= std::min(first.neutralMs + first.degradedMs,
+                                                     second.neutralMs + second.degradedMs);
+    }
+  }
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
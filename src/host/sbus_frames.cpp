@@ -0,0 +1,125 @@
+/* Byte for byte check of the SBUS output frames (include/SBUSFRAME.h).
+
+Encodes fixed channel sets and compares them with frames written out by hand, then checks
+random channel sets against a bit by bit reference packer and the decoder, and the channel
+mapping end points used by the SBUS output policy. Exit code 0 when everything matches.
+
+  vcu_host sbus-frames */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SBUSFRAME.h>
+
+namespace {
+
+struct SBUSVECTOR {
+  const char* name;
+  uint16_t channels[SBUS_CHANNELS];
+  uint8_t flags;
+  uint8_t frame[SBUS_FRAME_SIZE];
+};
+
+}  // namespace
+
+static const SBUSVECTOR vectors[] = {
+  {"all neutral (992)",
+   {992, 992, 992, 992, 992, 992, 992, 992, 992, 992, 992, 992, 992, 992, 992, 992}, 0x00,
+   {0x0F, 0xE0, 0x03, 0x1F, 0xF8, 0xC0, 0x07, 0x3E, 0xF0, 0x81, 0x0F, 0x7C, 0xE0, 0x03, 0x1F, 0xF8,
+    0xC0, 0x07, 0x3E, 0xF0, 0x81, 0x0F, 0x7C, 0x00, 0x00}},
+  {"all zero, failsafe",
+   {0}, SBUS_FLAG_FAILSAFE,
+   {0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00}},
+  {"all 2047, lost frame",
+   {2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047, 2047}, SBUS_FLAG_LOST_FRAME,
+   {0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x04, 0x00}},
+  {"ramp 172 + 100 n",
+   {172, 272, 372, 472, 572, 672, 772, 872, 972, 1072, 1172, 1272, 1372, 1472, 1572, 1672}, 0x00,
+   {0x0F, 0xAC, 0x80, 0x08, 0x5D, 0xB0, 0xC3, 0x23, 0x50, 0x11, 0x0C, 0x6D, 0xCC, 0x83, 0x21, 0x25,
+    0xF1, 0xC9, 0x55, 0xE0, 0x92, 0x18, 0xD1, 0x00, 0x00}},
+};
+
+// one bit at a time, channel 0 bit 0 first
+static void referenceEncode(const uint16_t channels[SBUS_CHANNELS], uint8_t flags, uint8_t frame[SBUS_FRAME_SIZE]) {
+  memset(frame, 0, SBUS_FRAME_SIZE);
+  frame[0] = SBUS_HEADER;
+  for (int bit = 0; bit < SBUS_CHANNELS * 11; bit++) {
+    if (channels[bit / 11] & (1 << (bit % 11))) frame[1 + bit / 8] |= 1 << (bit % 8);
+  }
+  frame[23] = flags;
+  frame[24] = SBUS_FOOTER;
+}
+
+static void printFrame(const char* label, const uint8_t frame[SBUS_FRAME_SIZE]) {
+  printf("  %-9s", label);
+  for (int i = 0; i < SBUS_FRAME_SIZE; i++) printf(" %02X", frame[i]);
+  printf("\n");
+}
+
+
+//==================================================================================//
+
+int sbusFrameCheck(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  int failures = 0;
+
+  for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+    uint8_t frame[SBUS_FRAME_SIZE];
+    sbusEncode(vectors[v].channels, vectors[v].flags, frame);
+    bool match = memcmp(frame, vectors[v].frame, SBUS_FRAME_SIZE) == 0;
+    printf("%-24s %s\n", vectors[v].name, match ? "ok" : "MISMATCH");
+    if (!match) {
+      printFrame("expected", vectors[v].frame);
+      printFrame("encoded", frame);
+      failures++;
+    }
+  }
+
+  // random channel sets: encoder against the reference, decoder back to the input
+  srand(7);
+  int randomFailures = 0;
+  for (int n = 0; n < 10000; n++) {
+    uint16_t channels[SBUS_CHANNELS];
+    for (int i = 0; i < SBUS_CHANNELS; i++) channels[i] = rand() & SBUS_VALUE_MAX;
+    uint8_t flags = rand() & 0x0F;
+
+    uint8_t frame[SBUS_FRAME_SIZE], reference[SBUS_FRAME_SIZE];
+    sbusEncode(channels, flags, frame);
+    referenceEncode(channels, flags, reference);
+
+    uint16_t decoded[SBUS_CHANNELS];
+    uint8_t decodedFlags;
+    bool ok = memcmp(frame, reference, SBUS_FRAME_SIZE) == 0 && sbusDecode(frame, decoded, decodedFlags) &&
+              memcmp(decoded, channels, sizeof(channels)) == 0 && decodedFlags == flags;
+    if (!ok && randomFailures++ == 0) {
+      printFrame("reference", reference);
+      printFrame("encoded", frame);
+    }
+  }
+  printf("%-24s %s\n", "10000 random frames", randomFailures ? "MISMATCH" : "ok");
+  failures += randomFailures ? 1 : 0;
+
+  // channel mapping as used by SBUSOUT.h
+  const SBUSCHANNELMAP steering = {0, 0, 180, 192, 1792};
+  const SBUSCHANNELMAP throttle = {1, 1000, 2000, 192, 1792};
+  struct { const SBUSCHANNELMAP* map; int16_t in; uint16_t out; } points[] = {
+    {&steering, 0, 192}, {&steering, 90, 992}, {&steering, 180, 1792}, {&steering, 200, 1792},
+    {&throttle, 1000, 192}, {&throttle, 1500, 992}, {&throttle, 2000, 1792}, {&throttle, 900, 192},
+  };
+  int mapFailures = 0;
+  for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++) {
+    uint16_t out = sbusMapValue(*points[i].map, points[i].in);
+    if (out != points[i].out) {
+      printf("  map channel %u: %d -> %u, expected %u\n", points[i].map->channel, points[i].in, out, points[i].out);
+      mapFailures++;
+    }
+  }
+  if (sbusFromMicros(1500) != 992 || sbusFromMicros(1000) != 192 || sbusFromMicros(2000) != 1792) mapFailures++;
+  printf("%-24s %s\n", "channel mapping", mapFailures ? "MISMATCH" : "ok");
+  failures += mapFailures ? 1 : 0;
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,443 @@
+/* Reference implementation of the serial command link (include/SERIALLINK.h).
+
+  vcu_host link <tty> [rate Hz] [seconds] [baud]  companion computer: sends drive commands at the
+                                                  given rate, prints status frames, link statistics
+                                                  and the VCU's log text
+  vcu_host link-vcu <tty> [baud]                  VCU end: answers every command with a status frame
+  vcu_host link-test [frames]                     both ends over a pseudo-terminal pair: commands in
+                                                  random chunk sizes mixed with corrupted frames and
+                                                  log text, checks that every good command is answered
+                                                  and every bad one rejected, reports round trip times
+
+The stream is split at the 0x00 delimiters. A segment that decodes to a good frame is a
+frame, a printable one is log text, anything else counts as a line error. */
+
+#include <Arduino.h>
+#include <SERIALLINK.h>
+#include <CANROUTE.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define LINK_HOST_ID        0x15
+#define LINK_TEST_FRAMES    20000
+#define LINK_TEST_BAD       20          // one in this many sent frames is corrupted
+
+static volatile bool linkRunning = true;
+
+static void linkStop(int) { linkRunning = false; }
+
+static int64_t linkNowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static speed_t linkSpeed(long baud) {
+  switch (baud) {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 2000000: return B2000000;
+    default: return B0;
+  }
+}
+
+static bool linkRaw(int fd, long baud) {
+  struct termios tio;
+  if (tcgetattr(fd, &tio) != 0) return false;
+  cfmakeraw(&tio);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  speed_t speed = linkSpeed(baud);
+  if (speed != B0) {
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  }
+  return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+static int linkOpen(const char* path, long baud) {
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0 || !linkRaw(fd, baud)) {
+    fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void linkWrite(int fd, const uint8_t* data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n < 0 && errno != EAGAIN && errno != EINTR) return;
+    if (n < 0) {
+      struct pollfd p = {fd, POLLOUT, 0};
+      poll(&p, 1, 10);
+      continue;
+    }
+    data += n;
+    length -= n;
+  }
+}
+
+
+//==================================================================================//
+
+namespace {
+
+// receiving end of either side: segments between delimiters become frames or text
+struct LINKSTREAM {
+  LINKRX rx;
+  std::string segment;
+  uint32_t textLines;
+  uint32_t lineErrors;
+};
+
+typedef void (*LINKFRAMEHANDLER)(const LINKRX& rx, void* context);
+
+}  // namespace
+
+static void linkStreamReset(LINKSTREAM& s) {
+  s.rx = LINKRX();
+  linkRxReset(s.rx);
+  s.segment.clear();
+  s.textLines = 0;
+  s.lineErrors = 0;
+}
+
+static bool linkPrintable(const std::string& text) {
+  for (size_t i = 0; i < text.size(); i++) {
+    unsigned char c = text[i];
+    if (c < 0x20 && c != '\n' && c != '\r' && c != '\t') return false;
+    if (c > 0x7E) return false;
+  }
+  return true;
+}
+
+static void linkStreamFeed(LINKSTREAM& s, const uint8_t* data, size_t length, LINKFRAMEHANDLER handler,
+                           void* context, bool echoText) {
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] != 0) {
+      s.segment.push_back((char)data[i]);
+      continue;
+    }
+    if (s.segment.empty()) continue;
+
+    uint16_t crcErrors = s.rx.crcErrors, framingErrors = s.rx.framingErrors;
+    s.segment.push_back(0);
+    bool complete;
+    linkParse(s.rx, (const uint8_t*)s.segment.data(), s.segment.size(), complete);
+    if (complete) {
+      handler(s.rx, context);
+    } else if (linkPrintable(s.segment.substr(0, s.segment.size() - 1))) {
+      // log text: not a link error
+      s.rx.crcErrors = crcErrors;
+      s.rx.framingErrors = framingErrors;
+      s.textLines++;
+      if (echoText) fwrite(s.segment.data(), 1, s.segment.size() - 1, stdout);
+    } else {
+      s.lineErrors++;
+    }
+    s.segment.clear();
+  }
+}
+
+
+//==================================================================================//
+
+namespace {
+
+// VCU end, the same handling as the CANBUS task: decode, route, answer with a status frame
+struct LINKVCU {
+  int fd;
+  uint8_t sequence;
+  uint32_t commands;
+  CANROUTES routes;
+};
+
+}  // namespace
+
+static void linkVcuFrame(const LINKRX& rx, void* context) {
+  LINKVCU& vcu = *(LINKVCU*)context;
+  CANRECIEVER msg;
+  if (!linkToCan(rx, msg) || canRoute(vcu.routes, msg) != CAN_ROUTE_COMMAND || !vcu.routes.command->update()) return;
+  vcu.commands++;
+
+  const CANCOMMAND& command = vcu.routes.command->read();
+  uint8_t data[8];
+  canPack(data, command.driveMode, command.throttle, command.steeringAngle, 1680, 0, 1);
+  uint8_t out[LINK_MAX_ENCODED];
+  size_t n = linkCanFrame(out, vcu.sequence++, LINK_HOST_ID, false, false, data, 8);
+  linkWrite(vcu.fd, out, n);
+}
+
+static int linkVcuLoop(int fd) {
+  LINKSTREAM stream;
+  linkStreamReset(stream);
+  static Handoff<CANCOMMAND> command;
+  static PATH pathBuilding, pathLatest;
+  static Handoff<PATH> path;
+  static SETPOINTQUEUE setpoints;
+  static SETPOINTRX setpointRx;
+  static STEERCAL steerCalLatest;
+  static STEERCALRX steerCalRx;
+  static Handoff<STEERCAL> steerCal;
+  steerCalRxBegin(steerCalRx, steerCalLatest);
+  LINKVCU vcu = {fd, 0, 0, {LINK_HOST_ID, &command, &pathBuilding, &pathLatest, &path, NULL, &setpoints, &setpointRx,
+                            &steerCalLatest, &steerCalRx, &steerCal}};
+  int64_t statsAt = linkNowUs() + 1000000;
+
+  while (linkRunning) {
+    struct pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, 100) > 0) {
+      if (p.revents & (POLLHUP | POLLERR)) break;
+      uint8_t chunk[256];
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n > 0) linkStreamFeed(stream, chunk, n, linkVcuFrame, &vcu, false);
+    }
+
+    if (linkNowUs() >= statsAt) {
+      // a log line between frames, like the firmware's Serial.print output
+      const char text[] = "vcu: link statistics follow\n";
+      linkWrite(fd, (const uint8_t*)text, sizeof(text) - 1);
+      uint8_t out[LINK_MAX_ENCODED];
+      size_t n = linkStatsFrame(out, vcu.sequence++, stream.rx);
+      linkWrite(fd, out, n);
+      statsAt += 1000000;
+    }
+  }
+  return 0;
+}
+
+
+//==================================================================================//
+
+namespace {
+
+// companion end
+struct LINKHOST {
+  uint32_t status;
+  uint32_t stats;
+  LINKRX vcuStats;              // the VCU's receive counters from its last LINK_STATS
+  std::vector<int64_t>* sentAt; // by throttle value, for round trip times
+  std::vector<int64_t>* rtt;
+  bool print;
+};
+
+}  // namespace
+
+static void linkHostFrame(const LINKRX& rx, void* context) {
+  LINKHOST& host = *(LINKHOST*)context;
+  if (rx.frame[0] == LINK_STATS && rx.length == 12) {
+    const uint8_t* p = rx.frame + 2;
+    host.vcuStats.frames = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    host.vcuStats.crcErrors = (p[4] << 8) | p[5];
+    host.vcuStats.framingErrors = (p[6] << 8) | p[7];
+    host.vcuStats.gaps = (p[8] << 8) | p[9];
+    host.stats++;
+    if (host.print) {
+      printf("vcu link: %u frames, %u CRC errors, %u framing errors, %u lost\n", host.vcuStats.frames,
+             host.vcuStats.crcErrors, host.vcuStats.framingErrors, host.vcuStats.gaps);
+    }
+    return;
+  }
+
+  CANRECIEVER msg;
+  if (!linkToCan(rx, msg)) return;
+  host.status++;
+  if (host.sentAt && msg.throttle >= 0 && msg.throttle < (int)host.sentAt->size() && (*host.sentAt)[msg.throttle]) {
+    host.rtt->push_back(linkNowUs() - (*host.sentAt)[msg.throttle]);
+    (*host.sentAt)[msg.throttle] = 0;
+  }
+  if (host.print && host.status % 100 == 1) {
+    printf("status 0x%X: drive mode %d throttle %d steering %d voltage %d\n", msg.id, msg.driveMode, msg.throttle,
+           msg.steeringAngle, msg.voltage);
+  }
+}
+
+static size_t linkCommand(uint8_t* out, uint8_t sequence, int8_t driveMode, int16_t throttle, uint8_t steering) {
+  uint8_t data[8];
+  canPack(data, driveMode, throttle, steering, 0, 0, 0);
+  return linkCanFrame(out, sequence, 0x100 + LINK_HOST_ID, false, false, data, 4);
+}
+
+static int linkCompanion(int fd, double rate, double seconds) {
+  LINKSTREAM stream;
+  linkStreamReset(stream);
+  LINKHOST host = LINKHOST();
+  host.print = true;
+
+  uint8_t sequence = 0;
+  int64_t start = linkNowUs(), next = start;
+  uint32_t sent = 0;
+  while (linkRunning && linkNowUs() - start < seconds * 1e6) {
+    int64_t now = linkNowUs();
+    if (now >= next) {
+      double t = (now - start) / 1e6;
+      uint8_t out[LINK_MAX_ENCODED];
+      size_t n = linkCommand(out, sequence++, 0, 1500 + (int16_t)(100 * sin(t)), 90 + (int8_t)(20 * sin(0.5 * t)));
+      linkWrite(fd, out, n);
+      sent++;
+      next += (int64_t)(1e6 / rate);
+    }
+
+    struct pollfd p = {fd, POLLIN, 0};
+    int wait = (int)std::max((int64_t)0, (next - linkNowUs()) / 1000);
+    if (poll(&p, 1, wait) > 0) {
+      uint8_t chunk[256];
+      ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n > 0) linkStreamFeed(stream, chunk, n, linkHostFrame, &host, true);
+    }
+  }
+
+  printf("sent %u commands, received %u status frames, %u statistics, %u log lines, %u CRC errors, "
+         "%u framing errors, %u line errors\n", sent, host.status, host.stats, stream.textLines, stream.rx.crcErrors,
+         stream.rx.framingErrors, stream.lineErrors);
+  return 0;
+}
+
+
+//==================================================================================//
+
+int linkHost(int argc, char** argv) {
+  if (argc < 1) return 2;
+  signal(SIGINT, linkStop);
+  int fd = linkOpen(argv[0], argc >= 4 ? atol(argv[3]) : 921600);
+  if (fd < 0) return 1;
+  int result = linkCompanion(fd, argc >= 2 ? atof(argv[1]) : 500, argc >= 3 ? atof(argv[2]) : 10);
+  close(fd);
+  return result;
+}
+
+int linkVcu(int argc, char** argv) {
+  if (argc < 1) return 2;
+  signal(SIGINT, linkStop);
+  int fd = linkOpen(argv[0], argc >= 2 ? atol(argv[1]) : 921600);
+  if (fd < 0) return 1;
+  int result = linkVcuLoop(fd);
+  close(fd);
+  return result;
+}
+
+// both ends in one process pair over a pty, the companion side checks the answers
+int linkTest(int argc, char** argv) {
+  uint32_t frames = argc >= 1 ? atol(argv[0]) : LINK_TEST_FRAMES;
+  frames = std::min(frames, (uint32_t)LINK_TEST_FRAMES);
+
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    fprintf(stderr, "no pseudo-terminal: %s\n", strerror(errno));
+    return 1;
+  }
+  const char* slave = ptsname(master);
+  int vcuFd = linkOpen(slave, 921600);
+  if (vcuFd < 0 || !linkRaw(master, 921600)) return 1;
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  pid_t child = fork();
+  if (child == 0) {
+    close(master);
+    signal(SIGTERM, linkStop);
+    _exit(linkVcuLoop(vcuFd));
+  }
+  close(vcuFd);
+
+  LINKSTREAM stream;
+  linkStreamReset(stream);
+  std::vector<int64_t> sentAt(2048, 0), rtt;
+  LINKHOST host = LINKHOST();
+  host.sentAt = &sentAt;
+  host.rtt = &rtt;
+
+  srand(11);
+  uint8_t sequence = 0;
+  uint32_t good = 0, bad = 0, inFlight = 0;
+  std::vector<uint8_t> pending;
+  int64_t start = linkNowUs();
+
+  uint32_t i = 0;
+  while (linkNowUs() - start < 20000000) {
+    // at most 16 commands unanswered, like a companion computer waiting on the status
+    if (i < frames && inFlight < 16) {
+      uint8_t out[LINK_MAX_ENCODED];
+      int16_t throttle = 1000 + (i % 1000);
+      size_t n = linkCommand(out, sequence++, 0, throttle, 90);
+      if (i % LINK_TEST_BAD == LINK_TEST_BAD - 1) {
+        out[2 + rand() % (n - 3)] ^= 1 << (rand() % 8);
+        for (size_t k = 1; k + 1 < n; k++) if (out[k] == 0) out[k] = 0x55;     // never a delimiter
+        bad++;
+      } else {
+        sentAt[throttle] = linkNowUs();
+        good++;
+        inFlight++;
+      }
+      pending.insert(pending.end(), out, out + n);
+      i++;
+
+      // written in random chunk sizes, cut anywhere
+      while (pending.size() > 0 && (rand() % 3 == 0 || i == frames || inFlight == 16)) {
+        size_t chunk = std::min(pending.size(), (size_t)(1 + rand() % 64));
+        linkWrite(master, pending.data(), chunk);
+        pending.erase(pending.begin(), pending.begin() + chunk);
+      }
+    }
+
+    struct pollfd p = {master, POLLIN, 0};
+    if (poll(&p, 1, i < frames && inFlight < 16 ? 0 : 5) > 0) {
+      uint8_t chunk[512];
+      ssize_t n = read(master, chunk, sizeof(chunk));
+      uint32_t before = host.status;
+      if (n > 0) linkStreamFeed(stream, chunk, n, linkHostFrame, &host, false);
+      inFlight -= std::min(inFlight, host.status - before);
+    }
+    if (i >= frames && host.status >= good) break;
+  }
+  double seconds = (linkNowUs() - start) / 1e6;
+
+  // last statistics from the VCU, then stop it
+  int64_t wait = linkNowUs() + 1500000;
+  uint32_t stats = host.stats;
+  while (host.stats == stats && linkNowUs() < wait) {
+    struct pollfd p = {master, POLLIN, 0};
+    if (poll(&p, 1, 10) > 0) {
+      uint8_t chunk[512];
+      ssize_t n = read(master, chunk, sizeof(chunk));
+      if (n > 0) linkStreamFeed(stream, chunk, n, linkHostFrame, &host, false);
+    }
+  }
+  kill(child, SIGTERM);
+  waitpid(child, NULL, 0);
+  close(master);
+
+  std::sort(rtt.begin(), rtt.end());
+  printf("link over a pty: %u good and %u corrupted commands in %.2f s (%.0f commands/s)\n", good, bad, seconds,
+         (good + bad) / seconds);
+  printf("  answered %u, VCU counted %u frames, %u CRC errors, %u framing errors, %u lost by sequence\n",
+         host.status, host.vcuStats.frames, host.vcuStats.crcErrors, host.vcuStats.framingErrors, host.vcuStats.gaps);
+  printf("  host side: %u log lines told apart, %u CRC errors, %u line errors\n", stream.textLines,
+         stream.rx.crcErrors, stream.lineErrors);
+  if (!rtt.empty()) {
+    printf("  round trip us: p50 %lld p99 %lld max %lld\n", (long long)rtt[rtt.size() / 2],
+           (long long)rtt[rtt.size() * 99 / 100], (long long)rtt.back());
+  }
+
+  bool pass = host.status == good && host.vcuStats.frames == good &&
+              host.vcuStats.crcErrors + host.vcuStats.framingErrors == bad && stream.rx.crcErrors == 0 &&
+              stream.lineErrors == 0;
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+/* Timed setpoint queue against bus jitter (include/SETPOINT.h).
+
+The master streams a throttle/steering trajectory (1 Hz throttle sweep of +-300 us, 0.5 Hz
+steering sweep of +-25 deg) as setpoint frames: 10 ms spacing, two setpoints per frame, sent
+SIM_AHEAD_MS ahead of their time. Each frame gets a bus delay of 0.3 ms plus a uniform
+jitter, 1 % of the frames three times that (a busy bus), frames stay in order, and a given
+share is lost. The control loop runs every 12 ms with up to 1 ms of scheduling jitter.
+
+For comparison the same trajectory is sent as plain drive commands (mode 0), one every 10 ms
+with the same delays, applied by the control loop as they come. For both, reported is the
+actuator error against the trajectory after removing the best constant delay, i.e. what the
+bus timing adds on top of a fixed latency (steering has a floor of ~0.3 deg from the whole
+degree servo angles). Then the stream stops without its last frame and the underrun
+fallback is timed, and a short trajectory sent complete with its end flag is played to its
+end. Exit code 1 if the queue adds more than SIM_MAX_THROTTLE_US / SIM_MAX_STEERING_DEG,
+whatever the jitter, or the fallback or the end of a trajectory does not bring the throttle
+to neutral in time, or a setpoint over the servo's whole steering range (30 - 150 deg, with the
+throttle at both ends of its range) does not come back from a frame as it went in.
+
+  vcu_host sim-setpoint [jitter ms] [loss %] */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <vector>
+#include <SETPOINT.h>
+
+#define SIM_SECONDS         20
+#define SIM_SPACING_MS      10
+#define SIM_AHEAD_MS        60
+#define SIM_LOOP_US         12000
+#define SIM_BUS_US          300
+#define SIM_MAX_DELAY_MS    100         // best delay search range
+#define SIM_MAX_THROTTLE_US  2.0        // 2 us setpoint resolution
+#define SIM_MAX_STEERING_DEG 0.4
+#define SIM_END_THROTTLE_US 1800        // throttle of the complete trajectory
+
+namespace {
+
+struct SIMCOMMAND {
+  int64_t arrival;              // us
+  uint8_t data[8];
+};
+
+struct SIMSAMPLE {
+  int64_t at;                   // us since the trajectory start on the master
+  int16_t throttle;
+  uint8_t steeringAngle;
+};
+
+}  // namespace
+
+static double simThrottle(double t) { return 1500 + 300 * sin(2 * M_PI * 1.0 * t); }
+static double simSteering(double t) { return 90 + 25 * sin(2 * M_PI * 0.5 * t); }
+
+static double simUniform(double low, double high) {
+  return low + (high - low) * rand() / (double)RAND_MAX;
+}
+
+// bus delay of one frame, in order after the previous one
+static int64_t simArrival(int64_t sent, int64_t& previous, double jitterMs) {
+  double jitter = simUniform(0, jitterMs * 1000);
+  if (rand() % 100 == 0) jitter *= 3;
+  int64_t arrival = sent + SIM_BUS_US + (int64_t)jitter;
+  if (arrival < previous) arrival = previous;
+  previous = arrival;
+  return arrival;
+}
+
+// rms actuator error after the constant delay that fits best
+static void simDelayError(const std::vector<SIMSAMPLE>& samples, double& delayMs, double& throttleRms,
+                          double& steeringRms) {
+  throttleRms = 1e9;
+  for (int d = 0; d <= SIM_MAX_DELAY_MS; d++) {
+    double sumT = 0, sumS = 0;
+    uint32_t n = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+      double t = samples[i].at / 1e6 - d / 1000.0;
+      if (t < 1 || t > SIM_SECONDS - 1) continue;
+      double eT = samples[i].throttle - simThrottle(t), eS = samples[i].steeringAngle - simSteering(t);
+      sumT += eT * eT;
+      sumS += eS * eS;
+      n++;
+    }
+    if (n && sqrt(sumT / n) < throttleRms) {
+      throttleRms = sqrt(sumT / n);
+      steeringRms = sqrt(sumS / n);
+      delayMs = d;
+    }
+  }
+}
+
+// frame round trip over the steering range, the throttle at its extremes; returns the mismatches
+static uint32_t simEncodingErrors(uint32_t& checked, uint8_t& firstSteering) {
+  static const int16_t throttles[] = {988, 1500, 2010};
+  uint32_t errors = 0;
+  checked = 0;
+  for (int steering = 30; steering <= 150; steering++) {
+    for (size_t i = 0; i < sizeof(throttles) / sizeof(throttles[0]); i++) {
+      uint8_t data[8];
+      setpointFrame(data, SETPOINT_FLAG_START, 0, 0, 0, throttles[i], steering, 1500, SETPOINT_STEERING_CENTER);
+      int16_t throttle;
+      uint8_t steeringAngle;
+      setpointUnpack(data + 4, throttle, steeringAngle);
+      checked++;
+      if (throttle != throttles[i] || steeringAngle != steering) {
+        if (errors++ == 0) firstSteering = steering;
+      }
+    }
+  }
+  return errors;
+}
+
+// complete trajectory of 300 ms at 1800 us: ms from its last setpoint until the throttle is
+// back at neutral, -1 if it stays off neutral
+static double simEndRamp() {
+  static SETPOINTQUEUE queue;
+  SETPOINTRX rx;
+  SETPOINTPLAYER player;
+  setpointBegin(queue, rx, player);
+
+  uint8_t data[8];
+  setpointFrame(data, SETPOINT_FLAG_START, 0, 0, 100, SIM_END_THROTTLE_US, 90, SIM_END_THROTTLE_US, 90);
+  setpointReceive(queue, rx, data, 8, 0);
+  setpointFrame(data, SETPOINT_FLAG_END, 1, 200, 100, SIM_END_THROTTLE_US, 90, SIM_END_THROTTLE_US, 90);
+  setpointReceive(queue, rx, data, 8, 0);
+
+  const int64_t last = (SETPOINT_LEAD_MS + 300) * 1000LL;
+  for (int64_t now = 0; now < last + 1000000; now += SIM_LOOP_US) {
+    uint8_t state = setpointSample(queue, player, now);
+    if (state == SETPOINT_DONE && player.throttle == 1500) return (now - last) / 1000.0;
+  }
+  return -1;
+}
+
+
+//==================================================================================//
+
+int setpointSim(int argc, char** argv) {
+  double jitterMs = argc >= 1 ? atof(argv[0]) : 8;
+  double lossPercent = argc >= 2 ? atof(argv[1]) : 1;
+  srand(5);
+
+  printf("setpoint queue: %d ms spacing, 2 per frame, sent %d ms ahead, lead %d ms, bus jitter 0 - %.1f ms "
+         "(1 %% x3), %.1f %% lost, control loop %d ms\n\n", SIM_SPACING_MS, SIM_AHEAD_MS, SETPOINT_LEAD_MS, jitterMs,
+         lossPercent, SIM_LOOP_US / 1000);
+
+  // queued trajectory: frames for the whole run, the last 3 s are never sent (underrun)
+  const int64_t stopAt = (SIM_SECONDS - 3) * 1000000LL;
+  std::deque<SIMCOMMAND> frames;
+  int64_t previous = 0;
+  uint32_t sent = 0, lost = 0;
+  for (int k = 0; k * 2 * SIM_SPACING_MS * 1000LL < stopAt; k++) {
+    int64_t t0 = k * 2 * SIM_SPACING_MS * 1000LL;
+    SIMCOMMAND frame;
+    setpointFrame(frame.data, k == 0 ? SETPOINT_FLAG_START : 0, k, t0 / 1000, SIM_SPACING_MS,
+                  lround(simThrottle(t0 / 1e6)), lround(simSteering(t0 / 1e6)),
+                  lround(simThrottle((t0 + SIM_SPACING_MS * 1000) / 1e6)),
+                  lround(simSteering((t0 + SIM_SPACING_MS * 1000) / 1e6)));
+    int64_t sendAt = t0 > SIM_AHEAD_MS * 1000 ? t0 - SIM_AHEAD_MS * 1000 : 0;
+    frame.arrival = simArrival(sendAt, previous, jitterMs);
+    sent++;
+    if (k > 0 && simUniform(0, 100) < lossPercent) {
+      lost++;
+      continue;
+    }
+    frames.push_back(frame);
+  }
+
+  // the VCU's trajectory time 0 is the start frame's arrival plus the lead, which is
+  // constant and ends up in the fitted delay
+  static SETPOINTQUEUE queue;
+  SETPOINTRX rx;
+  SETPOINTPLAYER player;
+  setpointBegin(queue, rx, player);
+
+  std::vector<SIMSAMPLE> queued;
+  int64_t underrunAt = -1, neutralAt = -1, lastSetpoint = 0;
+  uint32_t states[SETPOINT_DONE + 1] = {0};
+  for (int64_t now = 0; now < SIM_SECONDS * 1000000LL; now += SIM_LOOP_US + rand() % 1000) {
+    while (!frames.empty() && frames.front().arrival <= now) {
+      setpointReceive(queue, rx, frames.front().data, 8, frames.front().arrival);
+      frames.pop_front();
+    }
+    uint8_t state = setpointSample(queue, player, now);
+    states[state]++;
+    if (state == SETPOINT_RUNNING) lastSetpoint = now;
+    if (state == SETPOINT_FALLBACK && underrunAt < 0) underrunAt = now;
+    if (state == SETPOINT_FALLBACK && neutralAt < 0 && player.throttle == 1500) neutralAt = now;
+    if (now < stopAt) queued.push_back(SIMSAMPLE{now, player.throttle, player.steeringAngle});
+  }
+
+  // direct commands: one per 10 ms, applied as they come
+  std::vector<SIMSAMPLE> direct;
+  std::deque<SIMCOMMAND> commands;
+  previous = 0;
+  for (int64_t t = 0; t < SIM_SECONDS * 1000000LL; t += SIM_SPACING_MS * 1000) {
+    SIMCOMMAND frame;
+    frame.arrival = simArrival(t, previous, jitterMs);
+    frame.data[0] = lround(simThrottle(t / 1e6)) >> 8;
+    frame.data[1] = lround(simThrottle(t / 1e6)) & 0xFF;
+    frame.data[2] = lround(simSteering(t / 1e6));
+    if (simUniform(0, 100) >= lossPercent) commands.push_back(frame);
+  }
+  int16_t throttle = 1500;
+  uint8_t steeringAngle = 90;
+  for (int64_t now = 0; now < stopAt; now += SIM_LOOP_US + rand() % 1000) {
+    while (!commands.empty() && commands.front().arrival <= now) {
+      throttle = (commands.front().data[0] << 8) | commands.front().data[1];
+      steeringAngle = commands.front().data[2];
+      commands.pop_front();
+    }
+    direct.push_back(SIMSAMPLE{now, throttle, steeringAngle});
+  }
+
+  double queuedDelay, queuedThrottle, queuedSteering, directDelay, directThrottle, directSteering;
+  simDelayError(queued, queuedDelay, queuedThrottle, queuedSteering);
+  simDelayError(direct, directDelay, directThrottle, directSteering);
+
+  printf("  %-22s %10s %14s %14s\n", "", "delay ms", "throttle rms", "steering rms");
+  printf("  %-22s %10.0f %11.2f us %10.2f deg\n", "direct commands", directDelay, directThrottle, directSteering);
+  printf("  %-22s %10.0f %11.2f us %10.2f deg\n", "setpoint queue", queuedDelay, queuedThrottle, queuedSteering);
+  printf("\n  %u frames sent, %u lost (VCU counted %u), %u setpoints late on arrival, %u queue overflows\n", sent,
+         lost, rx.lost, rx.late, rx.overflows);
+  printf("  loop steps: waiting %u, running %u, hold %u, fallback %u, done %u\n", states[SETPOINT_WAITING],
+         states[SETPOINT_RUNNING], states[SETPOINT_HOLD], states[SETPOINT_FALLBACK], states[SETPOINT_DONE]);
+  printf("  stream stopped: underrun after %.0f ms, throttle at neutral after %.0f ms, %u underruns\n",
+         underrunAt >= 0 ? (underrunAt - lastSetpoint) / 1000.0 : -1.0,
+         neutralAt >= 0 ? (neutralAt - lastSetpoint) / 1000.0 : -1.0, player.underruns);
+
+  double endNeutral = simEndRamp();
+  printf("  trajectory end: throttle from %d us at neutral %.0f ms after the last setpoint\n", SIM_END_THROTTLE_US,
+         endNeutral);
+
+  uint32_t encodingChecked;
+  uint8_t badSteering = 0;
+  uint32_t encodingErrors = simEncodingErrors(encodingChecked, badSteering);
+  if (encodingErrors) {
+    printf("  frame encoding: %u of %u setpoints changed, first at %u deg\n", encodingErrors, encodingChecked, badSteering);
+  } else {
+    printf("  frame encoding: 30 - 150 deg and 988 - 2010 us round trip exactly\n");
+  }
+
+  bool pass = encodingErrors == 0 && queuedThrottle <= SIM_MAX_THROTTLE_US && queuedSteering <= SIM_MAX_STEERING_DEG && neutralAt >= 0 &&
+              neutralAt - lastSetpoint <= (SETPOINT_HOLD_MS + 300 / SETPOINT_RAMP_US) * 1000LL + 2 * SIM_LOOP_US &&
+              endNeutral >= 0 &&
+              endNeutral * 1000 <= (SIM_END_THROTTLE_US - 1500) / SETPOINT_RAMP_US * 1000LL + SIM_LOOP_US;
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+/* Curvature steering table against a floating point reference (include/STEERCAL.h).
+
+The built-in table is precomputed for a 260 mm wheelbase, a 2.22 1/m steering limit and an
+asymmetric linkage (1.00 servo degree per wheel degree to the left, 1.12 to the right), then
+every curvature from -2.4 to 2.4 1/m in 1/km steps goes through steerCalServo() and is
+compared with the servo angle from atan() in double, next to what evaluating the model with
+fixedAtan() every control step would give (the pursuit tracker's wheel angle). Then a
+measured table is loaded with calibration frames, and incomplete, non-monotonic and off
+center tables have to be rejected with the previous table kept. Exit code 1 if the table is
+more than SIM_MAX_ERROR_CDEG off the reference or a load check fails.
+
+  vcu_host steercal */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <FIXEDPOINT.h>
+#include <STEERCAL.h>
+#include <HOSTCHECK.h>
+
+#define SIM_MAX_ERROR_CDEG  5               // interpolation between exact points
+#define SIM_SWEEP           2400            // 1/km
+
+static const STEERGEOMETRY simGeometry = {260, 2220, {256, 287}, 1};
+
+// servo offset from the model in double, centidegrees, saturated like the table
+static double simReference(const STEERGEOMETRY& geometry, uint16_t step, int32_t curvature) {
+  uint8_t side = curvature >= 0 ? STEERCAL_LEFT : STEERCAL_RIGHT;
+  double k = fmin(fabs((double)curvature), (double)step * (STEERCAL_POINTS - 1));
+  double wheel = atan(geometry.wheelbase * k / 1e6) * 180 / M_PI;
+  double sign = (side == STEERCAL_LEFT ? 1 : -1) * geometry.direction;
+  return sign * wheel * geometry.linkage[side] / 256.0 * 100;
+}
+
+namespace {
+
+struct SIMERROR {
+  uint32_t count;
+  double sumSquares;
+  double max;
+  uint32_t servoMismatch;       // whole servo degrees differ from the rounded reference
+};
+
+}  // namespace
+
+static void simSweep(const STEERCAL& cal, SIMERROR& e) {
+  e = SIMERROR();
+  for (int32_t k = -SIM_SWEEP; k <= SIM_SWEEP; k++) {
+    bool saturated;
+    int32_t servo = steerCalServo(cal, k, saturated);
+    double reference = simReference(simGeometry, cal.branch[k >= 0 ? 0 : 1].step, k);
+    double error = servo - reference;
+    e.count++;
+    e.sumSquares += error * error;
+    e.max = fmax(e.max, fabs(error));
+    if (steerCalDegrees(servo) != lround(reference / 100)) e.servoMismatch++;
+  }
+}
+
+static void simPrint(const char* name, const SIMERROR& e) {
+  printf("  %-34s rms %6.2f  max %6.2f cdeg, servo degree differs %u / %u\n", name, sqrt(e.sumSquares / e.count),
+         e.max, e.servoMismatch, e.count);
+}
+
+// all frames of one branch, commit on the last one
+static void simFrames(std::vector<std::vector<uint8_t> >& frames, uint8_t side, const STEERBRANCH& branch,
+                      bool commit) {
+  for (uint8_t i = 0; i < STEERCAL_POINTS; i += 2) {
+    std::vector<uint8_t> data(8);
+    steerCalFrame(&data[0], side, commit && i + 2 >= STEERCAL_POINTS, i, branch);
+    frames.push_back(data);
+  }
+}
+
+// feeds the frames, true if the last one committed
+static bool simLoad(STEERCALRX& rx, STEERCAL& current, const std::vector<std::vector<uint8_t> >& frames) {
+  bool committed = false;
+  for (size_t i = 0; i < frames.size(); i++) committed = steerCalReceive(rx, current, &frames[i][0], 8);
+  return committed;
+}
+
+
+//==================================================================================//
+
+int steerCalReport(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+
+  STEERCAL cal;
+  steerCalDefault(cal, simGeometry);
+  printf("steering table: wheelbase %d mm, limit %u 1/km, %d points per branch, step %u 1/km, linkage %.2f / %.2f\n\n",
+         (int)simGeometry.wheelbase, simGeometry.maxCurvature, STEERCAL_POINTS, cal.branch[0].step,
+         simGeometry.linkage[0] / 256.0, simGeometry.linkage[1] / 256.0);
+
+  printf("  %8s %12s %12s\n", "1/km", "left cdeg", "right cdeg");
+  for (uint8_t i = 0; i < STEERCAL_POINTS; i += 4) {
+    printf("  %8u %12d %12d\n", i * cal.branch[0].step, cal.branch[0].servo[i], cal.branch[1].servo[i]);
+  }
+  printf("\n");
+
+  // the model evaluated per call in fixed point instead, as pursuitWheelAngle() does
+  SIMERROR tableError, modelError = SIMERROR();
+  simSweep(cal, tableError);
+  for (int32_t k = -SIM_SWEEP; k <= SIM_SWEEP; k++) {
+    uint8_t side = k >= 0 ? STEERCAL_LEFT : STEERCAL_RIGHT;
+    int64_t clamped = k >= 0 ? k : -k;
+    if (clamped > cal.branch[side].step * (STEERCAL_POINTS - 1)) clamped = cal.branch[side].step * (STEERCAL_POINTS - 1);
+    int32_t wheel = fixedAtan((int32_t)(simGeometry.wheelbase * clamped * FIXED_ONE_Q14 / 1000000));
+    int32_t servo = (side == STEERCAL_LEFT ? 1 : -1) * ((wheel * simGeometry.linkage[side] + 128) >> 8);
+    double reference = simReference(simGeometry, cal.branch[side].step, k);
+    double error = servo - reference;
+    modelError.count++;
+    modelError.sumSquares += error * error;
+    modelError.max = fmax(modelError.max, fabs(error));
+    if (steerCalDegrees(servo) != lround(reference / 100)) modelError.servoMismatch++;
+  }
+  simPrint("precomputed table, interpolated", tableError);
+  simPrint("fixedAtan model every call", modelError);
+  printf("\n");
+
+  // runtime loading: a measured, asymmetric table with a slight center trim
+  STEERCAL measured;
+  measured.branch[0].step = 150;
+  measured.branch[1].step = 125;
+  for (uint8_t i = 0; i < STEERCAL_POINTS; i++) {
+    measured.branch[0].servo[i] = (int16_t)(40 + 2600 * sin(i / 16.0 * 1.2) / sin(1.2));
+    measured.branch[1].servo[i] = (int16_t)(40 - 3100 * pow(i / 16.0, 0.9));
+  }
+
+  STEERCAL current = cal;
+  STEERCALRX rx;
+  steerCalRxBegin(rx, current);
+  std::vector<std::vector<uint8_t> > frames;
+  simFrames(frames, STEERCAL_LEFT, measured.branch[0], false);
+  simFrames(frames, STEERCAL_RIGHT, measured.branch[1], true);
+  bool pass = true;
+  pass &= hostCheck("measured table loaded with 18 frames",
+                   simLoad(rx, current, frames) && current.id == 1 &&
+                   memcmp(current.branch, measured.branch, sizeof(measured.branch)) == 0);
+
+  bool saturated, saturatedLeft, saturatedRight;
+  int32_t left = steerCalServo(current, 150 * 16 + 100, saturatedLeft);
+  int32_t right = steerCalServo(current, -125 * 16 - 100, saturatedRight);
+  pass &= hostCheck("beyond the limit: saturated at the last point of each branch",
+                   saturatedLeft && saturatedRight && left == measured.branch[0].servo[16] &&
+                   right == measured.branch[1].servo[16]);
+  pass &= hostCheck("straight ahead gives the center trim", steerCalServo(current, 0, saturated) == 40);
+
+  STEERCAL before = current;
+  std::vector<std::vector<uint8_t> > lost(frames);
+  lost.erase(lost.begin() + 3);
+  pass &= hostCheck("one frame lost: rejected, previous table kept",
+                   !simLoad(rx, current, lost) && memcmp(&current, &before, sizeof(current)) == 0);
+
+  STEERBRANCH bent = measured.branch[0];
+  bent.servo[9] = bent.servo[7];
+  frames.clear();
+  simFrames(frames, STEERCAL_LEFT, bent, true);
+  pass &= hostCheck("left branch turning back: rejected",
+                   !simLoad(rx, current, frames) && memcmp(&current, &before, sizeof(current)) == 0);
+
+  STEERBRANCH offCenter = measured.branch[1];
+  offCenter.servo[0] = 0;
+  frames.clear();
+  simFrames(frames, STEERCAL_RIGHT, offCenter, true);
+  pass &= hostCheck("right branch with another center: rejected",
+                   !simLoad(rx, current, frames) && memcmp(&current, &before, sizeof(current)) == 0);
+
+  STEERBRANCH wider = measured.branch[1];
+  wider.step = 140;
+  frames.clear();
+  simFrames(frames, STEERCAL_RIGHT, wider, true);
+  pass &= hostCheck("right branch alone: taken over, left branch unchanged",
+                   simLoad(rx, current, frames) && current.branch[1].step == 140 && current.id == 2 &&
+                   memcmp(&current.branch[0], &measured.branch[0], sizeof(STEERBRANCH)) == 0);
+  printf("  %u tables loaded, %u rejected\n", rx.loaded, rx.rejected);
+
+  pass &= tableError.max <= SIM_MAX_ERROR_CDEG;
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
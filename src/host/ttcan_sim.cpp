@@ -0,0 +1,403 @@
+/* Shared bus simulation of several VCUs, event driven against time-triggered (include/TTCAN.h).
+
+A 1 Mbps CAN bus with bitwise arbitration (lowest ID wins when the bus goes idle, one
+transmit FIFO per node) carries the traffic of the master and up to four VCUs:
+  master   commands to every VCU every 10 ms, a 32 frame path every 500 ms
+  VCU      status every 12 ms (control loop), 10 diagnostics records every second
+Event mode sends every frame as soon as the CANBUS task gets to it (up to 5 ms later).
+Time-triggered mode runs the firmware logic of TTNODE.h on the slot table of TTSCHEDULE.h:
+each VCU has its own clock (+-50 ppm), time stamps the reference with interrupt latency,
+its slot timer wakes late by the esp_timer dispatch latency, and it transmits only in its
+own slots; the master sends paths in the free slots. Reported per message class is the
+latency from the application handing a frame over to the end of the frame on the bus,
+against the bound from ttLatencyBound(), plus slot overruns and the sync error.
+
+  vcu_host sim-ttcan [nodes 1-4] [seconds] [reference loss %] */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <TTSCHEDULE.h>
+
+#define SIM_FIRST_NODE      0x15
+#define SIM_MAX_NODES       4
+#define SIM_STATUS_US       12000       // VCU loop period
+#define SIM_CANBUS_US       5000        // CANBUS task poll period, event mode
+#define SIM_COMMAND_US      10000
+#define SIM_PATH_US         500000
+#define SIM_PATH_FRAMES     32
+#define SIM_DIAG_US         1000000
+#define SIM_DIAG_FRAMES     10          // vcu-tt: task and jitter x2, heap, memory, TT, wake-up, CAN health x2
+#define SIM_DRIFT_PPM       50
+#define SIM_ISR_US          20          // reference time stamp latency, 2 - 20 us
+#define SIM_WAKE_US         40          // slot timer dispatch latency, 5 - 40 us
+#define SIM_TX_QUEUE        32          // TT_TX_QUEUE
+
+namespace {
+
+enum sim_class_enum{
+  SIM_REFERENCE = 0,
+  SIM_COMMAND,
+  SIM_STATUS,
+  SIM_DIAG,
+  SIM_PATH,
+  SIM_CLASSES
+};
+
+static const char* simClassNames[SIM_CLASSES] = {"reference", "command", "status", "diagnostics", "path"};
+
+struct SIMFRAME {
+  uint32_t id;
+  uint8_t cls;
+  double created;             // handed over by the application, global us
+  double ready;               // in the controller
+  int8_t slot;                // time-triggered: slot it was sent for, -1 otherwise
+};
+
+struct SIMNODE {
+  uint16_t id;                // 0 = master
+  double ppm;
+  double offset;              // local clock = global * (1 + ppm) + offset
+  std::deque<SIMFRAME> tx;    // controller FIFO
+
+  // time-triggered state, as in TTNODE.h
+  TTSTATE tt;
+  bool armed;
+  double timerAt;             // global us of the next slot timer callback
+  int64_t slotAt;             // local us of the armed slot
+  uint8_t kind;
+  bool statusValid;
+  SIMFRAME status;            // latest status sample
+  bool statusFresh;           // not sent yet
+  std::deque<SIMFRAME> queue; // queue slot frames
+
+  SIMFRAME command;           // master side: latest command for this VCU
+  bool commandFresh;
+
+  double nextStatus, nextDiag, nextCommand;
+  uint32_t slotsLate, queueDropped;
+};
+
+struct SIMRESULT {
+  std::vector<double> latency[SIM_CLASSES];
+  uint32_t superseded[SIM_CLASSES];
+  uint32_t overruns;          // time-triggered frame not completely inside its slot
+  uint32_t delayed;           // time-triggered frame that had to wait for the bus
+  uint32_t slotsLate;
+  uint32_t lostSync;
+  int32_t phaseMax;
+  uint32_t referencesLost;
+  double busyUs;
+};
+
+}  // namespace
+
+static double uniform(double low, double high) {
+  return low + (high - low) * (rand() / (RAND_MAX + 1.0));
+}
+
+static int64_t localTime(const SIMNODE& node, double global) {
+  return (int64_t)floor(global * (1.0 + node.ppm * 1e-6) + node.offset);
+}
+
+static double globalTime(const SIMNODE& node, int64_t local) {
+  return (local - node.offset) / (1.0 + node.ppm * 1e-6);
+}
+
+static bool ownsSlot(uint8_t slot) {
+  for (uint8_t i = 0; i < ttSchedule.count; i++) {
+    if (ttSchedule.slots[i].slot == slot) return true;
+  }
+  return false;
+}
+
+static uint32_t frameUs(const SIMFRAME& frame) {
+  return ttFrameTimeUs(frame.cls == SIM_REFERENCE ? 1 : 8, false, TT_BITRATE);
+}
+
+
+//==================================================================================//
+
+// slot timer, TTNODE.h ttArm()
+static void simArm(SIMNODE& node, int64_t from) {
+  uint8_t kind = 0;
+  int64_t at = ttNextSlot(node.tt, ttSchedule, node.id, from, kind);
+  node.armed = at >= 0;
+  node.slotAt = at;
+  node.kind = kind;
+  node.timerAt = at >= 0 ? globalTime(node, at) + uniform(5, SIM_WAKE_US) : 1e18;
+}
+
+// slot timer callback, TTNODE.h ttSlot()
+static void simSlot(SIMNODE& node, SIMRESULT& result) {
+  double now = node.timerAt;
+  int64_t local = localTime(node, now);
+  ttAdvance(node.tt, ttSchedule, local);
+
+  const int64_t latest = node.slotAt + ttSchedule.slotUs - TT_GUARD_US - ttFrameTimeUs(8, false, TT_BITRATE);
+  int8_t slot = (int8_t)((node.slotAt - node.tt.cycleStart + ttSchedule.cycleUs) % ttSchedule.cycleUs / ttSchedule.slotUs);
+
+  if (!node.tt.synced) {
+  } else if (local > latest) {
+    node.slotsLate++;
+  } else if (node.kind == TT_SLOT_STATUS && node.statusValid) {
+    SIMFRAME frame = node.status;
+    frame.ready = now;
+    frame.slot = slot;
+    if (!node.statusFresh) frame.created = -1;    // repeat, no latency sample
+    node.statusFresh = false;
+    node.tx.push_back(frame);
+  } else if (node.kind == TT_SLOT_QUEUE && !node.queue.empty()) {
+    SIMFRAME frame = node.queue.front();
+    node.queue.pop_front();
+    frame.ready = now;
+    frame.slot = slot;
+    node.tx.push_back(frame);
+  }
+  (void)result;
+  simArm(node, std::max(local, node.slotAt + ttSchedule.slotUs / 2));
+}
+
+static void simReference(SIMNODE& node, double end, uint8_t cycle) {
+  ttOnReference(node.tt, ttSchedule, localTime(node, end + uniform(2, SIM_ISR_US)), cycle);
+  if (!node.armed) simArm(node, localTime(node, end + SIM_ISR_US));
+}
+
+
+//==================================================================================//
+
+static void simulate(bool timeTriggered, int nodeCount, double seconds, double referenceLoss, SIMRESULT& result) {
+  srand(36);
+  result = SIMRESULT();
+
+  std::vector<SIMNODE> nodes(nodeCount + 1);
+  for (int n = 0; n <= nodeCount; n++) {
+    SIMNODE& node = nodes[n];
+    node = SIMNODE();
+    node.id = n == 0 ? TT_MASTER : SIM_FIRST_NODE + n - 1;
+    node.ppm = n == 0 ? 0 : uniform(-SIM_DRIFT_PPM, SIM_DRIFT_PPM);
+    node.offset = n == 0 ? 0 : uniform(0, 1e6);
+    node.timerAt = 1e18;
+    node.nextStatus = n == 0 ? 1e18 : uniform(0, SIM_STATUS_US);
+    node.nextDiag = n == 0 ? 1e18 : uniform(0, SIM_DIAG_US);
+    node.nextCommand = n == 0 ? 1e18 : uniform(0, SIM_COMMAND_US);
+  }
+  SIMNODE& master = nodes[0];
+  std::deque<SIMFRAME> paths;                   // master, time-triggered: waiting for free slots
+
+  const double end = seconds * 1e6;
+  double nextPath = uniform(0, SIM_PATH_US);
+  double nextCycle = 0;
+  uint8_t cycle = 0;
+  double nextMasterSlot = 0;                    // master: command and free slots, time-triggered
+  double now = 0;
+
+  while (now < end) {
+    // application side, every event at its own time
+    for (int n = 1; n <= nodeCount; n++) {
+      SIMNODE& node = nodes[n];
+      while (node.nextStatus <= now) {
+        SIMFRAME frame = {node.id, SIM_STATUS, node.nextStatus, node.nextStatus, -1};
+        if (timeTriggered) {
+          if (node.statusFresh) result.superseded[SIM_STATUS]++;
+          node.status = frame;
+          node.statusValid = node.statusFresh = true;
+        } else {
+          frame.ready = node.nextStatus + uniform(0, SIM_CANBUS_US);
+          node.tx.push_back(frame);
+        }
+        node.nextStatus += SIM_STATUS_US + uniform(0, 500);
+      }
+      while (node.nextDiag <= now) {
+        for (int i = 0; i < SIM_DIAG_FRAMES; i++) {
+          SIMFRAME frame = {0x600u + node.id, SIM_DIAG, node.nextDiag, node.nextDiag + uniform(0, SIM_CANBUS_US), -1};
+          if (!timeTriggered) node.tx.push_back(frame);
+          else if (node.queue.size() < SIM_TX_QUEUE - 1) node.queue.push_back(frame);
+          else node.queueDropped++;
+        }
+        node.nextDiag += SIM_DIAG_US;
+      }
+      while (node.nextCommand <= now) {
+        SIMFRAME frame = {(uint32_t)(TT_COMMAND_BASE + node.id), SIM_COMMAND, node.nextCommand, node.nextCommand, -1};
+        if (timeTriggered) {
+          if (node.commandFresh) result.superseded[SIM_COMMAND]++;
+          node.command = frame;
+          node.commandFresh = true;
+        } else {
+          master.tx.push_back(frame);
+        }
+        node.nextCommand += SIM_COMMAND_US;
+      }
+    }
+    while (nextPath <= now) {
+      for (int i = 0; i < SIM_PATH_FRAMES; i++) {
+        SIMFRAME frame = {0x200u + SIM_FIRST_NODE + (uint32_t)(i % nodeCount), SIM_PATH, nextPath, nextPath, -1};
+        if (timeTriggered) paths.push_back(frame);
+        else master.tx.push_back(frame);
+      }
+      nextPath += SIM_PATH_US;
+    }
+
+    // time-triggered master: reference at the cycle start, commands and paths in their slots
+    if (timeTriggered) {
+      while (nextCycle <= now) {
+        if (uniform(0, 100) >= referenceLoss) {
+          SIMFRAME frame = {TT_REFERENCE_ID, SIM_REFERENCE, nextCycle, nextCycle, 0};
+          master.tx.push_back(frame);
+        } else {
+          result.referencesLost++;
+        }
+        nextCycle += ttSchedule.cycleUs;
+      }
+      while (nextMasterSlot <= now) {
+        uint8_t slot = (uint8_t)(fmod(nextMasterSlot, ttSchedule.cycleUs) / ttSchedule.slotUs + 0.5) % ttSlotCount(ttSchedule);
+        double at = nextMasterSlot + TT_GUARD_US / 2;
+        if (slot != 0 && !ownsSlot(slot) && !paths.empty()) {
+          SIMFRAME frame = paths.front();
+          paths.pop_front();
+          frame.ready = at;
+          master.tx.push_back(frame);
+        }
+        for (uint8_t i = 0; i < ttSchedule.count; i++) {
+          const TTSLOT& s = ttSchedule.slots[i];
+          if (s.slot != slot || s.kind != TT_SLOT_COMMAND) continue;
+          int n = s.node - SIM_FIRST_NODE + 1;
+          if (n < 1 || n > nodeCount || nodes[n].command.cls != SIM_COMMAND) continue;
+          SIMFRAME frame = nodes[n].command;
+          if (!nodes[n].commandFresh) frame.created = -1;
+          nodes[n].commandFresh = false;
+          frame.ready = at;
+          frame.slot = slot;
+          master.tx.push_back(frame);
+        }
+        nextMasterSlot += ttSchedule.slotUs;
+      }
+      for (int n = 1; n <= nodeCount; n++) {
+        while (nodes[n].armed && nodes[n].timerAt <= now) simSlot(nodes[n], result);
+      }
+    }
+
+    // arbitration: the lowest ID among the frames ready when the bus goes idle
+    int winner = -1;
+    for (int n = 0; n <= nodeCount; n++) {
+      if (nodes[n].tx.empty() || nodes[n].tx.front().ready > now) continue;
+      if (winner < 0 || nodes[n].tx.front().id < nodes[winner].tx.front().id) winner = n;
+    }
+
+    if (winner < 0) {
+      // idle until the next thing happens
+      double next = end;
+      for (int n = 0; n <= nodeCount; n++) {
+        if (!nodes[n].tx.empty()) next = fmin(next, nodes[n].tx.front().ready);
+        next = fmin(next, nodes[n].nextStatus);
+        next = fmin(next, nodes[n].nextDiag);
+        next = fmin(next, nodes[n].nextCommand);
+        if (timeTriggered && nodes[n].armed) next = fmin(next, nodes[n].timerAt);
+      }
+      next = fmin(next, nextPath);
+      if (timeTriggered) next = fmin(next, fmin(nextCycle, nextMasterSlot));
+      now = fmax(next, now + 0.001);
+      continue;
+    }
+
+    SIMFRAME frame = nodes[winner].tx.front();
+    nodes[winner].tx.pop_front();
+    double start = now;
+    now += frameUs(frame);
+    result.busyUs += frameUs(frame);
+
+    if (frame.created >= 0 && frame.cls != SIM_REFERENCE) result.latency[frame.cls].push_back(now - frame.created);
+
+    if (timeTriggered && frame.slot >= 0) {
+      double slotStart = floor(start / ttSchedule.cycleUs) * ttSchedule.cycleUs + frame.slot * ttSchedule.slotUs;
+      if (start < slotStart || now > slotStart + ttSchedule.slotUs) result.overruns++;
+      if (start > frame.ready + 0.001) result.delayed++;
+    }
+    if (timeTriggered && frame.cls == SIM_REFERENCE) {
+      for (int n = 1; n <= nodeCount; n++) simReference(nodes[n], now, cycle);
+      cycle++;
+    }
+  }
+
+  for (int n = 1; n <= nodeCount; n++) {
+    result.slotsLate += nodes[n].slotsLate;
+    result.lostSync += nodes[n].tt.lostSync;
+    result.phaseMax = std::max(result.phaseMax, nodes[n].tt.phaseMax);
+  }
+}
+
+
+//==================================================================================//
+
+static void printResult(const char* mode, const SIMRESULT& result, double seconds, bool timeTriggered) {
+  printf("%s, bus load %.1f %%\n", mode, result.busyUs / (seconds * 1e4));
+  printf("  %-12s %8s %10s %10s %10s %10s %11s\n", "class", "frames", "mean [us]", "p99 [us]", "max [us]", "bound [us]",
+         "superseded");
+
+  for (int c = SIM_COMMAND; c < SIM_CLASSES; c++) {
+    std::vector<double> latency = result.latency[c];
+    std::sort(latency.begin(), latency.end());
+    double sum = 0;
+    for (size_t i = 0; i < latency.size(); i++) sum += latency[i];
+
+    // TT bounds from the schedule: commands and status one slot per cycle, the diagnostics
+    // burst drains one record per cycle, paths use the free slots and have none
+    uint32_t bound = 0;
+    if (timeTriggered && c == SIM_COMMAND) bound = ttLatencyBound(ttSchedule, SIM_FIRST_NODE, TT_SLOT_COMMAND);
+    if (timeTriggered && c == SIM_STATUS) bound = ttLatencyBound(ttSchedule, SIM_FIRST_NODE, TT_SLOT_STATUS);
+    if (timeTriggered && c == SIM_DIAG)
+      bound = ttLatencyBound(ttSchedule, SIM_FIRST_NODE, TT_SLOT_QUEUE) + (SIM_DIAG_FRAMES - 1) * ttSchedule.cycleUs;
+
+    char boundText[16] = "-";
+    if (bound) snprintf(boundText, sizeof(boundText), "%u", bound);
+    printf("  %-12s %8zu %10.0f %10.0f %10.0f %10s %11u\n", simClassNames[c], latency.size(),
+           latency.empty() ? 0 : sum / latency.size(), latency.empty() ? 0 : latency[latency.size() * 99 / 100],
+           latency.empty() ? 0 : latency.back(), boundText, result.superseded[c]);
+  }
+
+  if (timeTriggered) {
+    printf("  slot overruns %u, frames delayed by the bus %u, late slot timers %u, sync lost %u, "
+           "references lost %u, largest phase error %d us\n", result.overruns, result.delayed, result.slotsLate,
+           result.lostSync, result.referencesLost, result.phaseMax);
+  }
+}
+
+static void printScheduleError(const char* message, uint8_t slot, uint16_t node) {
+  printf("  schedule: %s (slot %u, node 0x%X)\n", message, slot, node);
+}
+
+int ttcanSim(int argc, char** argv) {
+  int nodes = argc >= 1 ? atoi(argv[0]) : SIM_MAX_NODES;
+  double seconds = argc >= 2 ? atof(argv[1]) : 10.0;
+  double referenceLoss = argc >= 3 ? atof(argv[2]) : 0.0;
+  if (nodes < 1 || nodes > SIM_MAX_NODES || seconds <= 0) {
+    fprintf(stderr, "nodes 1 - %d, seconds > 0\n", SIM_MAX_NODES);
+    return 2;
+  }
+
+  uint16_t errors = ttValidate(ttSchedule, printScheduleError);
+  printf("schedule: %u slots of %u us in a %u us cycle, %u assigned, %u errors\n", ttSlotCount(ttSchedule),
+         ttSchedule.slotUs, ttSchedule.cycleUs, ttSchedule.count, errors);
+
+  // a broken table has to be caught as well
+  const TTSLOT broken[] = {{1, TT_MASTER, TT_SLOT_REFERENCE}, {2, 0x15, TT_SLOT_COMMAND}, {2, 0x16, TT_SLOT_STATUS}};
+  const TTSCHEDULE brokenSchedule = {TT_CYCLE_US, 100, broken, 3};
+  uint16_t brokenErrors = ttValidate(brokenSchedule, NULL);
+  printf("broken test schedule: %u errors found\n\n", brokenErrors);
+  if (errors || brokenErrors < 4) return 1;
+
+  printf("%d VCUs, %.0f s, reference loss %.1f %%\n\n", nodes, seconds, referenceLoss);
+
+  SIMRESULT event, timed;
+  simulate(false, nodes, seconds, 0, event);
+  printResult("event driven", event, seconds, false);
+  printf("\n");
+  simulate(true, nodes, seconds, referenceLoss, timed);
+  printResult("time-triggered", timed, seconds, true);
+
+  return timed.overruns ? 1 : 0;
+}
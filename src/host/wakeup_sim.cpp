@@ -0,0 +1,193 @@
+/* Input triggered against polled control tasks (include/WAKEUP.h).
+
+Timeline model of the CANBUS and VCU tasks on a 1 ms FreeRTOS tick for a stream of inputs:
+  polling   CANBUS wakes 5 ticks after its loop ended (vTaskDelay), takes what arrived and
+            publishes it; VCU wakes 12 ticks after its loop and applies the latest input
+  event     the input interrupt wakes CANBUS, which publishes and notifies VCU; both also
+            wake after WAKE_INPUT_TIMEOUT_MS / WAKE_CONTROL_TIMEOUT_MS without input
+Task wake-up and loop times are taken from the diagnostics records of a bench unit (task
+switch after a notification ~15 us, CANBUS loop ~60 us, VCU loop ~150 us with the actuator
+write ~40 us in). Latency is input arrival (receive interrupt, PPM sync, SBUS line idle) to
+the actuator write of that input, as the wake-up diagnostics record counts it; inputs that
+a newer one overtook before the VCU task ran are not applied and not counted. Idle wake-ups
+are loops that found no new input. Exit code 1 if event driven control is not below 1 ms
+worst case latency, or if either task wakes more often than polling in any scenario (the
+control task counting idle wake-ups only).
+
+  vcu_host sim-wakeup [seconds] */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#define SIM_TICK_US           1000
+#define SIM_NOTIFY_US         15        // notification to the task running
+#define SIM_CANBUS_BUSY_US    60
+#define SIM_VCU_BUSY_US       150
+#define SIM_VCU_WRITE_US      40        // loop start to the actuator write
+#define SIM_CANBUS_PERIOD_MS  5         // polling
+#define SIM_VCU_PERIOD_MS     12
+#define SIM_INPUT_TIMEOUT_MS  30        // WAKE_INPUT_TIMEOUT_MS
+#define SIM_CONTROL_TIMEOUT_MS 30       // WAKE_CONTROL_TIMEOUT_MS
+#define SIM_MAX_EVENT_US      1000
+
+namespace {
+
+struct SIMSCENARIO {
+  const char* name;
+  double periodMs;                      // 0 = no input
+  double jitterMs;                      // uniform, CAN master scheduling
+};
+
+struct SIMRESULT {
+  double canbusWakeups;                 // per second
+  double vcuWakeups;
+  double vcuIdle;
+  double latencyMean;                   // us
+  double latencyP99;
+  double latencyMax;
+  uint32_t applied;
+};
+
+}  // namespace
+
+static int64_t simNextTick(int64_t t) {
+  return (t / SIM_TICK_US + 1) * SIM_TICK_US;
+}
+
+static std::vector<int64_t> simInputs(const SIMSCENARIO& scenario, int64_t duration) {
+  std::vector<int64_t> inputs;
+  if (scenario.periodMs <= 0) return inputs;
+  for (double t = 3000; t < duration; t += scenario.periodMs * 1000) {
+    inputs.push_back((int64_t)(t + scenario.jitterMs * 1000 * rand() / (double)RAND_MAX));
+  }
+  std::sort(inputs.begin(), inputs.end());
+  return inputs;
+}
+
+static void simLatency(SIMRESULT& r, std::vector<double>& latencies, int64_t seconds) {
+  r.canbusWakeups /= seconds;
+  r.vcuWakeups /= seconds;
+  r.vcuIdle /= seconds;
+  r.applied = latencies.size();
+  if (latencies.empty()) return;
+  std::sort(latencies.begin(), latencies.end());
+  double sum = 0;
+  for (size_t i = 0; i < latencies.size(); i++) sum += latencies[i];
+  r.latencyMean = sum / latencies.size();
+  r.latencyP99 = latencies[latencies.size() * 99 / 100];
+  r.latencyMax = latencies.back();
+}
+
+// fixed periods: CANBUS publishes what arrived since its last loop, VCU applies the latest
+static SIMRESULT simPolling(const std::vector<int64_t>& inputs, int64_t duration, int64_t seconds) {
+  SIMRESULT r = SIMRESULT();
+  std::vector<double> latencies;
+  size_t next = 0;
+  int64_t published = -1, publishedAt = 0, applied = -1;
+  int64_t canbus = 0, vcu = 400;        // first wake of each task
+
+  while (canbus < duration || vcu < duration) {
+    if (canbus <= vcu) {
+      r.canbusWakeups++;
+      while (next < inputs.size() && inputs[next] <= canbus) {
+        published = next++;
+        publishedAt = canbus + SIM_CANBUS_BUSY_US;
+      }
+      canbus = simNextTick(canbus + SIM_CANBUS_BUSY_US) + (SIM_CANBUS_PERIOD_MS - 1) * SIM_TICK_US;
+    } else {
+      r.vcuWakeups++;
+      if (published > applied && publishedAt <= vcu) {
+        applied = published;
+        latencies.push_back(vcu + SIM_VCU_WRITE_US - inputs[published]);
+      } else {
+        r.vcuIdle++;
+      }
+      vcu = simNextTick(vcu + SIM_VCU_BUSY_US) + (SIM_VCU_PERIOD_MS - 1) * SIM_TICK_US;
+    }
+  }
+  simLatency(r, latencies, seconds);
+  return r;
+}
+
+// every input wakes CANBUS and then VCU; each task also wakes on its timeout
+static SIMRESULT simEvent(const std::vector<int64_t>& inputs, int64_t duration, int64_t seconds) {
+  SIMRESULT r = SIMRESULT();
+  std::vector<double> latencies;
+  int64_t canbusFree = 0, canbusLast = 0, vcuFree = 0, vcuLast = 0;
+
+  for (size_t i = 0; i <= inputs.size(); i++) {
+    int64_t arrival = i < inputs.size() ? inputs[i] : duration;
+
+    // timeouts while nothing arrives
+    while (arrival - canbusLast > SIM_INPUT_TIMEOUT_MS * 1000) {
+      canbusLast += SIM_INPUT_TIMEOUT_MS * 1000;
+      r.canbusWakeups++;
+    }
+    while (arrival - vcuLast > SIM_CONTROL_TIMEOUT_MS * 1000) {
+      vcuLast += SIM_CONTROL_TIMEOUT_MS * 1000;
+      r.vcuWakeups++;
+      r.vcuIdle++;
+    }
+    if (i == inputs.size()) break;
+
+    int64_t canbus = std::max(arrival + SIM_NOTIFY_US, canbusFree);
+    canbusFree = canbus + SIM_CANBUS_BUSY_US;
+    canbusLast = canbus;
+    r.canbusWakeups++;
+
+    int64_t vcu = std::max(canbusFree + SIM_NOTIFY_US, vcuFree);
+    vcuFree = vcu + SIM_VCU_BUSY_US;
+    vcuLast = vcu;
+    r.vcuWakeups++;
+    latencies.push_back(vcu + SIM_VCU_WRITE_US - arrival);
+  }
+  simLatency(r, latencies, seconds);
+  return r;
+}
+
+static void simPrint(const char* mode, const SIMRESULT& r) {
+  printf("    %-8s %9.1f %9.1f %9.1f %10.0f %10.0f %10.0f\n", mode, r.canbusWakeups, r.vcuWakeups, r.vcuIdle,
+         r.latencyMean, r.latencyP99, r.latencyMax);
+}
+
+
+//==================================================================================//
+
+int wakeupSim(int argc, char** argv) {
+  int64_t seconds = argc >= 1 ? atoi(argv[0]) : 60;
+  if (seconds < 1) seconds = 1;
+  const int64_t duration = seconds * 1000000LL;
+  srand(7);
+
+  const SIMSCENARIO scenarios[] = {
+    {"CAN commands 50 Hz, 2 ms jitter", 20, 2},
+    {"CAN commands 100 Hz, 1 ms jitter", 10, 1},
+    {"PPM frames, 22.5 ms", 22.5, 0},
+    {"SBUS frames, 14 ms", 14, 0},
+    {"silent bus, no receiver", 0, 0},
+  };
+
+  printf("control task wake-ups: %lld s per scenario, 1 ms tick\n\n", (long long)seconds);
+  printf("    %-8s %9s %9s %9s %10s %10s %10s\n", "", "CANBUS/s", "VCU/s", "idle/s", "mean us", "p99 us", "max us");
+
+  bool pass = true;
+  for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    std::vector<int64_t> inputs = simInputs(scenarios[s], duration);
+    SIMRESULT polling = simPolling(inputs, duration, seconds);
+    SIMRESULT event = simEvent(inputs, duration, seconds);
+
+    printf("  %s\n", scenarios[s].name);
+    simPrint("polling", polling);
+    simPrint("event", event);
+
+    pass &= event.latencyMax < SIM_MAX_EVENT_US;
+    pass &= event.vcuIdle <= polling.vcuIdle && event.canbusWakeups <= polling.canbusWakeups;
+  }
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
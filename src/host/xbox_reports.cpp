@@ -0,0 +1,138 @@
+/* Xbox controller HID input reports through the decoder (include/XBOXHID.h).
+
+Report vectors laid out byte for byte like the notifications of an Xbox Series X|S controller
+(16 bytes, no report id): sticks centered and at both ends of each axis, triggers released,
+fully pressed and with bits above the 10 bit range set, the d-pad in all four directions,
+the diagonals and an out of range hat value, every face and menu button. Each is decoded and
+compared field by field with the expected report, then the rejection of short notifications
+is checked. Exit code 0 when everything matches.
+
+  vcu_host xbox-reports */
+
+#include <stdio.h>
+#include <string.h>
+#include <XBOXHID.h>
+
+namespace {
+
+struct XBOXVECTOR {
+  const char* name;
+  uint8_t data[XBOX_REPORT_LENGTH];
+  XBOXREPORT report;
+};
+
+}  // namespace
+
+#define XBOX_ALL_BUTTONS  (XBOX_BTN_A | XBOX_BTN_B | XBOX_BTN_X | XBOX_BTN_Y | XBOX_BTN_LB | XBOX_BTN_RB | \
+                           XBOX_BTN_SELECT | XBOX_BTN_START | XBOX_BTN_XBOX | XBOX_BTN_LSTICK | XBOX_BTN_RSTICK | \
+                           XBOX_BTN_SHARE)
+
+static const XBOXVECTOR vectors[] = {
+  {"released, centered",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, 0}},
+  {"d-pad up",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_DPAD_UP}},
+  {"d-pad right",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_DPAD_RIGHT}},
+  {"d-pad down",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_DPAD_DOWN}},
+  {"d-pad left",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_DPAD_LEFT}},
+  {"d-pad up-right",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_DPAD_UP | XBOX_BTN_DPAD_RIGHT}},
+  {"d-pad down-left",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_DPAD_DOWN | XBOX_BTN_DPAD_LEFT}},
+  {"d-pad up-left",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_DPAD_UP | XBOX_BTN_DPAD_LEFT}},
+  {"hat out of range",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, 0}},
+  {"sticks low end",
+   {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {0, 0, 0, 0, 0, 0, 0}},
+  {"sticks high end",
+   {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {65535, 65535, 65535, 65535, 0, 0, 0}},
+  {"sticks byte order",
+   {0x34, 0x12, 0x78, 0x56, 0xBC, 0x9A, 0xF0, 0xDE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {0x1234, 0x5678, 0x9ABC, 0xDEF0, 0, 0, 0}},
+  {"triggers full",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0xFF, 0x03, 0xFF, 0x03, 0x00, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 1023, 1023, 0}},
+  {"triggers, high bits set",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0xFF, 0xFF, 0x00, 0xFC, 0x00, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 1023, 0, 0}},
+  {"left trigger half",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 512, 0, 0}},
+  {"A, B, X, Y",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1B, 0x00, 0x00},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_BTN_A | XBOX_BTN_B | XBOX_BTN_X | XBOX_BTN_Y}},
+  {"every button, d-pad down",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x05, 0xDB, 0x7C, 0x01},
+   {32768, 32768, 32768, 32768, 0, 0, XBOX_ALL_BUTTONS | XBOX_BTN_DPAD_DOWN}},
+  {"unused bits only",
+   {0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x24, 0x83, 0xFE},
+   {32768, 32768, 32768, 32768, 0, 0, 0}},
+  {"full deflection, both triggers",
+   {0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0x03, 0xFF, 0x03, 0x00, 0xC0, 0x00, 0x00},
+   {0, 65535, 65535, 0, 1023, 1023, XBOX_BTN_LB | XBOX_BTN_RB}},
+};
+
+static bool sameReport(const XBOXREPORT& a, const XBOXREPORT& b) {
+  return a.joyLHori == b.joyLHori && a.joyLVert == b.joyLVert && a.joyRHori == b.joyRHori &&
+         a.joyRVert == b.joyRVert && a.trigLT == b.trigLT && a.trigRT == b.trigRT && a.buttons == b.buttons;
+}
+
+static void printReport(const char* label, const XBOXREPORT& r) {
+  printf("  %-9s LX %5u LY %5u RX %5u RY %5u LT %4u RT %4u buttons 0x%04X\n", label, r.joyLHori, r.joyLVert,
+         r.joyRHori, r.joyRVert, r.trigLT, r.trigRT, r.buttons);
+}
+
+
+//==================================================================================//
+
+int xboxReportCheck(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+  int failures = 0;
+
+  for (size_t v = 0; v < sizeof(vectors) / sizeof(vectors[0]); v++) {
+    XBOXREPORT report = XBOXREPORT();
+    bool decoded = decodeXboxReport(vectors[v].data, XBOX_REPORT_LENGTH, report);
+    bool match = decoded && sameReport(report, vectors[v].report);
+    printf("%-32s %s\n", vectors[v].name, match ? "ok" : "MISMATCH");
+    if (!match) {
+      printReport("expected", vectors[v].report);
+      printReport("decoded", report);
+      failures++;
+    }
+  }
+
+  // short and missing notifications are rejected and leave the report as it was
+  const XBOXREPORT before = {1, 2, 3, 4, 5, 6, 7};
+  XBOXREPORT report = before;
+  bool rejected = !decodeXboxReport(vectors[0].data, XBOX_REPORT_LENGTH - 1, report) && sameReport(report, before);
+  rejected &= !decodeXboxReport(NULL, XBOX_REPORT_LENGTH, report) && sameReport(report, before);
+  printf("%-32s %s\n", "short report rejected", rejected ? "ok" : "MISMATCH");
+  failures += rejected ? 0 : 1;
+
+  // a longer notification decodes its first 16 bytes
+  uint8_t longer[XBOX_REPORT_LENGTH + 4];
+  memcpy(longer, vectors[1].data, XBOX_REPORT_LENGTH);
+  memset(longer + XBOX_REPORT_LENGTH, 0xFF, 4);
+  report = XBOXREPORT();
+  bool extended = decodeXboxReport(longer, sizeof(longer), report) && sameReport(report, vectors[1].report);
+  printf("%-32s %s\n", "trailing bytes ignored", extended ? "ok" : "MISMATCH");
+  failures += extended ? 0 : 1;
+
+  return failures ? 1 : 0;
+}
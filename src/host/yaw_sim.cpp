@@ -0,0 +1,195 @@
+/* Yaw-rate feedback steering against a vehicle model (include/YAWRATE.h).
+
+Runs the firmware's estimator and controller on a simulated car: bicycle model with the yaw
+rate settling to speed * tan(wheel angle) / (wheelbase * (1 + gradient * speed^2)) with a first
+order lag SIM_YAW_TAU (gradient 0 is the kinematic model, below 0 oversteer, above understeer),
+a first order servo SIM_SERVO_TAU driven in whole degrees like drive(), and an MPU-6050 gyro at
+1 kHz (65.5 LSB per deg/s, bias, white noise) read in FIFO bursts every 10 ms. The control loop
+runs every 12 ms with the latest burst. Each run stands still for the bias calibration, then
+drives at a constant speed: a step of the steering command, held, then a 0.5 Hz slalom.
+
+Reported per run, open loop (correction off) and closed loop: steady-state yaw-rate error of
+the step against the kinematic target, overshoot over its own steady state, RMS error over the
+slalom against the response of a neutral car (the kinematic target through the controller's
+reference), the largest correction, and the bias error after calibration. A speed error (the
+argument) scales the target, the steady-state error follows it; the bounds on the errors hold
+without one. Exit code 1 if the closed loop leaves a steady-state error above 2 % on a car that
+follows the kinematic model or makes its slalom worse by more than 1 deg/s, does not bring the
+steady-state error of the oversteering car below 10 % and its slalom error below the open
+loop's, overshoots by more than 25 %, or the bias is off by more than 0.05 deg/s.
+
+  vcu_host sim-yaw [speed error %] */
+
+#include <YAWRATE.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#define SIM_PHYSICS_US        1000      // also the gyro sample period
+#define SIM_BURST_US          10000     // IMU_BURST_MS
+#define SIM_CONTROL_US        12000     // VCU task period
+#define SIM_SERVO_TAU         0.06      // s
+#define SIM_YAW_TAU           0.08      // s, tire force build-up
+#define SIM_GYRO_LSB          65.5      // per deg/s
+#define SIM_GYRO_BIAS         1.7       // deg/s
+#define SIM_GYRO_NOISE        0.05      // deg/s rms per sample
+#define SIM_CALIBRATE_S       1.0
+#define SIM_STEP_S            2.5
+#define SIM_SLALOM_S          4.0
+
+static const STEERGEOMETRY simGeometry = {260, 2220, {256, 256}, 1};
+static const YAWCONFIG simConfig = {(1 << 0) | (1 << 3) | (1 << 6), 384, 1280, 500, 800, 6000, 140};  // yawConfig in IMU.h
+
+namespace {
+
+struct SIMCASE {
+  const char* name;
+  double speed;                         // m/s
+  double gradient;                      // s^2/m^2
+  int step;                             // servo degrees from center
+};
+
+struct SIMRESULT {
+  double steadyError;                   // share of the target
+  double overshoot;
+  double slalomRms;                     // deg/s
+  double correctionMax;                 // deg wheel angle
+  double biasError;                     // deg/s
+};
+
+}  // namespace
+
+static double simGauss() {
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static SIMRESULT simRun(const SIMCASE& c, bool closed, double speedError) {
+  YAWESTIMATE estimate;
+  YAWCONTROL control = YAWCONTROL();
+  yawEstimateReset(estimate);
+  yawControlReset(control);
+  YAWCONFIG config = simConfig;
+  if (!closed) config.modes = 0;
+
+  const double wheelbase = simGeometry.wheelbase / 1000.0;
+  double steer = 0, yaw = 0;            // rad, rad/s
+  int16_t samples[32];
+  uint16_t count = 0;
+  int32_t measured = 0;
+  int servo = 90;
+  int64_t lastControl = 0;
+
+  double stepTarget = 0, stepPeak = 0, stepSum = 0, slalomSum2 = 0, turnIn = 0, reference = 0;
+  int stepSamples = 0, slalomSamples = 0;
+  SIMRESULT r = SIMRESULT();
+
+  const double total = SIM_CALIBRATE_S + SIM_STEP_S + SIM_SLALOM_S;
+  for (int64_t t = 0; t < (int64_t)(total * 1e6); t += SIM_PHYSICS_US) {
+    double s = t / 1e6;
+    bool driving = s >= SIM_CALIBRATE_S;
+    double speed = driving ? c.speed : 0;
+
+    // gyro sample into the FIFO, a burst every 10 ms
+    double raw = (yaw * 180 / M_PI + SIM_GYRO_BIAS + SIM_GYRO_NOISE * simGauss()) * SIM_GYRO_LSB;
+    samples[count++] = (int16_t)lround(raw);
+    if (t % SIM_BURST_US == SIM_BURST_US - SIM_PHYSICS_US) {
+      measured = yawBurst(estimate, samples, count, !driving);
+      count = 0;
+    }
+
+    // control loop: command, correction, whole servo degrees
+    if (t - lastControl >= SIM_CONTROL_US || t == 0) {
+      uint32_t dt = t - lastControl;
+      lastControl = t;
+      double phase = s - SIM_CALIBRATE_S - SIM_STEP_S;
+      int command = 90;
+      if (driving && phase < 0) command = 90 + c.step;
+      else if (driving) command = 90 + (int)lround(c.step * sin(2 * M_PI * 0.5 * phase));
+
+      int32_t offset = (command - 90) * 100;
+      int32_t reported = (int32_t)lround(speed * 1000 * (1 + speedError));
+      int32_t correction = yawUpdate(control, config, simGeometry, yawWheelAngle(simGeometry, offset), reported,
+                                     measured, yawCalibrated(estimate) && (config.modes & 1), dt);
+      servo = 90 + steerCalDegrees(offset + yawServoOffset(simGeometry, correction));
+      servo = std::min(120, std::max(60, servo));
+      r.correctionMax = std::max(r.correctionMax, fabs(correction / 100.0));
+
+      // kinematic target of the command, what the driver asked for
+      double target = speed * tan((command - 90) * M_PI / 180) / wheelbase * 180 / M_PI;
+      double limit = simConfig.maxLateral / 1000.0 / std::max(speed, 0.1) * 180 / M_PI;
+      target = std::max(-limit, std::min(limit, target));
+      turnIn += (target - turnIn) * dt / (simConfig.responseMs * 500.0 + dt);
+      reference += (turnIn - reference) * dt / (simConfig.responseMs * 500.0 + dt);
+      double actual = yaw * 180 / M_PI;
+      if (driving && phase < 0) {
+        stepTarget = target;
+        stepPeak = std::max(stepPeak, fabs(actual));
+        if (phase > -0.5) {
+          stepSum += actual;
+          stepSamples++;
+        }
+      } else if (driving) {
+        slalomSum2 += (actual - reference) * (actual - reference);
+        slalomSamples++;
+      }
+    }
+
+    // servo and yaw response
+    double dt = SIM_PHYSICS_US / 1e6;
+    steer += ((servo - 90) * M_PI / 180 - steer) * dt / SIM_SERVO_TAU;
+    double settled = speed * tan(steer) / (wheelbase * (1 + c.gradient * speed * speed));
+    yaw += (settled - yaw) * dt / SIM_YAW_TAU;
+  }
+
+  double steady = stepSamples ? stepSum / stepSamples : 0;
+  r.steadyError = stepTarget != 0 ? (steady - stepTarget) / stepTarget : 0;
+  r.overshoot = steady != 0 ? std::max(0.0, stepPeak / fabs(steady) - 1) : 0;
+  r.slalomRms = slalomSamples ? sqrt(slalomSum2 / slalomSamples) : 0;
+  r.biasError = yawRate(estimate.bias) / 1000.0 - SIM_GYRO_BIAS;
+  return r;
+}
+
+
+//==================================================================================//
+
+int yawSim(int argc, char** argv) {
+  double speedError = argc >= 1 ? atof(argv[0]) / 100.0 : 0.0;
+  srand(5);
+
+  const SIMCASE cases[] = {
+    {"kinematic 1.5 m/s", 1.5, 0, 15},
+    {"kinematic 3 m/s", 3.0, 0, 6},
+    {"oversteer 3 m/s", 3.0, -0.04, 6},
+    {"oversteer 5 m/s", 5.0, -0.02, 3},
+    {"understeer 3 m/s", 3.0, 0.04, 6},
+    {"understeer 5 m/s", 5.0, 0.02, 3},
+  };
+
+  printf("yaw-rate feedback: gain P %.2f, I %.2f/s, max correction %.1f deg, speed error %.0f %%\n\n",
+         simConfig.gainP / 256.0, simConfig.gainI / 256.0, simConfig.maxCorrection / 100.0, speedError * 100);
+  printf("  %-20s %-7s %10s %10s %12s %10s %10s\n", "", "", "steady", "overshoot", "slalom rms", "max corr", "bias err");
+
+  bool pass = true;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const SIMCASE& c = cases[i];
+    SIMRESULT open = simRun(c, false, speedError);
+    SIMRESULT closed = simRun(c, true, speedError);
+
+    printf("  %-20s %-7s %9.1f%% %9.1f%% %8.2f d/s %6.2f deg %6.3f d/s\n", c.name, "open",
+           100 * open.steadyError, 100 * open.overshoot, open.slalomRms, open.correctionMax, open.biasError);
+    printf("  %-20s %-7s %9.1f%% %9.1f%% %8.2f d/s %6.2f deg %6.3f d/s\n", "", "closed",
+           100 * closed.steadyError, 100 * closed.overshoot, closed.slalomRms, closed.correctionMax, closed.biasError);
+
+    pass &= fabs(closed.biasError) <= 0.05 && closed.overshoot <= 0.25;
+    if (c.gradient == 0 && speedError == 0) {
+      pass &= fabs(closed.steadyError) < 0.02 && closed.slalomRms <= open.slalomRms + 1.0;
+    }
+    if (c.gradient < 0 && speedError == 0) pass &= fabs(closed.steadyError) < 0.10 && closed.slalomRms < open.slalomRms;
+  }
+
+  printf("\n%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
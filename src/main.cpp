@@ -9,23 +9,129 @@ to the original developers. This code is provided "as-is" without any warranties
 For any questions or inquiries, please contact https://github.com/schaefchenn or wnw164@haw-hamburg.de */
 
 #include <Arduino.h>
+#include <VCUCONFIG.h>
 #include <CANBUS.h>
+#include <CANROUTE.h>
+#if VCU_XBOX
 #include <XBOX.h>
-#include <MANEUVER.h>
-#include <FRYSKY.h>
+#endif
+#include <DIAGNOSTICS.h>
+#include <HANDOFF.h>
+#include <PURSUIT.h>
+#include <SETPOINT.h>
+#include <STEERCAL.h>
+#include <BOOT.h>
+
+#if VCU_SERIAL_LINK && DIAG_OUTPUT == DIAG_OUT_SERIAL
+#error "VCU_SERIAL_LINK: the serial port carries the link, send the diagnostics on CAN"
+#endif
+
+// received frames are logged on the serial port unless the link uses it
+#define LOG_FRAMES        (!VCU_SERIAL_LINK)
 
 // Core definitions (assuming you have dual-core ESP32)
 static const BaseType_t pro_cpu = 0; // protocol core
 static const BaseType_t app_cpu = 1; // application core
 
+// Task layout
+#define TASK_LAYOUT_SHARED  0   // CANBUS and VCU share the application core at equal priority
+#define TASK_LAYOUT_SPLIT   1   // CAN/RC ingestion and logging on the protocol core, control on the application core
+
+#ifndef VCU_TASK_LAYOUT
+#define VCU_TASK_LAYOUT TASK_LAYOUT_SPLIT
+#endif
+
+#if VCU_TASK_LAYOUT == TASK_LAYOUT_SPLIT
+static const BaseType_t comms_cpu = pro_cpu;
+static const UBaseType_t comms_priority = 2;
+static const BaseType_t control_cpu = app_cpu;
+static const UBaseType_t control_priority = 3;    // control preempts anything else on its core
+#else
+static const BaseType_t comms_cpu = app_cpu;
+static const UBaseType_t comms_priority = 2;
+static const BaseType_t control_cpu = app_cpu;
+static const UBaseType_t control_priority = 2;
+#endif
+
 // Initialize CPU cores
 TaskHandle_t Task1;
 TaskHandle_t Task2;
-
-SemaphoreHandle_t driveModeMutex;
-
-// Set CAN ID
-#define CANBUS_ID 0x15    // put your CAN ID here
+TaskHandle_t bootTask;    // setup(), waits for the receiver to be attached before sealing the heap
+
+// Task stacks, static with VCU_STATIC_ALLOC (STATICMEM.h)
+#define CANBUS_STACK_SIZE   8192
+#define VCU_STACK_SIZE      8192
+#define XBOX_STACK_SIZE     4096
+
+TASKMEMORY<CANBUS_STACK_SIZE> canbusTaskMemory;
+TASKMEMORY<VCU_STACK_SIZE> vcuTaskMemory;
+#if VCU_JOBS
+TASKMEMORY<JOBS_STACK_SIZE> jobsTaskMemory;             // battery and IMU jobs (JOBTASK.h)
+#else
+TASKMEMORY<BATTERY_STACK_SIZE> batteryTaskMemory;
+#endif
+#if VCU_XBOX
+TASKMEMORY<XBOX_STACK_SIZE> xboxTaskMemory;
+#endif
+#if VCU_YAW_CONTROL && !VCU_JOBS
+TASKMEMORY<IMU_STACK_SIZE> imuTaskMemory;
+#endif
+
+// Cross task handoff, never blocks either side
+Handoff<CANCOMMAND> canCommand;                         // CANBUS -> VCU
+#if VCU_RX != RX_NONE
+Handoff<FRYSKY> rcInput(FRYSKY{90, 1500, 0});           // CANBUS -> VCU
+#endif
+Handoff<CANTELEMETRY> canTelemetry;                     // VCU -> CANBUS
+#if VCU_SERIAL_LINK
+Handoff<CANTELEMETRY> linkTelemetry;                    // VCU -> CANBUS, status frame on the serial link
+#endif
+Handoff<PATH> pathInput;                                // CANBUS -> VCU
+Handoff<STEERCAL> steerCalInput;                        // CANBUS -> VCU
+
+// Receiver, outputs, CAN ID and Xbox support come from the build environment (VCUCONFIG.h)
+typedef Vcu::Receiver Receiver;
+typedef Vcu::Output Output;
+
+// CAN controller state, the VCU keeps running without CAN; the CANBUS task recovers it from
+// bus-off and restarts it (CANHEALTH.h)
+bool canUp = false;
+#if VCU_CAN_TT
+bool ttReady = false;     // schedule valid and slot timer created (TTNODE.h)
+#endif
+
+#if VCU_CLOCK_SYNC
+// master timebase (CLOCKSYNC.h), owned by the CANBUS task
+CLOCKSYNC canClock;
+CLOCKPENDING clockPending;
+#if VCU_CAN_TT
+Handoff<CLOCKSYNC> clockShared;                         // CANBUS -> status slot timer
+#endif
+CLOCKLATENCY commandLatency;                            // VCU task, read out with the diagnostics
+portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+#define ROUTE_CLOCK       (&canClock)   // command ages in canRoute()
+#else
+#define ROUTE_CLOCK       NULL
+#endif
+
+// Diagnostics task slots
+#define DIAG_TASK_CANBUS  0
+#define DIAG_TASK_VCU     1
+#define DIAG_TASK_JOBS    2
+
+// records one diagnostics window queues at once: task and jitter per task slot, heap, memory,
+// TT, wake-up, CAN health and errors, boot, then what the build adds
+#if VCU_JOBS
+#define DIAG_JOB_RECORDS  JOBS_MAX
+#else
+#define DIAG_JOB_RECORDS  0
+#endif
+#define DIAG_WINDOW_RECORDS (2 * DIAG_MAX_TASKS + 7 + VCU_CLOCK_SYNC + VCU_POWER_SAVE + VCU_YAW_CONTROL + VCU_ESTOP + \
+                             DIAG_JOB_RECORDS + (VCU_RX != RX_NONE ? 3 : 0) + (VCU_RX2 != RX_NONE ? 1 : 0))
+#if VCU_CAN_TT && DIAG_OUTPUT == DIAG_OUT_CAN
+// the queue slots drain one frame per cycle, a window must fit the transmit queue whole
+static_assert(DIAG_WINDOW_RECORDS < TT_TX_QUEUE, "TT_TX_QUEUE too small for a diagnostics window");
+#endif
 
 // CAN send values
 int8_t driveMode = 2;     // 1 = XBOX Controller; 0 = CANBUS Drive Input
@@ -37,82 +143,424 @@ int8_t acknowledged;
 
 // CAN recieve values
 uint8_t canDMODE;
-int16_t canTHROTTLE;
-uint8_t canSTEERING;
+int16_t canTHROTTLE = 1500;   // neutral until the first command
+uint8_t canSTEERING = 90;
+int16_t canCURVATURE;         // 1/km, drive mode 6
+int64_t canCommandAt;         // local us the last command was received
 int16_t canVOLTAGE;
 int8_t canVELOCITY;
 int8_t canACKNOWLEDGED;
 
+// Onboard path tracking (drive mode 4): CAN throttle, steering from pure pursuit
+#define PATH_STEER_DIRECTION    1     // -1 if steering left means servo angles below center
+#define SPEED_PER_THROTTLE_US   15    // mm/s per us above neutral, estimate while the output measures no speed
+
+const PURSUITCONFIG pursuitConfig = {
+  260,      // wheelbase mm
+  300,      // lookahead at standstill mm
+  300,      // lookahead mm per m/s
+  250,      // min lookahead mm
+  1500,     // max lookahead mm
+  37256,    // max curvature Q24 1/mm: tan(30 deg) / 260 mm
+  150       // goal tolerance mm
+};
+
+PURSUITSTATE pursuit;
+int32_t vehicleSpeed;     // mm/s
+PATH pathBuilding;        // CANBUS side of the path reception
+PATH pathLatest;
+
+// Curvature steering (drive mode 6): built-in table from the geometry, replaced by CAN calibration frames
+const STEERGEOMETRY steerGeometry = {
+  260,              // wheelbase mm
+  2220,             // steering limit 1/km: tan(30 deg) / 260 mm
+  {256, 256},       // servo degrees per wheel degree Q8, left / right
+  PATH_STEER_DIRECTION
+};
+
+STEERCAL steerCalLatest;  // CANBUS side, the table in use
+STEERCALRX steerCalRx;
+
+// Streamed trajectory (drive mode 5): setpoints queued by the CANBUS task, played back by VCU
+SETPOINTQUEUE setpoints;
+SETPOINTRX setpointRx;    // CANBUS side
+SETPOINTPLAYER setpointPlayer;
+
+// where the CANBUS task hands received frames over (CANROUTE.h)
+CANROUTES canRoutes = {Vcu::canId, &canCommand, &pathBuilding, &pathLatest, &pathInput, ROUTE_CLOCK, &setpoints,
+                       &setpointRx, &steerCalLatest, &steerCalRx, &steerCalInput};
+
+// Static RAM per subsystem, checked against the budget here and printed at boot
+constexpr MEMBLOCK memBlocks[] = {
+  {"CANBUS task", TASKMEMORY<CANBUS_STACK_SIZE>::bytes},
+  {"VCU task", TASKMEMORY<VCU_STACK_SIZE>::bytes},
+#if VCU_JOBS
+  {"JOBS task", TASKMEMORY<JOBS_STACK_SIZE>::bytes},
+  {"job scheduler", jobsStaticBytes},
+#else
+  {"BATTERY task", TASKMEMORY<BATTERY_STACK_SIZE>::bytes},
+#endif
+#if VCU_XBOX
+  {"Xbox task", TASKMEMORY<XBOX_STACK_SIZE>::bytes},
+#endif
+#if VCU_YAW_CONTROL
+#if !VCU_JOBS
+  {"IMU task", TASKMEMORY<IMU_STACK_SIZE>::bytes},
+#endif
+  {"yaw-rate feedback", imuStaticBytes + yawStaticBytes},
+#endif
+#if VCU_RX != RX_NONE
+  {"radio receiver", Receiver::staticBytes + sizeof(rcInput)},
+  {"RC filters", 2 * sizeof(RCFILTERSTATE)},
+  {"RC link quality", sizeof(RCLINKSTATS)},
+#endif
+  {"outputs", Output::staticBytes},
+  {"battery voltage", batteryStaticBytes},
+  {"CAN handoffs", sizeof(canCommand) + sizeof(canTelemetry)},
+  {"path tracking", sizeof(pathInput) + sizeof(pathBuilding) + sizeof(pathLatest) + sizeof(pursuit)},
+  {"setpoint queue", sizeof(setpoints) + sizeof(setpointRx) + sizeof(setpointPlayer)},
+  {"steering table", sizeof(steerCalInput) + sizeof(steerCalLatest) + sizeof(steerCalRx)},
+  {"diagnostics", sizeof(_diag_tasks) + sizeof(_mem_seal) + wakeStaticBytes},
+  {"CAN health", canMonitorStaticBytes},
+#if VCU_POWER_SAVE
+  {"power management", powerStaticBytes},
+#endif
+#if VCU_ESTOP
+  {"emergency stop", estopStaticBytes},
+#endif
+#if CAN_RX_ISR
+  {"CAN receive ring", canRxStaticBytes},
+#endif
+#if VCU_CAN_TT
+  {"CAN schedule", ttStaticBytes},
+#endif
+#if VCU_SERIAL_LINK
+  {"serial link", linkStaticBytes + sizeof(linkTelemetry)},
+#endif
+#if VCU_CLOCK_SYNC
+  {"clock sync", sizeof(canClock) + sizeof(clockPending) + sizeof(commandLatency)},
+#endif
+};
+const size_t memBlockCount = sizeof(memBlocks) / sizeof(memBlocks[0]);
+
+static_assert(memTotal(memBlocks, memBlockCount) <= VCU_STATIC_RAM_BUDGET, "static RAM over VCU_STATIC_RAM_BUDGET");
+static_assert(sizeof(pathInput) <= 3 * sizeof(PATH) + 8, "path handoff larger than its three slots");
+
 
 
 //==================================================================================//
 
-void CANBUS (void * pvParameters) {
-  while (1){
-    CANRECIEVER msg = canReceiver();
+// control task: hands the status frame over together with the time the sample was taken
+void publishTelemetry(CANTELEMETRY telemetry) {
+  telemetry.at = esp_timer_get_time();
+  canTelemetry.publish(telemetry);
+#if VCU_SERIAL_LINK
+  linkTelemetry.publish(telemetry);
+#endif
+}
 
-    if (msg.recieved) {
-      Serial.print("recieved");
-      Serial.print("\tid: 0x");
-      Serial.print(msg.id, HEX);
+#if VCU_CAN_TT
+// status slot: latest telemetry of the control task, repeated every cycle once there is any
+bool ttStatusFrame(uint8_t data[8], uint32_t& id) {
+  static bool valid = false;
+  valid |= canTelemetry.update();
+  const CANTELEMETRY& t = canTelemetry.read();
+  canPack(data, t.driveMode, t.throttle, t.steeringAngle, t.voltage, t.velocity, t.acknowledged);
+#if VCU_CLOCK_SYNC
+  clockShared.update();
+  const CLOCKSYNC& clock = clockShared.read();
+  if (clock.state >= CLOCK_TRACKING && t.at) id = clockStampedId(Vcu::canId, clockStamp(clock, t.at));
+#endif
+  return valid;
+}
+#endif
+
+// controller up, frames time stamped in the receive interrupt where sync depends on it
+bool canStart() {
+#if VCU_CAN_TT
+  if (!ttReady) return false;
+#endif
+  if (!setupCANBUS()) return false;
+#if VCU_ESTOP
+  canRxBegin(xTaskGetCurrentTaskHandle(), Output::receive);
+#elif CAN_RX_ISR
+  canRxBegin(xTaskGetCurrentTaskHandle());
+#endif
+  return true;
+}
 
-      if (msg.extended) {
-        Serial.print("\textended");
-      }
+CANRECIEVER canReceive() {
+#if CAN_RX_ISR
+  CANRECIEVER msg = canRxReceiver();
+#else
+  CANRECIEVER msg = canReceiver();
+#endif
+
+#if VCU_CAN_TT
+  if (msg.recieved && ttReceive(msg)) msg.recieved = false;
+#endif
+#if VCU_CLOCK_SYNC
+  if (msg.recieved && clockReceive(canClock, clockPending, msg)) {
+    msg.recieved = false;
+#if VCU_CAN_TT
+    clockShared.publish(canClock);
+#endif
+  } else if (msg.recieved) {
+    clockUnstamp(msg);
+  }
+#endif
+  return msg;
+}
 
-      if (CAN.packetRtr()) {
-        Serial.print("\trtr");
-        Serial.print("\trequested length: ");
-        Serial.print(msg.reqLength);
+void CANBUS (void * pvParameters) {
+  // inputs come up here, in parallel with the control task already holding the actuators at neutral
+#if VCU_CAN_TT
+  ttReady = ttBegin(Vcu::canId, ttStatusFrame);
+#endif
+  canHealthReset(_can_health);
+  canUp = canStart();
+  bootMark(BOOT_CAN, canUp ? BOOT_OK : BOOT_DEGRADED);
+
+#if VCU_RX != RX_NONE
+  // attach the receiver here so the PPM interrupt is serviced on the comms core
+  setupFRYSKY<Receiver>();
+#if VCU_EVENT_DRIVEN
+  Receiver::notify(xTaskGetCurrentTaskHandle());
+#endif
+  bootMark(BOOT_RECEIVER, BOOT_OK);
+  int64_t rcPublishedAt = 0;
+#else
+  bootMark(BOOT_RECEIVER, BOOT_SKIPPED);
+#endif
+#if VCU_SERIAL_LINK
+  linkAttach(xTaskGetCurrentTaskHandle());
+  int64_t linkStatsAt = 0;
+#endif
+  xTaskNotifyGive(bootTask);    // init done on this core
 
-      } else {
+  while (1){
+    diagLoopBegin(DIAG_TASK_CANBUS);
+
+#if VCU_RX != RX_NONE
+    // radio receiver ingestion, the control task is woken for a new frame or the switch to failsafe
+    FRYSKY rc = getData<Receiver>();
+    rcInput.publish(rc);
+    if (rc.at != rcPublishedAt) {
+      rcPublishedAt = rc.at;
+      wakeControl(WAKE_RC);
+    }
+#endif
+
+    // controller health: bus-off recovery, restarts with backoff while it does not come back
+    uint8_t canAction = canHealthUpdate(_can_health, canSample(canUp), esp_timer_get_time());
+    if (canAction == CAN_ACTION_RECOVER) {
+      canRecover();
+    } else if (canAction == CAN_ACTION_REINIT) {
+      CAN.end();
+      canUp = canStart();
+    }
+    canMonitorPublish();
+    bool canLive = canUp && canHealthTransmit(_can_health);
 
-        if (xSemaphoreTake(driveModeMutex, portMAX_DELAY) == pdTRUE) { 
-          driveMode = msg.driveMode;                     // Critical section
-          xSemaphoreGive(driveModeMutex);           // Give mutex after critical section
-          vTaskDelay(10 / portTICK_PERIOD_MS);      // Small delay after critical section to yield
-        }
+    CANRECIEVER msg = canLive ? canReceive() : CANRECIEVER{};
+#if VCU_SERIAL_LINK
+    // companion computer frames take the same path, also while CAN is down
+    if (!msg.recieved) msg = linkReceive();
+#endif
+
+    if (msg.recieved) {
+      uint8_t route = canRoute(canRoutes, msg);
+      if (route == CAN_ROUTE_COMMAND) wakeControl(WAKE_CAN);
+      if (LOG_FRAMES) canRouteLog(canRoutes, msg, route);
+    }
 
-        canTHROTTLE = msg.throttle;
-        canSTEERING = msg.steeringAngle;
-
-        Serial.print("\tlength: ");
-        Serial.print(msg.length);
-        Serial.print("\tdrive mode: ");
-        Serial.print(msg.driveMode);
-        Serial.print("\tthrottle: ");
-        Serial.print(msg.throttle);
-        Serial.print("\tsteering angle: ");
-        Serial.print(msg.steeringAngle);
-        Serial.print("\tvoltage: ");
-        Serial.print(msg.voltage);
-        Serial.print("\tvelocity: ");
-        Serial.print(msg.velocity);
-        Serial.print("\tacknowledged: ");
-        Serial.print(msg.acknowledged);
-        Serial.println();
+#if VCU_SERIAL_LINK
+    // status frame and link statistics back to the companion computer
+    if (linkTelemetry.update()) {
+      const CANTELEMETRY& t = linkTelemetry.read();
+      uint8_t data[8];
+      canPack(data, t.driveMode, t.throttle, t.steeringAngle, t.voltage, t.velocity, t.acknowledged);
+      linkSend(Vcu::canId, data, 8);
+    }
+    if (esp_timer_get_time() >= linkStatsAt) {
+      linkSendStats();
+      linkStatsAt = esp_timer_get_time() + LINK_STATS_MS * 1000LL;
+    }
+#endif
+
+#if !VCU_CAN_TT
+    // status frame handed over by the control task (time-triggered: sent from the status slot)
+    if (canTelemetry.update() && canLive) {
+      const CANTELEMETRY& t = canTelemetry.read();
+      int id = Vcu::canId;
+#if VCU_CLOCK_SYNC
+      if (canClock.state >= CLOCK_TRACKING) id = clockStampedId(Vcu::canId, clockStamp(canClock, t.at));
+#endif
+      canSender(id, t.driveMode, t.throttle, t.steeringAngle, t.voltage, t.velocity, t.acknowledged);
+    }
+#endif
+
+    if ((canLive || DIAG_OUTPUT == DIAG_OUT_SERIAL) && publishDiagnostics(DIAG_CAN_BASE + Vcu::canId)) {
+#if VCU_CLOCK_SYNC
+      // clock state and the command latency of the window that just closed
+      portENTER_CRITICAL(&clockMux);
+      CLOCKLATENCY latency = commandLatency;
+      commandLatency = CLOCKLATENCY();
+      portEXIT_CRITICAL(&clockMux);
+
+      uint8_t record[8];
+      clockRecord(record, DIAG_RECORD_CLOCK, canClock, latency);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, record);
+#endif
+      uint8_t wakeup[8];
+      wakeRecord(wakeup, DIAG_RECORD_WAKE);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, wakeup);
+
+      // controller error state with the last outage, then the errors of the window
+      uint8_t health[8];
+      canHealthRecord(health, DIAG_RECORD_CAN, _can_health, esp_timer_get_time());
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, health);
+      canHealthErrorRecord(health, DIAG_RECORD_CAN_ERRORS, _can_health);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, health);
+#if VCU_POWER_SAVE
+      uint8_t power[8];
+      powerDiagRecord(power, DIAG_RECORD_POWER);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, power);
+#endif
+#if VCU_YAW_CONTROL
+      uint8_t yaw[8];
+      yawDiagRecord(yaw, DIAG_RECORD_YAW);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, yaw);
+#endif
+#if VCU_ESTOP
+      uint8_t estop[8];
+      estopDiagRecord(estop, DIAG_RECORD_ESTOP);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, estop);
+#endif
+#if VCU_JOBS
+      // the cooperative jobs' window before, then the report job closes this one
+      uint8_t jobs[JOBS_MAX][8];
+      uint8_t jobCount = jobsDiagRecords(jobs, DIAG_RECORD_JOB);
+      for (uint8_t i = 0; i < jobCount; i++) diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, jobs[i]);
+#endif
+#if VCU_RX != RX_NONE
+      // receiver link quality, then the inter-frame gaps of the window
+      uint8_t link[8];
+      rcLinkRecord(link, DIAG_RECORD_RC_LINK, _rx_link, esp_timer_get_time());
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, link);
+      for (uint8_t part = 0; part < 2; part++) {
+        rcLinkGapRecord(link, DIAG_RECORD_RC_GAPS, _rx_link, part);
+        diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, link);
       }
+#endif
+#if VCU_RX2 != RX_NONE
+      rxDivRecord(link, DIAG_RECORD_RC_DIVERSITY, Receiver::state);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, link);
+#endif
+    }
+
+    // boot stage report, once every stage is through
+    if (bootReport() && (canLive || DIAG_OUTPUT == DIAG_OUT_SERIAL)) {
+      uint8_t record[8];
+      bootRecord(record, DIAG_RECORD_BOOT);
+      diagWriteRecord(DIAG_CAN_BASE + Vcu::canId, record);
     }
 
+    diagLoopEnd(DIAG_TASK_CANBUS);
+
+#if VCU_SERIAL_LINK
+    // more link frames already buffered: go round again straight away
+    if (linkPending()) xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+#endif
+#if VCU_EVENT_DRIVEN
+    // woken per CAN, link or receiver frame, the timeout keeps the receiver failsafe and diagnostics going
+#if VCU_POWER_SAVE
+    // parked: nothing to time out, the wake-up interrupt brings the inputs back
+    ulTaskNotifyTake(pdFALSE, (powerParked() ? POWER_PARKED_TIMEOUT_MS : WAKE_INPUT_TIMEOUT_MS) / portTICK_PERIOD_MS);
+#else
+    ulTaskNotifyTake(pdFALSE, WAKE_INPUT_TIMEOUT_MS / portTICK_PERIOD_MS);
+#endif
+#elif CAN_RX_ISR || VCU_SERIAL_LINK
+    // woken per received frame, the receiver is still polled every 5 ms
+    ulTaskNotifyTake(pdFALSE, 5 / portTICK_PERIOD_MS);
+#else
     // yield
     vTaskDelay(5 / portTICK_PERIOD_MS);
+#endif
   }
 }
 
 
 
 void VCU (void * pvParameters){
+  wakeAttachControl(xTaskGetCurrentTaskHandle());
+#if VCU_RX != RX_NONE
+  int64_t rcAppliedAt = 0;
+#endif
+#if VCU_POWER_SAVE && VCU_RX != RX_NONE
+  int64_t rcSeenAt = 0;
+#endif
+
   while(1){
-    
+    diagLoopBegin(DIAG_TASK_VCU);
+
+    int64_t commandAt = 0;    // fresh CAN command this loop
+    if (canCommand.update()) {
+      const CANCOMMAND& command = canCommand.read();
+      commandAt = command.at;
+      canCommandAt = command.at;
+      driveMode = command.driveMode;
+      canTHROTTLE = command.throttle;
+      canSTEERING = command.steeringAngle;
+      canCURVATURE = command.curvature;
+
+#if VCU_CLOCK_SYNC
+      // one way latency from the master's stamp to here, where the command takes effect
+      if (command.stamped) {
+        int32_t applyAge = command.age + (int32_t)(esp_timer_get_time() - command.at);
+        portENTER_CRITICAL(&clockMux);
+        clockLatency(commandLatency, command.age, applyAge);
+        portEXIT_CRITICAL(&clockMux);
+      }
+#endif
+    }
+
+#if VCU_EVENT_DRIVEN
+    // no command within the timeout: the master is gone, neutral throttle until the next one
+    if (canCommandAt && esp_timer_get_time() - canCommandAt > WAKE_COMMAND_TIMEOUT_MS * 1000LL) {
+      canTHROTTLE = 1500;
+    }
+#endif
+
+#if VCU_YAW_CONTROL
+    // yaw-rate feedback on the steering writes of this loop, in the drive modes configured for it
+    yawMode(driveMode);
+#endif
+
+    // controller off the bus: the modes it commands hold the failsafe throttle until it is back
+    // and a new command arrives (the serial link carries the commands as well)
+    bool canDown = !VCU_SERIAL_LINK && canMonitorDown();
+    if (canDown) canTHROTTLE = CAN_DOWN_THROTTLE;
+
+    // inputs read, the actuators get commanded below
+    bootMark(BOOT_CONTROL, BOOT_OK);
+
+    // speed measured by the output (DShot eRPM), the status frame carries it in 0.1 m/s
+    int32_t measuredSpeed;
+    bool measured = Output::speed(measuredSpeed);
+    if (measured) vehicleSpeed = measuredSpeed;
+    velocity = measured ? constrain(measuredSpeed / 100, -127, 127) : 0;
+
     switch (driveMode){
       case 0: {
         // Initialize MANEUVER inside a block to avoid the jump error
         throttle = canTHROTTLE;
         steeringAngle = canSTEERING;
-        MANEUVER maneuver = drive(throttle, steeringAngle);
+        MANEUVER maneuver = drive<Output>(throttle, steeringAngle);
+        wakeApplied(commandAt);
         break;  // Exit the switch statement
       }
-      /*
+#if VCU_XBOX
       case 1: {
         // Initialize XBOX inside a block to avoid the jump error
         XBOX xboxData = getXboxData();
@@ -121,114 +569,263 @@ void VCU (void * pvParameters){
           throttle = map(xboxData.rightTrigger - xboxData.leftTrigger, -1023, 1023, 1000, 2000);
           steeringAngle = map(xboxData.joyLHoriValue, 0, 65535, 0 + steeringOffset, 180 - steeringOffset);
           if(xboxData.buttonA == 1){
-            canSender(CANBUS_ID, 1, throttle, steeringAngle, 1029, 40, 1);
+            publishTelemetry(CANTELEMETRY{1, throttle, steeringAngle, batteryVoltage(), 40, 1});
             vTaskDelay(100 / portTICK_PERIOD_MS); // debounce delay
           } else {
-            MANEUVER maneuver = drive(throttle, steeringAngle);
-            canSender(CANBUS_ID, 1, throttle, maneuver.steeringAngle, 1029, 30, 0);
+            MANEUVER maneuver = drive<Output>(throttle, steeringAngle);
+            publishTelemetry(CANTELEMETRY{1, throttle, maneuver.steeringAngle, batteryVoltage(), 30, 0});
           }
+        } else {
+          // controller lost: hold the car at neutral
+          drive<Output>(1500, centerSteeringAngle);
         }
-        */
+        break;  // Exit the switch statement
+      }
+#endif
+
 
         case 2: {
           vTaskDelay(5000 / portTICK_PERIOD_MS);
           steeringAngle = 90; // steeringOffset;
           throttle = 1500;
-          MANEUVER maneuver = drive(throttle, steeringAngle);
+          MANEUVER maneuver = drive<Output>(throttle, steeringAngle);
           vTaskDelay(10000 / portTICK_PERIOD_MS);
           steeringAngle = 90; // steeringOffset;
           throttle = 1600;
-          maneuver = drive(throttle, steeringAngle);
+          maneuver = drive<Output>(throttle, steeringAngle);
           vTaskDelay(1000 / portTICK_PERIOD_MS);
 
           steeringAngle = 60; // steeringOffset;
-          maneuver = drive(throttle, steeringAngle); // + steering offset
+          maneuver = drive<Output>(throttle, steeringAngle); // + steering offset
           vTaskDelay(400 / portTICK_PERIOD_MS);
           steeringAngle = 120; // steeringOffset;
-          maneuver = drive(throttle, steeringAngle); // + steering offset
+          maneuver = drive<Output>(throttle, steeringAngle); // + steering offset
           vTaskDelay(400 / portTICK_PERIOD_MS);
 
           steeringAngle = 90; // steeringOffset;
-          maneuver = drive(throttle, steeringAngle);
+          maneuver = drive<Output>(throttle, steeringAngle);
           vTaskDelay(300 / portTICK_PERIOD_MS);
 
           steeringAngle = 120; // steeringOffset;
-          maneuver = drive(throttle, steeringAngle); // + steering offset
+          maneuver = drive<Output>(throttle, steeringAngle); // + steering offset
           vTaskDelay(400 / portTICK_PERIOD_MS);
 
           steeringAngle = 60; // steeringOffset;
-          maneuver = drive(throttle, steeringAngle); // + steering offset
+          maneuver = drive<Output>(throttle, steeringAngle); // + steering offset
           vTaskDelay(400 / portTICK_PERIOD_MS);
 
           steeringAngle = 90; // steeringOffset;
-          maneuver = drive(throttle, steeringAngle);
+          maneuver = drive<Output>(throttle, steeringAngle);
           vTaskDelay(300 / portTICK_PERIOD_MS);
           throttle = 1000;
-          maneuver = drive(throttle, steeringAngle);
+          maneuver = drive<Output>(throttle, steeringAngle);
           vTaskDelay(300 / portTICK_PERIOD_MS);
           throttle = 1500;
-          maneuver = drive(throttle, steeringAngle);
+          maneuver = drive<Output>(throttle, steeringAngle);
           vTaskDelay(5000 / portTICK_PERIOD_MS);
           driveMode = 0;
         }
 
         break;  // Exit the switch statement
 
+#if VCU_RX != RX_NONE
       case 3: {
-        FRYSKY frysky = getData();
+        rcInput.update();
+        FRYSKY frysky = rcInput.read();
         //Serial.printf("throttle: %d, steering: %d\n", frysky.throttle, frysky.steeringAngle);
 
-        MANEUVER maneuver = drive(frysky.throttle, frysky.steeringAngle);
-        canSender(CANBUS_ID, 2, frysky.throttle, maneuver.steeringAngle, 1680, 00, 0);
+        MANEUVER maneuver = drive<Output>(frysky.throttle, frysky.steeringAngle);
+        if (frysky.at != rcAppliedAt) {
+          rcAppliedAt = frysky.at;
+          wakeApplied(frysky.at);
+        }
+        publishTelemetry(CANTELEMETRY{2, (int16_t)frysky.throttle, maneuver.steeringAngle, batteryVoltage(), velocity, 0});
 
         break;  // Exit the switch statement
       }
-    }
+#endif
 
-    vTaskDelay(12 / portTICK_PERIOD_MS);
-  }
-}
+      case 4: {
+        static int64_t lastStep;
+        int64_t now = esp_timer_get_time();
 
+        if (pathInput.update()) {
+          pursuitStart(pursuit);
+        } else if (pursuit.active) {
+          pursuitPredict(pursuit, vehicleSpeed, now - lastStep);
+        }
+        lastStep = now;
 
+        int32_t curvature = pursuitUpdate(pursuit, pursuitConfig, pathInput.read(), vehicleSpeed);
+        int32_t wheelAngle = pursuitWheelAngle(pursuitConfig, curvature) / 100;
 
-//==================================================================================//
+        throttle = (pursuit.active && !pursuit.done) ? canTHROTTLE : 1500;
+        steeringAngle = constrain(centerSteeringAngle + PATH_STEER_DIRECTION * wheelAngle,
+                                  centerSteeringAngle - steeringOffset, centerSteeringAngle + steeringOffset);
+        MANEUVER maneuver = drive<Output>(throttle, steeringAngle);
+        pursuitApply(pursuit, pursuitConfig, PATH_STEER_DIRECTION * (maneuver.steeringAngle - centerSteeringAngle) * 100);
+        if (!measured) vehicleSpeed = (throttle - 1500) * SPEED_PER_THROTTLE_US;
 
-void setup() {
-  // Initialize serial communication at 115200 baud rate
-  Serial.begin(115200);
-  while (!Serial);
+        publishTelemetry(CANTELEMETRY{4, throttle, maneuver.steeringAngle, batteryVoltage(), velocity, pursuit.done});
+        break;  // Exit the switch statement
+      }
 
-  // initialize maneuverability
-  setupMANEUVER();
+      case 5: {
+        // streamed trajectory, interpolated at this loop's rate; before the first setpoint the
+        // last output is held (neutral when the mode starts)
+        uint8_t state = setpointSample(setpoints, setpointPlayer, esp_timer_get_time());
+        throttle = canDown ? CAN_DOWN_THROTTLE : setpointPlayer.throttle;
+        steeringAngle = constrain(setpointPlayer.steeringAngle, centerSteeringAngle - steeringOffset,
+                                  centerSteeringAngle + steeringOffset);
+        MANEUVER maneuver = drive<Output>(throttle, steeringAngle);
 
-  // Wait a moment to start (so we don't miss Serial output)
-  vTaskDelay(2000 / portTICK_PERIOD_MS);
+        publishTelemetry(CANTELEMETRY{5, throttle, maneuver.steeringAngle, batteryVoltage(), velocity, (int8_t)state});
+        break;  // Exit the switch statement
+      }
+
+      case 6: {
+        // CAN throttle, curvature to servo angle through the steering table
+        steerCalInput.update();
+        bool saturated;
+        int32_t offset = steerCalServo(steerCalInput.read(), canCURVATURE, saturated);
+        throttle = canTHROTTLE;
+        steeringAngle = constrain(centerSteeringAngle + steerCalDegrees(offset),
+                                  centerSteeringAngle - steeringOffset, centerSteeringAngle + steeringOffset);
+        MANEUVER maneuver = drive<Output>(throttle, steeringAngle);
+        wakeApplied(commandAt);
+
+        publishTelemetry(CANTELEMETRY{6, throttle, maneuver.steeringAngle, batteryVoltage(), velocity, saturated});
+        break;  // Exit the switch statement
+      }
+    }
 
-  // Setup CAN communication and ECU Components
-  //setupXBOX();
-  setupCANBUS();
-  setupFRYSKY();
+#if VCU_POWER_SAVE
+    // power level from what was just written and the newest input of any source, in any mode
+    int64_t inputAt = commandAt;
+#if VCU_RX != RX_NONE
+    rcInput.update();
+    int64_t rcAt = rcInput.read().at;
+    if (rcAt != rcSeenAt) {
+      rcSeenAt = rcAt;
+      if (rcAt > inputAt) inputAt = rcAt;
+    }
+#endif
+    powerControl<Receiver>(inputAt);
+#endif
+
+    diagLoopEnd(DIAG_TASK_VCU);
+
+    // modes that follow a command run once per fresh input, the others keep their 12 ms period
+    bool inputDriven = VCU_EVENT_DRIVEN && (driveMode == 0 || driveMode == 3 || driveMode == 6);
+#if VCU_POWER_SAVE
+    // parked: only the wake-up interrupt or an input ends the wait early
+    if (powerParked()) wakeWait(true, POWER_PARKED_TIMEOUT_MS);
+    else
+#endif
+    wakeWait(inputDriven, inputDriven ? WAKE_CONTROL_TIMEOUT_MS : 12);
+  }
+}
 
 
-  driveModeMutex = xSemaphoreCreateMutex();
 
-  // Start CANcommunication (priority set to 1, 0 is the lowest priority)
-  xTaskCreatePinnedToCore(CANBUS,                                       // Function to be called
-                          "Controller Area Network Message Recieving",  // Name of task
-                          8192,                                         // Increased stack size
-                          NULL,                                         // Parameter to pass to function
-                          2,                                            // Increased priority
-                          NULL,                                         // Task handle
-                          app_cpu);
+//==================================================================================//
+
+void setup() {
+  // Initialize serial communication at VCU_SERIAL_BAUD, no waiting for a monitor
+#if VCU_SERIAL_LINK
+  linkBegin(VCU_SERIAL_BAUD);
+#else
+  Serial.begin(VCU_SERIAL_BAUD);
+#endif
+
+  // actuators first: steering centered and motor at neutral before anything else runs
+  setupMANEUVER<Output>();
+  bootMark(BOOT_ACTUATORS, BOOT_OK);
+
+  setupDIAGNOSTICS();
+  setpointBegin(setpoints, setpointRx, setpointPlayer);
+  steerCalDefault(steerCalLatest, steerGeometry);
+  steerCalRxBegin(steerCalRx, steerCalLatest);
+  steerCalInput.publish(steerCalLatest);
+
+#if VCU_POWER_SAVE
+  // PM locks allocated before the heap gets sealed; without power management the clock stays at max
+  powerBegin();
+#endif
+
+#if VCU_YAW_CONTROL
+  // I2C driver up before the heap gets sealed; without an IMU the task keeps looking for it
+  imuBegin(steerGeometry, SPEED_PER_THROTTLE_US);
+#endif
+
+  // battery ADC sampling by DMA, the driver allocates its buffers before the heap gets sealed
+  bool batteryUp = batteryBegin();
+  if (!batteryUp) Serial.println("Battery ADC setup failed, voltage reported as 0");
+
+  bootTask = xTaskGetCurrentTaskHandle();
+
+  // Start CANcommunication and radio receiver ingestion
+  Task1 = memCreateTask(CANBUS,                                         // Function to be called
+                        "Controller Area Network Message Recieving",    // Name of task
+                        canbusTaskMemory,                               // Stack, static or from the heap
+                        comms_priority,                                 // Priority from task layout
+                        comms_cpu);
 
   // Start CANcommunication (priority set to 1, 0 is the lowest priority)
-  xTaskCreatePinnedToCore(VCU,                                          // Function to be called
-                          "Electromic Controll Unit Functionality",     // Name of task
-                          8192,                                         // Increased stack size
-                          NULL,                                         // Parameter to pass to function
-                          2,                                            // Increased priority
-                          NULL,                                         // Task handle
-                          app_cpu);                                     // Assign to protocol core  
+  Task2 = memCreateTask(VCU,                                            // Function to be called
+                        "Electromic Controll Unit Functionality",       // Name of task
+                        vcuTaskMemory,                                  // Stack, static or from the heap
+                        control_priority,                               // Priority from task layout
+                        control_cpu);                                   // Core from task layout
+
+#if VCU_JOBS
+  // battery and IMU as cooperative jobs, one stack; on the control core where only the control task outranks it
+  jobsBegin(batteryUp);
+  _jobs_task = memCreateTask(JOBS,                                      // Function to be called
+                             "Cooperative Jobs",                        // Name of task
+                             jobsTaskMemory,                            // Stack
+                             control_priority - 1,                      // Below the control task
+                             control_cpu);
+#else
+  if (batteryUp) {
+    // wakes once per DMA block, well below the CAN task
+    memCreateTask(BATTERY,                                              // Function to be called
+                  "Battery Voltage",                                    // Name of task
+                  batteryTaskMemory,                                    // Stack
+                  1,                                                    // Below the CAN task
+                  comms_cpu);
+  }
+#endif
+
+#if VCU_YAW_CONTROL && !VCU_JOBS
+  // fixed rate FIFO bursts, on the control core where only the control task outranks it
+  memCreateTask(IMUTASK,                                                // Function to be called
+                "IMU Gyro Bursts",                                      // Name of task
+                imuTaskMemory,                                          // Stack
+                control_priority - 1,                                   // Below the control task
+                control_cpu);
+#endif
+
+#if VCU_XBOX
+  // BLE connection housekeeping, the controller reports arrive through the notification callback
+  memCreateTask(XBOXTASK,                                               // Function to be called
+                "Xbox Controller Connection",                           // Name of task
+                xboxTaskMemory,                                         // Stack
+                1,                                                      // Below the CAN task
+                comms_cpu);
+#endif
+  bootMark(BOOT_TASKS, BOOT_OK);
+
+  diagRegisterTask(DIAG_TASK_CANBUS, Task1);
+  diagRegisterTask(DIAG_TASK_VCU, Task2);
+#if VCU_JOBS
+  diagRegisterTask(DIAG_TASK_JOBS, _jobs_task);
+#endif
+
+  // boot memory report, then no more heap use (the CANBUS task brings up CAN and the receiver first)
+  ulTaskNotifyTake(pdTRUE, 1000 / portTICK_PERIOD_MS);
+  memReport(memBlocks, memBlockCount);
+  memSeal();
 }
 
 void loop() {